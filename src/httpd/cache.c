@@ -0,0 +1,208 @@
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <string.h>
+
+#include "dupin.h"
+#include "httpd.h"
+#include "cache.h"
+
+/* NOTE - cache of the serialized _all_docs responses. The key is the normalized request
+          (path and sorted arguments), the version is built by the caller from the update
+          sequences of the stores the response depends on before running the query: an
+          entry with a different version is stale and dropped. The LRU is bounded by
+          ResponseCacheMaxBytes, 0 disables the cache. */
+
+typedef struct ds_cache_entry_t DSCacheEntry;
+struct ds_cache_entry_t
+{
+  gchar *	key;
+  gchar *	version;
+  gchar *	etag;
+  gchar *	body;
+  gsize		size;
+
+  GList *	lru_node;
+};
+
+/* INITIALIZE ***************************************************************/
+static void cache_remove (DSGlobal * data, DSCacheEntry * entry);
+
+gboolean
+cache_init (DSGlobal * data, GError ** error)
+{
+  if (data->limit_responsecachemaxbytes == 0)
+    return TRUE;
+
+  data->cache_mutex = g_new0 (GMutex, 1);
+  g_mutex_init (data->cache_mutex);
+
+  data->cache_table = g_hash_table_new (g_str_hash, g_str_equal);
+  data->cache_lru = g_queue_new ();
+
+  return TRUE;
+}
+
+void
+cache_close (DSGlobal * data)
+{
+  DSCacheEntry *entry;
+
+  if (!data->cache_mutex)
+    return;
+
+  while ((entry = g_queue_peek_tail (data->cache_lru)))
+    cache_remove (data, entry);
+
+  g_queue_free (data->cache_lru);
+  g_hash_table_destroy (data->cache_table);
+
+  g_mutex_clear (data->cache_mutex);
+  g_free (data->cache_mutex);
+
+  data->cache_lru = NULL;
+  data->cache_table = NULL;
+  data->cache_mutex = NULL;
+}
+
+/* The mutex must be locked: */
+static void
+cache_remove (DSGlobal * data, DSCacheEntry * entry)
+{
+  g_hash_table_remove (data->cache_table, entry->key);
+  g_queue_delete_link (data->cache_lru, entry->lru_node);
+
+  data->cache_bytes -= entry->size;
+
+  g_free (entry->key);
+  g_free (entry->version);
+  g_free (entry->etag);
+  g_free (entry->body);
+  g_free (entry);
+}
+
+/* KEY *********************************************************************/
+static gint
+cache_key_compare (dp_keyvalue_t * a, dp_keyvalue_t * b)
+{
+  gint ret;
+
+  if ((ret = g_strcmp0 (a->key, b->key)))
+    return ret;
+
+  return g_strcmp0 (a->value, b->value);
+}
+
+/* The same query with the arguments in any order is the same entry: */
+gchar *
+cache_key (DSHttpdClient * client)
+{
+  GString *str;
+  GList *list, *arguments;
+
+  str = g_string_new (NULL);
+
+  for (list = client->request_path; list; list = list->next)
+    {
+      g_string_append_c (str, '/');
+      g_string_append (str, list->data);
+    }
+
+  arguments = g_list_sort (g_list_copy (client->request_arguments),
+			   (GCompareFunc) cache_key_compare);
+
+  for (list = arguments; list; list = list->next)
+    {
+      dp_keyvalue_t *kv = list->data;
+
+      g_string_append_c (str, list == arguments ? '?' : '&');
+      g_string_append (str, kv->key);
+
+      if (kv->value)
+	{
+	  g_string_append_c (str, '=');
+	  g_string_append (str, kv->value);
+	}
+    }
+
+  g_list_free (arguments);
+
+  return g_string_free (str, FALSE);
+}
+
+/* CACHE FUNC **************************************************************/
+gboolean
+cache_find (DSGlobal * data, gchar * key, gchar * version,
+	    gchar ** etag, gchar ** body, gsize * size)
+{
+  DSCacheEntry *entry;
+
+  if (!data->cache_mutex)
+    return FALSE;
+
+  g_mutex_lock (data->cache_mutex);
+
+  if (!(entry = g_hash_table_lookup (data->cache_table, key)))
+    {
+      g_mutex_unlock (data->cache_mutex);
+      return FALSE;
+    }
+
+  /* Something changed since the response was built: */
+  if (g_strcmp0 (entry->version, version))
+    {
+      cache_remove (data, entry);
+      g_mutex_unlock (data->cache_mutex);
+      return FALSE;
+    }
+
+  g_queue_unlink (data->cache_lru, entry->lru_node);
+  g_queue_push_head_link (data->cache_lru, entry->lru_node);
+
+  *etag = g_strdup (entry->etag);
+  *body = g_strndup (entry->body, entry->size);
+  *size = entry->size;
+
+  g_mutex_unlock (data->cache_mutex);
+
+  return TRUE;
+}
+
+void
+cache_add (DSGlobal * data, gchar * key, gchar * version,
+	   gchar * etag, gchar * body, gsize size)
+{
+  DSCacheEntry *entry;
+
+  if (!data->cache_mutex
+      || size > data->limit_responsecachemaxbytes)
+    return;
+
+  entry = g_malloc0 (sizeof (DSCacheEntry));
+  entry->key = g_strdup (key);
+  entry->version = g_strdup (version);
+  entry->etag = g_strdup (etag);
+  entry->body = g_strndup (body, size);
+  entry->size = size;
+
+  g_mutex_lock (data->cache_mutex);
+
+  if (g_hash_table_lookup (data->cache_table, key))
+    cache_remove (data, g_hash_table_lookup (data->cache_table, key));
+
+  g_hash_table_insert (data->cache_table, entry->key, entry);
+
+  g_queue_push_head (data->cache_lru, entry);
+  entry->lru_node = g_queue_peek_head_link (data->cache_lru);
+
+  data->cache_bytes += size;
+
+  while (data->cache_bytes > data->limit_responsecachemaxbytes
+	 && (entry = g_queue_peek_tail (data->cache_lru)))
+    cache_remove (data, entry);
+
+  g_mutex_unlock (data->cache_mutex);
+}
+
+/* EOF */
@@ -0,0 +1,28 @@
+#ifndef _DS_CACHE_H_
+#define _DS_CACHE_H_
+
+#include "dupin.h"
+
+gboolean	cache_init		(DSGlobal *	data,
+					 GError **	error);
+
+void		cache_close		(DSGlobal *	data);
+
+gchar *		cache_key		(DSHttpdClient * client);
+
+gboolean	cache_find		(DSGlobal *	data,
+					 gchar *	key,
+					 gchar *	version,
+					 gchar **	etag,
+					 gchar **	body,
+					 gsize *	size);
+
+void		cache_add		(DSGlobal *	data,
+					 gchar *	key,
+					 gchar *	version,
+					 gchar *	etag,
+					 gchar *	body,
+					 gsize		size);
+
+#endif
+/* EOF */
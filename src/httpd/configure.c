@@ -12,6 +12,8 @@ static gboolean configure_parser (xmlDocPtr xml, DSGlobal * data,
 				  GError ** error);
 static gboolean configure_log_verbose (xmlChar * string, LogVerbose * verbose,
 				       GError ** error);
+static gboolean configure_id_scheme (xmlChar * string, DupinIdScheme * scheme,
+				     GError ** error);
 static gboolean configure_httpd_parser (xmlDocPtr xml, DSGlobal * data,
 					GError ** error);
 static gboolean configure_limit_parser (xmlDocPtr xml, DSGlobal * data,
@@ -163,6 +165,17 @@ configure_parser (xmlDocPtr xml, DSGlobal * data, GError ** error)
 			}
 		    }
 
+		  /* Slow log file: */
+		  else
+		    if (!xmlStrcmp (cur->name, (xmlChar *) DS_SLOWLOGFILE_TAG))
+		    {
+		      if ((tmp = xmlNodeGetContent (cur)))
+			{
+			  data->slowlogfile = g_strdup ((gchar *) tmp);
+			  xmlFree (tmp);
+			}
+		    }
+
 		  /* Background: */
 		  else
 		    if (!xmlStrcmp (cur->name, (xmlChar *) DS_BACKGROUND_TAG))
@@ -176,6 +189,36 @@ configure_parser (xmlDocPtr xml, DSGlobal * data, GError ** error)
 			}
 		    }
 
+		  /* ID scheme: */
+		  else
+		    if (!xmlStrcmp (cur->name, (xmlChar *) DS_IDSCHEME_TAG))
+		    {
+		      if ((tmp = xmlNodeGetContent (cur)))
+			{
+			  if (configure_id_scheme
+			      (tmp, &data->id_scheme, error) == FALSE)
+			    {
+			      xmlFree (tmp);
+			      return FALSE;
+			    }
+
+			  xmlFree (tmp);
+			}
+		    }
+
+		  /* Trace: */
+		  else
+		    if (!xmlStrcmp (cur->name, (xmlChar *) DS_TRACE_TAG))
+		    {
+		      if ((tmp = xmlNodeGetContent (cur)))
+			{
+			  if (!xmlStrcmp (tmp, (xmlChar *) "true"))
+			    data->trace = TRUE;
+
+			  xmlFree (tmp);
+			}
+		    }
+
 		  /* Pid file: */
 		  else if (!xmlStrcmp (cur->name, (xmlChar *) DS_PIDFILE_TAG))
 		    {
@@ -337,6 +380,17 @@ configure_parser (xmlDocPtr xml, DSGlobal * data, GError ** error)
 			}
 		    }
 
+		  /* SQLite database compress: */
+		  else if (!xmlStrcmp (cur->name, (xmlChar *) DS_SQLITE_DB_COMPRESS_TAG))
+		    {
+		      if ((tmp = xmlNodeGetContent (cur)))
+			{
+			  data->sqlite_db_compress = g_regex_new ((gchar *) tmp, 0, 0, NULL);
+
+			  xmlFree (tmp);
+			}
+		    }
+
 		  /* NOTE - linkbase specific SQLite params */
 
 		  /* SQLite linkbase mode: */
@@ -390,6 +444,17 @@ configure_parser (xmlDocPtr xml, DSGlobal * data, GError ** error)
 			}
 		    }
 
+		  /* SQLite linkbase compress: */
+		  else if (!xmlStrcmp (cur->name, (xmlChar *) DS_SQLITE_LINKB_COMPRESS_TAG))
+		    {
+		      if ((tmp = xmlNodeGetContent (cur)))
+			{
+			  data->sqlite_linkb_compress = g_regex_new ((gchar *) tmp, 0, 0, NULL);
+
+			  xmlFree (tmp);
+			}
+		    }
+
 		  /* NOTE - attachment database specific SQLite params */
 
 		  /* SQLite attachment database mode: */
@@ -550,6 +615,31 @@ configure_log_verbose (xmlChar * string, LogVerbose * verbose,
   return TRUE;
 }
 
+static gboolean
+configure_id_scheme (xmlChar * string, DupinIdScheme * scheme,
+		     GError ** error)
+{
+  if (!xmlStrcmp (string, (xmlChar *) "random"))
+    *scheme = DP_ID_SCHEME_RANDOM;
+
+  else if (!xmlStrcmp (string, (xmlChar *) "ulid"))
+    *scheme = DP_ID_SCHEME_ULID;
+
+  else if (!xmlStrcmp (string, (xmlChar *) "uuidv7"))
+    *scheme = DP_ID_SCHEME_UUIDV7;
+
+  else
+    {
+      if (error != NULL && *error != NULL)
+        g_set_error (error, dupin_server_common_error_quark (), 0,
+		   "IdScheme can be 'random', 'ulid', 'uuidv7' and not '%s'.",
+		   string);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
 static gboolean
 configure_httpd_parser (xmlDocPtr xml, DSGlobal * data, GError ** error)
 {
@@ -601,6 +691,18 @@ configure_httpd_parser (xmlDocPtr xml, DSGlobal * data, GError ** error)
 			}
 		    }
 
+		  /* Acceptors: */
+		  else
+		    if (!xmlStrcmp
+			(cur->name, (xmlChar *) DS_HTTPD_ACCEPTORS_TAG))
+		    {
+		      if ((tmp = xmlNodeGetContent (cur)))
+			{
+			  data->httpd_acceptors = atoi ((char *) tmp);
+			  xmlFree (tmp);
+			}
+		    }
+
 		  /* ipv6: */
 		  else
 		    if (!xmlStrcmp (cur->name, (xmlChar *) DS_HTTPD_IPV6_TAG))
@@ -631,6 +733,9 @@ configure_httpd_parser (xmlDocPtr xml, DSGlobal * data, GError ** error)
   if (!data->httpd_listen)
     data->httpd_listen = DS_HTTPD_LISTEN_DEFAULT;
 
+  if (!data->httpd_acceptors)
+    data->httpd_acceptors = DS_HTTPD_ACCEPTORS_DEFAULT;
+
   return TRUE;
 }
 
@@ -662,6 +767,18 @@ configure_limit_parser (xmlDocPtr xml, DSGlobal * data, GError ** error)
 			}
 		    }
 
+		  /* ExecutorThreads: */
+		  else
+		    if (!xmlStrcmp
+			(cur->name, (xmlChar *) DS_LIMIT_EXECUTORTHREADS_TAG))
+		    {
+		      if ((tmp = xmlNodeGetContent (cur)))
+			{
+			  data->limit_executor_threads = atoi ((char *) tmp);
+			  xmlFree (tmp);
+			}
+		    }
+
 		  /* MaxHeaders: */
 		  else
 		    if (!xmlStrcmp
@@ -760,6 +877,30 @@ configure_limit_parser (xmlDocPtr xml, DSGlobal * data, GError ** error)
 			}
 		    }
 
+		  /* CacheMaxBytes: */
+		  else
+		    if (!xmlStrcmp
+			(cur->name, (xmlChar *) DS_LIMIT_CACHEMAXBYTES_TAG))
+		    {
+		      if ((tmp = xmlNodeGetContent (cur)))
+			{
+			  data->limit_cachemaxbytes = atoi ((char *) tmp);
+			  xmlFree (tmp);
+			}
+		    }
+
+		  /* ResponseCacheMaxBytes: */
+		  else
+		    if (!xmlStrcmp
+			(cur->name, (xmlChar *) DS_LIMIT_RESPONSECACHEMAXBYTES_TAG))
+		    {
+		      if ((tmp = xmlNodeGetContent (cur)))
+			{
+			  data->limit_responsecachemaxbytes = atoi ((char *) tmp);
+			  xmlFree (tmp);
+			}
+		    }
+
 		  /* MapMaxThreads: */
 		  else
 		    if (!xmlStrcmp
@@ -832,6 +973,78 @@ configure_limit_parser (xmlDocPtr xml, DSGlobal * data, GError ** error)
 			  xmlFree (tmp);
 			}
 		    }
+
+		  /* AttachmentExternalMinSize: */
+		  else
+		    if (!xmlStrcmp
+			(cur->name, (xmlChar *) DS_LIMIT_ATTACHMENT_EXTERNAL_MINSIZE_TAG))
+		    {
+		      if ((tmp = xmlNodeGetContent (cur)))
+			{
+			  data->limit_attachment_external_minsize = atoi ((char *) tmp);
+			  xmlFree (tmp);
+			}
+		    }
+
+		  /* CompressLevel: */
+		  else
+		    if (!xmlStrcmp
+			(cur->name, (xmlChar *) DS_LIMIT_COMPRESS_LEVEL_TAG))
+		    {
+		      if ((tmp = xmlNodeGetContent (cur)))
+			{
+			  data->limit_compress_level = atoi ((char *) tmp);
+			  xmlFree (tmp);
+			}
+		    }
+
+		  /* CompressDictSize: */
+		  else
+		    if (!xmlStrcmp
+			(cur->name, (xmlChar *) DS_LIMIT_COMPRESS_DICTSIZE_TAG))
+		    {
+		      if ((tmp = xmlNodeGetContent (cur)))
+			{
+			  data->limit_compress_dictsize = atoi ((char *) tmp);
+			  xmlFree (tmp);
+			}
+		    }
+
+		  /* HttpCompressMinSize: */
+		  else
+		    if (!xmlStrcmp
+			(cur->name, (xmlChar *) DS_LIMIT_HTTP_COMPRESS_MINSIZE_TAG))
+		    {
+		      if ((tmp = xmlNodeGetContent (cur)))
+			{
+			  data->limit_http_compress_minsize = atoi ((char *) tmp);
+			  xmlFree (tmp);
+			}
+		    }
+
+		  /* HttpCompressLevel: */
+		  else
+		    if (!xmlStrcmp
+			(cur->name, (xmlChar *) DS_LIMIT_HTTP_COMPRESS_LEVEL_TAG))
+		    {
+		      if ((tmp = xmlNodeGetContent (cur)))
+			{
+			  data->limit_http_compress_level = atoi ((char *) tmp);
+			  xmlFree (tmp);
+			}
+		    }
+
+		  /* SlowRequestThreshold: */
+		  else
+		    if (!xmlStrcmp
+			(cur->name, (xmlChar *) DS_LIMIT_SLOWREQUEST_THRESHOLD_TAG))
+		    {
+		      if ((tmp = xmlNodeGetContent (cur)))
+			{
+			  data->limit_slowrequest_threshold = atoi ((char *) tmp);
+			  xmlFree (tmp);
+			}
+		    }
 		}
 	    }
 
@@ -848,6 +1061,9 @@ configure_limit_parser (xmlDocPtr xml, DSGlobal * data, GError ** error)
   if (!data->limit_timeoutforthread)
     data->limit_timeoutforthread = DS_LIMIT_TIMEOUTFORTHREAD_DEFAULT;
 
+  if (!data->limit_cachemaxbytes)
+    data->limit_cachemaxbytes = DS_LIMIT_CACHEMAXBYTES_DEFAULT;
+
   if (!data->limit_map_max_threads)
     data->limit_map_max_threads = DS_LIMIT_MAP_MAXTHREADS_DEFAULT;
 
@@ -866,6 +1082,24 @@ configure_limit_parser (xmlDocPtr xml, DSGlobal * data, GError ** error)
   if (!data->limit_checklinks_max_threads)
     data->limit_checklinks_max_threads = DS_LIMIT_CHECKLINKS_MAXTHREADS_DEFAULT;
 
+  if (!data->limit_compress_level)
+    data->limit_compress_level = DS_LIMIT_COMPRESS_LEVEL_DEFAULT;
+
+  if (!data->limit_http_compress_level
+      || data->limit_http_compress_level > 9)
+    data->limit_http_compress_level = DS_LIMIT_HTTP_COMPRESS_LEVEL_DEFAULT;
+
+  /* NOTE - the parser keeps the header offsets in a fixed array, so no more
+            than PARSER_MAX_HEADERS lines can be accepted whatever is configured */
+
+  if (data->limit_maxheaders > PARSER_MAX_HEADERS)
+    g_warning ("%s %d is above the maximum supported, %d is used",
+	       DS_LIMIT_MAXHEADERS_TAG, data->limit_maxheaders, PARSER_MAX_HEADERS);
+
+  if (!data->limit_maxheaders
+      || data->limit_maxheaders > PARSER_MAX_HEADERS)
+    data->limit_maxheaders = PARSER_MAX_HEADERS;
+
   if (!data->sqlite_path)
     data->sqlite_path = g_strdup (DUPIN_DB_PATH);
 
@@ -885,6 +1119,9 @@ configure_free (DSGlobal * data)
   if (data->logfile)
     g_free (data->logfile);
 
+  if (data->slowlogfile)
+    g_free (data->slowlogfile);
+
   if (data->pidfile)
     g_free (data->pidfile);
 
@@ -924,6 +1161,9 @@ configure_free (DSGlobal * data)
   if (data->sqlite_db_connect)
     g_regex_unref (data->sqlite_db_connect);
 
+  if (data->sqlite_db_compress)
+    g_regex_unref (data->sqlite_db_compress);
+
   if (data->sqlite_linkb_allow)
     g_regex_unref (data->sqlite_linkb_allow);
 
@@ -933,6 +1173,9 @@ configure_free (DSGlobal * data)
   if (data->sqlite_linkb_connect)
     g_regex_unref (data->sqlite_linkb_connect);
 
+  if (data->sqlite_linkb_compress)
+    g_regex_unref (data->sqlite_linkb_compress);
+
   if (data->sqlite_attachment_db_allow)
     g_regex_unref (data->sqlite_attachment_db_allow);
 
@@ -15,10 +15,13 @@
 #define DS_GENERAL_TAG		"General"
 #define DS_LOGFILE_TAG		"LogFile"
 #define DS_LOGVERBOSE_TAG	"LogVerbose"
+#define DS_SLOWLOGFILE_TAG	"SlowLogFile"
 #define DS_PIDFILE_TAG		"PidFile"
 #define DS_BACKGROUND_TAG	"Background"
 #define DS_USER_TAG		"User"
 #define DS_GROUP_TAG		"Group"
+#define DS_TRACE_TAG		"Trace"
+#define DS_IDSCHEME_TAG		"IdScheme"
 
 #define DS_SQLITE_PATH_TAG			"SQLitePath"
 
@@ -31,6 +34,7 @@
 #define DS_SQLITE_DB_DENY_TAG			"SQLiteDBDeny"
 #define DS_SQLITE_DB_CONNECT_TAG		"SQLiteDBConnect"
 #define DS_SQLITE_DB_MODE_TAG			"SQLiteDBMode"
+#define DS_SQLITE_DB_COMPRESS_TAG		"SQLiteDBCompress"
 
 #define DS_SQLITE_ATTACHMENT_DB_ALLOW_TAG	"SQLiteAttachmentDBAllow"
 #define DS_SQLITE_ATTACHMENT_DB_DENY_TAG	"SQLiteAttachmentDBDeny"
@@ -41,6 +45,7 @@
 #define DS_SQLITE_LINKB_DENY_TAG		"SQLiteLinkBDeny"
 #define DS_SQLITE_LINKB_CONNECT_TAG		"SQLiteLinkBConnect"
 #define DS_SQLITE_LINKB_MODE_TAG		"SQLiteLinkBMode"
+#define DS_SQLITE_LINKB_COMPRESS_TAG		"SQLiteLinkBCompress"
 
 #define DS_SQLITE_VIEW_ALLOW_TAG		"SQLiteViewAllow"
 #define DS_SQLITE_VIEW_DENY_TAG			"SQLiteViewDeny"
@@ -52,8 +57,10 @@
 #define DS_HTTPD_INTERFACE_TAG	"Interface"
 #define DS_HTTPD_PORT_TAG	"Port"
 #define DS_HTTPD_LISTEN_TAG	"Listen"
+#define DS_HTTPD_ACCEPTORS_TAG	"Acceptors"
 
 #define DS_HTTPD_LISTEN_DEFAULT	5
+#define DS_HTTPD_ACCEPTORS_DEFAULT	1 /* more than one needs SO_REUSEPORT */
 
 #define DS_LIMIT_TAG				"Limits"
 #define DS_LIMIT_MAXHEADERS_TAG 		"MaxHeaders"
@@ -61,26 +68,42 @@
 #define DS_LIMIT_MAXCONTENTLENGTH_TAG 		"MaxContentLength"
 #define DS_LIMIT_CLIENTSFORTHREAD_TAG		"ClientsForThread"
 #define DS_LIMIT_THREADNUMB_TAG			"ThreadNumb"
+#define DS_LIMIT_EXECUTORTHREADS_TAG		"ExecutorThreads"
 #define DS_LIMIT_TIMEOUT_TAG			"Timeout"
 #define DS_LIMIT_TIMEOUTFORTHREAD_TAG		"TimeoutForThread"
 #define DS_LIMIT_CACHESIZE_TAG			"CacheSize"
 #define DS_LIMIT_CACHEMAXFILE_TAG		"CacheMaxFileSize"
+#define DS_LIMIT_CACHEMAXBYTES_TAG		"CacheMaxBytes"
+#define DS_LIMIT_RESPONSECACHEMAXBYTES_TAG	"ResponseCacheMaxBytes"
 #define DS_LIMIT_MAP_MAXTHREADS_TAG 		"MapMaxThreads"
 #define DS_LIMIT_REDUCE_MAXTHREADS_TAG 		"ReduceMaxThreads"
 #define DS_LIMIT_REDUCE_TIMEOUTFORTHREAD_TAG	"ReduceTimeoutForThread"
 #define DS_LIMIT_SYNC_INTERVAL_TAG		"SyncInterval"
 #define DS_LIMIT_COMPACT_MAXTHREADS_TAG		"CompactMaxThreads"
 #define DS_LIMIT_CHECKLINKS_MAXTHREADS_TAG	"CheckLinksMaxThreads"
+#define DS_LIMIT_ATTACHMENT_EXTERNAL_MINSIZE_TAG	"AttachmentExternalMinSize"
+#define DS_LIMIT_COMPRESS_LEVEL_TAG		"CompressLevel"
+#define DS_LIMIT_COMPRESS_DICTSIZE_TAG		"CompressDictSize"
+#define DS_LIMIT_HTTP_COMPRESS_MINSIZE_TAG	"HttpCompressMinSize"
+#define DS_LIMIT_HTTP_COMPRESS_LEVEL_TAG	"HttpCompressLevel"
+#define DS_LIMIT_SLOWREQUEST_THRESHOLD_TAG	"SlowRequestThreshold"
 
 #define DS_LIMIT_TIMEOUT_DEFAULT			5
 #define DS_LIMIT_CLIENTSFORTHREAD_DEFAULT		5
 #define DS_LIMIT_TIMEOUTFORTHREAD_DEFAULT		2
+#define DS_LIMIT_CACHEMAXBYTES_DEFAULT			16777216 /* bytes */
+#define DS_LIMIT_EXECUTORTHREADS_DEFAULT		0 /* zero means one per CPU core */
 #define DS_LIMIT_MAP_MAXTHREADS_DEFAULT			4
 #define DS_LIMIT_REDUCE_MAXTHREADS_DEFAULT		4
 #define DS_LIMIT_REDUCE_TIMEOUTFORTHREAD_DEFAULT	2 /* timeout for g_cond_timed_wait() from map thread on view reduce/re-reduce thread*/
 #define DS_LIMIT_SYNC_INTERVAL_DEFAULT			60 /* every minute */
 #define DS_LIMIT_COMPACT_MAXTHREADS_DEFAULT		2
 #define DS_LIMIT_CHECKLINKS_MAXTHREADS_DEFAULT		2
+#define DS_LIMIT_ATTACHMENT_EXTERNAL_MINSIZE_DEFAULT	0 /* bytes - zero means attachments always stay inside SQLite */
+#define DS_LIMIT_COMPRESS_LEVEL_DEFAULT			3
+#define DS_LIMIT_COMPRESS_DICTSIZE_DEFAULT		0 /* bytes - zero means no trained dictionary */
+#define DS_LIMIT_HTTP_COMPRESS_MINSIZE_DEFAULT		0 /* bytes - zero means responses are never gzip/deflate encoded */
+#define DS_LIMIT_HTTP_COMPRESS_LEVEL_DEFAULT		6
 
 typedef enum {
   LOG_VERBOSE_ERROR,
@@ -93,12 +116,19 @@ struct ds_global_t
 {
   gchar *       configfile;             /* Config File */
 
-  GMutex *      logmutex;               /* Mutex about the log */
+  struct ds_log_t * logring;            /* Ring of the entries and writer thread */
   GIOChannel *  logio;                  /* Log IO Channel */
   gchar *       logfile;                /* Log File */
   LogVerbose    logverbose;
 
+  struct ds_slowlog_t * slowlog;        /* Slow request log */
+  gchar *       slowlogfile;            /* Slow request log File */
+
   gboolean      background;             /* Demonize or not */
+
+  gboolean      trace;                  /* Tracing spans on at startup, see /_trace */
+
+  DupinIdScheme id_scheme;              /* Generated document IDs */
   gchar *       pidfile;                /* Pid File */
 
   gchar *       user;                   /* Permissions */
@@ -114,6 +144,7 @@ struct ds_global_t
   GRegex * sqlite_db_allow;
   GRegex * sqlite_db_deny;
   GRegex * sqlite_db_connect;
+  GRegex * sqlite_db_compress;
 
   DupinSQLiteOpenType sqlite_attachment_db_mode;
   GRegex * sqlite_attachment_db_allow;
@@ -124,6 +155,7 @@ struct ds_global_t
   GRegex * sqlite_linkb_allow;
   GRegex * sqlite_linkb_deny;
   GRegex * sqlite_linkb_connect;
+  GRegex * sqlite_linkb_compress;
 
   DupinSQLiteOpenType sqlite_view_mode;
   GRegex * sqlite_view_allow;
@@ -136,6 +168,7 @@ struct ds_global_t
   gchar *       httpd_interface;
   gint          httpd_port;
   gint          httpd_listen;
+  guint         httpd_acceptors;
   gboolean      httpd_ipv6;
 
   GIOChannel *  httpd_socket;
@@ -145,6 +178,8 @@ struct ds_global_t
   GMutex *      httpd_mutex;
   GList *       httpd_threads;
 
+  struct ds_executor_t * httpd_executor; /* runs the requests, the httpd threads only do I/O */
+
   guint         httpd_clients_numb;
   guint         httpd_threads_numb;
 
@@ -153,11 +188,14 @@ struct ds_global_t
   guint         limit_maxcontentlength;
   guint         limit_clientsforthread;
   guint         limit_threadnumb;
+  guint         limit_executor_threads;
 
   guint         limit_timeout;
   guint         limit_timeoutforthread;
   guint         limit_cachesize;
   guint         limit_cachemaxfilesize;
+  guint         limit_cachemaxbytes;
+  guint         limit_responsecachemaxbytes; /* 0 = no cache of _all_docs responses */
 
   guint         limit_compact_max_threads;
 
@@ -168,12 +206,33 @@ struct ds_global_t
   guint         limit_reduce_timeoutforthread;
   guint         limit_sync_interval;
 
+  guint         limit_attachment_external_minsize;
+
+  guint         limit_compress_level;
+  guint         limit_compress_dictsize;
+
+  guint         limit_http_compress_minsize;
+  guint         limit_http_compress_level;
+
+  guint         limit_slowrequest_threshold; /* msec, 0 = no slow request log */
+
   /* TimeVal: */
   GTimeVal      start_timeval;
 
   GMutex *      map_mutex;
   GHashTable *  map_table;
-  GList *       map_unreflist;
+  GQueue *      map_lru;
+  gsize         map_bytes;
+  gint          map_inotify;
+  GSource *     map_inotify_source;
+  GHashTable *  map_watches;
+
+  GMutex *      cache_mutex;
+  GHashTable *  cache_table;
+  GQueue *      cache_lru;
+  gsize         cache_bytes;
+
+  struct ds_stats_t * stats;            /* Request counters of /_stats */
 
   /* Dupin: */
   Dupin *       dupin;
@@ -11,6 +11,7 @@
 #include "../lib/dupin_internal.h"
 
 #include "configure.h"
+#include "parser.h"
 
 typedef struct ds_httpd_thread_t DSHttpdThread;
 struct ds_httpd_thread_t
@@ -27,19 +28,46 @@ struct ds_httpd_thread_t
 
   GList *	clients;
   guint		clients_numb;
+
+  /* NOTE - acceptor threads own a SO_REUSEPORT listening socket and serve what they accept */
+  GIOChannel *	socket;
+  gint		socket_fd;
+  GSource *	socket_source;
 };
 
 typedef struct ds_map_t DSMap;
 struct ds_map_t
 {
-  gchar *	filename;
+  gchar *	key;		/* requested path */
+  gchar *	filename;	/* file served for it */
   time_t	mtime;
+  gsize		size;
 
   gchar *	mime;
   GMappedFile *	map;
 
-  GList *	unrefnode;
+  gchar *	etag;
+  gsize		last_modified;
+
+  gchar *	gzip;		/* precompressed copy, built on the first gzip request */
+  gsize		gzip_size;
+
+  GList *	lru_node;	/* NULL once out of the cache */
   guint		ref;
+
+  gint		wd;		/* inotify watch of its directory, -1 if none */
+};
+
+/* NOTE - one byte range of a partial GET, start and end are inclusive */
+
+typedef struct ds_httpd_range_t DSHttpdRange;
+struct ds_httpd_range_t
+{
+  gsize		start;
+  gsize		end;
+
+  gchar *	part;		/* multipart/byteranges part header, NULL for single range */
+  gsize		part_size;
 };
 
 typedef enum
@@ -51,6 +79,16 @@ typedef enum
   DS_HTTPD_REQUEST_DELETE
 } HttpdRequest;
 
+/* NOTE - state of a Transfer-Encoding: chunked request body */
+
+typedef enum
+{
+  DS_HTTPD_CHUNK_SIZE = 0,
+  DS_HTTPD_CHUNK_DATA,
+  DS_HTTPD_CHUNK_DATA_END,
+  DS_HTTPD_CHUNK_TRAILER
+} DSHttpdChunkState;
+
 typedef enum
 {
   DS_HTTPD_OUTPUT_NONE = 0,
@@ -61,6 +99,13 @@ typedef enum
   DS_HTTPD_OUTPUT_CHANGES_COMET
 } DSHttpdOutputType;
 
+typedef enum
+{
+  DS_HTTPD_ENCODING_IDENTITY = 0,
+  DS_HTTPD_ENCODING_GZIP,
+  DS_HTTPD_ENCODING_DEFLATE
+} DSHttpdEncoding;
+
 typedef struct ds_httpd_client_t DSHttpdClient;
 struct ds_httpd_client_t
 {
@@ -73,12 +118,22 @@ struct ds_httpd_client_t
   GSource *	timeout_source;
   GSource *	channel_source;
 
-  GList *	headers;
-  guint		headers_numb;
+  gchar		input_header[PARSER_BUFFER_SIZE];	/* receive buffer, kept till the request is done */
+  gsize		input_header_size;
+  gsize		input_header_done;	/* bytes already used, body bytes may follow */
+  DSParser	input_parser;
  
   HttpdRequest	request;
+  gboolean	request_target_parsed;	/* request_path and request_arguments are built lazily */
+  gboolean	request_target_valid;
   GList *	request_path;
   GList *	request_arguments;
+  gint		request_status;	/* DSHttpStatusCode set by the executor, sent back by the I/O thread */
+  const gchar *	request_handler;	/* static name the request is accounted under in /_stats */
+
+  DupinTiming *	timing;		/* phases of the request, only with a SlowRequestThreshold */
+  gchar *	timing_request;	/* request line for the slow log, once executed */
+  gint64	timing_write_start;
 
   gint		request_included_docs_level;
   gint		request_included_links_level;
@@ -87,6 +142,15 @@ struct ds_httpd_client_t
   gsize		body_size;
   gsize		body_done;
 
+  gboolean	input_chunked;
+  DSHttpdChunkState input_chunk_state;
+  gsize		input_chunk_size;	/* bytes left in the current chunk */
+  gchar *	input_chunk_line;	/* chunk size, chunk end or trailer line being received */
+  gsize		input_chunk_line_size;
+
+  DupinAttachmentUpload * input_upload;	/* attachment body spooled instead of kept in body */
+  gchar *	input_buffer;
+
   DSHttpdOutputType output_type;
 
   gchar * 	output_etag;
@@ -96,11 +160,15 @@ struct ds_httpd_client_t
   gsize		output_header_size;
   gsize		output_header_done;
 
+  /* NOTE - the following point into input_header and are not freed */
   gchar *	input_mime;
   gchar *	input_if_none_match;
   gchar *	input_if_match;
   gchar *	input_if_modified_since;
   gchar *	input_if_unmodified_since;
+  gchar *	input_range;
+  gchar *	input_if_range;
+  gchar *	input_accept_encoding;
 
   gsize		output_last_modified;
 
@@ -108,6 +176,17 @@ struct ds_httpd_client_t
 
   gsize		output_size;
 
+  gchar *	output_content_range;
+
+  /* NOTE - string and map bodies are compressed before the header is sent, the
+            others are deflated while written and end when the connection closes */
+  DSHttpdEncoding output_encoding;
+  gpointer	output_zstream;		/* z_stream of a streamed body */
+  GByteArray *	output_zbuffer;		/* deflated bytes not yet written */
+  gsize		output_zbuffer_done;
+  gboolean	output_zfinished;
+  gboolean	output_complete;	/* the body producer reached its end */
+
   gchar *	dupin_error_msg;
   gchar *	dupin_warning_msg;
 
@@ -142,6 +221,17 @@ struct ds_httpd_client_t
       gsize		size;
       gsize		done;
       gsize		offset;
+      gsize		offset_end;	/* exclusive end of the range being sent */
+
+      DSHttpdRange *	ranges;
+      guint		ranges_numb;
+      guint		ranges_current;
+
+      gchar *		part;		/* multipart separator being sent */
+      gsize		part_size;
+      gsize		part_done;
+      gchar *		trailer;
+      gsize		trailer_size;
     } blob;
 
     struct
@@ -154,6 +244,9 @@ struct ds_httpd_client_t
       gsize		   done;
       gsize		   offset;
 
+      GString *		   chunk;	/* framed chunk being sent, the socket may take it in pieces */
+      gsize		   chunk_done;
+
       gchar * 		   change_string;
       gsize		   change_size;
       gboolean 		   change_generated;
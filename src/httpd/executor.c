@@ -0,0 +1,261 @@
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "dupin.h"
+#include "executor.h"
+
+/* NOTE - work-stealing executor: every worker owns a run queue, tasks pushed from
+          outside are spread round-robin, a worker with an empty queue steals the
+          oldest task of the others before going to sleep */
+
+#define EXECUTOR_RETRY_USEC	1000	/* wait for a task counted but not yet queued or popped */
+
+typedef struct ds_executor_worker_t DSExecutorWorker;
+struct ds_executor_worker_t
+{
+  DSExecutor *	executor;
+  guint		index;
+
+  GThread *	thread;
+
+  GMutex	mutex;
+  GQueue	tasks;
+};
+
+struct ds_executor_t
+{
+  GFunc		func;
+  gpointer	user_data;
+
+  DSExecutorWorker * workers;
+  guint		workers_numb;
+
+  GMutex	idle_mutex;
+  GCond		idle_cond;
+
+  gint		pending;	/* queued tasks, all queues */
+  guint		next;		/* round-robin for tasks pushed from outside */
+  gboolean	quit;
+};
+
+/* NOTE - the worker running the current thread, if any, so that tasks pushed by a task stay local */
+
+static GPrivate executor_worker_current;
+
+static gpointer executor_worker (DSExecutorWorker * worker);
+
+DSExecutor *
+executor_new (guint threads, GFunc func, gpointer user_data, GError ** error)
+{
+  DSExecutor *executor;
+  guint i;
+
+  g_return_val_if_fail (func != NULL, NULL);
+
+  if (threads == 0)
+#if GLIB_CHECK_VERSION (2,36,0)
+    threads = g_get_num_processors ();
+#else
+    threads = 1;
+#endif
+
+  executor = g_malloc0 (sizeof (DSExecutor));
+  executor->func = func;
+  executor->user_data = user_data;
+
+  g_mutex_init (&executor->idle_mutex);
+  g_cond_init (&executor->idle_cond);
+
+  executor->workers = g_malloc0 (sizeof (DSExecutorWorker) * threads);
+  executor->workers_numb = threads;
+
+  for (i = 0; i < threads; i++)
+    {
+      DSExecutorWorker *worker = &executor->workers[i];
+
+      worker->executor = executor;
+      worker->index = i;
+
+      g_mutex_init (&worker->mutex);
+      g_queue_init (&worker->tasks);
+    }
+
+  for (i = 0; i < threads; i++)
+    {
+      DSExecutorWorker *worker = &executor->workers[i];
+
+      if (!
+	  (worker->thread =
+#if GLIB_CHECK_VERSION (2,31,8)
+	   g_thread_new ("executor_thread", (GThreadFunc) executor_worker, worker)))
+#else
+	   g_thread_create ((GThreadFunc) executor_worker, worker, TRUE, error)))
+#endif
+	{
+	  executor_free (executor);
+	  return NULL;
+	}
+    }
+
+  return executor;
+}
+
+void
+executor_push (DSExecutor * executor, gpointer task)
+{
+  DSExecutorWorker *worker;
+
+  g_return_if_fail (executor != NULL);
+
+  if (!(worker = g_private_get (&executor_worker_current))
+      || worker->executor != executor)
+    worker =
+      &executor->workers[(guint) g_atomic_int_add ((gint *) &executor->next, 1) %
+			 executor->workers_numb];
+
+  g_mutex_lock (&worker->mutex);
+  g_queue_push_tail (&worker->tasks, task);
+  g_mutex_unlock (&worker->mutex);
+
+  g_mutex_lock (&executor->idle_mutex);
+  g_atomic_int_inc (&executor->pending);
+  g_cond_signal (&executor->idle_cond);
+  g_mutex_unlock (&executor->idle_mutex);
+}
+
+guint
+executor_unprocessed (DSExecutor * executor)
+{
+  g_return_val_if_fail (executor != NULL, 0);
+
+  return g_atomic_int_get (&executor->pending);
+}
+
+guint
+executor_threads (DSExecutor * executor)
+{
+  g_return_val_if_fail (executor != NULL, 0);
+
+  return executor->workers_numb;
+}
+
+/* Stops the workers, queued tasks are dropped and running ones waited for: */
+void
+executor_free (DSExecutor * executor)
+{
+  guint i;
+
+  if (!executor)
+    return;
+
+  g_mutex_lock (&executor->idle_mutex);
+  executor->quit = TRUE;
+  g_cond_broadcast (&executor->idle_cond);
+  g_mutex_unlock (&executor->idle_mutex);
+
+  for (i = 0; i < executor->workers_numb; i++)
+    if (executor->workers[i].thread)
+      g_thread_join (executor->workers[i].thread);
+
+  for (i = 0; i < executor->workers_numb; i++)
+    {
+      g_queue_clear (&executor->workers[i].tasks);
+      g_mutex_clear (&executor->workers[i].mutex);
+    }
+
+  g_free (executor->workers);
+
+  g_cond_clear (&executor->idle_cond);
+  g_mutex_clear (&executor->idle_mutex);
+
+  g_free (executor);
+}
+
+static gpointer
+executor_worker_pop (DSExecutorWorker * worker)
+{
+  gpointer task;
+
+  g_mutex_lock (&worker->mutex);
+  task = g_queue_pop_head (&worker->tasks);
+  g_mutex_unlock (&worker->mutex);
+
+  return task;
+}
+
+/* NOTE - a busy victim is skipped, unless wait is set because tasks are known to be queued */
+
+static gpointer
+executor_worker_steal (DSExecutorWorker * worker, gboolean wait)
+{
+  DSExecutor *executor = worker->executor;
+  gpointer task = NULL;
+  guint i;
+
+  for (i = 1; i < executor->workers_numb && !task; i++)
+    {
+      DSExecutorWorker *victim =
+	&executor->workers[(worker->index + i) % executor->workers_numb];
+
+      if (wait == TRUE)
+	g_mutex_lock (&victim->mutex);
+
+      else if (g_mutex_trylock (&victim->mutex) == FALSE)
+	continue;
+
+      task = g_queue_pop_head (&victim->tasks);
+      g_mutex_unlock (&victim->mutex);
+    }
+
+  return task;
+}
+
+static gpointer
+executor_worker (DSExecutorWorker * worker)
+{
+  DSExecutor *executor = worker->executor;
+  gpointer task;
+
+  g_private_set (&executor_worker_current, worker);
+
+  while (TRUE)
+    {
+      if ((task = executor_worker_pop (worker))
+	  || (task = executor_worker_steal (worker, FALSE))
+	  || (g_atomic_int_get (&executor->pending) > 0
+	      && (task = executor_worker_steal (worker, TRUE))))
+	{
+	  g_atomic_int_add (&executor->pending, -1);
+
+	  executor->func (task, executor->user_data);
+	  continue;
+	}
+
+      g_mutex_lock (&executor->idle_mutex);
+
+      /* NOTE - every queue was found empty under its lock, yet pending counts a task being
+                popped by another worker: wait a little for it rather than scanning again */
+      if (executor->quit == FALSE
+	  && g_atomic_int_get (&executor->pending) > 0)
+	g_cond_wait_until (&executor->idle_cond, &executor->idle_mutex,
+			   g_get_monotonic_time () + EXECUTOR_RETRY_USEC);
+
+      while (executor->quit == FALSE
+	     && g_atomic_int_get (&executor->pending) <= 0)
+	g_cond_wait (&executor->idle_cond, &executor->idle_mutex);
+
+      if (executor->quit == TRUE)
+	{
+	  g_mutex_unlock (&executor->idle_mutex);
+	  break;
+	}
+
+      g_mutex_unlock (&executor->idle_mutex);
+    }
+
+  g_private_set (&executor_worker_current, NULL);
+  return NULL;
+}
+
+/* EOF */
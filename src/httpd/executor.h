@@ -0,0 +1,23 @@
+#ifndef _DS_EXECUTOR_H_
+#define _DS_EXECUTOR_H_
+
+#include "dupin.h"
+
+typedef struct ds_executor_t DSExecutor;
+
+DSExecutor *	executor_new		(guint		threads,
+					 GFunc		func,
+					 gpointer	user_data,
+					 GError **	error);
+
+void		executor_push		(DSExecutor *	executor,
+					 gpointer	task);
+
+guint		executor_unprocessed	(DSExecutor *	executor);
+
+guint		executor_threads	(DSExecutor *	executor);
+
+void		executor_free		(DSExecutor *	executor);
+
+#endif
+/* EOF */
@@ -5,8 +5,11 @@
 #include "dupin.h"
 #include "httpd.h"
 #include "log.h"
+#include "executor.h"
 #include "map.h"
 #include "request.h"
+#include "stats.h"
+#include "slowlog.h"
 #include "dupin_server_common.h"
 #include "../lib/dupin_utils.h"
 #include "../lib/dupin_date.h"
@@ -15,6 +18,7 @@
 #ifdef G_OS_UNIX
 #  include <netinet/in.h>
 #  include <sys/socket.h>
+#  include <sys/uio.h>
 #  include <netdb.h>
 #  include <errno.h>
 #  include <unistd.h>
@@ -23,6 +27,10 @@
 #include <string.h>
 #include <stdlib.h>
 
+#ifdef HAVE_ZLIB
+#  include <zlib.h>
+#endif
+
 DSHttpStatus DSHttpStatusList[] = {
   {HTTP_STATUS_200, "HTTP/1.1 200 OK", "{\"ok\": true}", 12, HTTP_MIME_JSON,
    FALSE}
@@ -30,6 +38,9 @@ DSHttpStatus DSHttpStatusList[] = {
   {HTTP_STATUS_201, "HTTP/1.1 201 Created", "{\"ok\": true}", 12,
    HTTP_MIME_JSON, FALSE}
   ,
+  {HTTP_STATUS_206, "HTTP/1.1 206 Partial Content", "{\"ok\": true}", 12,
+   HTTP_MIME_JSON, FALSE}
+  ,
   {HTTP_STATUS_304, "HTTP/1.1 304 Not Modified",
    "Not Modified", 12, HTTP_MIME_TEXTHTML, TRUE}
   ,
@@ -51,6 +62,9 @@ DSHttpStatus DSHttpStatusList[] = {
   {HTTP_STATUS_412, "HTTP/1.1 412 Precondition Failed",
    "Precondition Failed", 19, HTTP_MIME_TEXTHTML, TRUE}
   ,
+  {HTTP_STATUS_416, "HTTP/1.1 416 Requested Range Not Satisfiable",
+   "Requested Range Not Satisfiable", 31, HTTP_MIME_TEXTHTML, TRUE}
+  ,
   {HTTP_STATUS_500, "HTTP/1.1 500 Internal Server Error",
    "Internal Server Error", 21, HTTP_MIME_TEXTHTML, TRUE}
   ,
@@ -65,29 +79,43 @@ static GIOChannel *httpd_create (DSGlobal * data, GError ** error,
 static GIOChannel *httpd_create6 (DSGlobal * data, GError ** error,
 				  gint * ret_fd);
 
+static gint httpd_accept (DSGlobal * data, gint socket_fd, gchar ** ip);
 static gboolean httpd_read (GIOChannel *, GIOCondition, DSGlobal *);
 static gboolean httpd_read_timeout (DSGlobal * data);
 
+static DSHttpdThread *httpd_acceptor_new (DSGlobal * data, GError ** error);
+static gboolean httpd_acceptor_read (GIOChannel *, GIOCondition,
+				     DSHttpdThread * thread);
+static gboolean httpd_acceptor_read_timeout (DSHttpdThread * thread);
+
 static DSHttpdThread *httpd_thread_new (DSGlobal * data, GError ** error);
 static gpointer httpd_thread (DSHttpdThread * thread);
 static void httpd_thread_close (DSHttpdThread * thread);
 static gboolean httpd_thread_close_timeout (DSHttpdThread * thread);
 static void httpd_thread_free (DSHttpdThread * thread);
 
+static DSHttpdClient *httpd_client_new (DSGlobal * data, gint fd, gchar * ip);
 static gboolean httpd_client_add (DSGlobal * data, DSHttpdClient * client);
+static void httpd_client_attach (DSHttpdThread * thread,
+				 DSHttpdClient * client);
 static void httpd_client_close (DSHttpdClient * client);
+static void httpd_client_timing_done (DSHttpdClient * client);
 static void httpd_client_free (DSHttpdClient * client);
 static gboolean httpd_client_timeout (DSHttpdClient * client);
 static void httpd_client_timeout_refresh (DSHttpdClient * client);
 static gboolean httpd_client_read_header (GIOChannel *, GIOCondition,
 					  DSHttpdClient * client);
-static gboolean httpd_client_read_header_timeout (DSHttpdClient * client);
 static gboolean httpd_client_read_body (GIOChannel *, GIOCondition,
 					DSHttpdClient * client);
-static gboolean httpd_client_read_body_timeout (DSHttpdClient * client);
 static gboolean httpd_client_write_header (GIOChannel *, GIOCondition,
 					   DSHttpdClient * client);
-static gboolean httpd_client_write_header_timeout (DSHttpdClient * client);
+static gboolean httpd_client_write_response (GIOChannel *, GIOCondition,
+					     DSHttpdClient *);
+static GIOStatus httpd_client_write_chars (DSHttpdClient * client,
+					   GIOChannel * source,
+					   const gchar * buf, gsize count,
+					   gsize * done);
+static gboolean httpd_client_write_finish (DSHttpdClient * client);
 static gboolean httpd_client_write_body (GIOChannel *, GIOCondition,
 					 DSHttpdClient * client);
 static gboolean httpd_client_write_body_timeout (DSHttpdClient * client);
@@ -98,6 +126,8 @@ static gboolean httpd_client_header (DSHttpdClient * client,
 				     DSHttpStatusCode * error);
 
 static void httpd_client_request (DSHttpdClient * client);
+static void httpd_client_execute (DSHttpdClient * client, DSGlobal * data);
+static gboolean httpd_client_execute_done (DSHttpdClient * client);
 
 /* INITIALIZE ***************************************************************/
 
@@ -105,6 +135,34 @@ static void httpd_client_request (DSHttpdClient * client);
 gboolean
 httpd_init (DSGlobal * data, GError ** error)
 {
+  guint i;
+
+#ifndef SO_REUSEPORT
+  if (data->httpd_acceptors > 1)
+    {
+      log_write (data, LOG_VERBOSE_WARNING, LOG_STARTUP, "error",
+		 LOG_VERBOSE_WARNING, LOG_TYPE_STRING,
+		 "SO_REUSEPORT is not supported, using one acceptor", NULL);
+      data->httpd_acceptors = 1;
+    }
+#endif
+
+  /* The requests are executed here, the httpd threads only do I/O: */
+  if (!(data->httpd_executor =
+	executor_new (data->limit_executor_threads,
+		      (GFunc) httpd_client_execute, data, error)))
+    return FALSE;
+
+  /* Many sockets on the same port, the kernel spreads the connections: */
+  if (data->httpd_acceptors > 1)
+    {
+      for (i = 0; i < data->httpd_acceptors; i++)
+	if (!httpd_acceptor_new (data, error))
+	  return FALSE;
+
+      return TRUE;
+    }
+
   if (data->httpd_ipv6 == FALSE)
     {
       if (!
@@ -127,8 +185,6 @@ httpd_init (DSGlobal * data, GError ** error)
 
   if (data->limit_threadnumb != 0)
     {
-      guint i;
-
       for (i = 0; i < data->limit_threadnumb; i++)
 	if (!httpd_thread_new (data, error))
 	  return FALSE;
@@ -141,12 +197,26 @@ httpd_init (DSGlobal * data, GError ** error)
 void
 httpd_close (DSGlobal * data)
 {
-  g_source_destroy (data->httpd_socket_source);
-  g_source_unref (data->httpd_socket_source);
-  data->httpd_socket_source = NULL;
+  if (data->httpd_socket_source)
+    {
+      g_source_destroy (data->httpd_socket_source);
+      g_source_unref (data->httpd_socket_source);
+      data->httpd_socket_source = NULL;
+    }
+
+  if (data->httpd_socket)
+    {
+      g_io_channel_shutdown (data->httpd_socket, FALSE, NULL);
+      g_io_channel_unref (data->httpd_socket);
+      data->httpd_socket = NULL;
+    }
 
-  g_io_channel_shutdown (data->httpd_socket, FALSE, NULL);
-  g_io_channel_unref (data->httpd_socket);
+  /* NOTE - queued requests are dropped, their clients are closed with the threads below */
+  if (data->httpd_executor)
+    {
+      executor_free (data->httpd_executor);
+      data->httpd_executor = NULL;
+    }
 
   while (data->httpd_threads)
     httpd_thread_close (data->httpd_threads->data);
@@ -178,6 +248,19 @@ httpd_create6 (DSGlobal * data, GError ** error, gint * ret_fd)
       return NULL;
     }
 
+#ifdef SO_REUSEPORT
+  if (data->httpd_acceptors > 1
+      && setsockopt (fd, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof (int)))
+    {
+      close (fd);
+      if (error != NULL && *error != NULL)
+        g_set_error (error, dupin_server_common_error_quark (), 0,
+		   "Error setting SO_REUSEPORT on the socket: %s\n",
+		   g_strerror (errno));
+      return NULL;
+    }
+#endif
+
   memset (&sock, 0, sizeof (struct sockaddr_in6));
   sock.sin6_family = AF_INET6;
   sock.sin6_port = htons (data->httpd_port);
@@ -260,6 +343,19 @@ httpd_create (DSGlobal * data, GError ** error, gint * ret_fd)
       return NULL;
     }
 
+#ifdef SO_REUSEPORT
+  if (data->httpd_acceptors > 1
+      && setsockopt (fd, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof (int)))
+    {
+      close (fd);
+      if (error != NULL && *error != NULL)
+        g_set_error (error, dupin_server_common_error_quark (), 0,
+		   "Error setting SO_REUSEPORT on the socket: %s\n",
+		   g_strerror (errno));
+      return NULL;
+    }
+#endif
+
   memset (&sock, 0, sizeof (struct sockaddr_in));
   sock.sin_family = AF_INET;
   sock.sin_port = htons (data->httpd_port);
@@ -317,15 +413,13 @@ httpd_create (DSGlobal * data, GError ** error, gint * ret_fd)
 }
 
 /* Reading function: */
-static gboolean
-httpd_read (GIOChannel * source, GIOCondition cond, DSGlobal * data)
+/* Accepts a connection, returns the socket or -1: */
+static gint
+httpd_accept (DSGlobal * data, gint socket_fd, gchar ** ip)
 {
   struct sockaddr_in sock;
   struct sockaddr_in6 sock6;
 
-  DSHttpdClient *client;
-
-  gchar *ip;
   gint fd;
 
   /* IPv6: */
@@ -336,22 +430,8 @@ httpd_read (GIOChannel * source, GIOCondition cond, DSGlobal * data)
       GString *str;
 
       /* IPv6 accept: */
-      if ((fd =
-	   accept (data->httpd_socket_fd, (struct sockaddr *) &sock6,
-		   &size)) < 0)
-	{
-	  g_source_destroy (data->httpd_socket_source);
-	  g_source_unref (data->httpd_socket_source);
-
-	  data->httpd_socket_source = g_timeout_source_new (200);
-	  g_source_set_callback (data->httpd_socket_source,
-				 (GSourceFunc) httpd_read_timeout, data,
-				 NULL);
-	  g_source_attach (data->httpd_socket_source,
-			   g_main_context_default ());
-
-	  return FALSE;
-	}
+      if ((fd = accept (socket_fd, (struct sockaddr *) &sock6, &size)) < 0)
+	return -1;
 
       /* Log information: */
       str = g_string_new (NULL);
@@ -365,7 +445,7 @@ httpd_read (GIOChannel * source, GIOCondition cond, DSGlobal * data)
 	    g_string_append_printf (str, "%c", id < 15 ? ':' : ' ');
 	}
 
-      ip = g_string_free (str, FALSE);
+      *ip = g_string_free (str, FALSE);
     }
 
   /* IPv4: */
@@ -375,58 +455,46 @@ httpd_read (GIOChannel * source, GIOCondition cond, DSGlobal * data)
       gint addr;
 
       /* IPv4 accept: */
-      if ((fd =
-	   accept (data->httpd_socket_fd, (struct sockaddr *) &sock,
-		   &size)) < 0)
-	{
-	  g_source_destroy (data->httpd_socket_source);
-	  g_source_unref (data->httpd_socket_source);
-
-	  data->httpd_socket_source = g_timeout_source_new (200);
-	  g_source_set_callback (data->httpd_socket_source,
-				 (GSourceFunc) httpd_read_timeout, data,
-				 NULL);
-	  g_source_attach (data->httpd_socket_source,
-			   g_main_context_default ());
-
-	  return FALSE;
-	}
+      if ((fd = accept (socket_fd, (struct sockaddr *) &sock, &size)) < 0)
+	return -1;
 
       addr = ntohl (sock.sin_addr.s_addr);
 
-      ip =
+      *ip =
 	g_strdup_printf ("%d.%d.%d.%d", (unsigned int) addr >> 24,
 			 (unsigned int) (addr >> 16) % 256,
 			 (unsigned int) (addr >> 8) % 256,
 			 (unsigned int) addr % 256);
     }
 
-  /* MaxClients check: */
-  if (data->limit_maxclients > 0
-      && data->httpd_clients_numb >= data->limit_maxclients)
-    {
-      log_write (data, LOG_VERBOSE_WARNING, LOG_HTTPD_CLIENT_ERROR, "error",
-		 LOG_VERBOSE_WARNING, LOG_TYPE_STRING, "Too many clients",
-		 NULL);
-      g_free (ip);
-      close (fd);
+  return fd;
+}
 
-      return TRUE;
-    }
+static gboolean
+httpd_read (GIOChannel * source, GIOCondition cond, DSGlobal * data)
+{
+  DSHttpdClient *client;
 
-  /* A new struct for a new client: */
-  client = g_malloc0 (sizeof (DSHttpdClient));
+  gchar *ip;
+  gint fd;
 
-  client->ip = ip;
-#ifdef G_OS_WIN32
-  client->channel = g_io_channel_win32_new (fd);
-#else
-  client->channel = g_io_channel_unix_new (fd);
-#endif
-  g_io_channel_set_encoding (client->channel, NULL, NULL);
+  if ((fd = httpd_accept (data, data->httpd_socket_fd, &ip)) < 0)
+    {
+      g_source_destroy (data->httpd_socket_source);
+      g_source_unref (data->httpd_socket_source);
 
-  client->request_included_docs_level = 0;
-  client->request_included_links_level = 0;
+      data->httpd_socket_source = g_timeout_source_new (200);
+      g_source_set_callback (data->httpd_socket_source,
+			     (GSourceFunc) httpd_read_timeout, data,
+			     NULL);
+      g_source_attach (data->httpd_socket_source,
+		       g_main_context_default ());
+
+      return FALSE;
+    }
+
+  if (!(client = httpd_client_new (data, fd, ip)))
+    return TRUE;
 
   if (httpd_client_add (data, client) == FALSE)
     {
@@ -451,28 +519,164 @@ httpd_read_timeout (DSGlobal * data)
   return FALSE;
 }
 
+/* ACCEPTORS ***************************************************************/
+
+/* A thread with its own SO_REUSEPORT socket, it never exits on idle: */
+static DSHttpdThread *
+httpd_acceptor_new (DSGlobal * data, GError ** error)
+{
+  DSHttpdThread *thread;
+  GIOChannel *socket;
+  gint socket_fd;
+
+  if (data->httpd_ipv6 == FALSE)
+    socket = httpd_create (data, error, &socket_fd);
+  else
+    socket = httpd_create6 (data, error, &socket_fd);
+
+  if (!socket)
+    return NULL;
+
+  if (!(thread = httpd_thread_new (data, error)))
+    {
+      g_io_channel_shutdown (socket, FALSE, NULL);
+      g_io_channel_unref (socket);
+      return NULL;
+    }
+
+  g_mutex_lock (thread->mutex);
+
+  thread->socket = socket;
+  thread->socket_fd = socket_fd;
+
+  thread->socket_source = g_io_create_watch (thread->socket, G_IO_IN);
+  g_source_set_callback (thread->socket_source,
+			 (GSourceFunc) httpd_acceptor_read, thread, NULL);
+  g_source_attach (thread->socket_source, thread->context);
+
+  g_mutex_unlock (thread->mutex);
+
+  return thread;
+}
+
+static gboolean
+httpd_acceptor_read (GIOChannel * source, GIOCondition cond,
+		     DSHttpdThread * thread)
+{
+  DSHttpdClient *client;
+
+  gchar *ip;
+  gint fd;
+
+  if ((fd = httpd_accept (thread->data, thread->socket_fd, &ip)) < 0)
+    {
+      g_source_destroy (thread->socket_source);
+      g_source_unref (thread->socket_source);
+
+      thread->socket_source = g_timeout_source_new (200);
+      g_source_set_callback (thread->socket_source,
+			     (GSourceFunc) httpd_acceptor_read_timeout,
+			     thread, NULL);
+      g_source_attach (thread->socket_source, thread->context);
+
+      return FALSE;
+    }
+
+  if (!(client = httpd_client_new (thread->data, fd, ip)))
+    return TRUE;
+
+  g_atomic_int_inc ((gint *) &thread->data->httpd_clients_numb);
+
+  httpd_client_attach (thread, client);
+  return TRUE;
+}
+
+static gboolean
+httpd_acceptor_read_timeout (DSHttpdThread * thread)
+{
+  g_source_destroy (thread->socket_source);
+  g_source_unref (thread->socket_source);
+
+  thread->socket_source = g_io_create_watch (thread->socket, G_IO_IN);
+  g_source_set_callback (thread->socket_source,
+			 (GSourceFunc) httpd_acceptor_read, thread, NULL);
+  g_source_attach (thread->socket_source, thread->context);
+
+  return FALSE;
+}
+
 /* CLIENT ******************************************************************/
+
+/* A new struct for a new client, NULL if there are too many: */
+static DSHttpdClient *
+httpd_client_new (DSGlobal * data, gint fd, gchar * ip)
+{
+  DSHttpdClient *client;
+
+  /* MaxClients check: */
+  if (data->limit_maxclients > 0
+      && g_atomic_int_get ((gint *) &data->httpd_clients_numb) >= data->limit_maxclients)
+    {
+      log_write (data, LOG_VERBOSE_WARNING, LOG_HTTPD_CLIENT_ERROR, "error",
+		 LOG_VERBOSE_WARNING, LOG_TYPE_STRING, "Too many clients",
+		 NULL);
+      g_free (ip);
+      close (fd);
+
+      return NULL;
+    }
+
+  client = g_malloc0 (sizeof (DSHttpdClient));
+
+  client->ip = ip;
+#ifdef G_OS_WIN32
+  client->channel = g_io_channel_win32_new (fd);
+#else
+  client->channel = g_io_channel_unix_new (fd);
+#endif
+  g_io_channel_set_encoding (client->channel, NULL, NULL);
+
+  /* NOTE - the socket is non-blocking and the channel unbuffered: a read returns what has
+            arrived and a write what the socket takes, so a client never stalls its thread */
+  g_io_channel_set_buffered (client->channel, FALSE);
+  g_io_channel_set_flags (client->channel, G_IO_FLAG_NONBLOCK, NULL);
+
+  client->request_included_docs_level = 0;
+  client->request_included_links_level = 0;
+
+  if (data->slowlog)
+    client->timing = dupin_timing_new ();
+
+  return client;
+}
+
+/* NOTE - the list of threads is only changed by the main loop, which is also the one
+          accepting, so no global lock is needed here: the least loaded thread is picked */
+
 static gboolean
 httpd_client_add (DSGlobal * data, DSHttpdClient * client)
 {
   GList *list;
   DSHttpdThread *thread = NULL;
+  guint clients_numb, min = G_MAXUINT;
 
-  g_mutex_lock (data->httpd_mutex);
-  data->httpd_clients_numb++;
+  g_atomic_int_inc ((gint *) &data->httpd_clients_numb);
 
-  /* Looking for a empty thread: */
+  /* Looking for the least loaded thread: */
   for (list = data->httpd_threads; list; list = list->next)
     {
-      thread = list->data;
+      DSHttpdThread *tmp = list->data;
 
-      g_mutex_lock (thread->mutex);
+      if (tmp->socket)
+	continue;
 
-      if (thread->clients_numb < data->limit_clientsforthread)
-	break;
+      clients_numb = g_atomic_int_get ((gint *) &tmp->clients_numb);
 
-      g_mutex_unlock (thread->mutex);
-      thread = NULL;
+      if (clients_numb < data->limit_clientsforthread && clients_numb < min)
+	{
+	  thread = tmp;
+	  min = clients_numb;
+	}
     }
 
   /* Creating a new thread: */
@@ -482,8 +686,7 @@ httpd_client_add (DSGlobal * data, DSHttpdClient * client)
 
       if (!(thread = httpd_thread_new (data, &error)))
 	{
-	  data->httpd_clients_numb--;
-	  g_mutex_unlock (data->httpd_mutex);
+	  g_atomic_int_add ((gint *) &data->httpd_clients_numb, -1);
 
 	  log_write (data, LOG_VERBOSE_ERROR, LOG_HTTPD_CLIENT_ERROR, "error",
 		     LOG_VERBOSE_ERROR, LOG_TYPE_STRING, error->message,
@@ -494,15 +697,20 @@ httpd_client_add (DSGlobal * data, DSHttpdClient * client)
 
 	  return FALSE;
 	}
-
-      g_mutex_lock (thread->mutex);
     }
 
-  g_mutex_unlock (data->httpd_mutex);
+  httpd_client_attach (thread, client);
+  return TRUE;
+}
+
+static void
+httpd_client_attach (DSHttpdThread * thread, DSHttpdClient * client)
+{
+  g_mutex_lock (thread->mutex);
 
   /* Adding the new client: */
   thread->clients = g_list_prepend (thread->clients, client);
-  thread->clients_numb++;
+  g_atomic_int_inc ((gint *) &thread->clients_numb);
 
   if (thread->timeout_source)
     {
@@ -524,7 +732,6 @@ httpd_client_add (DSGlobal * data, DSHttpdClient * client)
   g_source_attach (client->channel_source, thread->context);
 
   g_mutex_unlock (thread->mutex);
-  return TRUE;
 }
 
 /* After X seconds, the client will be closed: */
@@ -570,11 +777,15 @@ static gboolean
 httpd_client_read_header (GIOChannel * source, GIOCondition cond,
 			  DSHttpdClient * client)
 {
-  gchar *line = NULL;
-  gsize size, last;
+  gsize done;
   GIOStatus status;
+  DSParserStatus parsed;
+  gint64 start;
 
-  status = g_io_channel_read_line (source, &line, &size, &last, NULL);
+  status = g_io_channel_read_chars (source,
+				    client->input_header + client->input_header_size,
+				    PARSER_BUFFER_SIZE - client->input_header_size,
+				    &done, NULL);
 
   /* The status of the read: */
   switch (status)
@@ -582,17 +793,9 @@ httpd_client_read_header (GIOChannel * source, GIOCondition cond,
     case G_IO_STATUS_NORMAL:
       break;
 
-      /* Setting a delay: */
+      /* The socket is not ready, the watch fires again once it is: */
     case G_IO_STATUS_AGAIN:
-      g_source_destroy (client->channel_source);
-      g_source_unref (client->channel_source);
-
-      client->channel_source = g_timeout_source_new (200);
-      g_source_set_callback (client->channel_source,
-			     (GSourceFunc) httpd_client_read_header_timeout,
-			     client, NULL);
-      g_source_attach (client->channel_source, client->thread->context);
-      return FALSE;
+      return TRUE;
 
       /* Close the socket: */
     case G_IO_STATUS_ERROR:
@@ -608,263 +811,207 @@ httpd_client_read_header (GIOChannel * source, GIOCondition cond,
   /* Removing the timeout: */
   httpd_client_timeout_refresh (client);
 
-  /* If the line is too long: */
-  if (size > HTTP_MAX_LINE)
-    {
-      log_write (client->thread->data, LOG_VERBOSE_INFO,
-		 LOG_HTTPD_CLIENT_ERROR, "client", LOG_VERBOSE_INFO,
-		 LOG_TYPE_STRING, client->ip, "error", LOG_VERBOSE_INFO,
-		 LOG_TYPE_STRING, "Header line too long", NULL);
+  client->input_header_size += done;
 
-      httpd_client_send (client, HTTP_STATUS_400);
-      g_free (line);
-      return FALSE;
-    }
+  start = client->timing ? g_get_monotonic_time () : 0;
 
-  line[last] = 0;
+  parsed = parser_parse (&client->input_parser, client->input_header,
+			 client->input_header_size);
+
+  if (client->timing)
+    client->timing->phases[DP_TIMING_PARSE] += g_get_monotonic_time () - start;
 
-  /* Empty line means the data block: */
-  if (line[0] == 0)
+  switch (parsed)
     {
-      DSHttpStatusCode error;
+    case PARSER_INCOMPLETE:
+      /* If the header is too long: */
+      if (client->input_header_size >= PARSER_BUFFER_SIZE)
+	{
+	  log_write (client->thread->data, LOG_VERBOSE_INFO,
+		     LOG_HTTPD_CLIENT_ERROR, "client", LOG_VERBOSE_INFO,
+		     LOG_TYPE_STRING, client->ip, "error", LOG_VERBOSE_INFO,
+		     LOG_TYPE_STRING, "Header too long", NULL);
 
-      g_free (line);
+	  httpd_client_send (client, HTTP_STATUS_400);
+	  return FALSE;
+	}
 
-      /* Validation of the HTTP header: */
-      if (httpd_client_header (client, &error) == FALSE)
-	httpd_client_send (client, error);
+      return TRUE;
 
+    case PARSER_ERROR:
+      httpd_client_send (client, HTTP_STATUS_400);
       return FALSE;
-    }
 
-  client->headers = g_list_append (client->headers, line);
-  client->headers_numb++;
+    case PARSER_TOO_MANY_HEADERS:
+      break;
 
-  if (client->thread->data->limit_maxheaders > 0
-      && client->headers_numb >= client->thread->data->limit_maxheaders)
-    {
-      log_write (client->thread->data, LOG_VERBOSE_INFO,
-		 LOG_HTTPD_CLIENT_ERROR, "client", LOG_VERBOSE_INFO,
-		 LOG_TYPE_STRING, client->ip, "error", LOG_VERBOSE_INFO,
-		 LOG_TYPE_STRING, "Too many line of header", NULL);
-      httpd_client_send (client, HTTP_STATUS_400);
-      return FALSE;
-    }
+    case PARSER_DONE:
+      if (client->thread->data->limit_maxheaders == 0
+	  || client->input_parser.headers_numb + 1 < client->thread->data->limit_maxheaders)
+	{
+	  DSHttpStatusCode error;
 
-  return TRUE;
-}
+	  client->input_header_done = client->input_parser.size;
 
-static gboolean
-httpd_client_read_header_timeout (DSHttpdClient * client)
-{
-  g_source_destroy (client->channel_source);
-  g_source_unref (client->channel_source);
+	  /* Validation of the HTTP header: */
+	  if (httpd_client_header (client, &error) == FALSE)
+	    httpd_client_send (client, error);
 
-  client->channel_source = g_io_create_watch (client->channel, G_IO_IN);
-  g_source_set_callback (client->channel_source,
-			 (GSourceFunc) httpd_client_read_header, client,
-			 NULL);
-  g_source_attach (client->channel_source, client->thread->context);
+	  return FALSE;
+	}
+
+      break;
+    }
+
+  log_write (client->thread->data, LOG_VERBOSE_INFO,
+	     LOG_HTTPD_CLIENT_ERROR, "client", LOG_VERBOSE_INFO,
+	     LOG_TYPE_STRING, client->ip, "error", LOG_VERBOSE_INFO,
+	     LOG_TYPE_STRING, "Too many line of header", NULL);
+  httpd_client_send (client, HTTP_STATUS_400);
   return FALSE;
 }
 
 static gboolean httpd_client_header_parse (DSHttpdClient * client,
 					   gchar * request, GList ** parts,
 					   GList ** keyvalue);
+static gboolean httpd_client_read_body_buffer (DSHttpdClient * client);
+
+/* NOTE - the request target is split in path and arguments only when needed,
+          FALSE means the request is answered with 400 */
 
-/* Header parser: */
 static gboolean
-httpd_client_header (DSHttpdClient * client, DSHttpStatusCode * error)
+httpd_client_request_target (DSHttpdClient * client)
 {
-  GList *list;
-  gchar **parts;
+  gchar *target;
 
-  gsize csize = 0;
+  if (client->request_target_parsed == TRUE)
+    return client->request_target_valid;
 
-  if (!client->headers)
-    {
-      *error = HTTP_STATUS_400;
-      return FALSE;
-    }
+  client->request_target_parsed = TRUE;
 
-  parts = g_strsplit (client->headers->data, " ", -1);
+  target = g_strndup (client->input_header + client->input_parser.target.offset,
+		      client->input_parser.target.len);
 
-  if (!parts || !parts[0] || !parts[1] || !parts[2] || parts[3])
-    {
-      *error = HTTP_STATUS_400;
+  client->request_target_valid =
+    httpd_client_header_parse (client, target, &client->request_path,
+			       &client->request_arguments);
 
-      if (parts)
-	g_strfreev (parts);
+  g_free (target);
 
-      return FALSE;
-    }
+  return client->request_target_valid;
+}
 
-  if (!g_strcmp0 (parts[0], "GET"))
+/* Header parser: */
+static gboolean
+httpd_client_header (DSHttpdClient * client, DSHttpStatusCode * error)
+{
+  DSParser *parser = &client->input_parser;
+  gchar *buf = client->input_header;
+  guint i;
+
+  gsize csize = 0;
+
+  if (parser_span_equal (buf, &parser->method, "GET", 3))
     client->request = DS_HTTPD_REQUEST_GET;
 
-  else if (!g_strcmp0 (parts[0], "HEAD"))
+  else if (parser_span_equal (buf, &parser->method, "HEAD", 4))
     client->request = DS_HTTPD_REQUEST_HEAD;
 
-  else if (!g_strcmp0 (parts[0], "POST"))
+  else if (parser_span_equal (buf, &parser->method, "POST", 4))
     client->request = DS_HTTPD_REQUEST_POST;
 
-  else if (!g_strcmp0 (parts[0], "PUT"))
+  else if (parser_span_equal (buf, &parser->method, "PUT", 3))
     client->request = DS_HTTPD_REQUEST_PUT;
 
-  else if (!g_strcmp0 (parts[0], "DELETE"))
+  else if (parser_span_equal (buf, &parser->method, "DELETE", 6))
     client->request = DS_HTTPD_REQUEST_DELETE;
 
   else
     {
       *error = HTTP_STATUS_400;
-      g_strfreev (parts);
       return FALSE;
     }
 
-  if (g_strcmp0 (parts[2], "HTTP/1.1") && g_strcmp0 (parts[2], "HTTP/1.0"))
+  if (!parser_span_equal (buf, &parser->version, "HTTP/1.1", 8)
+      && !parser_span_equal (buf, &parser->version, "HTTP/1.0", 8))
     {
       *error = HTTP_STATUS_400;
-      g_strfreev (parts);
       return FALSE;
     }
 
-  if (httpd_client_header_parse
-      (client, parts[1], &client->request_path,
-       &client->request_arguments) == FALSE)
+  if (buf[parser->target.offset] != '/')
     {
       *error = HTTP_STATUS_400;
-      g_strfreev (parts);
       return FALSE;
     }
 
-  g_strfreev (parts);
-
-  for (list = client->headers->next; list; list = list->next)
+  for (i = 0; i < parser->headers_numb; i++)
     {
-      gchar *line = list->data;
-
-      //g_message ("%s\n", line);
-
-      if (!strncasecmp (line, HTTP_CONTENT_LENGTH, HTTP_CONTENT_LENGTH_LEN))
-	{
-	  line += HTTP_CONTENT_LENGTH_LEN;
-
-	  while (line[0] != 0 && (line[0] == ' ' || line[0] == '\t'))
-	    line++;
+      DSParserHeader *header = &parser->headers[i];
+      gchar *value = buf + header->value.offset;
 
-	  if (line[0] != ':')
-	    continue;
-
-	  line++;
-
-	  while (line[0] != 0 && (line[0] == ' ' || line[0] == '\t'))
-	    line++;
-
-	  if (line[0] != 0)
-	    csize = atoi (line);
-	}
+      //g_message ("%.*s: %s\n", (gint) header->name.len, buf + header->name.offset, value);
 
-      if (!strncasecmp (line, HTTP_CONTENT_TYPE, HTTP_CONTENT_TYPE_LEN))
+      if (parser_span_equal_nocase (buf, &header->name, HTTP_CONTENT_LENGTH, HTTP_CONTENT_LENGTH_LEN))
 	{
-	  line += HTTP_CONTENT_TYPE_LEN;
-
-	  while (line[0] != 0 && (line[0] == ' ' || line[0] == '\t'))
-	    line++;
-
-	  if (line[0] != ':')
-	    continue;
-
-	  line++;
-
-	  while (line[0] != 0 && (line[0] == ' ' || line[0] == '\t'))
-	    line++;
-
-          client->input_mime = g_strdup (line);
-	}
-
-      if (!strncasecmp (line, HTTP_IF_MATCH, HTTP_IF_MATCH_LEN))
-	{
-	  line += HTTP_IF_MATCH_LEN;
-
-	  while (line[0] != 0 && (line[0] == ' ' || line[0] == '\t'))
-	    line++;
-
-	  if (line[0] != ':')
-	    continue;
-
-	  line++;
-
-	  while (line[0] != 0 && (line[0] == ' ' || line[0] == '\t'))
-	    line++;
-
-          client->input_if_match = g_strdup (line);
+	  if (value[0] != 0)
+	    csize = atoi (value);
 	}
 
-      if (!strncasecmp (line, HTTP_IF_NONE_MATCH, HTTP_IF_NONE_MATCH_LEN))
+      else if (parser_span_equal_nocase (buf, &header->name, HTTP_TRANSFER_ENCODING, HTTP_TRANSFER_ENCODING_LEN))
 	{
-	  line += HTTP_IF_NONE_MATCH_LEN;
+	  /* NOTE - chunked must be the last coding applied, any other is not supported */
 
-	  while (line[0] != 0 && (line[0] == ' ' || line[0] == '\t'))
-	    line++;
-
-	  if (line[0] != ':')
-	    continue;
+	  if (g_str_has_suffix (value, "chunked") == FALSE)
+	    {
+	      *error = HTTP_STATUS_400;
+	      return FALSE;
+	    }
 
-	  line++;
-
-	  while (line[0] != 0 && (line[0] == ' ' || line[0] == '\t'))
-	    line++;
-
-          client->input_if_none_match = g_strdup (line);
+          client->input_chunked = TRUE;
 	}
 
-      if (!strncasecmp (line, HTTP_IF_MODIFIED_SINCE, HTTP_IF_MODIFIED_SINCE_LEN))
-	{
-	  line += HTTP_IF_MODIFIED_SINCE_LEN;
+      else if (parser_span_equal_nocase (buf, &header->name, HTTP_CONTENT_TYPE, HTTP_CONTENT_TYPE_LEN))
+        client->input_mime = value;
 
-	  while (line[0] != 0 && (line[0] == ' ' || line[0] == '\t'))
-	    line++;
+      else if (parser_span_equal_nocase (buf, &header->name, HTTP_IF_MATCH, HTTP_IF_MATCH_LEN))
+        client->input_if_match = value;
 
-	  if (line[0] != ':')
-	    continue;
+      else if (parser_span_equal_nocase (buf, &header->name, HTTP_IF_NONE_MATCH, HTTP_IF_NONE_MATCH_LEN))
+        client->input_if_none_match = value;
 
-	  line++;
+      else if (parser_span_equal_nocase (buf, &header->name, HTTP_IF_MODIFIED_SINCE, HTTP_IF_MODIFIED_SINCE_LEN))
+        client->input_if_modified_since = value;
 
-	  while (line[0] != 0 && (line[0] == ' ' || line[0] == '\t'))
-	    line++;
+      else if (parser_span_equal_nocase (buf, &header->name, HTTP_IF_UNMODIFIED_SINCE, HTTP_IF_UNMODIFIED_SINCE_LEN))
+        client->input_if_unmodified_since = value;
 
-          client->input_if_modified_since = g_strdup (line);
-	}
-
-      if (!strncasecmp (line, HTTP_IF_UNMODIFIED_SINCE, HTTP_IF_UNMODIFIED_SINCE_LEN))
-	{
-	  line += HTTP_IF_UNMODIFIED_SINCE_LEN;
-
-	  while (line[0] != 0 && (line[0] == ' ' || line[0] == '\t'))
-	    line++;
+      else if (parser_span_equal_nocase (buf, &header->name, HTTP_RANGE, HTTP_RANGE_LEN))
+        client->input_range = value;
 
-	  if (line[0] != ':')
-	    continue;
-
-	  line++;
+      else if (parser_span_equal_nocase (buf, &header->name, HTTP_IF_RANGE, HTTP_IF_RANGE_LEN))
+        client->input_if_range = value;
 
-	  while (line[0] != 0 && (line[0] == ' ' || line[0] == '\t'))
-	    line++;
-
-          client->input_if_unmodified_since = g_strdup (line);
-	}
+      else if (parser_span_equal_nocase (buf, &header->name, HTTP_ACCEPT_ENCODING, HTTP_ACCEPT_ENCODING_LEN))
+        client->input_accept_encoding = value;
     }
 
   log_write (client->thread->data, LOG_VERBOSE_INFO, LOG_HTTPD_CLIENT_CONNECT,
 	     "client", LOG_VERBOSE_INFO, LOG_TYPE_STRING, client->ip,
-	     "request", LOG_VERBOSE_INFO, LOG_TYPE_STRING, client->headers->data,
+	     "request", LOG_VERBOSE_INFO, LOG_TYPE_STRING, buf + parser->request_line.offset,
 	     "Content-Length", LOG_VERBOSE_INFO, LOG_TYPE_INTEGER, (gint) csize,
 	     "Content-Type", LOG_VERBOSE_INFO, LOG_TYPE_STRING, client->input_mime,
 	     "If-Match", LOG_VERBOSE_INFO, LOG_TYPE_STRING, client->input_if_match,
 	     "If-None-Match", LOG_VERBOSE_INFO, LOG_TYPE_STRING, client->input_if_none_match,
 	     NULL);
 
-  if (csize != 0)
+  /* NOTE - Content-Length is ignored when the body is chunked, see http://tools.ietf.org/html/rfc2616#section-4.4 */
+
+  if (client->input_chunked == TRUE)
+    csize = 0;
+
+  if (csize != 0
+      || client->input_chunked == TRUE)
     {
       if (client->thread->data->limit_maxcontentlength != 0
 	  && csize >= client->thread->data->limit_maxcontentlength)
@@ -878,8 +1025,48 @@ httpd_client_header (DSHttpdClient * client, DSHttpStatusCode * error)
 	  return FALSE;
 	}
 
+      /* Large or chunked attachment bodies go to a spool file while they arrive: */
+      if (client->request == DS_HTTPD_REQUEST_PUT
+	  && (client->input_chunked == TRUE || csize >= HTTP_UPLOAD_SPOOL_MINSIZE))
+	{
+	  if (httpd_client_request_target (client) == FALSE)
+	    {
+	      *error = HTTP_STATUS_400;
+	      return FALSE;
+	    }
+
+	  if (request_is_attachment_upload (client) == TRUE)
+	    {
+	      if (!(client->input_upload = dupin_attachment_upload_new (client->thread->data->dupin, NULL)))
+		{
+		  log_write (client->thread->data, LOG_VERBOSE_INFO,
+			     LOG_HTTPD_CLIENT_ERROR, "client", LOG_VERBOSE_INFO,
+			     LOG_TYPE_STRING, client->ip, "error", LOG_VERBOSE_INFO,
+			     LOG_TYPE_STRING, "Cannot create upload file", NULL);
+
+		  *error = HTTP_STATUS_500;
+		  return FALSE;
+		}
+
+	      client->input_buffer = g_malloc (sizeof (gchar) * HTTP_UPLOAD_CHUNK_SIZE);
+	    }
+	}
+
       client->body_size = csize;
-      client->body = g_malloc (sizeof (gchar) * csize);
+
+      /* NOTE - the framing lines get their own buffer, the header ones are still
+                referenced till the request is executed */
+      if (client->input_chunked == TRUE)
+	client->input_chunk_line = g_malloc (sizeof (gchar) * (HTTP_MAX_LINE + 2));
+
+      /* NOTE - chunked bodies kept in RAM grow as chunks arrive */
+      if (client->input_upload == NULL
+          && client->input_chunked == FALSE)
+        client->body = g_malloc (sizeof (gchar) * csize);
+
+      /* Body bytes read together with the header: */
+      if (httpd_client_read_body_buffer (client) == FALSE)
+	return TRUE;
 
       g_source_destroy (client->channel_source);
       g_source_unref (client->channel_source);
@@ -990,18 +1177,59 @@ httpd_client_header_parse (DSHttpdClient * client, gchar * request,
 
 /* CLIENT READ BODY *******************************************************/
 
+static gboolean httpd_client_read_body_consume (DSHttpdClient * client,
+						gchar * buf, gsize len);
+static gboolean httpd_client_read_body_line (DSHttpdClient * client,
+					     gchar * line, gsize last);
+static gboolean httpd_client_read_body_data (DSHttpdClient * client,
+					     gchar * buf, gsize done);
+
 /* This function reads something from the client: */
 static gboolean
 httpd_client_read_body (GIOChannel * source, GIOCondition cond,
 			DSHttpdClient * client)
 {
-  gsize done;
+  gchar *buf = NULL;
+  gchar framing_buf[HTTP_MAX_LINE];
+  gsize count, done = 0;
   GIOStatus status;
+  gboolean framing;
 
-  status =
-    g_io_channel_read_chars (source, client->body + client->body_done,
-			     client->body_size - client->body_done, &done,
-			     NULL);
+  /* Chunk size, chunk end and trailer lines, with any chunk data read along: */
+  framing = (client->input_chunked == TRUE
+	     && client->input_chunk_state != DS_HTTPD_CHUNK_DATA) ? TRUE : FALSE;
+
+  if (framing == TRUE)
+    {
+      buf = framing_buf;
+      count = sizeof (framing_buf);
+    }
+
+  else
+    {
+      if (client->input_chunked == TRUE)
+        count = client->input_chunk_size;
+      else
+        count = client->body_size - client->body_done;
+
+      if (client->input_upload != NULL)
+        {
+          buf = client->input_buffer;
+          count = MIN (count, HTTP_UPLOAD_CHUNK_SIZE);
+        }
+      else
+        {
+          if (client->input_chunked == TRUE)
+            {
+              count = MIN (count, HTTP_UPLOAD_CHUNK_SIZE);
+              client->body = g_realloc (client->body, client->body_done + count);
+            }
+
+          buf = client->body + client->body_done;
+        }
+    }
+
+  status = g_io_channel_read_chars (source, buf, count, &done, NULL);
 
   /* The status of the read: */
   switch (status)
@@ -1009,17 +1237,9 @@ httpd_client_read_body (GIOChannel * source, GIOCondition cond,
     case G_IO_STATUS_NORMAL:
       break;
 
-      /* Setting a delay: */
+      /* The socket is not ready, the watch fires again once it is: */
     case G_IO_STATUS_AGAIN:
-      g_source_destroy (client->channel_source);
-      g_source_unref (client->channel_source);
-
-      client->channel_source = g_timeout_source_new (200);
-      g_source_set_callback (client->channel_source,
-			     (GSourceFunc) httpd_client_read_body_timeout,
-			     client, NULL);
-      g_source_attach (client->channel_source, client->thread->context);
-      return FALSE;
+      return TRUE;
 
       /* Close the socket: */
     case G_IO_STATUS_ERROR:
@@ -1036,39 +1256,293 @@ httpd_client_read_body (GIOChannel * source, GIOCondition cond,
   /* Removing the timeout: */
   httpd_client_timeout_refresh (client);
 
-  client->body_done += done;
+  if (framing == TRUE)
+    return httpd_client_read_body_consume (client, buf, done);
 
-  /* Some check: */
-  if (client->body_done >= client->body_size)
+  return httpd_client_read_body_data (client, buf, done);
+}
+
+/* Consumes the body bytes read together with the header, the receive buffer
+   itself is left untouched: */
+static gboolean
+httpd_client_read_body_buffer (DSHttpdClient * client)
+{
+  gchar *buf = client->input_header + client->input_header_done;
+  gsize len = client->input_header_size - client->input_header_done;
+
+  client->input_header_done = client->input_header_size;
+
+  if (len == 0)
+    return TRUE;
+
+  return httpd_client_read_body_consume (client, buf, len);
+}
+
+/* Consumes body bytes not read straight into their destination, an incomplete
+   chunk line is kept in input_chunk_line till the rest arrives: */
+static gboolean
+httpd_client_read_body_consume (DSHttpdClient * client, gchar * buf, gsize len)
+{
+  while (len > 0)
+    {
+      gsize count;
+
+      if (client->input_chunked == TRUE
+	  && client->input_chunk_state != DS_HTTPD_CHUNK_DATA)
+	{
+	  gchar *eol;
+	  gsize last;
+
+	  eol = parser_find (buf, len, '\n');
+	  count = eol != NULL ? eol - buf : len;
+
+	  if (client->input_chunk_line_size + count > HTTP_MAX_LINE + 1)
+	    {
+	      log_write (client->thread->data, LOG_VERBOSE_INFO,
+			 LOG_HTTPD_CLIENT_ERROR, "client", LOG_VERBOSE_INFO,
+			 LOG_TYPE_STRING, client->ip, "error", LOG_VERBOSE_INFO,
+			 LOG_TYPE_STRING, "Chunk line too long", NULL);
+
+	      httpd_client_send (client, HTTP_STATUS_400);
+	      return FALSE;
+	    }
+
+	  memcpy (client->input_chunk_line + client->input_chunk_line_size, buf, count);
+	  client->input_chunk_line_size += count;
+
+	  if (eol == NULL)
+	    return TRUE;
+
+	  buf += count + 1;
+	  len -= count + 1;
+
+	  last = client->input_chunk_line_size;
+	  client->input_chunk_line_size = 0;
+
+	  if (last > 0 && client->input_chunk_line[last - 1] == '\r')
+	    last--;
+
+	  if (httpd_client_read_body_line (client, g_strndup (client->input_chunk_line, last), last) == FALSE)
+	    return FALSE;
+
+	  continue;
+	}
+
+      if (client->input_chunked == TRUE)
+	count = MIN (len, client->input_chunk_size);
+      else
+	count = MIN (len, client->body_size - client->body_done);
+
+      if (client->input_upload == NULL)
+	{
+	  if (client->input_chunked == TRUE)
+	    client->body = g_realloc (client->body, client->body_done + count);
+
+	  memcpy (client->body + client->body_done, buf, count);
+
+	  if (httpd_client_read_body_data (client, client->body + client->body_done, count) == FALSE)
+	    return FALSE;
+	}
+      else if (httpd_client_read_body_data (client, buf, count) == FALSE)
+	return FALSE;
+
+      buf += count;
+      len -= count;
+    }
+
+  return TRUE;
+}
+
+/* Chunked body framing, see http://tools.ietf.org/html/rfc2616#section-3.6.1 */
+static gboolean
+httpd_client_read_body_line (DSHttpdClient * client, gchar * line, gsize last)
+{
+  gchar *end = NULL;
+  guint64 size;
+
+  if (last > HTTP_MAX_LINE)
     {
+      log_write (client->thread->data, LOG_VERBOSE_INFO,
+		 LOG_HTTPD_CLIENT_ERROR, "client", LOG_VERBOSE_INFO,
+		 LOG_TYPE_STRING, client->ip, "error", LOG_VERBOSE_INFO,
+		 LOG_TYPE_STRING, "Chunk line too long", NULL);
+
+      httpd_client_send (client, HTTP_STATUS_400);
+      g_free (line);
+      return FALSE;
+    }
+
+  line[last] = 0;
+
+  switch (client->input_chunk_state)
+    {
+    case DS_HTTPD_CHUNK_SIZE:
+      size = g_ascii_strtoull (line, &end, 16);
+
+      /* NOTE - chunk extensions after ';' are ignored */
+      if (end == line
+	  || (end[0] != 0 && end[0] != ';' && end[0] != ' ' && end[0] != '\t'))
+	{
+	  log_write (client->thread->data, LOG_VERBOSE_INFO,
+		     LOG_HTTPD_CLIENT_ERROR, "client", LOG_VERBOSE_INFO,
+		     LOG_TYPE_STRING, client->ip, "error", LOG_VERBOSE_INFO,
+		     LOG_TYPE_STRING, "Invalid chunk size", NULL);
+
+	  httpd_client_send (client, HTTP_STATUS_400);
+	  g_free (line);
+	  return FALSE;
+	}
+
+      g_free (line);
+
+      if (client->thread->data->limit_maxcontentlength != 0
+	  && client->body_done + size >= client->thread->data->limit_maxcontentlength)
+	{
+	  log_write (client->thread->data, LOG_VERBOSE_INFO,
+		     LOG_HTTPD_CLIENT_ERROR, "client", LOG_VERBOSE_INFO,
+		     LOG_TYPE_STRING, client->ip, "error", LOG_VERBOSE_INFO,
+		     LOG_TYPE_STRING, "Chunked body too big", NULL);
+
+	  httpd_client_send (client, HTTP_STATUS_400);
+	  return FALSE;
+	}
+
+      if (size == 0)
+	client->input_chunk_state = DS_HTTPD_CHUNK_TRAILER;
+      else
+	{
+	  client->input_chunk_size = size;
+	  client->input_chunk_state = DS_HTTPD_CHUNK_DATA;
+	}
+
+      return TRUE;
+
+    case DS_HTTPD_CHUNK_DATA_END:
+      if (line[0] != 0)
+	{
+	  log_write (client->thread->data, LOG_VERBOSE_INFO,
+		     LOG_HTTPD_CLIENT_ERROR, "client", LOG_VERBOSE_INFO,
+		     LOG_TYPE_STRING, client->ip, "error", LOG_VERBOSE_INFO,
+		     LOG_TYPE_STRING, "Invalid chunk end", NULL);
+
+	  httpd_client_send (client, HTTP_STATUS_400);
+	  g_free (line);
+	  return FALSE;
+	}
+
+      g_free (line);
+      client->input_chunk_state = DS_HTTPD_CHUNK_SIZE;
+      return TRUE;
+
+    case DS_HTTPD_CHUNK_TRAILER:
+      /* NOTE - trailer headers are not used */
+      if (line[0] != 0)
+	{
+	  g_free (line);
+	  return TRUE;
+	}
+
+      g_free (line);
+
+      client->body_size = client->body_done;
       httpd_client_request (client);
       return FALSE;
+
+    default:
+      break;
     }
 
+  g_free (line);
   return TRUE;
 }
 
 static gboolean
-httpd_client_read_body_timeout (DSHttpdClient * client)
+httpd_client_read_body_data (DSHttpdClient * client, gchar * buf, gsize done)
 {
-  g_source_destroy (client->channel_source);
-  g_source_unref (client->channel_source);
+  if (client->input_upload != NULL
+      && dupin_attachment_upload_write (client->input_upload, buf, done, NULL) == FALSE)
+    {
+      log_write (client->thread->data, LOG_VERBOSE_INFO,
+		 LOG_HTTPD_CLIENT_ERROR, "client", LOG_VERBOSE_INFO,
+		 LOG_TYPE_STRING, client->ip, "error", LOG_VERBOSE_INFO,
+		 LOG_TYPE_STRING, "Cannot write upload file", NULL);
 
-  client->channel_source = g_io_create_watch (client->channel, G_IO_IN);
-  g_source_set_callback (client->channel_source,
-			 (GSourceFunc) httpd_client_read_body, client, NULL);
-  g_source_attach (client->channel_source, client->thread->context);
-  return FALSE;
+      httpd_client_send (client, HTTP_STATUS_500);
+      return FALSE;
+    }
+
+  client->body_done += done;
+
+  if (client->input_chunked == TRUE)
+    {
+      client->input_chunk_size -= done;
+
+      if (client->input_chunk_size == 0)
+	client->input_chunk_state = DS_HTTPD_CHUNK_DATA_END;
+
+      return TRUE;
+    }
+
+  /* Some check: */
+  if (client->body_done >= client->body_size)
+    {
+      httpd_client_request (client);
+      return FALSE;
+    }
+
+  return TRUE;
 }
 
 /* CLIENT REQUEST ***********************************************************/
+
+/* NOTE - the request runs on the executor pool so that a slow one does not stall
+          the other clients served by the same httpd thread, which is left with the
+          non-blocking socket reads and writes only */
+
 static void
 httpd_client_request (DSHttpdClient * client)
+{
+  /* No idle timeout while the request is executed: */
+  if (client->timeout_source)
+    {
+      g_source_destroy (client->timeout_source);
+      g_source_unref (client->timeout_source);
+      client->timeout_source = NULL;
+    }
+
+  executor_push (client->thread->data->httpd_executor, client);
+}
+
+static void
+httpd_client_execute (DSHttpdClient * client, DSGlobal * data)
 {
   guint i;
   DSHttpStatusCode status;
+  GSource *source;
+  gboolean valid;
+  gint64 start = g_get_monotonic_time ();
+  gint64 span = dupin_trace_begin ();
+
+  /* Library code running for this request adds to its timing context: */
+  if (client->timing)
+    {
+      dupin_timing_set_current (client->timing);
+
+      client->timing_request = g_strndup (client->input_header + client->input_parser.request_line.offset,
+					  client->input_parser.request_line.len);
+    }
 
-  if (!client->request_path)
+  valid = httpd_client_request_target (client);
+
+  if (client->timing)
+    dupin_timing_add (DP_TIMING_PARSE, g_get_monotonic_time () - start);
+
+  client->request_handler = NULL;
+
+  if (valid == FALSE)
+    status = HTTP_STATUS_400;
+
+  else if (!client->request_path)
     {
       status = request_global (client, client->request_path,
 		      client->request_arguments);
@@ -1081,31 +1555,64 @@ httpd_client_request (DSHttpdClient * client)
 ==49190==    by 0x100003BBE: httpd_client_request (in src/httpd/dupin_server)
 ==49190==    by 0x1000039C7: httpd_client_read_body (in src/httpd/dupin_server)
        */
-
-      httpd_client_send (client, status);
-      return;
     }
 
-  for (i = 0; request_types[i].request; i++)
+  else
     {
-      if (client->request == request_types[i].request_type
-	  && !g_strcmp0 (client->request_path->data, request_types[i].request))
-	{
-	  status =
-	    request_types[i].func (client, client->request_path->next,
-				   client->request_arguments);
-	  break;
-	}
-    }
+      for (i = 0; request_types[i].request; i++)
+        {
+          if (client->request == request_types[i].request_type
+	      && !g_strcmp0 (client->request_path->data, request_types[i].request))
+	    {
+	      client->request_handler = request_types[i].request;
+
+	      status =
+	        request_types[i].func (client, client->request_path->next,
+				       client->request_arguments);
+	      break;
+	    }
+        }
 
-  if (!request_types[i].request)
-    {
-      status =
-        request_global (client, client->request_path,
-	                client->request_arguments);
+      if (!request_types[i].request)
+        {
+          status =
+            request_global (client, client->request_path,
+	                    client->request_arguments);
+        }
     }
 
-  httpd_client_send (client, status);
+  client->request_status = status;
+
+  /* NOTE - requests not routed to a handler are accounted under request_global */
+  stats_request (data, client->request_handler ? client->request_handler : "request_global",
+		 g_get_monotonic_time () - start,
+		 client->input_parser.size + client->body_size, client->output_size,
+		 status >= HTTP_STATUS_400 ? TRUE : FALSE);
+
+  dupin_trace_end ("request", client->request_handler ? client->request_handler : "request_global",
+		   NULL, span);
+
+  if (client->timing)
+    dupin_timing_set_current (NULL);
+
+  /* The response is written by the httpd thread of the client: */
+  source = g_idle_source_new ();
+  g_source_set_callback (source, (GSourceFunc) httpd_client_execute_done,
+			 client, NULL);
+  g_source_attach (source, client->thread->context);
+  g_source_unref (source);
+}
+
+static gboolean
+httpd_client_execute_done (DSHttpdClient * client)
+{
+  httpd_client_timeout_refresh (client);
+
+  if (client->timing)
+    client->timing_write_start = g_get_monotonic_time ();
+
+  httpd_client_send (client, client->request_status);
+  return FALSE;
 }
 
 /* CLIENT WRITE HEADER ****************************************************/
@@ -1142,23 +1649,15 @@ httpd_client_write_header (GIOChannel * source, GIOCondition cond,
 	  g_source_set_callback (client->channel_source,
 				 (GSourceFunc) httpd_client_write_body,
 				 client, NULL);
-	  g_source_attach (client->channel_source, g_main_context_default ());
+	  g_source_attach (client->channel_source, client->thread->context);
 	  return FALSE;
 	}
 
-      break;
-
-      /* Setting a delay: */
-    case G_IO_STATUS_AGAIN:
-      g_source_destroy (client->channel_source);
-      g_source_unref (client->channel_source);
+      break;
 
-      client->channel_source = g_timeout_source_new (200);
-      g_source_set_callback (client->channel_source,
-			     (GSourceFunc) httpd_client_write_header_timeout,
-			     client, NULL);
-      g_source_attach (client->channel_source, g_main_context_default ());
-      return FALSE;
+      /* The socket is not ready, the watch fires again once it is: */
+    case G_IO_STATUS_AGAIN:
+      return TRUE;
 
       /* Close the socket: */
     case G_IO_STATUS_ERROR:
@@ -1173,25 +1672,88 @@ httpd_client_write_header (GIOChannel * source, GIOCondition cond,
   return TRUE;
 }
 
+/* CLIENT WRITE RESPONSE ***************************************************/
+
+/* NOTE - string responses are written with writev() of header and body straight to
+          the non-blocking socket, till it is all sent or the socket buffer is full; only
+          then the G_IO_OUT watch is armed, and it carries on from there */
+
 static gboolean
-httpd_client_write_header_timeout (DSHttpdClient * client)
+httpd_client_write_response (GIOChannel * source, GIOCondition cond,
+			     DSHttpdClient * client)
 {
-  g_source_destroy (client->channel_source);
-  g_source_unref (client->channel_source);
+  struct iovec iov[2];
+  gint iovcnt;
+  gssize done;
+  gsize header_left;
 
-  client->channel_source = g_io_create_watch (client->channel, G_IO_OUT);
-  g_source_set_callback (client->channel_source,
-			 (GSourceFunc) httpd_client_write_header, client,
-			 NULL);
-  g_source_attach (client->channel_source, g_main_context_default ());
-  return FALSE;
+httpd_client_write_response_again:
+
+  iovcnt = 0;
+  header_left = client->output_header_size - client->output_header_done;
+
+  if (header_left > 0)
+    {
+      iov[iovcnt].iov_base = client->output_header + client->output_header_done;
+      iov[iovcnt].iov_len = header_left;
+      iovcnt++;
+    }
+
+  if (client->request != DS_HTTPD_REQUEST_HEAD
+      && client->output.string.done < client->output_size)
+    {
+      iov[iovcnt].iov_base = client->output.string.string + client->output.string.done;
+      iov[iovcnt].iov_len = client->output_size - client->output.string.done;
+      iovcnt++;
+    }
+
+  if (iovcnt == 0)
+    {
+      httpd_client_close (client);
+      return FALSE;
+    }
+
+  done = writev (g_io_channel_unix_get_fd (source), iov, iovcnt);
+
+  if (done < 0)
+    {
+      if (errno == EINTR)
+	goto httpd_client_write_response_again;
+
+      /* Socket buffer full, wait for the next G_IO_OUT: */
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+	{
+	  /* Removing the timeout: */
+	  httpd_client_timeout_refresh (client);
+	  return TRUE;
+	}
+
+      httpd_client_close (client);
+      return FALSE;
+    }
+
+  if ((gsize) done >= header_left)
+    {
+      client->output_header_done = client->output_header_size;
+      client->output.string.done += done - header_left;
+    }
+  else
+    client->output_header_done += done;
+
+  if (client->output_header_done >= client->output_header_size
+      && (client->request == DS_HTTPD_REQUEST_HEAD
+	  || client->output.string.done >= client->output_size))
+    {
+      httpd_client_close (client);
+      return FALSE;
+    }
+
+  /* A short write, the socket may take the rest right away: */
+  goto httpd_client_write_response_again;
 }
 
 /* CLIENT WRITE BODY *******************************************************/
 
-static gboolean httpd_client_write_body_string (GIOChannel * source,
-						GIOCondition cond,
-						DSHttpdClient * client);
 static gboolean httpd_client_write_body_io (GIOChannel * source,
 					    GIOCondition cond,
 					    DSHttpdClient * client);
@@ -1216,7 +1778,7 @@ httpd_client_write_body (GIOChannel * source, GIOCondition cond,
       break;
 
     case DS_HTTPD_OUTPUT_STRING:
-      return httpd_client_write_body_string (source, cond, client);
+      return httpd_client_write_response (source, cond, client);
 
     case DS_HTTPD_OUTPUT_IO:
       return httpd_client_write_body_io (source, cond, client);
@@ -1234,70 +1796,6 @@ httpd_client_write_body (GIOChannel * source, GIOCondition cond,
   return TRUE;
 }
 
-static gboolean
-httpd_client_write_body_string (GIOChannel * source, GIOCondition cond,
-				DSHttpdClient * client)
-{
-  gsize done;
-  GIOStatus status;
-
-  if (client->request == DS_HTTPD_REQUEST_HEAD)
-    {
-      status = g_io_channel_flush (client->channel, NULL);
-
-      httpd_client_close (client);
-      return FALSE;
-    }
-
-  if ((status =
-       g_io_channel_write_chars (source,
-				 client->output.string.string +
-				 client->output.string.done,
-				 client->output_size -
-				 client->output.string.done, &done,
-				 NULL)) == G_IO_STATUS_NORMAL)
-    status = g_io_channel_flush (client->channel, NULL);
-
-  /* The status of the read: */
-  switch (status)
-    {
-    case G_IO_STATUS_NORMAL:
-      client->output.string.done += done;
-
-      if (client->output.string.done >= client->output_size)
-	{
-	  httpd_client_close (client);
-	  return FALSE;
-	}
-
-      break;
-
-      /* Setting a delay: */
-    case G_IO_STATUS_AGAIN:
-      g_source_destroy (client->channel_source);
-      g_source_unref (client->channel_source);
-
-      client->channel_source = g_timeout_source_new (200);
-
-      g_source_set_callback (client->channel_source,
-			     (GSourceFunc) httpd_client_write_body_timeout,
-			     client, NULL);
-      g_source_attach (client->channel_source, g_main_context_default ());
-      return FALSE;
-
-      /* Close the socket: */
-    case G_IO_STATUS_ERROR:
-    case G_IO_STATUS_EOF:
-      httpd_client_close (client);
-      return FALSE;
-    }
-
-  /* Removing the timeout: */
-  httpd_client_timeout_refresh (client);
-
-  return TRUE;
-}
-
 static gboolean httpd_client_write_body_io_read (DSHttpdClient * client);
 
 static gboolean
@@ -1316,14 +1814,11 @@ httpd_client_write_body_io (GIOChannel * source, GIOCondition cond,
 	}
     }
 
-  if ((status =
-       g_io_channel_write_chars (source,
-				 client->output.io.string +
-				 client->output.io.done,
-				 client->output.io.size -
-				 client->output.io.done, &done,
-				 NULL)) == G_IO_STATUS_NORMAL)
-    status = g_io_channel_flush (client->channel, NULL);
+  status = httpd_client_write_chars (client, source,
+				     client->output.io.string +
+				     client->output.io.done,
+				     client->output.io.size -
+				     client->output.io.done, &done);
 
   /* The status of the read: */
   switch (status)
@@ -1336,17 +1831,9 @@ httpd_client_write_body_io (GIOChannel * source, GIOCondition cond,
 
       break;
 
-      /* Setting a delay: */
+      /* The socket is not ready, the watch fires again once it is: */
     case G_IO_STATUS_AGAIN:
-      g_source_destroy (client->channel_source);
-      g_source_unref (client->channel_source);
-
-      client->channel_source = g_timeout_source_new (200);
-      g_source_set_callback (client->channel_source,
-			     (GSourceFunc) httpd_client_write_body_timeout,
-			     client, NULL);
-      g_source_attach (client->channel_source, g_main_context_default ());
-      return FALSE;
+      return TRUE;
 
       /* Close the socket: */
     case G_IO_STATUS_ERROR:
@@ -1389,8 +1876,11 @@ httpd_client_write_body_io_read (DSHttpdClient * client)
       g_source_attach (client->channel_source, client->thread->context);
       return TRUE;
 
-    case G_IO_STATUS_ERROR:
     case G_IO_STATUS_EOF:
+      client->output_complete = TRUE;
+      return FALSE;
+
+    case G_IO_STATUS_ERROR:
       return FALSE;
     }
   return FALSE;
@@ -1426,17 +1916,9 @@ httpd_client_write_body_map (GIOChannel * source, GIOCondition cond,
 
       break;
 
-      /* Setting a delay: */
+      /* The socket is not ready, the watch fires again once it is: */
     case G_IO_STATUS_AGAIN:
-      g_source_destroy (client->channel_source);
-      g_source_unref (client->channel_source);
-
-      client->channel_source = g_timeout_source_new (200);
-      g_source_set_callback (client->channel_source,
-			     (GSourceFunc) httpd_client_write_body_timeout,
-			     client, NULL);
-      g_source_attach (client->channel_source, g_main_context_default ());
-      return FALSE;
+      return TRUE;
 
       /* Close the socket: */
     case G_IO_STATUS_ERROR:
@@ -1452,6 +1934,15 @@ httpd_client_write_body_map (GIOChannel * source, GIOCondition cond,
 }
 
 static gboolean httpd_client_write_body_blob_read (DSHttpdClient * client);
+static gboolean httpd_client_write_body_blob_next_range (DSHttpdClient * client);
+static gboolean httpd_client_write_body_blob_part (GIOChannel * source,
+						   GIOCondition cond,
+						   DSHttpdClient * client);
+#ifndef G_OS_WIN32
+static gboolean httpd_client_write_body_blob_sendfile (GIOChannel * source,
+						       GIOCondition cond,
+						       DSHttpdClient * client);
+#endif
 
 static gboolean
 httpd_client_write_body_blob (GIOChannel * source, GIOCondition cond,
@@ -1460,6 +1951,32 @@ httpd_client_write_body_blob (GIOChannel * source, GIOCondition cond,
   gsize done;
   GIOStatus status;
 
+  /* Multipart separators go out before each range and after the last one: */
+  if (client->output.blob.part != NULL)
+    return httpd_client_write_body_blob_part (source, cond, client);
+
+  if (client->output.blob.size == 0
+      && client->output.blob.offset >= client->output.blob.offset_end)
+    {
+      if (httpd_client_write_body_blob_next_range (client) == FALSE)
+	{
+	  /* Every range has been sent: */
+	  client->output_complete = TRUE;
+
+	  httpd_client_close (client);
+	  return FALSE;
+	}
+
+      return TRUE;
+    }
+
+#ifndef G_OS_WIN32
+  /* NOTE - sendfile() cannot deflate, an encoded body is read and written */
+  if (client->output_zstream == NULL
+      && dupin_attachment_record_is_external (client->output.blob.record) == TRUE)
+    return httpd_client_write_body_blob_sendfile (source, cond, client);
+#endif
+
   if (client->output.blob.size == 0)
     {
       if (httpd_client_write_body_blob_read (client) == FALSE)
@@ -1469,14 +1986,11 @@ httpd_client_write_body_blob (GIOChannel * source, GIOCondition cond,
 	}
     }
 
-  if ((status =
-       g_io_channel_write_chars (source,
-				 client->output.blob.string +
-				 client->output.blob.done,
-				 client->output.blob.size -
-				 client->output.blob.done, &done,
-				 NULL)) == G_IO_STATUS_NORMAL)
-    status = g_io_channel_flush (client->channel, NULL);
+  status = httpd_client_write_chars (client, source,
+				     client->output.blob.string +
+				     client->output.blob.done,
+				     client->output.blob.size -
+				     client->output.blob.done, &done);
 
   /* The status of the read: */
   switch (status)
@@ -1489,17 +2003,9 @@ httpd_client_write_body_blob (GIOChannel * source, GIOCondition cond,
 
       break;
 
-      /* Setting a delay: */
+      /* The socket is not ready, the watch fires again once it is: */
     case G_IO_STATUS_AGAIN:
-      g_source_destroy (client->channel_source);
-      g_source_unref (client->channel_source);
-
-      client->channel_source = g_timeout_source_new (200);
-      g_source_set_callback (client->channel_source,
-			     (GSourceFunc) httpd_client_write_body_timeout,
-			     client, NULL);
-      g_source_attach (client->channel_source, g_main_context_default ());
-      return FALSE;
+      return TRUE;
 
       /* Close the socket: */
     case G_IO_STATUS_ERROR:
@@ -1520,7 +2026,8 @@ httpd_client_write_body_blob_read (DSHttpdClient * client)
   gboolean status = dupin_attachment_record_blob_read
 				(client->output.blob.record,
 				 client->output.blob.string,
-				 sizeof (client->output.blob.string),
+				 MIN (sizeof (client->output.blob.string),
+				      client->output.blob.offset_end - client->output.blob.offset),
 				 client->output.blob.offset,
 				 &client->output.blob.size, NULL);
 
@@ -1534,51 +2041,232 @@ httpd_client_write_body_blob_read (DSHttpdClient * client)
   return status;
 }
 
+/* NOTE - move to the next range of a multipart/byteranges response, or to its
+          closing boundary once the last range has been sent */
+
+static gboolean
+httpd_client_write_body_blob_next_range (DSHttpdClient * client)
+{
+  DSHttpdRange * range;
+
+  if (client->output.blob.ranges_numb < 2
+      || client->output.blob.ranges_current >= client->output.blob.ranges_numb)
+    return FALSE;
+
+  client->output.blob.ranges_current++;
+  client->output.blob.part_done = 0;
+
+  if (client->output.blob.ranges_current == client->output.blob.ranges_numb)
+    {
+      client->output.blob.part = client->output.blob.trailer;
+      client->output.blob.part_size = client->output.blob.trailer_size;
+      return TRUE;
+    }
+
+  range = &client->output.blob.ranges[client->output.blob.ranges_current];
+
+  client->output.blob.offset = range->start;
+  client->output.blob.offset_end = range->end + 1;
+  client->output.blob.part = range->part;
+  client->output.blob.part_size = range->part_size;
+
+  return TRUE;
+}
+
+static gboolean
+httpd_client_write_body_blob_part (GIOChannel * source, GIOCondition cond,
+				   DSHttpdClient * client)
+{
+  gsize done;
+  GIOStatus status;
+
+  if ((status =
+       g_io_channel_write_chars (source,
+				 client->output.blob.part +
+				 client->output.blob.part_done,
+				 client->output.blob.part_size -
+				 client->output.blob.part_done, &done,
+				 NULL)) == G_IO_STATUS_NORMAL)
+    status = g_io_channel_flush (client->channel, NULL);
+
+  /* The status of the read: */
+  switch (status)
+    {
+    case G_IO_STATUS_NORMAL:
+      client->output.blob.part_done += done;
+
+      if (client->output.blob.part_done >= client->output.blob.part_size)
+        {
+          client->output.blob.part = NULL;
+          client->output.blob.part_size = client->output.blob.part_done = 0;
+        }
+
+      break;
+
+      /* The socket is not ready, the watch fires again once it is: */
+    case G_IO_STATUS_AGAIN:
+      return TRUE;
+
+      /* Close the socket: */
+    case G_IO_STATUS_ERROR:
+    case G_IO_STATUS_EOF:
+      httpd_client_close (client);
+      return FALSE;
+    }
+
+  /* Removing the timeout: */
+  httpd_client_timeout_refresh (client);
+
+  return TRUE;
+}
+
+#ifndef G_OS_WIN32
+/* NOTE - the channel is unbuffered, so we can hand the socket to sendfile() directly
+          - no copy through user space; the socket is non-blocking, each call sends what
+          fits in its buffer and a full one just waits for the next G_IO_OUT */
+
+static gboolean
+httpd_client_write_body_blob_sendfile (GIOChannel * source, GIOCondition cond,
+				       DSHttpdClient * client)
+{
+  gsize done = 0;
+
+  if (dupin_attachment_record_blob_sendfile (client->output.blob.record,
+					     g_io_channel_unix_get_fd (source),
+					     MIN (HTTP_SENDFILE_SIZE, client->output.blob.offset_end - client->output.blob.offset),
+					     client->output.blob.offset,
+					     &done, NULL) == FALSE)
+    {
+      httpd_client_close (client);
+      return FALSE;
+    }
+
+  /* The socket buffer is full, the G_IO_OUT watch fires again once it drains: */
+  if (done == 0)
+    return TRUE;
+
+  client->output.blob.offset += done;
+
+  /* Removing the timeout: */
+  httpd_client_timeout_refresh (client);
+
+  return TRUE;
+}
+#endif
+
 /* NOTE - simple implementation of RFC 2616 Chunked Transfer Coding
           see http://tools.ietf.org/html/rfc2616#section-3.6.1 */
 
 static gboolean httpd_client_write_body_changes_comet_read (DSHttpdClient * client);
 
+/* Writes what the socket takes of the framed chunk, which is dropped once all sent: */
+static GIOStatus
+httpd_client_write_body_changes_comet_chunk (DSHttpdClient * client,
+					     GIOChannel * source)
+{
+  GString *chunk = client->output.changes_comet.chunk;
+  gsize done = 0;
+  GIOStatus status;
+
+  status = g_io_channel_write_chars (source,
+				     chunk->str + client->output.changes_comet.chunk_done,
+				     chunk->len - client->output.changes_comet.chunk_done,
+				     &done, NULL);
+
+  client->output.changes_comet.chunk_done += done;
+
+  if (client->output.changes_comet.chunk_done >= chunk->len)
+    {
+      g_string_free (chunk, TRUE);
+      client->output.changes_comet.chunk = NULL;
+      client->output.changes_comet.chunk_done = 0;
+    }
+
+  return status;
+}
+
+/* The feed is over, its last chunk is still to be sent before closing: */
+static gboolean
+httpd_client_write_body_changes_comet_end (GIOChannel * source,
+					   DSHttpdClient * client)
+{
+  GIOStatus status = G_IO_STATUS_NORMAL;
+
+  if (client->output.changes_comet.chunk != NULL)
+    status = httpd_client_write_body_changes_comet_chunk (client, source);
+
+  if ((status == G_IO_STATUS_NORMAL || status == G_IO_STATUS_AGAIN)
+      && client->output.changes_comet.chunk != NULL)
+    {
+      /* Removing the timeout: */
+      httpd_client_timeout_refresh (client);
+      return TRUE;
+    }
+
+  httpd_client_close (client);
+  return FALSE;
+}
+
 static gboolean
 httpd_client_write_body_changes_comet (GIOChannel * source, GIOCondition cond,
 			    	       DSHttpdClient * client)
 {
-  gsize done;
+  gsize done = 0;
   GIOStatus status;
 
+  if (client->output_complete == TRUE)
+    return httpd_client_write_body_changes_comet_end (source, client);
+
   if (client->output.changes_comet.size == 0)
     {
       if (httpd_client_write_body_changes_comet_read (client) == FALSE)
         {
-          if ((status = g_io_channel_write_chars (source, "0\r\n\r\n", -1, NULL, NULL)) == G_IO_STATUS_NORMAL)
-            status = g_io_channel_flush (client->channel, NULL);
+          client->output_complete = TRUE;
 
-//g_message("httpd_client_write_body_changes_comet: written footer chunk\n");
+          /* A deflated feed gets its last chunk from httpd_client_write_finish(): */
+          if (client->output_zstream == NULL)
+            {
+              client->output.changes_comet.chunk = g_string_new ("0\r\n\r\n");
+              return httpd_client_write_body_changes_comet_end (source, client);
+            }
 
           httpd_client_close (client);
           return FALSE;
         }
     }
 
-  GString * hex_chunk_size_str = g_string_new (NULL);
-  g_string_append_printf (hex_chunk_size_str, "%X\r\n", (guint)(client->output.changes_comet.size - client->output.changes_comet.done) );
-  gchar * hex_chunk_size = g_string_free (hex_chunk_size_str, FALSE); 
+  /* The deflated chunks are framed by httpd_client_write_chars(): */
+  if (client->output_zstream != NULL)
+    status = httpd_client_write_chars (client, source,
+				       client->output.changes_comet.string +
+				       client->output.changes_comet.done,
+				       client->output.changes_comet.size -
+				       client->output.changes_comet.done, &done);
 
-//g_message("httpd_client_write_body_changes_comet: written chunk length=%s (=hex=%X)\n", hex_chunk_size, (guint)(client->output.changes_comet.size - client->output.changes_comet.done) );
+  /* NOTE - size line, data and end of a chunk are framed together, so that a
+            short write cannot leave a chunk announcing more than what follows */
+  else
+    {
+      gsize left = client->output.changes_comet.size - client->output.changes_comet.done;
 
-  if (((status = g_io_channel_write_chars (source,
-  			hex_chunk_size, -1, NULL, NULL)) == G_IO_STATUS_NORMAL)
-      && ((status = g_io_channel_write_chars (source,
-                                 client->output.changes_comet.string +
-                                 client->output.changes_comet.done,
-                                 client->output.changes_comet.size -
-                                 client->output.changes_comet.done, &done,
-                                 NULL)) == G_IO_STATUS_NORMAL)
-      && ((status = g_io_channel_write_chars (source,
-				 "\r\n", -1, NULL, NULL)) == G_IO_STATUS_NORMAL))
-    status = g_io_channel_flush (client->channel, NULL);
+      if (client->output.changes_comet.chunk == NULL)
+        {
+          client->output.changes_comet.chunk = g_string_sized_new (left + 16);
+          g_string_append_printf (client->output.changes_comet.chunk, "%X\r\n", (guint) left);
+          g_string_append_len (client->output.changes_comet.chunk,
+			       client->output.changes_comet.string +
+			       client->output.changes_comet.done, left);
+          g_string_append_len (client->output.changes_comet.chunk, "\r\n", 2);
+        }
+
+//g_message("httpd_client_write_body_changes_comet: written chunk length=%X\n", (guint) left);
 
-  g_free (hex_chunk_size);
+      status = httpd_client_write_body_changes_comet_chunk (client, source);
+
+      /* The data is sent once its whole chunk is: */
+      if (client->output.changes_comet.chunk == NULL)
+        done = left;
+    }
 
   gsize bytes_read = client->output.changes_comet.size;
   gunichar ch = g_utf8_get_char (client->output.changes_comet.string);
@@ -1610,23 +2298,15 @@ httpd_client_write_body_changes_comet (GIOChannel * source, GIOCondition cond,
                g_source_set_callback (client->channel_source,
                              (GSourceFunc) httpd_client_write_body_timeout,
                              client, NULL);
-               g_source_attach (client->channel_source, g_main_context_default ());
+               g_source_attach (client->channel_source, client->thread->context);
              }
         }
 
       break;
 
-      /* Setting a delay: */
+      /* The socket is not ready, the watch fires again once it is: */
     case G_IO_STATUS_AGAIN:
-      g_source_destroy (client->channel_source);
-      g_source_unref (client->channel_source);
-
-      client->channel_source = g_timeout_source_new (200);
-      g_source_set_callback (client->channel_source,
-                             (GSourceFunc) httpd_client_write_body_timeout,
-                             client, NULL);
-      g_source_attach (client->channel_source, g_main_context_default ());
-      return FALSE;
+      return TRUE;
 
       /* Close the socket: */
     case G_IO_STATUS_ERROR:
@@ -1710,7 +2390,7 @@ Reason: KERN_INVALID_ADDRESS at address: 0x0000000000000000
   client->channel_source = g_io_create_watch (client->channel, G_IO_ERR | G_IO_HUP | G_IO_OUT );
   g_source_set_callback (client->channel_source,
 			 (GSourceFunc) httpd_client_write_body, client, NULL);
-  g_source_attach (client->channel_source, g_main_context_default ());
+  g_source_attach (client->channel_source, client->thread->context);
   return FALSE;
 }
 
@@ -1720,6 +2400,7 @@ static void
 httpd_client_send (DSHttpdClient * client, DSHttpStatusCode code)
 {
   GString *str;
+  gboolean vary;
   guint i;
 
   for (i = 0; DSHttpStatusList[i].code != HTTP_STATUS_END; i++)
@@ -1764,6 +2445,11 @@ httpd_client_send (DSHttpdClient * client, DSHttpStatusCode code)
         }
     }
 
+  /* Content-Encoding: */
+  vary = httpd_client_compress (client, code,
+				client->output_mime ? client->output_mime :
+				DSHttpStatusList[i].mime);
+
   /* Header: */
   str = g_string_new (NULL);
   str = g_string_append (str, DSHttpStatusList[i].header);
@@ -1806,8 +2492,32 @@ httpd_client_send (DSHttpdClient * client, DSHttpStatusCode code)
       g_free (last_modified_date);
     }
 
-  /* Body length: */
-  if (client->output_type != DS_HTTPD_OUTPUT_CHANGES_COMET)
+  /* Byte ranges */
+  if (client->output_type == DS_HTTPD_OUTPUT_BLOB)
+    {
+      g_string_append_printf (str, "%s: bytes\r\n", HTTP_ACCEPT_RANGES);
+    }
+
+  if (client->output_content_range != NULL)
+    {
+      g_string_append_printf (str, "%s: %s\r\n", HTTP_CONTENT_RANGE, client->output_content_range);
+    }
+
+  if (client->output_encoding != DS_HTTPD_ENCODING_IDENTITY)
+    {
+      g_string_append_printf (str, "%s: %s\r\n", HTTP_CONTENT_ENCODING,
+			      client->output_encoding == DS_HTTPD_ENCODING_GZIP ?
+			      "gzip" : "deflate");
+    }
+
+  if (vary == TRUE)
+    {
+      g_string_append_printf (str, "%s: %s\r\n", HTTP_VARY, HTTP_ACCEPT_ENCODING);
+    }
+
+  /* Body length - a deflated stream ends when the connection is closed: */
+  if (client->output_type != DS_HTTPD_OUTPUT_CHANGES_COMET
+      && client->output_zstream == NULL)
     {
       g_string_append_printf (str, "%s: %" G_GSIZE_FORMAT "\r\n", HTTP_CONTENT_LENGTH,
 			  client->output_size);
@@ -1831,29 +2541,431 @@ httpd_client_send (DSHttpdClient * client, DSHttpStatusCode code)
   /* Creating the writing function: */
   g_source_destroy (client->channel_source);
   g_source_unref (client->channel_source);
+  client->channel_source = NULL;
+
+  if (client->output_type == DS_HTTPD_OUTPUT_STRING)
+    {
+      /* Small responses usually leave with the first write: */
+      if (httpd_client_write_response (client->channel, G_IO_OUT, client) == FALSE)
+	return;
+
+      client->channel_source = g_io_create_watch (client->channel, G_IO_OUT);
+      g_source_set_callback (client->channel_source,
+			     (GSourceFunc) httpd_client_write_response, client,
+			     NULL);
+      g_source_attach (client->channel_source, client->thread->context);
+      return;
+    }
 
   client->channel_source = g_io_create_watch (client->channel, G_IO_OUT);
   g_source_set_callback (client->channel_source,
 			 (GSourceFunc) httpd_client_write_header, client,
 			 NULL);
-  g_source_attach (client->channel_source, g_main_context_default ());
+  g_source_attach (client->channel_source, client->thread->context);
+}
+
+/* CLIENT COMPRESSION ******************************************************/
+
+/* NOTE - gzip and deflate Content-Encoding, see http://tools.ietf.org/html/rfc2616#section-3.5 */
+
+gchar *
+httpd_compress (const gchar * buf, gsize size, DSHttpdEncoding encoding,
+		gint level, gsize * compressed_size)
+{
+#ifdef HAVE_ZLIB
+  z_stream z;
+  gchar *out;
+  gsize bound;
+
+  memset (&z, 0, sizeof (z_stream));
+
+  if (deflateInit2 (&z, level, Z_DEFLATED,
+		    encoding == DS_HTTPD_ENCODING_GZIP ? 15 + 16 : 15, 8,
+		    Z_DEFAULT_STRATEGY) != Z_OK)
+    return NULL;
+
+  bound = deflateBound (&z, size) + 32;
+  out = g_malloc (bound);
+
+  z.next_in = (Bytef *) buf;
+  z.avail_in = size;
+  z.next_out = (Bytef *) out;
+  z.avail_out = bound;
+
+  if (deflate (&z, Z_FINISH) != Z_STREAM_END)
+    {
+      deflateEnd (&z);
+      g_free (out);
+      return NULL;
+    }
+
+  *compressed_size = z.total_out;
+  deflateEnd (&z);
+  return out;
+#else
+  return NULL;
+#endif
+}
+
+static DSHttpdEncoding
+httpd_client_accept_encoding (DSHttpdClient * client)
+{
+  DSHttpdEncoding ret = DS_HTTPD_ENCODING_IDENTITY;
+  gchar **codings;
+  guint i;
+
+  if (client->input_accept_encoding == NULL)
+    return DS_HTTPD_ENCODING_IDENTITY;
+
+  codings = g_strsplit (client->input_accept_encoding, ",", -1);
+
+  for (i = 0; codings[i]; i++)
+    {
+      gchar *coding = g_strstrip (codings[i]);
+      gchar *q;
+
+      /* Skip the codings refused with q=0: */
+      if ((q = strchr (coding, ';')))
+	{
+	  *q++ = 0;
+	  q = g_strstrip (q);
+	  g_strchomp (coding);
+
+	  if (g_str_has_prefix (q, "q=") && g_ascii_strtod (q + 2, NULL) == 0)
+	    continue;
+	}
+
+      if (!g_ascii_strcasecmp (coding, "gzip")
+	  || !g_ascii_strcasecmp (coding, "x-gzip"))
+	{
+	  ret = DS_HTTPD_ENCODING_GZIP;
+	  break;
+	}
+
+      if (!g_ascii_strcasecmp (coding, "deflate"))
+	ret = DS_HTTPD_ENCODING_DEFLATE;
+    }
+
+  g_strfreev (codings);
+  return ret;
+}
+
+static gboolean
+httpd_client_compressible (const gchar * mime)
+{
+  if (mime == NULL)
+    return FALSE;
+
+  if (g_str_has_prefix (mime, "text/")
+      || strstr (mime, "json")
+      || strstr (mime, "javascript")
+      || strstr (mime, "xml"))
+    return TRUE;
+
+  return FALSE;
+}
+
+/* Picks the encoding of the response and compresses what is already in memory;
+   returns TRUE when the response depends on Accept-Encoding: */
+static gboolean
+httpd_client_compress (DSHttpdClient * client, DSHttpStatusCode code,
+		       const gchar * mime)
+{
+#ifdef HAVE_ZLIB
+  DSGlobal *data = client->thread->data;
+  DSHttpdEncoding encoding;
+
+  if (data->limit_http_compress_minsize == 0
+      || httpd_client_compressible (mime) == FALSE)
+    return FALSE;
+
+  /* Byte ranges refer to the identity body: */
+  if (code == HTTP_STATUS_206
+      || code == HTTP_STATUS_304
+      || client->output_content_range != NULL)
+    return FALSE;
+
+  if (client->output_type != DS_HTTPD_OUTPUT_CHANGES_COMET
+      && client->output_size < data->limit_http_compress_minsize)
+    return TRUE;
+
+  if ((encoding = httpd_client_accept_encoding (client)) == DS_HTTPD_ENCODING_IDENTITY)
+    return TRUE;
+
+  switch (client->output_type)
+    {
+    case DS_HTTPD_OUTPUT_NONE:
+      return FALSE;
+
+    case DS_HTTPD_OUTPUT_STRING:
+      {
+	gsize size;
+	gchar *compressed = httpd_compress (client->output.string.string,
+					    client->output_size, encoding,
+					    data->limit_http_compress_level,
+					    &size);
+
+	if (compressed == NULL)
+	  return TRUE;
+
+	if (size >= client->output_size)
+	  {
+	    g_free (compressed);
+	    return TRUE;
+	  }
+
+	g_free (client->output.string.string);
+	client->output.string.string = compressed;
+	client->output_size = size;
+      }
+      break;
+
+    case DS_HTTPD_OUTPUT_MAP:
+      /* Static files keep a gzip copy only: */
+      if (encoding != DS_HTTPD_ENCODING_GZIP
+	  || map_gzip (data, client->output.map.map) == FALSE)
+	return TRUE;
+
+      client->output.map.contents = client->output.map.map->gzip;
+      client->output_size = client->output.map.map->gzip_size;
+      break;
+
+    case DS_HTTPD_OUTPUT_IO:
+    case DS_HTTPD_OUTPUT_BLOB:
+    case DS_HTTPD_OUTPUT_CHANGES_COMET:
+      {
+	z_stream *z;
+
+	/* A HEAD response has no body to deflate and no length to tell: */
+	if (client->request == DS_HTTPD_REQUEST_HEAD)
+	  return TRUE;
+
+	z = g_malloc0 (sizeof (z_stream));
+
+	if (deflateInit2 (z, data->limit_http_compress_level, Z_DEFLATED,
+			  encoding == DS_HTTPD_ENCODING_GZIP ? 15 + 16 : 15, 8,
+			  Z_DEFAULT_STRATEGY) != Z_OK)
+	  {
+	    g_free (z);
+	    return TRUE;
+	  }
+
+	client->output_zstream = z;
+	client->output_zbuffer = g_byte_array_new ();
+      }
+      break;
+    }
+
+  client->output_encoding = encoding;
+  return TRUE;
+#else
+  return FALSE;
+#endif
+}
+
+#ifdef HAVE_ZLIB
+static gboolean
+httpd_client_deflate (DSHttpdClient * client, const gchar * buf, gsize count,
+		      gint flush)
+{
+  z_stream *z = client->output_zstream;
+  GByteArray *out = client->output_zbuffer;
+  guchar chunk[4096];
+  guint start;
+
+  /* Dropping what is already written: */
+  if (client->output_zbuffer_done > 0)
+    {
+      g_byte_array_remove_range (out, 0, client->output_zbuffer_done);
+      client->output_zbuffer_done = 0;
+    }
+
+  start = out->len;
+
+  z->next_in = (Bytef *) buf;
+  z->avail_in = count;
+
+  do
+    {
+      z->next_out = chunk;
+      z->avail_out = sizeof (chunk);
+
+      if (deflate (z, flush) == Z_STREAM_ERROR)
+	return FALSE;
+
+      g_byte_array_append (out, chunk, sizeof (chunk) - z->avail_out);
+    }
+  while (z->avail_out == 0);
+
+  /* The changes feed is chunked, so is its deflated form: */
+  if (client->output_type == DS_HTTPD_OUTPUT_CHANGES_COMET)
+    {
+      gsize len = out->len - start;
+
+      if (len > 0)
+	{
+	  gchar size_line[20];
+	  gint n = g_snprintf (size_line, sizeof (size_line), "%X\r\n", (guint) len);
+
+	  g_byte_array_set_size (out, out->len + n);
+	  memmove (out->data + start + n, out->data + start, len);
+	  memcpy (out->data + start, size_line, n);
+	  g_byte_array_append (out, (guchar *) "\r\n", 2);
+	}
+
+      if (flush == Z_FINISH)
+	g_byte_array_append (out, (guchar *) "0\r\n\r\n", 5);
+    }
+
+  return TRUE;
+}
+
+static GIOStatus
+httpd_client_write_compressed (DSHttpdClient * client, GIOChannel * source)
+{
+  GByteArray *out = client->output_zbuffer;
+  GIOStatus status;
+  gsize done = 0;
+
+  if (client->output_zbuffer_done < out->len)
+    {
+      status = g_io_channel_write_chars (source,
+					 (gchar *) out->data + client->output_zbuffer_done,
+					 out->len - client->output_zbuffer_done,
+					 &done, NULL);
+
+      client->output_zbuffer_done += done;
+
+      if (status != G_IO_STATUS_NORMAL)
+	return status;
+    }
+
+  return g_io_channel_flush (source, NULL);
+}
+
+static gboolean
+httpd_client_write_trailer (GIOChannel * source, GIOCondition cond,
+			    DSHttpdClient * client)
+{
+  GIOStatus status = httpd_client_write_compressed (client, source);
+
+  if (status == G_IO_STATUS_AGAIN)
+    return TRUE;
+
+  if (status != G_IO_STATUS_NORMAL
+      || client->output_zbuffer_done >= client->output_zbuffer->len)
+    {
+      httpd_client_close (client);
+      return FALSE;
+    }
+
+  /* Removing the timeout: */
+  httpd_client_timeout_refresh (client);
+
+  return TRUE;
+}
+#endif
+
+/* Writes a piece of the body, deflated when the response is encoded; a
+   deflated piece is consumed at once and written over the next calls: */
+static GIOStatus
+httpd_client_write_chars (DSHttpdClient * client, GIOChannel * source,
+			  const gchar * buf, gsize count, gsize * done)
+{
+  GIOStatus status;
+
+#ifdef HAVE_ZLIB
+  if (client->output_zstream != NULL)
+    {
+      *done = 0;
+
+      /* What was deflated before goes first: */
+      status = httpd_client_write_compressed (client, source);
+
+      if (status == G_IO_STATUS_AGAIN)
+	return G_IO_STATUS_NORMAL;
+
+      if (status != G_IO_STATUS_NORMAL
+	  || client->output_zbuffer_done < client->output_zbuffer->len)
+	return status;
+
+      /* Changes must reach the client as they happen: */
+      if (httpd_client_deflate (client, buf, count,
+				client->output_type == DS_HTTPD_OUTPUT_CHANGES_COMET ?
+				Z_SYNC_FLUSH : Z_NO_FLUSH) == FALSE)
+	return G_IO_STATUS_ERROR;
+
+      *done = count;
+
+      status = httpd_client_write_compressed (client, source);
+      return status == G_IO_STATUS_AGAIN ? G_IO_STATUS_NORMAL : status;
+    }
+#endif
+
+  if ((status =
+       g_io_channel_write_chars (source, buf, count, done,
+				 NULL)) == G_IO_STATUS_NORMAL)
+    status = g_io_channel_flush (source, NULL);
+
+  return status;
+}
+
+/* Before closing, the end of a deflated body is still to be sent; a body
+   cut short by an error, a hang up or a timeout is closed as it is: */
+static gboolean
+httpd_client_write_finish (DSHttpdClient * client)
+{
+#ifdef HAVE_ZLIB
+  if (client->output_zstream == NULL
+      || client->output_complete == FALSE
+      || client->output_zfinished == TRUE)
+    return FALSE;
+
+  client->output_zfinished = TRUE;
+
+  if (httpd_client_deflate (client, NULL, 0, Z_FINISH) == FALSE)
+    return FALSE;
+
+  if (client->channel_source)
+    {
+      g_source_destroy (client->channel_source);
+      g_source_unref (client->channel_source);
+    }
+
+  client->channel_source = g_io_create_watch (client->channel, G_IO_OUT);
+  g_source_set_callback (client->channel_source,
+			 (GSourceFunc) httpd_client_write_trailer, client,
+			 NULL);
+  g_source_attach (client->channel_source, client->thread->context);
+
+  httpd_client_timeout_refresh (client);
+  return TRUE;
+#else
+  return FALSE;
+#endif
 }
 
 /* CLIENT CLOSE *************************************************************/
 static void
 httpd_client_close (DSHttpdClient * client)
 {
-  g_mutex_lock (client->thread->data->httpd_mutex);
+  if (httpd_client_write_finish (client) == TRUE)
+    return;
+
+  if (client->timing)
+    httpd_client_timing_done (client);
+
   g_mutex_lock (client->thread->mutex);
 
   client->thread->clients = g_list_remove (client->thread->clients, client);
-  client->thread->clients_numb--;
 
-  if (client->thread->clients_numb == 0 && !client->thread->timeout_source)
+  if (g_atomic_int_dec_and_test ((gint *) &client->thread->clients_numb)
+      && !client->thread->timeout_source
+      && !client->thread->socket)
     {
       if (!client->thread->data->limit_threadnumb
 	  || client->thread->data->limit_threadnumb <
-	  client->thread->data->httpd_threads_numb)
+	  (guint) g_atomic_int_get ((gint *) &client->thread->data->httpd_threads_numb))
 	{
 	  client->thread->timeout_source =
 	    g_timeout_source_new (client->thread->data->
@@ -1868,15 +2980,38 @@ httpd_client_close (DSHttpdClient * client)
 
   g_mutex_unlock (client->thread->mutex);
 
-  client->thread->data->httpd_clients_numb--;
-  g_mutex_unlock (client->thread->data->httpd_mutex);
+  g_atomic_int_add ((gint *) &client->thread->data->httpd_clients_numb, -1);
 
   httpd_client_free (client);
 }
 
+/* NOTE - the write phase lasts from the end of the execution to the close, so with
+          "Connection: close" the total is the whole life of the client */
+
+static void
+httpd_client_timing_done (DSHttpdClient * client)
+{
+  DSGlobal *data = client->thread->data;
+  gint64 now = g_get_monotonic_time ();
+
+  if (client->timing_write_start)
+    client->timing->phases[DP_TIMING_WRITE] += now - client->timing_write_start;
+
+  /* Requests never executed are not logged: */
+  if (!client->timing_request
+      || now - client->timing->start < (gint64) data->limit_slowrequest_threshold * 1000)
+    return;
+
+  slowlog_write (data, client->ip, client->timing_request,
+		 client->request_handler, client->request_status,
+		 now - client->timing->start, client->timing);
+}
+
 static void
 httpd_client_free (DSHttpdClient * client)
 {
+  guint i;
+
   if (!client)
     return;
 
@@ -1901,11 +3036,16 @@ httpd_client_free (DSHttpdClient * client)
       g_source_unref (client->timeout_source);
     }
 
-  if (client->headers)
+#ifdef HAVE_ZLIB
+  if (client->output_zstream)
     {
-      g_list_foreach (client->headers, (GFunc) g_free, NULL);
-      g_list_free (client->headers);
+      deflateEnd (client->output_zstream);
+      g_free (client->output_zstream);
     }
+#endif
+
+  if (client->output_zbuffer)
+    g_byte_array_free (client->output_zbuffer, TRUE);
 
   if (client->request_path)
     {
@@ -1923,23 +3063,26 @@ httpd_client_free (DSHttpdClient * client)
   if (client->body)
     g_free (client->body);
 
-  if (client->output_header)
-    g_free (client->output_header);
+  if (client->timing)
+    dupin_timing_free (client->timing);
+
+  if (client->timing_request)
+    g_free (client->timing_request);
 
-  if (client->input_if_match)
-    g_free (client->input_if_match);
+  if (client->input_upload)
+    dupin_attachment_upload_free (client->input_upload);
 
-  if (client->input_if_none_match)
-    g_free (client->input_if_none_match);
+  if (client->input_buffer)
+    g_free (client->input_buffer);
 
-  if (client->input_if_modified_since)
-    g_free (client->input_if_modified_since);
+  if (client->input_chunk_line)
+    g_free (client->input_chunk_line);
 
-  if (client->input_if_unmodified_since)
-    g_free (client->input_if_unmodified_since);
+  if (client->output_header)
+    g_free (client->output_header);
 
-  if (client->input_mime)
-    g_free (client->input_mime);
+  if (client->output_content_range)
+    g_free (client->output_content_range);
 
   if (client->output_mime)
     g_free (client->output_mime);
@@ -1982,6 +3125,18 @@ httpd_client_free (DSHttpdClient * client)
           dupin_attachment_record_blob_close (client->output.blob.record);
           dupin_attachment_record_close (client->output.blob.record); 
         }
+
+      if (client->output.blob.ranges)
+        {
+          for (i = 0; i < client->output.blob.ranges_numb; i++)
+            if (client->output.blob.ranges[i].part)
+              g_free (client->output.blob.ranges[i].part);
+
+          g_free (client->output.blob.ranges);
+        }
+
+      if (client->output.blob.trailer)
+        g_free (client->output.blob.trailer);
       break;
 
     case DS_HTTPD_OUTPUT_CHANGES_COMET:
@@ -1994,6 +3149,9 @@ httpd_client_free (DSHttpdClient * client)
       if (client->output.changes_comet.change_string != NULL)
         g_free (client->output.changes_comet.change_string);
 
+      if (client->output.changes_comet.chunk != NULL)
+        g_string_free (client->output.changes_comet.chunk, TRUE);
+
       if (client->output.changes_comet.db)
         {
           dupin_database_unref (client->output.changes_comet.db); 
@@ -2035,8 +3193,12 @@ httpd_thread_new (DSGlobal * data, GError ** error)
       return NULL;
     }
 
+  g_mutex_lock (data->httpd_mutex);
+
   data->httpd_threads = g_list_prepend (data->httpd_threads, thread);
-  data->httpd_threads_numb++;
+  g_atomic_int_inc ((gint *) &data->httpd_threads_numb);
+
+  g_mutex_unlock (data->httpd_mutex);
 
   return thread;
 }
@@ -2065,7 +3227,7 @@ httpd_thread_close (DSHttpdThread * thread)
 
   thread->data->httpd_threads =
     g_list_remove (thread->data->httpd_threads, thread);
-  thread->data->httpd_threads_numb--;
+  g_atomic_int_add ((gint *) &thread->data->httpd_threads_numb, -1);
 
   g_mutex_unlock (thread->data->httpd_mutex);
 
@@ -2093,6 +3255,18 @@ httpd_thread_free (DSHttpdThread * thread)
       g_source_unref (thread->timeout_source);
     }
 
+  if (thread->socket_source)
+    {
+      g_source_destroy (thread->socket_source);
+      g_source_unref (thread->socket_source);
+    }
+
+  if (thread->socket)
+    {
+      g_io_channel_shutdown (thread->socket, FALSE, NULL);
+      g_io_channel_unref (thread->socket);
+    }
+
   if (thread->loop)
     {
       if (g_main_loop_is_running (thread->loop) == TRUE)
@@ -6,6 +6,10 @@
 #include "configure.h"
 
 #define HTTP_MAX_LINE			2048	/* byte */
+#define HTTP_SENDFILE_SIZE		262144	/* byte - max sent per write event */
+#define HTTP_RANGES_MAX			32	/* more ranges than this are ignored and the whole body is sent */
+#define HTTP_UPLOAD_CHUNK_SIZE		65536	/* byte - max read per event when streaming an upload */
+#define HTTP_UPLOAD_SPOOL_MINSIZE	65536	/* byte - attachment bodies from this size are spooled, not kept in RAM */
 
 #define HTTP_DATE			"Date"
 #define HTTP_DATE_LEN			4
@@ -46,6 +50,27 @@
 #define HTTP_LAST_MODIFIED		"Last-Modified"
 #define HTTP_LAST_MODIFIED_LEN		13
 
+#define HTTP_RANGE			"Range"
+#define HTTP_RANGE_LEN			5
+
+#define HTTP_IF_RANGE			"If-Range"
+#define HTTP_IF_RANGE_LEN		8
+
+#define HTTP_ACCEPT_RANGES		"Accept-Ranges"
+#define HTTP_ACCEPT_RANGES_LEN		13
+
+#define HTTP_CONTENT_RANGE		"Content-Range"
+#define HTTP_CONTENT_RANGE_LEN		13
+
+#define HTTP_ACCEPT_ENCODING		"Accept-Encoding"
+#define HTTP_ACCEPT_ENCODING_LEN	15
+
+#define HTTP_CONTENT_ENCODING		"Content-Encoding"
+#define HTTP_CONTENT_ENCODING_LEN	16
+
+#define HTTP_VARY			"Vary"
+#define HTTP_VARY_LEN			4
+
 #define HTTP_WWW_REDIRECT \
 "<?xml version=\"1.1\"?>\n" \
 "<!DOCTYPE html PUBLIC \"-//W3C//DTD XHTML 1.0 Strict//EN\"\n" \
@@ -68,6 +93,7 @@
 #define HTTP_MIME_TEXTPLAIN	"text/plain; charset=utf-8"
 #define HTTP_MIME_TEXTHTML	"text/html; charset=utf-8"
 #define HTTP_MIME_JSON		"application/json; charset=utf-8"
+#define HTTP_MIME_PROMETHEUS	"text/plain; version=0.0.4; charset=utf-8"
 /* #define HTTP_MIME_PORTABLE_LISTINGS_JSON		"application/listings+json; charset=utf-8; profile=\"http://portablelistings.net/profiles/core/1.0/\"" */
 #define HTTP_MIME_PORTABLE_LISTINGS_JSON		HTTP_MIME_JSON
 
@@ -75,12 +101,14 @@ typedef enum
 {
   HTTP_STATUS_200 = 0,
   HTTP_STATUS_201,
+  HTTP_STATUS_206,
   HTTP_STATUS_304,
   HTTP_STATUS_400,
   HTTP_STATUS_403,
   HTTP_STATUS_404,
   HTTP_STATUS_409,
   HTTP_STATUS_412,
+  HTTP_STATUS_416,
   HTTP_STATUS_500,
   HTTP_STATUS_501,
   HTTP_STATUS_503,
@@ -109,6 +137,12 @@ gboolean	httpd_init		(DSGlobal *	data,
 
 void		httpd_close		(DSGlobal *	data);
 
+gchar *		httpd_compress		(const gchar *	buf,
+					 gsize		size,
+					 DSHttpdEncoding encoding,
+					 gint		level,
+					 gsize *	compressed_size);
+
 
 typedef struct dp_keyvalue_t    dp_keyvalue_t;
 
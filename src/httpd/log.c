@@ -7,50 +7,180 @@
 
 #include <string.h>
 
+/* NOTE - log_write formats the entry in the calling thread and appends it to a bounded
+          lock-free ring (multi producer, single consumer, a sequence number per cell);
+          a writer thread writes the entries in batches, woken every
+          DS_LOG_FLUSH_INTERVAL or when DS_LOG_FLUSH_ENTRIES are pending. With the ring
+          full the entry is dropped and counted, the writer logs the count. */
+
+#define DS_LOG_RING_SIZE	8192	/* power of two */
+#define DS_LOG_FLUSH_ENTRIES	256
+#define DS_LOG_FLUSH_INTERVAL	(G_USEC_PER_SEC / 5)
+
+typedef struct ds_log_cell_t DSLogCell;
+struct ds_log_cell_t
+{
+  gint		seq;
+  gchar *	entry;
+};
+
+typedef struct ds_log_t DSLog;
+struct ds_log_t
+{
+  DSLogCell	cells[DS_LOG_RING_SIZE];
+
+  gint		tail;		/* next cell for the producers */
+  gint		head;		/* next cell for the writer */
+  gint		dropped;
+
+  GMutex	mutex;
+  GCond		cond;
+  gboolean	quit;
+
+  GThread *	thread;
+};
+
+static gpointer log_writer (DSGlobal * data);
+
 gboolean
 log_open (DSGlobal * data, GError ** error)
 {
-  data->logmutex = g_new0 (GMutex, 1);
-  g_mutex_init (data->logmutex);
+  DSLog *ring;
+  guint i;
 
   if (!(data->logio = g_io_channel_new_file (data->logfile, "a", error)))
     return FALSE;
 
+  ring = g_malloc0 (sizeof (DSLog));
+
+  for (i = 0; i < DS_LOG_RING_SIZE; i++)
+    ring->cells[i].seq = i;
+
+  g_mutex_init (&ring->mutex);
+  g_cond_init (&ring->cond);
+
+  data->logring = ring;
+
+  if (!
+      (ring->thread =
+#if GLIB_CHECK_VERSION (2,31,8)
+       g_thread_new ("log_thread", (GThreadFunc) log_writer, data)))
+#else
+       g_thread_create ((GThreadFunc) log_writer, data, TRUE, error)))
+#endif
+    {
+      g_mutex_clear (&ring->mutex);
+      g_cond_clear (&ring->cond);
+      g_free (ring);
+      data->logring = NULL;
+      return FALSE;
+    }
+
   return TRUE;
 }
 
 void
 log_close (DSGlobal * data)
 {
+  DSLog *ring;
+
   if (!data->logio)
     return;
 
+  if ((ring = data->logring))
+    {
+      /* The writer drains the ring before quitting: */
+      g_mutex_lock (&ring->mutex);
+      ring->quit = TRUE;
+      g_cond_signal (&ring->cond);
+      g_mutex_unlock (&ring->mutex);
+
+      g_thread_join (ring->thread);
+
+      g_mutex_clear (&ring->mutex);
+      g_cond_clear (&ring->cond);
+      g_free (ring);
+
+      data->logring = NULL;
+    }
+
   g_io_channel_shutdown (data->logio, TRUE, NULL);
   g_io_channel_unref (data->logio);
+}
+
+/* RING *********************************************************************/
 
-  g_mutex_clear (data->logmutex);
-  g_free (data->logmutex);
+/* Called by any thread, never blocks: */
+static gboolean
+log_ring_push (DSLog * ring, gchar * entry)
+{
+  DSLogCell *cell;
+  guint pos = (guint) g_atomic_int_get (&ring->tail);
+
+  while (1)
+    {
+      gint diff;
+
+      cell = &ring->cells[pos & (DS_LOG_RING_SIZE - 1)];
+      diff = (gint) ((guint) g_atomic_int_get (&cell->seq) - pos);
+
+      if (diff == 0)
+	{
+	  if (g_atomic_int_compare_and_exchange (&ring->tail, (gint) pos, (gint) (pos + 1)))
+	    break;
+
+	  pos = (guint) g_atomic_int_get (&ring->tail);
+	}
+
+      /* Full: */
+      else if (diff < 0)
+	return FALSE;
+
+      else
+	pos = (guint) g_atomic_int_get (&ring->tail);
+    }
+
+  cell->entry = entry;
+  g_atomic_int_set (&cell->seq, (gint) (pos + 1));
+
+  /* NOTE - signaled without the mutex, a lost wakeup only waits the interval */
+  if (pos + 1 - (guint) g_atomic_int_get (&ring->head) == DS_LOG_FLUSH_ENTRIES)
+    g_cond_signal (&ring->cond);
+
+  return TRUE;
+}
+
+/* Called by the writer thread only: */
+static gchar *
+log_ring_pop (DSLog * ring)
+{
+  DSLogCell *cell;
+  guint pos = (guint) ring->head;
+  gchar *entry;
+
+  cell = &ring->cells[pos & (DS_LOG_RING_SIZE - 1)];
+
+  if ((guint) g_atomic_int_get (&cell->seq) != pos + 1)
+    return NULL;
+
+  entry = cell->entry;
+  cell->entry = NULL;
+
+  g_atomic_int_set (&cell->seq, (gint) (pos + DS_LOG_RING_SIZE));
+  g_atomic_int_set (&ring->head, (gint) (pos + 1));
+
+  return entry;
 }
 
 /* WRITE SYSTEM *************************************************************/
 
-/* This function writes something into the log file: */
+/* This function writes a batch into the log file: */
 static void
-log_write_internal (DSGlobal * data, LogVerbose verbose, gchar * format, ...)
+log_write_channel (DSGlobal * data, gchar * string, gsize size)
 {
-  va_list va;
-  gchar *string;
   GError *error = NULL;
-  gsize size, written, ret;
-
-  if (data->logverbose < verbose)
-    return;
-
-  va_start (va, format);
-  string = g_strdup_vprintf (format, va);
-  va_end (va);
+  gsize written, ret;
 
-  size = strlen (string);
   ret = 0;
 
   while (1)
@@ -80,14 +210,27 @@ log_write_internal (DSGlobal * data, LogVerbose verbose, gchar * format, ...)
       ret += written;
     }
 
-  g_free (string);
-
   g_io_channel_flush (data->logio, NULL);
 }
 
+/* This function appends something to the entry: */
+static void
+log_write_internal (DSGlobal * data, GString * entry, LogVerbose verbose,
+		    gchar * format, ...)
+{
+  va_list va;
+
+  if (data->logverbose < verbose)
+    return;
+
+  va_start (va, format);
+  g_string_append_vprintf (entry, format, va);
+  va_end (va);
+}
+
 /* This function writes the first part of the JSON object: */
 static void
-log_write_before (DSGlobal * data)
+log_write_before (DSGlobal * data, GString * entry)
 {
   GTimeVal tv;
   gchar *str;
@@ -115,7 +258,7 @@ log_write_before (DSGlobal * data)
 
   str = g_time_val_to_iso8601 (&tv);
 
-  log_write_internal (data, LOG_VERBOSE_ERROR,
+  log_write_internal (data, entry, LOG_VERBOSE_ERROR,
 		      "{ \"time\" : %d.%d, \"timeIso8601\" : \"%s\"",
 		      tv.tv_sec, tv.tv_usec, str);
 
@@ -124,40 +267,45 @@ log_write_before (DSGlobal * data)
 
 /* Ths function writes the end part of the JSON object: */
 static void
-log_write_after (DSGlobal * data)
+log_write_after (DSGlobal * data, GString * entry)
 {
-  log_write_internal (data, LOG_VERBOSE_ERROR, " }\n");
+  log_write_internal (data, entry, LOG_VERBOSE_ERROR, " }\n");
 }
 
 /* This function write the node about the type of this message: */
 static void
-log_write_type (DSGlobal * data, LogType type)
+log_write_type (DSGlobal * data, GString * entry, LogType type)
 {
   switch (type)
     {
     case LOG_STARTUP:
-      log_write_internal (data, LOG_VERBOSE_ERROR,
+      log_write_internal (data, entry, LOG_VERBOSE_ERROR,
 			  ", \"type\" : \"STARTUP\"");
       break;
 
     case LOG_QUIT:
-      log_write_internal (data, LOG_VERBOSE_ERROR, ", \"type\" : \"QUIT\"");
+      log_write_internal (data, entry, LOG_VERBOSE_ERROR, ", \"type\" : \"QUIT\"");
       break;
 
     case LOG_HTTPD_CLIENT_CONNECT:
-      log_write_internal (data, LOG_VERBOSE_ERROR,
+      log_write_internal (data, entry, LOG_VERBOSE_ERROR,
 			  ", \"type\" : \"ISTANCE_HTTPD_CLIENT_CONNECT\"");
       break;
 
     case LOG_HTTPD_CLIENT_DISCONNECT:
-      log_write_internal (data, LOG_VERBOSE_ERROR,
+      log_write_internal (data, entry, LOG_VERBOSE_ERROR,
 			  ", \"type\" : \"ISTANCE_HTTPD_CLIENT_DISCONNECT\"");
       break;
 
     case LOG_HTTPD_CLIENT_ERROR:
-      log_write_internal (data, LOG_VERBOSE_ERROR,
+      log_write_internal (data, entry, LOG_VERBOSE_ERROR,
 			  ", \"type\" : \"ISTANCE_HTTPD_CLIENT_ERROR\"");
       break;
+
+    case LOG_DROPPED:
+      log_write_internal (data, entry, LOG_VERBOSE_ERROR,
+			  ", \"type\" : \"LOG_DROPPED\"");
+      break;
     }
 }
 
@@ -209,7 +357,7 @@ log_write_parse_string (gchar * ptr)
 
 /* For any nodes, this function writes it into the log file: */
 static void
-log_write_nodes (DSGlobal * data, va_list va)
+log_write_nodes (DSGlobal * data, GString * entry, va_list va)
 {
   gchar *node;
   gchar *string;
@@ -226,55 +374,130 @@ log_write_nodes (DSGlobal * data, va_list va)
 	{
 	case LOG_TYPE_STRING:
 	  string = log_write_parse_string (va_arg (va, gchar *));
-	  log_write_internal (data, verbose, ", \"%s\" : \"%s\"", node,
+	  log_write_internal (data, entry, verbose, ", \"%s\" : \"%s\"", node,
 			      string);
 	  g_free (string);
 	  break;
 
 	case LOG_TYPE_INTEGER:
 	  integer = va_arg (va, gint);
-	  log_write_internal (data, verbose, ", \"%s\" : %d", node, integer);
+	  log_write_internal (data, entry, verbose, ", \"%s\" : %d", node, integer);
 	  break;
 
 	case LOG_TYPE_DOUBLE:
 	  doub = va_arg (va, gdouble);
-	  log_write_internal (data, verbose, ", \"%s\" : %f", node, doub);
+	  log_write_internal (data, entry, verbose, ", \"%s\" : %f", node, doub);
 	  break;
 
 	case LOG_TYPE_BOOLEAN:
 	  boolean = va_arg (va, gboolean);
-	  log_write_internal (data, verbose, ", \"%s\" : %s", node,
+	  log_write_internal (data, entry, verbose, ", \"%s\" : %s", node,
 			      boolean == TRUE ? "true" : "false");
 	  break;
 
 	case LOG_TYPE_NULL:
-	  log_write_internal (data, verbose, ", \"%s\" : null", node);
+	  log_write_internal (data, entry, verbose, ", \"%s\" : null", node);
 	  break;
 	}
     }
 }
 
+/* This function builds a whole JSON object: */
+static gchar *
+log_entry (DSGlobal * data, LogType type, va_list va)
+{
+  GString *entry = g_string_new (NULL);
+
+  log_write_before (data, entry);
+  log_write_type (data, entry, type);
+  log_write_nodes (data, entry, va);
+  log_write_after (data, entry);
+
+  return g_string_free (entry, FALSE);
+}
+
+static gchar *
+log_entry_nodes (DSGlobal * data, LogType type, ...)
+{
+  va_list va;
+  gchar *entry;
+
+  va_start (va, type);
+  entry = log_entry (data, type, va);
+  va_end (va);
+
+  return entry;
+}
+
+/* The writer thread: */
+static gpointer
+log_writer (DSGlobal * data)
+{
+  DSLog *ring = data->logring;
+  GString *batch = g_string_new (NULL);
+  gboolean quit = FALSE;
+
+  while (quit == FALSE)
+    {
+      gchar *entry;
+      gint dropped;
+
+      g_mutex_lock (&ring->mutex);
+
+      if (ring->quit == FALSE)
+	g_cond_wait_until (&ring->cond, &ring->mutex,
+			   g_get_monotonic_time () + DS_LOG_FLUSH_INTERVAL);
+
+      quit = ring->quit;
+      g_mutex_unlock (&ring->mutex);
+
+      while ((entry = log_ring_pop (ring)))
+	{
+	  g_string_append (batch, entry);
+	  g_free (entry);
+	}
+
+      if ((dropped = g_atomic_int_get (&ring->dropped)))
+	{
+	  g_atomic_int_add (&ring->dropped, -dropped);
+
+	  entry = log_entry_nodes (data, LOG_DROPPED, "dropped", LOG_VERBOSE_ERROR,
+				   LOG_TYPE_INTEGER, dropped, NULL);
+	  g_string_append (batch, entry);
+	  g_free (entry);
+	}
+
+      if (batch->len)
+	{
+	  log_write_channel (data, batch->str, batch->len);
+	  g_string_truncate (batch, 0);
+	}
+    }
+
+  g_string_free (batch, TRUE);
+
+  return NULL;
+}
+
 /* Generic log: */
 void
 log_write (DSGlobal * data, LogVerbose verbose, LogType type, ...)
 {
   va_list va;
+  gchar *entry;
 
   if (data->logverbose < verbose)
     return;
 
-  g_mutex_lock (data->logmutex);
-
   va_start (va, type);
-
-  log_write_before (data);
-  log_write_type (data, type);
-  log_write_nodes (data, va);
-  log_write_after (data);
-
+  entry = log_entry (data, type, va);
   va_end (va);
 
-  g_mutex_unlock (data->logmutex);
+  if (log_ring_push (data->logring, entry) == FALSE)
+    {
+      g_free (entry);
+      g_atomic_int_inc (&data->logring->dropped);
+    }
 }
 
 /* EOF */
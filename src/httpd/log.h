@@ -11,7 +11,9 @@ typedef enum {
 
   LOG_HTTPD_CLIENT_CONNECT,
   LOG_HTTPD_CLIENT_DISCONNECT,
-  LOG_HTTPD_CLIENT_ERROR
+  LOG_HTTPD_CLIENT_ERROR,
+
+  LOG_DROPPED
 } LogType;
 
 typedef enum {
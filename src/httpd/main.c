@@ -8,6 +8,9 @@
 #include "httpd.h"
 #include "configure.h"
 #include "map.h"
+#include "cache.h"
+#include "stats.h"
+#include "slowlog.h"
 #include "dupin_server_common.h"
 
 #include <stdlib.h>
@@ -83,6 +86,13 @@ main (int argc, char **argv)
       goto main_error_log;
     }
 
+  /* Open the slow request log: */
+  if (slowlog_open (data, &error) == FALSE)
+    {
+      fprintf (stderr, "Error about the Slow Log File: %s\n", (error) ? error->message : DUPIN_UNKNOWN_ERROR);
+      goto main_error_slowlog;
+    }
+
 #ifdef G_OS_UNIX
   /* Permissions */
   if (dupin_server_common_permission (data, &error) == FALSE)
@@ -111,6 +121,20 @@ main (int argc, char **argv)
       goto main_error_map;
     }
 
+  /* Response cache: */
+  if (cache_init (data, &error) == FALSE)
+    {
+      fprintf (stderr, "Error activing the response cache: %s\n", (error) ? error->message : DUPIN_UNKNOWN_ERROR);
+      goto main_error_cache;
+    }
+
+  /* Request counters: */
+  if (stats_init (data, &error) == FALSE)
+    {
+      fprintf (stderr, "Error activing the statistics: %s\n", (error) ? error->message : DUPIN_UNKNOWN_ERROR);
+      goto main_error_stats;
+    }
+
   /* HTTP Server: */
   if (httpd_init (data, &error) == FALSE)
     {
@@ -130,6 +154,10 @@ main (int argc, char **argv)
 
   httpd_close (data);
 
+  stats_close (data);
+
+  cache_close (data);
+
   map_close (data);
 
   dupin_shutdown (data->dupin);
@@ -139,6 +167,8 @@ main (int argc, char **argv)
   /* Close everything: */
   g_main_loop_unref (data->loop);
 
+  slowlog_close (data);
+
   log_close (data);
 
 #ifdef G_OS_UNIX
@@ -150,6 +180,12 @@ main (int argc, char **argv)
   return 0;
 
 main_error_httpd:
+  stats_close (data);
+
+main_error_stats:
+  cache_close (data);
+
+main_error_cache:
   map_close (data);
 
 main_error_map:
@@ -161,6 +197,9 @@ main_error_dupin:
     g_error_free (error);
 
 main_error_permission:
+  slowlog_close (data);
+
+main_error_slowlog:
   log_close (data);
 
 main_error_log:
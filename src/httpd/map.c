@@ -7,9 +7,41 @@
 #include "dupin.h"
 #include "httpd.h"
 #include "map.h"
+#include "log.h"
+
+#ifdef HAVE_SYS_INOTIFY_H
+#  include <sys/inotify.h>
+#  include <unistd.h>
+#  include <errno.h>
+#endif
+
+/* NOTE - the cache is an LRU bounded by entries (CacheSize) and by bytes (CacheMaxBytes).
+          Entries are looked up by the requested path, without touching the file system;
+          with inotify the directories of the cached files are watched and changed entries
+          dropped, otherwise every hit is revalidated with a stat(). Entries still in use by
+          a client are kept alive by their reference count after being dropped. */
 
 /* INITIALIZE ***************************************************************/
-void map_free (DSMap * map);
+static void map_free (DSMap * map);
+static void map_release (DSGlobal * data, DSMap * map);
+static void map_evict (DSGlobal * data);
+
+#ifdef HAVE_SYS_INOTIFY_H
+/* NOTE - one watch per directory, shared by the entries of the files in it and
+          removed when the last of them leaves the cache */
+
+typedef struct ds_map_watch_t DSMapWatch;
+struct ds_map_watch_t
+{
+  gchar *	dirname;
+  guint		count;
+};
+
+static void map_watch_free (DSMapWatch * watch);
+static void map_watch_release (DSGlobal * data, gint wd);
+static gboolean map_inotify_read (GIOChannel * source, GIOCondition cond,
+				  DSGlobal * data);
+#endif
 
 /* Generic init: */
 gboolean
@@ -19,8 +51,36 @@ map_init (DSGlobal * data, GError ** error)
   g_mutex_init (data->map_mutex);
 
   data->map_table =
-    g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
-			   (GDestroyNotify) map_free);
+    g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+  data->map_lru = g_queue_new ();
+
+#ifdef HAVE_SYS_INOTIFY_H
+  data->map_watches =
+    g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+			   (GDestroyNotify) map_watch_free);
+
+  if ((data->map_inotify = inotify_init ()) >= 0)
+    {
+      GIOChannel *channel = g_io_channel_unix_new (data->map_inotify);
+
+      g_io_channel_set_encoding (channel, NULL, NULL);
+      g_io_channel_set_buffered (channel, FALSE);
+      g_io_channel_set_flags (channel, G_IO_FLAG_NONBLOCK, NULL);
+
+      data->map_inotify_source = g_io_create_watch (channel, G_IO_IN);
+      g_source_set_callback (data->map_inotify_source,
+			     (GSourceFunc) map_inotify_read, data, NULL);
+      g_source_attach (data->map_inotify_source, g_main_context_default ());
+
+      g_io_channel_unref (channel);
+    }
+  else
+    log_write (data, LOG_VERBOSE_WARNING, LOG_STARTUP,
+	       "error", LOG_VERBOSE_WARNING, LOG_TYPE_STRING,
+	       "inotify not available, cached files are checked at every request",
+	       NULL);
+#endif
 
   return TRUE;
 }
@@ -29,22 +89,50 @@ map_init (DSGlobal * data, GError ** error)
 void
 map_close (DSGlobal * data)
 {
-  if (data->map_mutex)
+#ifdef HAVE_SYS_INOTIFY_H
+  if (data->map_inotify_source)
     {
-      g_mutex_clear (data->map_mutex);
-      g_free (data->map_mutex);
+      g_source_destroy (data->map_inotify_source);
+      g_source_unref (data->map_inotify_source);
+      data->map_inotify_source = NULL;
+    }
+
+  if (data->map_inotify >= 0)
+    close (data->map_inotify);
+
+  if (data->map_watches)
+    g_hash_table_destroy (data->map_watches);
+#endif
+
+  if (data->map_lru)
+    {
+      DSMap *map;
+
+      while ((map = g_queue_pop_head (data->map_lru)))
+	{
+	  map->lru_node = NULL;
+	  map_release (data, map);
+	}
+
+      g_queue_free (data->map_lru);
     }
 
   if (data->map_table)
     g_hash_table_destroy (data->map_table);
 
-  if (data->map_unreflist)
-    g_list_free (data->map_unreflist);
+  if (data->map_mutex)
+    {
+      g_mutex_clear (data->map_mutex);
+      g_free (data->map_mutex);
+    }
 }
 
-void
+static void
 map_free (DSMap * map)
 {
+  if (map->key)
+    g_free (map->key);
+
   if (map->filename)
     g_free (map->filename);
 
@@ -58,111 +146,235 @@ map_free (DSMap * map)
   if (map->mime)
     g_free (map->mime);
 
+  if (map->etag)
+    g_free (map->etag);
+
+  if (map->gzip)
+    g_free (map->gzip);
+
   g_free (map);
 }
 
+/* NOTE - the cache holds one reference of its entries, the mutex must be locked */
+
+static void
+map_release (DSGlobal * data, DSMap * map)
+{
+  map->ref--;
+
+  if (map->ref == 0)
+    map_free (map);
+}
+
+static void
+map_remove (DSGlobal * data, DSMap * map)
+{
+  if (map->lru_node == NULL)
+    return;
+
+  g_hash_table_remove (data->map_table, map->key);
+
+  g_queue_delete_link (data->map_lru, map->lru_node);
+  map->lru_node = NULL;
+
+  data->map_bytes -= map->size + (map->gzip ? map->gzip_size : 0);
+
+#ifdef HAVE_SYS_INOTIFY_H
+  if (map->wd >= 0)
+    {
+      map_watch_release (data, map->wd);
+      map->wd = -1;
+    }
+#endif
+
+  map_release (data, map);
+}
+
+/* The least recently used entries go till the limits are respected: */
+static void
+map_evict (DSGlobal * data)
+{
+  DSMap *map;
+
+  while ((map = g_queue_peek_tail (data->map_lru)))
+    {
+      if ((data->limit_cachesize == 0
+	   || g_queue_get_length (data->map_lru) <= data->limit_cachesize)
+	  && (data->limit_cachemaxbytes == 0
+	      || data->map_bytes <= data->limit_cachemaxbytes))
+	break;
+
+      map_remove (data, map);
+    }
+}
+
 /* MAP FUNC ****************************************************************/
 DSMap *
-map_find (DSGlobal * data, gchar * filename, time_t mtime)
+map_find (DSGlobal * data, gchar * key)
 {
   DSMap *map;
 
   g_mutex_lock (data->map_mutex);
 
-  if (!(map = g_hash_table_lookup (data->map_table, filename)))
+  if (!(map = g_hash_table_lookup (data->map_table, key)))
+    {
+      g_mutex_unlock (data->map_mutex);
+      return NULL;
+    }
+
+#ifdef HAVE_SYS_INOTIFY_H
+  if (data->map_inotify < 0)
+#endif
     {
-      GMappedFile *mf;
       struct stat st;
 
-      if (g_stat (filename, &st) != 0)
+      if (g_stat (map->filename, &st) != 0
+	  || st.st_mtime != map->mtime
+	  || (gsize) st.st_size != map->size)
 	{
+	  map_remove (data, map);
 	  g_mutex_unlock (data->map_mutex);
 	  return NULL;
 	}
+    }
 
-      if (data->limit_cachemaxfilesize != 0
-	  && st.st_size >= data->limit_cachemaxfilesize)
-	{
-	  g_mutex_unlock (data->map_mutex);
-	  return NULL;
-	}
+  /* Most recently used: */
+  g_queue_unlink (data->map_lru, map->lru_node);
+  g_queue_push_head_link (data->map_lru, map->lru_node);
 
-      if (data->limit_cachesize != 0
-	  && g_hash_table_size (data->map_table) >= data->limit_cachesize)
-	{
-	  if (!data->map_unreflist)
-	    {
-	      g_mutex_unlock (data->map_mutex);
-	      return NULL;
-	    }
+  map->ref++;
 
-	  map = data->map_unreflist->data;
-	  g_hash_table_remove (data->map_table, map->filename);
-	  data->map_unreflist = g_list_remove (data->map_unreflist, map);
-	}
+  g_mutex_unlock (data->map_mutex);
 
-      if (!(mf = g_mapped_file_new (filename, FALSE, NULL)))
-	{
-	  g_mutex_unlock (data->map_mutex);
-	  return NULL;
-	}
+  return map;
+}
 
-      map = g_malloc0 (sizeof (DSMap));
+DSMap *
+map_add (DSGlobal * data, gchar * key, gchar * filename, struct stat * st)
+{
+  DSMap *map;
+  GMappedFile *mf;
+  gboolean uncertain;
 
-      map->filename = g_strdup (filename);
-      map->mtime = st.st_mtime;
-      map->map = mf;
+  if (data->limit_cachemaxfilesize != 0
+      && st->st_size >= data->limit_cachemaxfilesize)
+    return NULL;
 
-      gboolean uncertain;
+  if (data->limit_cachemaxbytes != 0
+      && st->st_size > data->limit_cachemaxbytes)
+    return NULL;
+
+  if (!(mf = g_mapped_file_new (filename, FALSE, NULL)))
+    return NULL;
+
+  map = g_malloc0 (sizeof (DSMap));
+
+  map->key = g_strdup (key);
+  map->filename = g_strdup (filename);
+  map->mtime = st->st_mtime;
+  map->size = st->st_size;
+  map->map = mf;
+  map->wd = -1;
+
+  /* Validators computed once: */
+  map->etag = g_strdup_printf ("%lx-%lx", (gulong) map->mtime, (gulong) map->size);
+  map->last_modified = (gsize) map->mtime * G_USEC_PER_SEC;
 
 #ifndef MIMEGUESS_STRICT
-      if (g_str_has_suffix (filename, ".html") == TRUE
-	  || g_str_has_suffix (filename, ".htm") == TRUE)
-	map->mime = g_strdup (HTTP_MIME_TEXTHTML);
+  if (g_str_has_suffix (filename, ".html") == TRUE
+      || g_str_has_suffix (filename, ".htm") == TRUE)
+    map->mime = g_strdup (HTTP_MIME_TEXTHTML);
+
+  else if (g_str_has_suffix (filename, ".css") == TRUE)
+    map->mime = g_strdup ("text/css");
 
-      else if (g_str_has_suffix (filename, ".css") == TRUE)
-	map->mime = g_strdup ("text/css");
+  else if (g_str_has_suffix (filename, ".png") == TRUE)
+    map->mime = g_strdup ("image/png");
 
-      else if (g_str_has_suffix (filename, ".png") == TRUE)
-	map->mime = g_strdup ("image/png");
+  else if (g_str_has_suffix (filename, ".js") == TRUE)
+    map->mime = g_strdup ("application/javascript");
 
-      else if (g_str_has_suffix (filename, ".js") == TRUE)
-	map->mime = g_strdup ("application/javascript");
+  else if (!(map->mime = g_content_type_guess (filename, NULL, 0, &uncertain)) || uncertain == TRUE)
+    {
+      if (map->mime)
+	g_free (map->mime);
 
-      else if (!(map->mime = g_content_type_guess (filename, NULL, 0, &uncertain)))
-	map->mime = g_strdup (HTTP_MIME_TEXTHTML);
+      map->mime = g_strdup (HTTP_MIME_TEXTHTML);
+    }
 #else
-      if (!(map->mime = g_content_type_guess (filename, NULL, 0, &uncertain)))
-	map->mime = g_strdup (HTTP_MIME_TEXTHTML);
+  if (!(map->mime = g_content_type_guess (filename, NULL, 0, &uncertain)) || uncertain == TRUE)
+    {
+      if (map->mime)
+	g_free (map->mime);
+
+      map->mime = g_strdup (HTTP_MIME_TEXTHTML);
+    }
 #endif
 
-      if( uncertain == TRUE )
-	{
-	  map->mime = g_strdup (HTTP_MIME_TEXTHTML);
-	}
+  /* One reference for the cache, one for the caller: */
+  map->ref = 2;
 
-      g_hash_table_insert (data->map_table, g_strdup (filename), map);
-    }
+  g_mutex_lock (data->map_mutex);
 
-  if (map->mtime != mtime)
-    {
-      if (map->unrefnode)
-	data->map_unreflist =
-	  g_list_delete_link (data->map_unreflist, map->unrefnode);
+  /* Another client was faster: */
+  if (g_hash_table_lookup (data->map_table, key))
+    map_remove (data, g_hash_table_lookup (data->map_table, key));
 
-      g_hash_table_remove (data->map_table, map->filename);
-      g_mutex_unlock (data->map_mutex);
-      return NULL;
-    }
+  g_hash_table_insert (data->map_table, g_strdup (key), map);
 
-  map->ref++;
+  g_queue_push_head (data->map_lru, map);
+  map->lru_node = g_queue_peek_head_link (data->map_lru);
 
-  if (map->unrefnode)
+  data->map_bytes += map->size;
+
+#ifdef HAVE_SYS_INOTIFY_H
+  if (data->map_inotify >= 0)
     {
-      data->map_unreflist =
-	g_list_delete_link (data->map_unreflist, map->unrefnode);
-      map->unrefnode = NULL;
+      gchar *dirname = g_path_get_dirname (filename);
+      DSMapWatch *watch;
+      struct stat now;
+      gint wd;
+
+      if ((wd = inotify_add_watch (data->map_inotify, dirname,
+				   IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_MOVED_FROM
+				   | IN_MOVED_TO | IN_DELETE | IN_DELETE_SELF | IN_MOVE_SELF)) < 0)
+	{
+	  /* Not watched, so not cached: */
+	  g_free (dirname);
+	  map_remove (data, map);
+	  g_mutex_unlock (data->map_mutex);
+	  return map;
+	}
+
+      /* The same directory gives back the same watch: */
+      if ((watch = g_hash_table_lookup (data->map_watches, GINT_TO_POINTER (wd))))
+	g_free (dirname);
+
+      else
+	{
+	  watch = g_malloc0 (sizeof (DSMapWatch));
+	  watch->dirname = dirname;
+	  g_hash_table_insert (data->map_watches, GINT_TO_POINTER (wd), watch);
+	}
+
+      watch->count++;
+      map->wd = wd;
+
+      /* NOTE - a change between the stat of the caller and the watch raised no event,
+                so the file is checked again now that it is watched: */
+      if (g_stat (filename, &now) != 0
+	  || now.st_mtime != map->mtime
+	  || (gsize) now.st_size != map->size)
+	{
+	  map_remove (data, map);
+	  map_release (data, map);
+	  g_mutex_unlock (data->map_mutex);
+	  return NULL;
+	}
     }
+#endif
+
+  map_evict (data);
 
   g_mutex_unlock (data->map_mutex);
 
@@ -175,15 +387,186 @@ map_unref (DSGlobal * data, DSMap * map)
 {
   g_mutex_lock (data->map_mutex);
 
-  map->ref--;
+  map_release (data, map);
 
-  if (map->ref == 0)
+  g_mutex_unlock (data->map_mutex);
+}
+
+/* GZIP ********************************************************************/
+
+/* NOTE - the gzip copy lives as long as the map, so static files are compressed
+          once and not at every request */
+
+gboolean
+map_gzip (DSGlobal * data, DSMap * map)
+{
+  gboolean ret;
+
+  g_mutex_lock (data->map_mutex);
+
+  if (map->gzip == NULL && map->gzip_size == 0)
     {
-      data->map_unreflist = g_list_prepend (data->map_unreflist, map);
-      map->unrefnode = data->map_unreflist;
+      map->gzip = httpd_compress (g_mapped_file_get_contents (map->map), map->size,
+				  DS_HTTPD_ENCODING_GZIP,
+				  data->limit_http_compress_level,
+				  &map->gzip_size);
+
+      /* Not worth it, do not try again: */
+      if (map->gzip == NULL || map->gzip_size >= map->size)
+	{
+	  if (map->gzip)
+	    g_free (map->gzip);
+
+	  map->gzip = NULL;
+	  map->gzip_size = map->size;
+	}
+
+      else if (map->lru_node != NULL)
+	{
+	  data->map_bytes += map->gzip_size;
+	  map_evict (data);
+	}
     }
 
+  ret = map->gzip != NULL ? TRUE : FALSE;
+
   g_mutex_unlock (data->map_mutex);
+
+  return ret;
+}
+
+/* INOTIFY *****************************************************************/
+
+#ifdef HAVE_SYS_INOTIFY_H
+static void
+map_watch_free (DSMapWatch * watch)
+{
+  g_free (watch->dirname);
+  g_free (watch);
 }
 
+/* NOTE - the mutex must be locked */
+
+static void
+map_watch_release (DSGlobal * data, gint wd)
+{
+  DSMapWatch *watch;
+
+  if (!(watch = g_hash_table_lookup (data->map_watches, GINT_TO_POINTER (wd))))
+    return;
+
+  watch->count--;
+
+  if (watch->count > 0)
+    return;
+
+  g_hash_table_remove (data->map_watches, GINT_TO_POINTER (wd));
+  inotify_rm_watch (data->map_inotify, wd);
+}
+
+static void
+map_inotify_invalidate (DSGlobal * data, gchar * path, gboolean directory)
+{
+  GList *list, *l;
+
+  list = g_queue_peek_head_link (data->map_lru);
+
+  for (l = list; l; )
+    {
+      DSMap *map = l->data;
+
+      l = l->next;
+
+      if (directory == TRUE)
+	{
+	  gsize len = strlen (path);
+
+	  if (strncmp (map->filename, path, len) != 0
+	      || map->filename[len] != G_DIR_SEPARATOR)
+	    continue;
+	}
+
+      else if (strcmp (map->filename, path) != 0)
+	continue;
+
+      map_remove (data, map);
+    }
+}
+
+static gboolean
+map_inotify_read (GIOChannel * source, GIOCondition cond, DSGlobal * data)
+{
+  union
+  {
+    struct inotify_event event;
+    gchar buf[4096];
+  } events;
+  gssize len;
+
+  while ((len = read (data->map_inotify, events.buf, sizeof (events.buf))) > 0)
+    {
+      gchar *buf = events.buf;
+      gchar *ptr;
+
+      g_mutex_lock (data->map_mutex);
+
+      for (ptr = buf; ptr < buf + len; ptr += sizeof (struct inotify_event) + ((struct inotify_event *) ptr)->len)
+	{
+	  struct inotify_event *event = (struct inotify_event *) ptr;
+	  DSMapWatch *watch;
+	  gchar *dirname;
+
+	  /* NOTE - the kernel queue overflowed and events were lost, so none of
+		    the entries can be trusted any more */
+	  if (event->mask & IN_Q_OVERFLOW)
+	    {
+	      DSMap *map;
+
+	      while ((map = g_queue_peek_head (data->map_lru)))
+		map_remove (data, map);
+
+	      continue;
+	    }
+
+	  if (!(watch = g_hash_table_lookup (data->map_watches, GINT_TO_POINTER (event->wd))))
+	    continue;
+
+	  dirname = watch->dirname;
+
+	  /* NOTE - the entries dropped release the watch, which goes with the last
+		    of them: the directory name is copied before */
+	  if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED))
+	    {
+	      dirname = g_strdup (dirname);
+	      map_inotify_invalidate (data, dirname, TRUE);
+	      g_free (dirname);
+
+	      if (g_hash_table_lookup (data->map_watches, GINT_TO_POINTER (event->wd)))
+		{
+		  g_hash_table_remove (data->map_watches, GINT_TO_POINTER (event->wd));
+
+		  if (!(event->mask & IN_IGNORED))
+		    inotify_rm_watch (data->map_inotify, event->wd);
+		}
+
+	      continue;
+	    }
+
+	  if (event->len > 0)
+	    {
+	      gchar *path = g_build_filename (dirname, event->name, NULL);
+
+	      /* A renamed or deleted directory takes its files with it: */
+	      map_inotify_invalidate (data, path, (event->mask & IN_ISDIR) ? TRUE : FALSE);
+	      g_free (path);
+	    }
+	}
+
+      g_mutex_unlock (data->map_mutex);
+    }
+
+  return TRUE;
+}
+#endif
+
 /* EOF */
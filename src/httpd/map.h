@@ -9,11 +9,18 @@ gboolean	map_init		(DSGlobal *	data,
 void		map_close		(DSGlobal *	data);
 
 DSMap *		map_find		(DSGlobal *	data,
+					 gchar *	key);
+
+DSMap *		map_add			(DSGlobal *	data,
+					 gchar *	key,
 					 gchar *	filename,
-					 time_t		mtime);
+					 struct stat *	st);
 
 void		map_unref		(DSGlobal *	data,
 					 DSMap *	map);
 
+gboolean	map_gzip		(DSGlobal *	data,
+					 DSMap *	map);
+
 #endif
 /* EOF */
@@ -0,0 +1,165 @@
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <string.h>
+
+#include "parser.h"
+
+#if defined (__SSE2__) && defined (__GNUC__)
+#  include <emmintrin.h>
+#endif
+
+/* Returns the first c in buf, 16 bytes at a time where SSE2 is available: */
+gchar *
+parser_find (gchar * buf, gsize len, gchar c)
+{
+#if defined (__SSE2__) && defined (__GNUC__)
+  const __m128i needle = _mm_set1_epi8 (c);
+  gsize i;
+
+  for (i = 0; i + 16 <= len; i += 16)
+    {
+      __m128i chunk = _mm_loadu_si128 ((const __m128i *) (buf + i));
+      gint mask = _mm_movemask_epi8 (_mm_cmpeq_epi8 (chunk, needle));
+
+      if (mask)
+	return buf + i + __builtin_ctz (mask);
+    }
+
+  return memchr (buf + i, c, len - i);
+#else
+  return memchr (buf, c, len);
+#endif
+}
+
+gboolean
+parser_span_equal (const gchar * buf, DSParserSpan * span, const gchar * str,
+		   gsize str_len)
+{
+  return (span->len == str_len
+	  && !memcmp (buf + span->offset, str, str_len)) ? TRUE : FALSE;
+}
+
+gboolean
+parser_span_equal_nocase (const gchar * buf, DSParserSpan * span,
+			  const gchar * str, gsize str_len)
+{
+  return (span->len == str_len
+	  && !g_ascii_strncasecmp (buf + span->offset, str, str_len)) ? TRUE : FALSE;
+}
+
+/* Request line: METHOD SP TARGET SP VERSION */
+static gboolean
+parser_parse_request_line (DSParser * parser, gchar * buf, gsize start,
+			   gsize end)
+{
+  gchar *line = buf + start;
+  gsize len = end - start;
+  gchar *sp1, *sp2;
+
+  if (!(sp1 = parser_find (line, len, ' '))
+      || !(sp2 = parser_find (sp1 + 1, len - (sp1 + 1 - line), ' '))
+      || parser_find (sp2 + 1, len - (sp2 + 1 - line), ' '))
+    return FALSE;
+
+  parser->method.offset = start;
+  parser->method.len = sp1 - line;
+
+  parser->target.offset = sp1 + 1 - buf;
+  parser->target.len = sp2 - (sp1 + 1);
+
+  parser->version.offset = sp2 + 1 - buf;
+  parser->version.len = end - parser->version.offset;
+
+  if (!parser->method.len || !parser->target.len || !parser->version.len)
+    return FALSE;
+
+  parser->request_line.offset = start;
+  parser->request_line.len = len;
+
+  buf[end] = 0;
+  return TRUE;
+}
+
+/* Header line: NAME [SP] : [SP] VALUE [SP], lines without ':' are ignored */
+static gboolean
+parser_parse_header_line (DSParser * parser, gchar * buf, gsize start,
+			  gsize end)
+{
+  DSParserHeader *header;
+  gchar *colon;
+  gsize name_end, value_start, value_end;
+
+  if (!(colon = parser_find (buf + start, end - start, ':')))
+    return TRUE;
+
+  if (parser->headers_numb >= PARSER_MAX_HEADERS)
+    return FALSE;
+
+  name_end = colon - buf;
+  while (name_end > start && (buf[name_end - 1] == ' ' || buf[name_end - 1] == '\t'))
+    name_end--;
+
+  value_start = colon + 1 - buf;
+  while (value_start < end && (buf[value_start] == ' ' || buf[value_start] == '\t'))
+    value_start++;
+
+  value_end = end;
+  while (value_end > value_start && (buf[value_end - 1] == ' ' || buf[value_end - 1] == '\t'))
+    value_end--;
+
+  header = &parser->headers[parser->headers_numb++];
+
+  header->name.offset = start;
+  header->name.len = name_end - start;
+
+  header->value.offset = value_start;
+  header->value.len = value_end - value_start;
+
+  buf[value_end] = 0;
+  return TRUE;
+}
+
+/* NOTE - called again as more bytes arrive in buf, only the new complete lines are parsed */
+
+DSParserStatus
+parser_parse (DSParser * parser, gchar * buf, gsize len)
+{
+  gchar *eol;
+
+  while (parser->scanned < len
+	 && (eol = parser_find (buf + parser->scanned, len - parser->scanned, '\n')))
+    {
+      gsize start = parser->scanned;
+      gsize end = eol - buf;
+
+      parser->scanned = end + 1;
+
+      if (end > start && buf[end - 1] == '\r')
+	end--;
+
+      /* Request line: */
+      if (!parser->request_line.len)
+	{
+	  if (parser_parse_request_line (parser, buf, start, end) == FALSE)
+	    return PARSER_ERROR;
+
+	  continue;
+	}
+
+      /* Empty line means the data block: */
+      if (end == start)
+	{
+	  parser->size = parser->scanned;
+	  return PARSER_DONE;
+	}
+
+      if (parser_parse_header_line (parser, buf, start, end) == FALSE)
+	return PARSER_TOO_MANY_HEADERS;
+    }
+
+  return PARSER_INCOMPLETE;
+}
+
+/* EOF */
@@ -0,0 +1,70 @@
+#ifndef _DS_PARSER_H_
+#define _DS_PARSER_H_
+
+#include <glib.h>
+
+/* NOTE - the HTTP header is parsed in place: the parser only records offsets into
+          the receive buffer, the request line and the header values are
+          NUL-terminated there so they can be used as strings without copies */
+
+#define PARSER_BUFFER_SIZE	8192	/* byte - max size of the whole request header */
+#define PARSER_MAX_HEADERS	64
+
+typedef struct ds_parser_span_t DSParserSpan;
+struct ds_parser_span_t
+{
+  gsize		offset;
+  gsize		len;
+};
+
+typedef struct ds_parser_header_t DSParserHeader;
+struct ds_parser_header_t
+{
+  DSParserSpan	name;
+  DSParserSpan	value;
+};
+
+typedef enum
+{
+  PARSER_INCOMPLETE = 0,
+  PARSER_DONE,
+  PARSER_ERROR,
+  PARSER_TOO_MANY_HEADERS
+} DSParserStatus;
+
+typedef struct ds_parser_t DSParser;
+struct ds_parser_t
+{
+  gsize		scanned;	/* start of the first line not parsed yet */
+  gsize		size;		/* length of the header with the empty line, once done */
+
+  DSParserSpan	request_line;
+  DSParserSpan	method;
+  DSParserSpan	target;
+  DSParserSpan	version;
+
+  DSParserHeader headers[PARSER_MAX_HEADERS];
+  guint		headers_numb;
+};
+
+DSParserStatus	parser_parse		(DSParser *	parser,
+					 gchar *	buf,
+					 gsize		len);
+
+gchar *		parser_find		(gchar *	buf,
+					 gsize		len,
+					 gchar		c);
+
+gboolean	parser_span_equal	(const gchar *	buf,
+					 DSParserSpan *	span,
+					 const gchar *	str,
+					 gsize		str_len);
+
+gboolean	parser_span_equal_nocase
+					(const gchar *	buf,
+					 DSParserSpan *	span,
+					 const gchar *	str,
+					 gsize		str_len);
+
+#endif
+/* EOF */
@@ -5,7 +5,10 @@
 #include "dupin.h"
 #include "dupin_internal.h"
 
+#include "executor.h"
 #include "map.h"
+#include "cache.h"
+#include "stats.h"
 #include "request.h"
 
 #include "../tbjsonpath/tb_jsonpath.h"
@@ -46,16 +49,74 @@ static gboolean request_record_response (DSHttpdClient * client,
 					 GList * response_list,
 			 		 gboolean is_bulk);
 
+/* NOTE - the routers name the handler a request is accounted under in /_stats */
+#define REQUEST_HANDLER(client, func) \
+  ((client)->request_handler = G_STRINGIFY (func), (func))
+
 /* WWW FUNCTION *************************************************************/
+static DSHttpStatusCode
+request_www_map (DSHttpdClient * client, DSMap * map)
+{
+  client->output_last_modified = map->last_modified;
+  client->output_etag_len = strlen (map->etag);
+  client->output_etag = g_strndup (map->etag, client->output_etag_len);
+
+  /* Has the file changed ? */
+  gboolean file_is_changed = TRUE;
+  if (client->input_if_none_match != NULL)
+    file_is_changed = dupin_util_http_if_none_match (client->input_if_none_match, map->etag);
+  else if (client->input_if_modified_since != NULL)
+    file_is_changed = dupin_util_http_if_modified_since (client->input_if_modified_since, map->last_modified);
+
+  if (file_is_changed == FALSE)
+    {
+      map_unref (client->thread->data, map);
+      return HTTP_STATUS_304;
+    }
+
+  client->output_type = DS_HTTPD_OUTPUT_MAP;
+
+  client->output.map.contents = g_mapped_file_get_contents (map->map);
+  client->output_size = map->size;
+  client->output_mime = g_strdup (map->mime);
+  client->output.map.map = map;
+
+  return HTTP_STATUS_200;
+}
+
 static DSHttpStatusCode
 request_www (DSHttpdClient * client,
 	     GList * paths,
 	     GList * arguments)
 {
   gchar *path = NULL;
+  GString *key;
+  GList *list;
   struct stat st;
   DSMap *map;
 
+  /* NOTE - a cached file is found by the requested path, without any stat() */
+
+  key = g_string_new (DS_WWW_PATH);
+
+  for (list = paths; list; list = list->next)
+    {
+      if (!g_strcmp0 (list->data, ".."))
+	{
+          request_set_error (client, "www path is not '..'");
+	  g_string_free (key, TRUE);
+	  return HTTP_STATUS_403;
+	}
+
+      g_string_append_printf (key, "%s%s", G_DIR_SEPARATOR_S, (gchar *) list->data);
+    }
+
+  if ((map = map_find (client->thread->data, key->str)))
+    {
+      g_string_free (key, TRUE);
+      return request_www_map (client, map);
+    }
+
   if (!paths)
     {
       path =
@@ -66,6 +127,7 @@ request_www (DSHttpdClient * client,
 	{
           request_set_error (client, "www path does not exist or is invalid");
 	  g_free (path);
+	  g_string_free (key, TRUE);
 	  return HTTP_STATUS_403;
 	}
     }
@@ -76,14 +138,6 @@ request_www (DSHttpdClient * client,
 
       for (; paths; paths = paths->next)
 	{
-	  if (!g_strcmp0 (paths->data, ".."))
-	    {
-              request_set_error (client, "www path is not '..'");
-	      if (path)
-		g_free (path);
-	      return HTTP_STATUS_403;
-	    }
-
 	  if (!path)
 	    newpath =
 	      g_build_path (G_DIR_SEPARATOR_S, DS_WWW_PATH, paths->data,
@@ -99,6 +153,7 @@ request_www (DSHttpdClient * client,
 	    {
               request_set_error (client, "www path does not exist");
 	      g_free (newpath);
+	      g_string_free (key, TRUE);
 	      return HTTP_STATUS_403;
 	    }
 
@@ -111,11 +166,12 @@ request_www (DSHttpdClient * client,
 	    g_build_path (G_DIR_SEPARATOR_S, path, HTTP_INDEX_HTML, NULL);
 	  g_free (path);
 
-	  if (g_file_test (path, G_FILE_TEST_EXISTS | G_FILE_TEST_IS_REGULAR)
+	  if (g_file_test (newpath, G_FILE_TEST_EXISTS | G_FILE_TEST_IS_REGULAR)
 	      == FALSE)
 	    {
               request_set_error (client, "www path does not exist or is invalid");
 	      g_free (newpath);
+	      g_string_free (key, TRUE);
 	      return HTTP_STATUS_403;
 	    }
 
@@ -127,18 +183,18 @@ request_www (DSHttpdClient * client,
     {
       request_set_error (client, "www path does match");
       g_free (path);
+      g_string_free (key, TRUE);
       return HTTP_STATUS_403;
     }
 
   /* Try with a map: */
-  if ((map = map_find (client->thread->data, path, st.st_mtime)))
-    {
-      client->output_type = DS_HTTPD_OUTPUT_MAP;
+  map = map_add (client->thread->data, key->str, path, &st);
+  g_string_free (key, TRUE);
 
-      client->output.map.contents = g_mapped_file_get_contents (map->map);
-      client->output_size = g_mapped_file_get_length (map->map);
-      client->output_mime = g_strdup (map->mime);
-      client->output.map.map = map;
+  if (map != NULL)
+    {
+      g_free (path);
+      return request_www_map (client, map);
     }
 
   else
@@ -184,6 +240,80 @@ request_quit (DSHttpdClient * client,
 }
 
 /* STATUS FUNCTION *********************************************************/
+
+/* Lock contention and I/O of every store, to find the hot ones: */
+static JsonObject *
+request_status_stores (Dupin * d)
+{
+  JsonObject *stores, *dbs, *linkbs, *views;
+  gchar **names;
+  gint i;
+
+  stores = json_object_new ();
+
+  dbs = json_object_new ();
+
+  if ((names = dupin_get_databases (d)))
+    {
+      for (i = 0; names[i]; i++)
+	{
+	  DupinDB *db;
+
+	  if ((db = dupin_database_open (d, names[i], NULL)))
+	    {
+	      json_object_set_member (dbs, names[i], dupin_database_get_stats (db));
+	      dupin_database_unref (db);
+	    }
+	}
+
+      g_strfreev (names);
+    }
+
+  json_object_set_object_member (stores, "databases", dbs);
+
+  linkbs = json_object_new ();
+
+  if ((names = dupin_get_linkbases (d)))
+    {
+      for (i = 0; names[i]; i++)
+	{
+	  DupinLinkB *linkb;
+
+	  if ((linkb = dupin_linkbase_open (d, names[i], NULL)))
+	    {
+	      json_object_set_member (linkbs, names[i], dupin_linkbase_get_stats (linkb));
+	      dupin_linkbase_unref (linkb);
+	    }
+	}
+
+      g_strfreev (names);
+    }
+
+  json_object_set_object_member (stores, "linkbases", linkbs);
+
+  views = json_object_new ();
+
+  if ((names = dupin_get_views (d)))
+    {
+      for (i = 0; names[i]; i++)
+	{
+	  DupinView *view;
+
+	  if ((view = dupin_view_open (d, names[i], NULL)))
+	    {
+	      json_object_set_member (views, names[i], dupin_view_get_stats (view));
+	      dupin_view_unref (view);
+	    }
+	}
+
+      g_strfreev (names);
+    }
+
+  json_object_set_object_member (stores, "views", views);
+
+  return stores;
+}
+
 static DSHttpStatusCode
 request_status (DSHttpdClient * client,
 		GList * paths,
@@ -258,10 +388,14 @@ request_status (DSHttpdClient * client,
   json_object_set_object_member (obj, "thisTimeVal", nobj2 );
 
   /* Number of threads: */
-  json_object_set_int_member (obj, "threads", client->thread->data->httpd_threads_numb);
+  json_object_set_int_member (obj, "threads", g_atomic_int_get ((gint *) &client->thread->data->httpd_threads_numb));
 
   /* Number of clients: */
-  json_object_set_int_member (obj, "clients", client->thread->data->httpd_clients_numb);
+  json_object_set_int_member (obj, "clients", g_atomic_int_get ((gint *) &client->thread->data->httpd_clients_numb));
+
+  /* Executor threads and requests waiting for one: */
+  json_object_set_int_member (obj, "executorThreads", executor_threads (client->thread->data->httpd_executor));
+  json_object_set_int_member (obj, "queuedRequests", executor_unprocessed (client->thread->data->httpd_executor));
 
   /* Limit obj: */
   nobj3 = json_object_new ();
@@ -307,11 +441,17 @@ request_status (DSHttpdClient * client,
   /* listen: */
   json_object_set_int_member (nobj4, "listen", client->thread->data->httpd_listen);
 
+  /* acceptors: */
+  json_object_set_int_member (nobj4, "acceptors", client->thread->data->httpd_acceptors);
+
   /* ipv6: */
   json_object_set_boolean_member (nobj4, "ipv6", client->thread->data->httpd_ipv6);
 
   json_object_set_object_member (obj, "httpd", nobj4 );
 
+  /* Stores: */
+  json_object_set_object_member (obj, "stores", request_status_stores (client->thread->data->dupin));
+
   /* Serialize: */
   client->output_type = DS_HTTPD_OUTPUT_STRING;
 
@@ -476,39 +616,41 @@ request_global_get (DSHttpdClient * client,
 	 	    GList * arguments)
 {
   if (!path)
-    return request_global_get_server_info (client, path, arguments);
+    return REQUEST_HANDLER (client, request_global_get_server_info) (client, path, arguments);
 
   /* GET /_all_dbs */
   if (!g_strcmp0 (path->data, REQUEST_ALL_DBS))
-    return request_global_get_all_dbs (client, path, arguments);
+    return REQUEST_HANDLER (client, request_global_get_all_dbs) (client, path, arguments);
 
   /* GET /_all_linkbs */
   if (!g_strcmp0 (path->data, REQUEST_ALL_LINKBS))
-    return request_global_get_all_linkbs (client, path, arguments);
+    return REQUEST_HANDLER (client, request_global_get_all_linkbs) (client, path, arguments);
 
   /* GET /_all_attachment_dbs */
   if (!g_strcmp0 (path->data, REQUEST_ALL_ATTACH_DBS))
-    return request_global_get_all_attachment_dbs (client, path, arguments);
+    return REQUEST_HANDLER (client, request_global_get_all_attachment_dbs) (client, path, arguments);
 
   /* GET /_all_views */
   if (!g_strcmp0 (path->data, REQUEST_ALL_VIEWS))
-    return request_global_get_all_views (client, path, arguments);
+    return REQUEST_HANDLER (client, request_global_get_all_views) (client, path, arguments);
 
   /* GET /_uuids */
   if (!g_strcmp0 (path->data, REQUEST_UUIDS))
-    return request_global_get_uuids (client, path, arguments);
+    return REQUEST_HANDLER (client, request_global_get_uuids) (client, path, arguments);
 
   /* GET /database */
   if (!path->next)
-    return request_global_get_database (client, path, arguments);
+    return REQUEST_HANDLER (client, request_global_get_database) (client, path, arguments);
 
   /* GET /database/_changes */
   if (!path->next->next && !g_strcmp0 (path->next->data, REQUEST_ALL_CHANGES))
-    return request_global_get_changes_database (client, path, arguments);
+    return REQUEST_HANDLER (client, request_global_get_changes_database) (client, path, arguments);
 
   /* GET /database/_all_docs */
   if (!path->next->next && !g_strcmp0 (path->next->data, REQUEST_ALL_DOCS))
-    return request_global_get_all_docs (client, path, arguments);
+    return request_global_get_cached (client, path, arguments,
+				      request_version_database (client, path->data),
+				      REQUEST_HANDLER (client, request_global_get_all_docs));
 
   if (!g_strcmp0 (path->next->data, REQUEST_PORTABLE_LISTINGS))
     {
@@ -517,18 +659,18 @@ request_global_get (DSHttpdClient * client,
           if (path->next->next->next)
             {
               /* GET /database/_portable_listings/id/relationship */
-              return request_global_get_portable_listings_record_relationship (client, path, arguments);
+              return REQUEST_HANDLER (client, request_global_get_portable_listings_record_relationship) (client, path, arguments);
 	    }
 	  else
 	    {
               /* GET /database/_portable_listings/id */
-              return request_global_get_portable_listings_record (client, path, arguments);
+              return REQUEST_HANDLER (client, request_global_get_portable_listings_record) (client, path, arguments);
 	    }
 	}
       else
 	{
           /* GET /database/_portable_listings */
-          return request_global_get_portable_listings (client, path, arguments);
+          return REQUEST_HANDLER (client, request_global_get_portable_listings) (client, path, arguments);
 	}
     }
 
@@ -536,18 +678,20 @@ request_global_get (DSHttpdClient * client,
     {
       /* GET /_linkbs/linkbase */
       if (!path->next->next)
-	return request_global_get_linkbase (client, path->next, arguments);
+	return REQUEST_HANDLER (client, request_global_get_linkbase) (client, path->next, arguments);
 
       /* GET /_linkbs/linkbase/_all_docs */
       if (!g_strcmp0 (path->next->next->data, REQUEST_ALL_LINKS))
-        return request_global_get_all_docs_linkbase (client, path->next, arguments);
+        return request_global_get_cached (client, path->next, arguments,
+					  request_version_linkbase (client, path->next->data),
+					  REQUEST_HANDLER (client, request_global_get_all_docs_linkbase));
 
       /* GET /_linkbs/linkbase/_changes */
       if (!g_strcmp0 (path->next->next->data, REQUEST_ALL_CHANGES))
-        return request_global_get_changes_linkbase (client, path->next, arguments);
+        return REQUEST_HANDLER (client, request_global_get_changes_linkbase) (client, path->next, arguments);
 
       /* GET /_linkbs/linkbase/id */
-      return request_global_get_record_linkbase (client, path->next, arguments);
+      return REQUEST_HANDLER (client, request_global_get_record_linkbase) (client, path->next, arguments);
 
       request_set_error (client, "Linkbases GET allowed commands: /_linkbs/linkbase, /_linkbs/linkbase/_all_docs, /_linkbs/linkbase/_changes or /_linkbs/linkbase/id");
 
@@ -558,20 +702,22 @@ request_global_get (DSHttpdClient * client,
     {
       /* GET /_views/view */
       if (!path->next->next)
-	return request_global_get_view (client, path, arguments);
+	return REQUEST_HANDLER (client, request_global_get_view) (client, path, arguments);
 
       else if (!path->next->next->next)
 	{
 	  /* GET /_views/view/_all_docs */
 	  if (!g_strcmp0 (path->next->next->data, REQUEST_ALL_DOCS))
-	    return request_global_get_all_docs_view (client, path, arguments);
+	    return request_global_get_cached (client, path, arguments,
+					      request_version_view (client, path->next->data),
+					      REQUEST_HANDLER (client, request_global_get_all_docs_view));
 
 	  /* GET /_views/view/_sync */
 	  if (!g_strcmp0 (path->next->next->data, REQUEST_SYNC))
-	    return request_global_view_sync (client, path, arguments);
+	    return REQUEST_HANDLER (client, request_global_view_sync) (client, path, arguments);
 
 	  /* GET /_views/view/id */
-	  return request_global_get_record_view (client, path, arguments);
+	  return REQUEST_HANDLER (client, request_global_get_record_view) (client, path, arguments);
 	}
 
       request_set_error (client, "Views GET allowed commands: /_views/view/_all_docs, /_views/view/_sync or /_views/view/id");
@@ -580,7 +726,7 @@ request_global_get (DSHttpdClient * client,
     }
 
   /* GET /database/id */
-  return request_global_get_record (client, path, arguments);
+  return REQUEST_HANDLER (client, request_global_get_record) (client, path, arguments);
 
   request_set_error (client, "Record GET allowed commands: /database/id");
 
@@ -1267,6 +1413,179 @@ request_global_get_changes_database_error:
   return HTTP_STATUS_500;
 }
 
+/* CACHED LISTS ************************************************************/
+
+/* NOTE - the version of a listing is made of the update sequences of the store and of
+          the stores its documents and links can come from; it is taken before running
+          the query so a change happened meanwhile never leaves a stale entry behind */
+
+static gchar *
+request_version_database (DSHttpdClient * client, gchar * name)
+{
+  DupinDB *db;
+  DupinLinkB *linkb;
+  gchar *version;
+
+  if (!(db = dupin_database_open (client->thread->data->dupin, name, NULL)))
+    return NULL;
+
+  linkb = dupin_database_get_default_linkbase (db);
+
+  version = g_strdup_printf ("%x.%x", dupin_database_get_update_seq (db),
+			     linkb ? dupin_linkbase_get_update_seq (linkb) : 0);
+
+  dupin_database_unref (db);
+
+  return version;
+}
+
+static gchar *
+request_version_linkbase (DSHttpdClient * client, gchar * name)
+{
+  DupinLinkB *linkb;
+  gchar *parent = NULL;
+  gchar *version;
+
+  if (!(linkb = dupin_linkbase_open (client->thread->data->dupin, name, NULL)))
+    return NULL;
+
+  if (dupin_linkbase_get_parent_is_db (linkb) == TRUE)
+    parent = request_version_database (client, dupin_linkbase_get_parent (linkb));
+
+  version = g_strdup_printf ("%x.%s", dupin_linkbase_get_update_seq (linkb),
+			     parent ? parent : "");
+
+  if (parent)
+    g_free (parent);
+
+  dupin_linkbase_unref (linkb);
+
+  return version;
+}
+
+static gchar *
+request_version_view (DSHttpdClient * client, gchar * name)
+{
+  DupinView *view;
+  DupinView *parent_view;
+  gchar *parent = NULL;
+  gchar *version;
+
+  if (!(view = dupin_view_open (client->thread->data->dupin, name, NULL)))
+    return NULL;
+
+  if (dupin_view_get_parent_is_db (view) == TRUE)
+    parent = request_version_database (client, (gchar *) dupin_view_get_parent (view));
+
+  else if (dupin_view_get_parent_is_linkb (view) == TRUE)
+    parent = request_version_linkbase (client, (gchar *) dupin_view_get_parent (view));
+
+  else if ((parent_view = dupin_view_open (client->thread->data->dupin,
+					   (gchar *) dupin_view_get_parent (view), NULL)))
+    {
+      parent = g_strdup_printf ("%x", dupin_view_get_update_seq (parent_view));
+      dupin_view_unref (parent_view);
+    }
+
+  version = g_strdup_printf ("%x.%s", dupin_view_get_update_seq (view),
+			     parent ? parent : "");
+
+  if (parent)
+    g_free (parent);
+
+  dupin_view_unref (view);
+
+  return version;
+}
+
+static gchar *
+request_version_etag (gchar * key, gchar * version)
+{
+  gchar *str = g_strconcat (key, " ", version, NULL);
+  gchar *etag = g_compute_checksum_for_string (DUPIN_ID_HASH_ALGO, str, -1);
+
+  g_free (str);
+
+  return etag;
+}
+
+/* The ETag of a listing is the digest of the request and of its version, so a
+   conditional GET is answered before touching the database; func runs only if
+   the cached response of the same request is older than version: */
+static DSHttpStatusCode
+request_global_get_cached (DSHttpdClient * client,
+			   GList * path,
+			   GList * arguments,
+			   gchar * version,
+			   DSHttpStatusCode (*func) (DSHttpdClient *, GList *, GList *))
+{
+  DSGlobal *data = client->thread->data;
+  DSHttpStatusCode code;
+  gchar *key;
+  gchar *etag;
+  gchar *body;
+  gsize size;
+
+  if (version == NULL)
+    return func (client, path, arguments);
+
+  key = cache_key (client);
+
+  /* ETag */
+  etag = request_version_etag (key, version);
+
+  if (dupin_util_http_if_none_match (client->input_if_none_match, etag) == FALSE)
+    {
+      client->output_etag = etag;
+      client->output_etag_len = strlen (etag);
+
+      g_free (key);
+      g_free (version);
+
+      return HTTP_STATUS_304;
+    }
+
+  g_free (etag);
+
+  if (cache_find (data, key, version, &etag, &body, &size) == TRUE)
+    {
+      client->output_etag = etag;
+      client->output_etag_len = strlen (etag);
+
+      client->output_mime = g_strdup (HTTP_MIME_JSON);
+      client->output_type = DS_HTTPD_OUTPUT_STRING;
+      client->output.string.string = body;
+      client->output_size = size;
+
+      g_free (key);
+      g_free (version);
+
+      return HTTP_STATUS_200;
+    }
+
+  code = func (client, path, arguments);
+
+  if (code == HTTP_STATUS_200 || code == HTTP_STATUS_304)
+    {
+      if (client->output_etag)
+	g_free (client->output_etag);
+
+      client->output_etag = request_version_etag (key, version);
+      client->output_etag_len = strlen (client->output_etag);
+    }
+
+  if (code == HTTP_STATUS_200
+      && client->output_type == DS_HTTPD_OUTPUT_STRING
+      && client->output.string.string != NULL)
+    cache_add (data, key, version, client->output_etag,
+	       client->output.string.string, client->output_size);
+
+  g_free (key);
+  g_free (version);
+
+  return code;
+}
+
 static DSHttpStatusCode
 request_global_get_all_docs (DSHttpdClient * client,
 			     GList * path,
@@ -1905,6 +2224,8 @@ request_global_get_database (DSHttpdClient * client,
   /* NOTE - Compaction removes old revs, only the latest rev is represented in view queries, and only the latest revision is replicated. */
   json_object_set_boolean_member (obj, "compact_running", dupin_database_is_compacting (db));
 
+  json_object_set_member (obj, "stats", dupin_database_get_stats (db));
+
   client->output.string.string = dupin_util_json_serialize (node);
   client->output_size = strlen(client->output.string.string);
 
@@ -1933,6 +2254,194 @@ request_global_get_database_error:
   return HTTP_STATUS_500;
 }
 
+/* NOTE - parse a "bytes=" Range header against the attachment being sent, see
+          http://tools.ietf.org/html/rfc2616#section-14.35 - returns FALSE if the
+          header is not valid and must be ignored, an empty ranges array means
+          well-formed but not satisfiable */
+
+static gboolean
+request_global_get_record_attachment_ranges_parse (gchar * header,
+						   gsize length,
+						   GArray * ranges)
+{
+  gchar ** specs;
+  gint i;
+  gint specs_numb = 0;
+
+  while (header[0] == ' ' || header[0] == '\t')
+    header++;
+
+  if (g_ascii_strncasecmp (header, "bytes=", 6))
+    return FALSE;
+
+  specs = g_strsplit (header + 6, ",", -1);
+
+  for (i = 0; specs[i] != NULL; i++)
+    {
+      DSHttpdRange range;
+      gchar * spec = g_strstrip (specs[i]);
+      gchar * dash = strchr (spec, '-');
+      gchar * end = NULL;
+
+      memset (&range, 0, sizeof (DSHttpdRange));
+
+      if (spec[0] == '\0')
+        continue;
+
+      if (dash == NULL || ++specs_numb > HTTP_RANGES_MAX)
+        {
+          g_strfreev (specs);
+          return FALSE;
+        }
+
+      /* Suffix range "-N" means the last N bytes */
+      if (dash == spec)
+        {
+          guint64 suffix = g_ascii_strtoull (dash + 1, &end, 10);
+
+          if (!g_ascii_isdigit (dash[1]) || *end != '\0')
+            {
+              g_strfreev (specs);
+              return FALSE;
+            }
+
+          if (suffix == 0 || length == 0)
+            continue;
+
+          range.start = (suffix >= length) ? 0 : length - suffix;
+          range.end = length - 1;
+        }
+      else
+        {
+          guint64 first = g_ascii_strtoull (spec, &end, 10);
+          guint64 last = length - 1;
+
+          if (!g_ascii_isdigit (spec[0]) || end != dash)
+            {
+              g_strfreev (specs);
+              return FALSE;
+            }
+
+          if (dash[1] != '\0')
+            {
+              last = g_ascii_strtoull (dash + 1, &end, 10);
+
+              if (!g_ascii_isdigit (dash[1]) || *end != '\0' || last < first)
+                {
+                  g_strfreev (specs);
+                  return FALSE;
+                }
+
+              if (last >= length)
+                last = length - 1;
+            }
+
+          /* Not satisfiable */
+          if (first >= length)
+            continue;
+
+          range.start = first;
+          range.end = last;
+        }
+
+      g_array_append_val (ranges, range);
+    }
+
+  g_strfreev (specs);
+
+  /* "bytes=" or only empty specs */
+  if (specs_numb == 0)
+    return FALSE;
+
+  return TRUE;
+}
+
+static DSHttpStatusCode
+request_global_get_record_attachment_ranges (DSHttpdClient * client)
+{
+  GArray * ranges;
+  gsize length = dupin_attachment_record_get_length (client->output.blob.record);
+  guint i;
+
+  ranges = g_array_new (FALSE, TRUE, sizeof (DSHttpdRange));
+
+  if (request_global_get_record_attachment_ranges_parse (client->input_range, length, ranges) == FALSE)
+    {
+      g_array_free (ranges, TRUE);
+      return HTTP_STATUS_200;
+    }
+
+  if (ranges->len == 0)
+    {
+      g_array_free (ranges, TRUE);
+
+      client->output_content_range = g_strdup_printf ("bytes */%" G_GSIZE_FORMAT, length);
+
+      dupin_attachment_record_blob_close (client->output.blob.record);
+      dupin_attachment_record_close (client->output.blob.record);
+      memset (&client->output, 0, sizeof (client->output));
+
+      g_free (client->output_mime);
+      client->output_mime = NULL;
+      client->output_type = DS_HTTPD_OUTPUT_NONE;
+
+      request_set_error (client, "Requested range not satisfiable");
+      return HTTP_STATUS_416;
+    }
+
+  client->output.blob.ranges_numb = ranges->len;
+  client->output.blob.ranges_current = 0;
+  client->output.blob.ranges = (DSHttpdRange *) g_array_free (ranges, FALSE);
+
+  if (client->output.blob.ranges_numb == 1)
+    {
+      DSHttpdRange * range = &client->output.blob.ranges[0];
+
+      client->output_content_range = g_strdup_printf ("bytes %" G_GSIZE_FORMAT "-%" G_GSIZE_FORMAT "/%" G_GSIZE_FORMAT,
+						      range->start, range->end, length);
+      client->output_size = range->end - range->start + 1;
+    }
+
+  /* NOTE - multipart/byteranges body, see http://tools.ietf.org/html/rfc2616#section-19.2 */
+
+  else
+    {
+      gchar * boundary = g_strdup_printf ("%08x%08x", g_random_int (), g_random_int ());
+
+      client->output_size = 0;
+
+      for (i = 0; i < client->output.blob.ranges_numb; i++)
+        {
+          DSHttpdRange * range = &client->output.blob.ranges[i];
+
+          range->part = g_strdup_printf ("\r\n--%s\r\n%s: %s\r\n%s: bytes %" G_GSIZE_FORMAT "-%" G_GSIZE_FORMAT "/%" G_GSIZE_FORMAT "\r\n\r\n",
+					 boundary,
+					 HTTP_CONTENT_TYPE, client->output_mime,
+					 HTTP_CONTENT_RANGE, range->start, range->end, length);
+          range->part_size = strlen (range->part);
+
+          client->output_size += range->part_size + (range->end - range->start + 1);
+        }
+
+      client->output.blob.trailer = g_strdup_printf ("\r\n--%s--\r\n", boundary);
+      client->output.blob.trailer_size = strlen (client->output.blob.trailer);
+      client->output_size += client->output.blob.trailer_size;
+
+      client->output.blob.part = client->output.blob.ranges[0].part;
+      client->output.blob.part_size = client->output.blob.ranges[0].part_size;
+
+      g_free (client->output_mime);
+      client->output_mime = g_strdup_printf ("multipart/byteranges; boundary=%s", boundary);
+
+      g_free (boundary);
+    }
+
+  client->output.blob.offset = client->output.blob.ranges[0].start;
+  client->output.blob.offset_end = client->output.blob.ranges[0].end + 1;
+
+  return HTTP_STATUS_206;
+}
+
 static DSHttpStatusCode
 request_global_get_record (DSHttpdClient * client,
 			   GList * path,
@@ -2332,6 +2841,7 @@ request_global_get_record (DSHttpdClient * client,
           client->output_type = DS_HTTPD_OUTPUT_BLOB;
           client->output_mime = g_strdup (dupin_attachment_record_get_type (client->output.blob.record));
           client->output_size = dupin_attachment_record_get_length (client->output.blob.record);
+          client->output.blob.offset_end = client->output_size;
 
           /* Last-Modified */
           client->output_last_modified = dupin_record_get_created (record);
@@ -2348,10 +2858,16 @@ request_global_get_record (DSHttpdClient * client,
 
           g_free (doc_id);
 
-          if (record_is_changed == TRUE)
-            return HTTP_STATUS_200;
-          else
+          if (record_is_changed == FALSE)
             return HTTP_STATUS_304;
+
+          /* Partial GET */
+          if (client->input_range != NULL
+              && client->request == DS_HTTPD_REQUEST_GET
+              && dupin_util_http_if_range (client->input_if_range, client->output_etag, client->output_last_modified) == TRUE)
+            return request_global_get_record_attachment_ranges (client);
+
+          return HTTP_STATUS_200;
         }
 
       JsonNode *node_temp=NULL;
@@ -2601,6 +3117,8 @@ request_global_get_linkbase (DSHttpdClient * client,
   json_object_set_boolean_member (obj, "compact_running", dupin_linkbase_is_compacting (linkb));
   json_object_set_boolean_member (obj, "check_running", dupin_linkbase_is_checking (linkb));
 
+  json_object_set_member (obj, "stats", dupin_linkbase_get_stats (linkb));
+
   client->output.string.string = dupin_util_json_serialize (node);
   client->output_size = strlen(client->output.string.string);
 
@@ -4045,6 +4563,8 @@ request_global_get_view (DSHttpdClient * client,
 
   json_object_set_boolean_member (obj, "compact_running", dupin_view_is_compacting (view));
 
+  json_object_set_member (obj, "stats", dupin_view_get_stats (view));
+
   /* Writing: */
 
   client->output.string.string = dupin_util_json_serialize (node);
@@ -5437,19 +5957,19 @@ request_global_post (DSHttpdClient * client,
         {
           /* POST /_linkbs/linkbase/_compact */
 	  if (!g_strcmp0 (path->next->next->data, REQUEST_POST_COMPACT_LINKBASE))
-            return request_global_post_compact_linkbase (client, path->next, arguments);
+            return REQUEST_HANDLER (client, request_global_post_compact_linkbase) (client, path->next, arguments);
 
           /* POST /_linkbs/linkbase/_check */
           if (!g_strcmp0 (path->next->next->data, REQUEST_POST_CHECK_LINKBASE))
-            return request_global_post_check_linkbase (client, path->next, arguments);
+            return REQUEST_HANDLER (client, request_global_post_check_linkbase) (client, path->next, arguments);
 
           /* POST /_linkbs/linkbase/_all_docs */
           if (!g_strcmp0 (path->next->next->data, REQUEST_POST_ALL_LINKS))
-            return request_global_post_all_docs_linkbase (client, path->next, arguments);
+            return REQUEST_HANDLER (client, request_global_post_all_docs_linkbase) (client, path->next, arguments);
 
           /* POST /_linkbs/linkbase/_bulk_docs */
           if (!g_strcmp0 (path->next->next->data, REQUEST_POST_BULK_DOCS))
-            return request_global_post_bulk_links (client, path->next, arguments);
+            return REQUEST_HANDLER (client, request_global_post_bulk_links) (client, path->next, arguments);
         }
 
       request_set_error (client, "POST /_linkbs allowed commands are: /_linkbs/linkbase/_all_docs, /_linkbs/linkbase/_bulk_docs, /_linkbs/linkbase/_compact and /_linkbs/linkbase/_check");
@@ -5463,11 +5983,11 @@ request_global_post (DSHttpdClient * client,
         {
           /* POST /_views/view/_compact */
 	  if (!g_strcmp0 (path->next->next->data, REQUEST_POST_COMPACT_VIEW))
-            return request_global_post_compact_view (client, path->next, arguments);
+            return REQUEST_HANDLER (client, request_global_post_compact_view) (client, path->next, arguments);
 
           /* POST /_views/view/_all_docs */
           if (!g_strcmp0 (path->next->next->data, REQUEST_POST_ALL_DOCS))
-            return request_global_post_all_docs_view (client, path, arguments);
+            return REQUEST_HANDLER (client, request_global_post_all_docs_view) (client, path, arguments);
         }
 
       request_set_error (client, "POST /_views allowed commands are: /_views/view/_all_docs and /_views/view/_compact");
@@ -5477,42 +5997,42 @@ request_global_post (DSHttpdClient * client,
 
   /* POST /database */
   if (!path->next)
-    return request_global_post_record (client, path, arguments);
+    return REQUEST_HANDLER (client, request_global_post_record) (client, path, arguments);
 
   /* POST /database/_bulk_docs */
   if (!g_strcmp0 (path->next->data, REQUEST_POST_BULK_DOCS) && !path->next->next)
-    return request_global_post_bulk_docs (client, path, arguments);
+    return REQUEST_HANDLER (client, request_global_post_bulk_docs) (client, path, arguments);
 
   /* POST /database/_all_docs */
   if (!path->next->next && !g_strcmp0 (path->next->data, REQUEST_POST_ALL_DOCS))
-    return request_global_post_all_docs (client, path, arguments);
+    return REQUEST_HANDLER (client, request_global_post_all_docs) (client, path, arguments);
 
   /* POST /database/_compact */
   if (!g_strcmp0 (path->next->data, REQUEST_POST_COMPACT_DATABASE) && !path->next->next)
-    return request_global_post_compact_database (client, path, arguments);
+    return REQUEST_HANDLER (client, request_global_post_compact_database) (client, path, arguments);
 
   /* POST /database/doc_id/_links */
   if (path->next
       && path->next->next && !g_strcmp0 (path->next->next->data, REQUEST_OBJ_LINKS)
       && !path->next->next->next)
-    return request_global_post_doc_link (client, path, arguments, DP_LINK_TYPE_WEB_LINK);
+    return REQUEST_HANDLER (client, request_global_post_doc_link) (client, path, arguments, DP_LINK_TYPE_WEB_LINK);
 
   /* POST /database/doc_id/_relationships */
   if (path->next
       && path->next->next && !g_strcmp0 (path->next->next->data, REQUEST_OBJ_RELATIONSHIPS)
       && !path->next->next->next)
-    return request_global_post_doc_link (client, path, arguments, DP_LINK_TYPE_RELATIONSHIP);
+    return REQUEST_HANDLER (client, request_global_post_doc_link) (client, path, arguments, DP_LINK_TYPE_RELATIONSHIP);
 
   /* POST /database/doc_id */
   if (path->next
       && !path->next->next )
-    return request_global_post_doc_link (client, path, arguments, DP_LINK_TYPE_ANY);
+    return REQUEST_HANDLER (client, request_global_post_doc_link) (client, path, arguments, DP_LINK_TYPE_ANY);
 
   /* POST /database/doc_id/_bulk_links */
   if (path->next
       && path->next->next && !g_strcmp0 (path->next->next->data, REQUEST_POST_BULK_LINKS)
       && !path->next->next->next)
-    return request_global_post_bulk_doc_links (client, path, arguments);
+    return REQUEST_HANDLER (client, request_global_post_bulk_doc_links) (client, path, arguments);
 
   request_set_error (client, "POST /database allowed commands are: /database, /database/_bulk_docs, /database/_all_docs, /database/_compact, /database/doc_id, /database/doc_id/_bulk_links, /database/doc_id/_links, /database/doc_id/_relationships");
 
@@ -6588,7 +7108,7 @@ request_global_put (DSHttpdClient * client,
     {
       /* PUT /_linkbs/linkbase/id */
       if (path->next && path->next->next)
-	return request_global_put_link_record (client, path->next, arguments);
+	return REQUEST_HANDLER (client, request_global_put_link_record) (client, path->next, arguments);
 
       request_set_error (client, "PUT /_linkbs allowed commands: /_linkbs/linkbase/id");
 
@@ -6599,7 +7119,7 @@ request_global_put (DSHttpdClient * client,
     {
       /* PUT /_views/view */
       if (path->next && !path->next->next)
-	return request_global_put_view (client, path, arguments);
+	return REQUEST_HANDLER (client, request_global_put_view) (client, path, arguments);
 
       request_set_error (client, "PUT /_views allowed commands: /_views/view");
 
@@ -6609,12 +7129,12 @@ request_global_put (DSHttpdClient * client,
   /* PUT /database */
   if (!path->next)
     {
-      return request_global_put_database (client, path, arguments);
+      return REQUEST_HANDLER (client, request_global_put_database) (client, path, arguments);
     }
   else
     {
       /* PUT /document_ID */
-      return request_global_put_record (client, path, arguments);
+      return REQUEST_HANDLER (client, request_global_put_record) (client, path, arguments);
     }
 }
 
@@ -6855,7 +7375,7 @@ request_global_put_record (DSHttpdClient * client,
   GList * l=NULL;
   gboolean res;
  
-  if (!client->body
+  if ((!client->body && !client->input_upload)
       || !path->next->data)
     {
       request_set_error (client, "Missing or invalid PUT body");
@@ -7273,6 +7793,31 @@ request_global_put_link_record_end:
   return code;
 }
 
+/* NOTE - tells the httpd, before the body is read, if the request is routed to
+          request_global_put_record_attachment () and its body can be spooled */
+
+gboolean
+request_is_attachment_upload (DSHttpdClient * client)
+{
+  GList * path = client->request_path;
+
+  if (client->request != DS_HTTPD_REQUEST_PUT
+      || !path
+      || !path->next
+      || !path->next->next
+      || !g_strcmp0 (path->data, REQUEST_LINKBS)
+      || !g_strcmp0 (path->data, REQUEST_VIEWS))
+    return FALSE;
+
+  /* PUT _special_document/document_ID/attachment */
+  if (g_utf8_get_char (path->next->data) == '_')
+    return (path->next->next->next
+            && g_strcmp0 (path->next->next->next->data, REQUEST_FIELDS)) ? TRUE : FALSE;
+
+  /* PUT /document_ID/attachment */
+  return g_strcmp0 (path->next->next->data, REQUEST_FIELDS) ? TRUE : FALSE;
+}
+
 static DSHttpStatusCode
 request_global_put_record_attachment (DSHttpdClient * client,
 				      GList * path,
@@ -7287,7 +7832,7 @@ request_global_put_record_attachment (DSHttpdClient * client,
   GList * l=NULL;
   GError *error = NULL;
 
-  if (!client->body
+  if ((!client->body && !client->input_upload)
       || !client->input_mime
       || !path->next->data
       || !path->next->next)
@@ -7354,9 +7899,14 @@ request_global_put_record_attachment (DSHttpdClient * client,
 
   const void * client_body_ref = (const void *)client->body;
 
-  if (dupin_attachment_record_insert (dupin_database_get_default_attachment_db (db), doc_id, mvcc, title_parts,
-				      client->body_size, client->input_mime,
-				      &client_body_ref, &response_list, &error) == TRUE)
+  if ((client->input_upload != NULL
+       && dupin_attachment_record_insert_upload (dupin_database_get_default_attachment_db (db), doc_id, mvcc, title_parts,
+						 client->input_mime, client->input_upload,
+						 &response_list, &error) == TRUE)
+      || (client->input_upload == NULL
+          && dupin_attachment_record_insert (dupin_database_get_default_attachment_db (db), doc_id, mvcc, title_parts,
+					     client->body_size, client->input_mime,
+					     &client_body_ref, &response_list, &error) == TRUE))
     {
       if (request_record_response (client, response_list, FALSE) == FALSE)
         {
@@ -7417,7 +7967,7 @@ request_global_delete (DSHttpdClient * client,
     {
       /* DELETE /_linkbs/linkbase/id */
       if (path->next && path->next->next)
-	return request_global_delete_link_record (client, path->next, arguments);
+	return REQUEST_HANDLER (client, request_global_delete_link_record) (client, path->next, arguments);
 
       request_set_error (client, "DELETE /_linkbs allowed commands: /_linkbs/linkbase/id");
 
@@ -7426,13 +7976,13 @@ request_global_delete (DSHttpdClient * client,
 
   /* DELETE /database */
   if (!path->next)
-    return request_global_delete_database (client, path, arguments);
+    return REQUEST_HANDLER (client, request_global_delete_database) (client, path, arguments);
 
   if (!g_strcmp0 (path->data, REQUEST_VIEWS))
     {
       /* DELETE /_views/view */
       if (!path->next->next)
-	return request_global_delete_view (client, path, arguments);
+	return REQUEST_HANDLER (client, request_global_delete_view) (client, path, arguments);
 
       request_set_error (client, "DELETE /_views allowed commands: /_views/view");
 
@@ -7440,7 +7990,7 @@ request_global_delete (DSHttpdClient * client,
     }
 
   /* DELETE /database/id */
-  return request_global_delete_record (client, path, arguments);
+  return REQUEST_HANDLER (client, request_global_delete_record) (client, path, arguments);
 }
 
 static DSHttpStatusCode
@@ -8087,6 +8637,83 @@ request_global_delete_link_record (DSHttpdClient * client,
 
 }
 
+/* STATS FUNCTION **********************************************************/
+static DSHttpStatusCode
+request_stats (DSHttpdClient * client,
+	       GList * paths,
+	       GList * arguments)
+{
+  gboolean prometheus = FALSE;
+  GList *list;
+
+  for (list = arguments; list; list = list->next)
+    {
+      dp_keyvalue_t *kv = list->data;
+
+      if (!g_strcmp0 (kv->key, REQUEST_STATS_FORMAT)
+	  && !g_strcmp0 (kv->value, REQUEST_STATS_FORMAT_PROMETHEUS))
+	prometheus = TRUE;
+    }
+
+  if (prometheus == TRUE)
+    client->output.string.string = stats_prometheus (client->thread->data);
+  else
+    client->output.string.string = stats_json (client->thread->data);
+
+  if (client->output.string.string == NULL)
+    {
+      request_set_error (client, "Cannot return stats");
+      return HTTP_STATUS_500;
+    }
+
+  client->output_type = DS_HTTPD_OUTPUT_STRING;
+  client->output_size = strlen (client->output.string.string);
+  client->output_mime = g_strdup (prometheus == TRUE ? HTTP_MIME_PROMETHEUS : HTTP_MIME_JSON);
+
+  return HTTP_STATUS_200;
+}
+
+/* TRACE FUNCTION **********************************************************/
+
+/* NOTE - GET dumps the recorded spans, PUT clears them and starts tracing, DELETE stops it;
+          the spans carry their arguments, so all of them are local only like _quit */
+
+static DSHttpStatusCode
+request_trace (DSHttpdClient * client,
+	       GList * paths,
+	       GList * arguments)
+{
+  if (g_strcmp0 (client->ip, "127.0.0.1")
+      && g_strcmp0 (client->ip, "localhost"))
+    {
+      request_set_error (client, "Trace command forbidden");
+      return HTTP_STATUS_403;
+    }
+
+  if (client->request == DS_HTTPD_REQUEST_GET)
+    client->output.string.string = dupin_trace_dump ();
+
+  else
+    {
+      if (client->request == DS_HTTPD_REQUEST_PUT)
+	{
+	  dupin_trace_clear ();
+	  dupin_trace_set_enabled (TRUE);
+	}
+      else
+	dupin_trace_set_enabled (FALSE);
+
+      client->output.string.string = g_strdup_printf ("{\"ok\":true,\"enabled\":%s}",
+						      dupin_trace_is_enabled () == TRUE ? "true" : "false");
+    }
+
+  client->output_type = DS_HTTPD_OUTPUT_STRING;
+  client->output_size = strlen (client->output.string.string);
+  client->output_mime = g_strdup (HTTP_MIME_JSON);
+
+  return HTTP_STATUS_200;
+}
+
 /* DATA STRUCT *************************************************************/
 
 RequestType request_types[] = {
@@ -8096,6 +8723,14 @@ RequestType request_types[] = {
   ,
   {REQUEST_STATUS, DS_HTTPD_REQUEST_GET, request_status}
   ,
+  {REQUEST_STATS, DS_HTTPD_REQUEST_GET, request_stats}
+  ,
+  {REQUEST_TRACE, DS_HTTPD_REQUEST_GET, request_trace}
+  ,
+  {REQUEST_TRACE, DS_HTTPD_REQUEST_PUT, request_trace}
+  ,
+  {REQUEST_TRACE, DS_HTTPD_REQUEST_DELETE, request_trace}
+  ,
   {NULL}
 };
 
@@ -26,6 +26,10 @@ DSHttpStatusCode
 				 GList *		path,
 				 GList *		arguments);
 
+gboolean
+		request_is_attachment_upload
+				(DSHttpdClient * client);
+
 gboolean
 		request_get_changes_comet_database
 				(DSHttpdClient * client,
@@ -0,0 +1,154 @@
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "dupin.h"
+#include "slowlog.h"
+#include "dupin_server_common.h"
+
+#include <string.h>
+
+/* NOTE - one JSON object per line for each request slower than SlowRequestThreshold.
+          Slow requests are expected to be rare, so entries are written directly
+          under a mutex instead of going through the ring of the main log. */
+
+typedef struct ds_slowlog_t DSSlowLog;
+struct ds_slowlog_t
+{
+  GMutex	mutex;
+  GIOChannel *	io;
+};
+
+gboolean
+slowlog_open (DSGlobal * data, GError ** error)
+{
+  DSSlowLog *slowlog;
+  GIOChannel *io;
+
+  if (!data->limit_slowrequest_threshold)
+    return TRUE;
+
+  if (!data->slowlogfile)
+    {
+      if (error != NULL && *error != NULL)
+        g_set_error (error, dupin_server_common_error_quark (), 0,
+		   "No SlowLogFile tag in the config file.");
+      return FALSE;
+    }
+
+  if (!(io = g_io_channel_new_file (data->slowlogfile, "a", error)))
+    return FALSE;
+
+  slowlog = g_malloc0 (sizeof (DSSlowLog));
+
+  g_mutex_init (&slowlog->mutex);
+  slowlog->io = io;
+
+  data->slowlog = slowlog;
+
+  return TRUE;
+}
+
+void
+slowlog_close (DSGlobal * data)
+{
+  DSSlowLog *slowlog;
+
+  if (!(slowlog = data->slowlog))
+    return;
+
+  g_io_channel_shutdown (slowlog->io, TRUE, NULL);
+  g_io_channel_unref (slowlog->io);
+
+  g_mutex_clear (&slowlog->mutex);
+  g_free (slowlog);
+
+  data->slowlog = NULL;
+}
+
+void
+slowlog_write (DSGlobal * data, const gchar * ip, const gchar * request,
+	       const gchar * handler, gint status, gint64 usec,
+	       DupinTiming * timing)
+{
+  DSSlowLog *slowlog;
+  JsonNode *node;
+  JsonObject *obj, *phases;
+  JsonArray *statements;
+  GTimeVal tv;
+  GError *error = NULL;
+  gchar *str, *entry;
+  guint i;
+
+  if (!(slowlog = data->slowlog))
+    return;
+
+  g_get_current_time (&tv);
+
+  node = json_node_new (JSON_NODE_OBJECT);
+  obj = json_object_new ();
+  json_node_take_object (node, obj);
+
+  str = g_time_val_to_iso8601 (&tv);
+  json_object_set_string_member (obj, "timeIso8601", str);
+  g_free (str);
+
+  json_object_set_string_member (obj, "client", ip);
+  json_object_set_string_member (obj, "request", request);
+  json_object_set_string_member (obj, "handler", handler ? handler : "request_global");
+  json_object_set_int_member (obj, "status", status);
+  json_object_set_int_member (obj, "usec", usec);
+
+  phases = json_object_new ();
+
+  for (i = 0; i < DP_TIMING_PHASES; i++)
+    json_object_set_int_member (phases, dupin_timing_phase_name (i), timing->phases[i]);
+
+  json_object_set_object_member (obj, "phases", phases);
+
+  statements = json_array_new ();
+
+  for (i = 0; i < timing->statements->len; i++)
+    {
+      DupinTimingStatement *statement =
+	&g_array_index (timing->statements, DupinTimingStatement, i);
+      JsonObject *sobj = json_object_new ();
+
+      json_object_set_string_member (sobj, "sql", statement->sql);
+      json_object_set_int_member (sobj, "usec", statement->usec);
+      json_object_set_int_member (sobj, "fullscanStep", statement->fullscan_step);
+      json_object_set_int_member (sobj, "sort", statement->sort);
+      json_object_set_int_member (sobj, "autoindex", statement->autoindex);
+      json_object_set_int_member (sobj, "vmStep", statement->vm_step);
+
+      json_array_add_object_element (statements, sobj);
+    }
+
+  json_object_set_array_member (obj, "statements", statements);
+  json_object_set_int_member (obj, "statementsDropped", timing->statements_dropped);
+
+  str = dupin_util_json_serialize (node);
+  json_node_free (node);
+
+  if (!str)
+    return;
+
+  entry = g_strdup_printf ("%s\n", str);
+  g_free (str);
+
+  g_mutex_lock (&slowlog->mutex);
+
+  if (g_io_channel_write_chars (slowlog->io, entry, -1, NULL, &error) == G_IO_STATUS_ERROR)
+    {
+      g_message ("Error writing into the slow log file: %s", error->message);
+      g_error_free (error);
+    }
+
+  g_io_channel_flush (slowlog->io, NULL);
+
+  g_mutex_unlock (&slowlog->mutex);
+
+  g_free (entry);
+}
+
+/* EOF */
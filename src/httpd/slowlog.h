@@ -0,0 +1,22 @@
+#ifndef _DS_SLOWLOG_H_
+#define _DS_SLOWLOG_H_
+
+#include "dupin.h"
+
+#include "configure.h"
+
+gboolean	slowlog_open		(DSGlobal *	data,
+					 GError **	error);
+
+void		slowlog_close		(DSGlobal *	data);
+
+void		slowlog_write		(DSGlobal *	data,
+					 const gchar *	ip,
+					 const gchar *	request,
+					 const gchar *	handler,
+					 gint		status,
+					 gint64		usec,
+					 DupinTiming *	timing);
+
+#endif
+/* EOF */
@@ -0,0 +1,747 @@
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <string.h>
+
+#include "dupin.h"
+#include "stats.h"
+
+/* NOTE - request counters of /_stats. Every thread running requests owns a block of
+          counters that only it writes, without locks or atomic operations; a read
+          merges the blocks of all threads and may see the last requests of a thread
+          not yet accounted. The mutex is only taken to register a new thread or a
+          new handler name, and by the readers. */
+
+#define DS_STATS_HANDLERS	128
+
+/* NOTE - latency bucket b holds the requests up to 2^b usec, the last one has no upper bound */
+#define DS_STATS_BUCKETS	28
+
+typedef struct ds_stats_handler_t DSStatsHandler;
+struct ds_stats_handler_t
+{
+  guint64	count;
+  guint64	errors;
+  guint64	usec;
+  guint64	buckets[DS_STATS_BUCKETS];
+};
+
+typedef struct ds_stats_thread_t DSStatsThread;
+struct ds_stats_thread_t
+{
+  guint64	bytes_in;
+  guint64	bytes_out;
+
+  DSStatsHandler handlers[DS_STATS_HANDLERS];
+};
+
+/* The counters of a view at the previous read, for the throughput: */
+typedef struct ds_stats_view_t DSStatsView;
+struct ds_stats_view_t
+{
+  gsize		mapped;
+  gsize		reduced;
+  gint64	time;
+};
+
+typedef struct ds_stats_t DSStats;
+struct ds_stats_t
+{
+  GMutex	mutex;
+
+  GPtrArray *	threads;
+
+  const gchar *	handlers[DS_STATS_HANDLERS];
+  gint		handlers_numb;
+
+  GHashTable *	views;
+};
+
+/* A snapshot of the counters, built by the readers: */
+typedef struct ds_stats_store_t DSStatsStore;
+struct ds_stats_store_t
+{
+  const gchar *	type;
+  gchar *	name;
+  gint		cache_hit;
+  gint		cache_miss;
+};
+
+typedef struct ds_stats_view_sample_t DSStatsViewSample;
+struct ds_stats_view_sample_t
+{
+  gchar *	name;
+  gsize		mapped;
+  gsize		reduced;
+  gdouble	map_rate;
+  gdouble	reduce_rate;
+  gboolean	has_rate;
+  gssize	lag;
+  gboolean	syncing;
+};
+
+typedef struct ds_stats_snapshot_t DSStatsSnapshot;
+struct ds_stats_snapshot_t
+{
+  guint64	bytes_in;
+  guint64	bytes_out;
+
+  const gchar *	handlers[DS_STATS_HANDLERS];
+  DSStatsHandler totals[DS_STATS_HANDLERS];
+  gint		handlers_numb;
+
+  GList *	stores;
+  GList *	views;
+};
+
+static GPrivate stats_thread_current;
+
+/* INITIALIZE ***************************************************************/
+
+gboolean
+stats_init (DSGlobal * data, GError ** error)
+{
+  DSStats *stats = g_malloc0 (sizeof (DSStats));
+
+  g_mutex_init (&stats->mutex);
+  stats->threads = g_ptr_array_new_with_free_func (g_free);
+  stats->views = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+  data->stats = stats;
+
+  return TRUE;
+}
+
+/* NOTE - called once the threads running requests are stopped */
+void
+stats_close (DSGlobal * data)
+{
+  DSStats *stats = data->stats;
+
+  if (!stats)
+    return;
+
+  g_ptr_array_free (stats->threads, TRUE);
+  g_hash_table_destroy (stats->views);
+  g_mutex_clear (&stats->mutex);
+  g_free (stats);
+
+  data->stats = NULL;
+}
+
+/* WRITE ********************************************************************/
+
+static DSStatsThread *
+stats_thread (DSStats * stats)
+{
+  DSStatsThread *thread;
+
+  if ((thread = g_private_get (&stats_thread_current)))
+    return thread;
+
+  thread = g_malloc0 (sizeof (DSStatsThread));
+
+  g_mutex_lock (&stats->mutex);
+  g_ptr_array_add (stats->threads, thread);
+  g_mutex_unlock (&stats->mutex);
+
+  g_private_set (&stats_thread_current, thread);
+
+  return thread;
+}
+
+static gint
+stats_handler (DSStats * stats, const gchar * handler)
+{
+  gint numb = g_atomic_int_get (&stats->handlers_numb);
+  gint i;
+
+  for (i = 0; i < numb; i++)
+    if (stats->handlers[i] == handler)
+      return i;
+
+  g_mutex_lock (&stats->mutex);
+
+  /* Maybe another thread has added it: */
+  for (i = numb; i < stats->handlers_numb; i++)
+    if (stats->handlers[i] == handler)
+      break;
+
+  if (i == stats->handlers_numb)
+    {
+      if (i == DS_STATS_HANDLERS)
+	i = -1;
+      else
+	{
+	  stats->handlers[i] = handler;
+	  g_atomic_int_set (&stats->handlers_numb, i + 1);
+	}
+    }
+
+  g_mutex_unlock (&stats->mutex);
+
+  return i;
+}
+
+void
+stats_request (DSGlobal * data, const gchar * handler, gint64 usec,
+	       gsize bytes_in, gsize bytes_out, gboolean error)
+{
+  DSStatsThread *thread;
+  DSStatsHandler *h;
+  guint bucket;
+  gint i;
+
+  if (!data->stats || !handler)
+    return;
+
+  thread = stats_thread (data->stats);
+
+  thread->bytes_in += bytes_in;
+  thread->bytes_out += bytes_out;
+
+  if ((i = stats_handler (data->stats, handler)) < 0)
+    return;
+
+  h = &thread->handlers[i];
+
+  if (usec < 0)
+    usec = 0;
+
+  bucket = g_bit_storage ((gulong) usec);
+
+  if (bucket >= DS_STATS_BUCKETS)
+    bucket = DS_STATS_BUCKETS - 1;
+
+  h->count++;
+  h->usec += usec;
+  h->buckets[bucket]++;
+
+  if (error == TRUE)
+    h->errors++;
+}
+
+/* READ *********************************************************************/
+
+static void
+stats_store (DSStatsSnapshot * snapshot, const gchar * type, const gchar * name,
+	     sqlite3 * db)
+{
+  DSStatsStore *store = g_malloc0 (sizeof (DSStatsStore));
+  int cur, high;
+
+  store->type = type;
+  store->name = g_strdup (name);
+
+  if (sqlite3_db_status (db, SQLITE_DBSTATUS_CACHE_HIT, &cur, &high, 0) == SQLITE_OK)
+    store->cache_hit = cur;
+
+  if (sqlite3_db_status (db, SQLITE_DBSTATUS_CACHE_MISS, &cur, &high, 0) == SQLITE_OK)
+    store->cache_miss = cur;
+
+  snapshot->stores = g_list_prepend (snapshot->stores, store);
+}
+
+static void
+stats_stores (DSStatsSnapshot * snapshot, Dupin * d)
+{
+  gchar **names;
+  gint i;
+
+  if ((names = dupin_get_databases (d)))
+    {
+      for (i = 0; names[i]; i++)
+	{
+	  DupinDB *db;
+
+	  if ((db = dupin_database_open (d, names[i], NULL)))
+	    {
+	      stats_store (snapshot, "database", names[i], db->db);
+	      dupin_database_unref (db);
+	    }
+	}
+
+      g_strfreev (names);
+    }
+
+  if ((names = dupin_get_linkbases (d)))
+    {
+      for (i = 0; names[i]; i++)
+	{
+	  DupinLinkB *linkb;
+
+	  if ((linkb = dupin_linkbase_open (d, names[i], NULL)))
+	    {
+	      stats_store (snapshot, "linkbase", names[i], linkb->db);
+	      dupin_linkbase_unref (linkb);
+	    }
+	}
+
+      g_strfreev (names);
+    }
+
+  if ((names = dupin_get_attachment_dbs (d)))
+    {
+      for (i = 0; names[i]; i++)
+	{
+	  DupinAttachmentDB *attachment_db;
+
+	  if ((attachment_db = dupin_attachment_db_open (d, names[i], NULL)))
+	    {
+	      stats_store (snapshot, "attachment_db", names[i], attachment_db->db);
+	      dupin_attachment_db_unref (attachment_db);
+	    }
+	}
+
+      g_strfreev (names);
+    }
+
+  snapshot->stores = g_list_reverse (snapshot->stores);
+}
+
+/* Rows of the parent not mapped yet: */
+static gssize
+stats_view_lag (Dupin * d, DupinView * view)
+{
+  gchar *parent = (gchar *) dupin_view_get_parent (view);
+  gsize max_rowid = 0;
+
+  if (dupin_view_get_parent_is_db (view) == TRUE)
+    {
+      DupinDB *db;
+
+      if (!(db = dupin_database_open (d, parent, NULL)))
+	return -1;
+
+      dupin_database_get_max_rowid (db, &max_rowid);
+      dupin_database_unref (db);
+    }
+  else if (dupin_view_get_parent_is_linkb (view) == TRUE)
+    {
+      DupinLinkB *linkb;
+
+      if (!(linkb = dupin_linkbase_open (d, parent, NULL)))
+	return -1;
+
+      dupin_linkbase_get_max_rowid (linkb, &max_rowid);
+      dupin_linkbase_unref (linkb);
+    }
+  else
+    {
+      DupinView *parent_view;
+
+      if (!(parent_view = dupin_view_open (d, parent, NULL)))
+	return -1;
+
+      dupin_view_record_get_max_rowid (parent_view, &max_rowid, TRUE);
+      dupin_view_unref (parent_view);
+    }
+
+  return (gssize) max_rowid - (gssize) dupin_view_get_sync_map_rowid (view);
+}
+
+static void
+stats_views (DSStats * stats, DSStatsSnapshot * snapshot, Dupin * d)
+{
+  gint64 now = g_get_monotonic_time ();
+  gchar **names;
+  gint i;
+
+  if (!(names = dupin_get_views (d)))
+    return;
+
+  for (i = 0; names[i]; i++)
+    {
+      DSStatsViewSample *sample;
+      DSStatsView *previous;
+      DupinView *view;
+
+      if (!(view = dupin_view_open (d, names[i], NULL)))
+	continue;
+
+      sample = g_malloc0 (sizeof (DSStatsViewSample));
+      sample->name = g_strdup (names[i]);
+      sample->mapped = view->sync_map_processed_count;
+      sample->reduced = view->sync_reduce_processed_count;
+      sample->syncing = dupin_view_is_syncing (view);
+      sample->lag = stats_view_lag (d, view);
+
+      stats_store (snapshot, "view", names[i], view->db);
+
+      /* NOTE - the throughput is measured between two reads of the stats */
+      g_mutex_lock (&stats->mutex);
+
+      if ((previous = g_hash_table_lookup (stats->views, names[i])))
+	{
+	  gdouble seconds = (gdouble) (now - previous->time) / G_USEC_PER_SEC;
+
+	  if (seconds > 0
+	      && sample->mapped >= previous->mapped
+	      && sample->reduced >= previous->reduced)
+	    {
+	      sample->map_rate = (sample->mapped - previous->mapped) / seconds;
+	      sample->reduce_rate = (sample->reduced - previous->reduced) / seconds;
+	      sample->has_rate = TRUE;
+	    }
+	}
+      else
+	{
+	  previous = g_malloc0 (sizeof (DSStatsView));
+	  g_hash_table_insert (stats->views, g_strdup (names[i]), previous);
+	}
+
+      previous->mapped = sample->mapped;
+      previous->reduced = sample->reduced;
+      previous->time = now;
+
+      g_mutex_unlock (&stats->mutex);
+
+      dupin_view_unref (view);
+
+      snapshot->views = g_list_prepend (snapshot->views, sample);
+    }
+
+  g_strfreev (names);
+
+  snapshot->views = g_list_reverse (snapshot->views);
+}
+
+static DSStatsSnapshot *
+stats_snapshot (DSGlobal * data)
+{
+  DSStats *stats = data->stats;
+  DSStatsSnapshot *snapshot = g_malloc0 (sizeof (DSStatsSnapshot));
+  guint t;
+  gint i, b;
+
+  g_mutex_lock (&stats->mutex);
+
+  snapshot->handlers_numb = stats->handlers_numb;
+  memcpy (snapshot->handlers, stats->handlers, sizeof (snapshot->handlers));
+
+  for (t = 0; t < stats->threads->len; t++)
+    {
+      DSStatsThread *thread = g_ptr_array_index (stats->threads, t);
+
+      snapshot->bytes_in += thread->bytes_in;
+      snapshot->bytes_out += thread->bytes_out;
+
+      for (i = 0; i < snapshot->handlers_numb; i++)
+	{
+	  DSStatsHandler *h = &thread->handlers[i];
+	  DSStatsHandler *total = &snapshot->totals[i];
+
+	  total->count += h->count;
+	  total->errors += h->errors;
+	  total->usec += h->usec;
+
+	  for (b = 0; b < DS_STATS_BUCKETS; b++)
+	    total->buckets[b] += h->buckets[b];
+	}
+    }
+
+  g_mutex_unlock (&stats->mutex);
+
+  stats_stores (snapshot, data->dupin);
+  stats_views (stats, snapshot, data->dupin);
+
+  return snapshot;
+}
+
+static void
+stats_snapshot_free (DSStatsSnapshot * snapshot)
+{
+  GList *list;
+
+  for (list = snapshot->stores; list; list = list->next)
+    {
+      DSStatsStore *store = list->data;
+
+      g_free (store->name);
+      g_free (store);
+    }
+
+  for (list = snapshot->views; list; list = list->next)
+    {
+      DSStatsViewSample *sample = list->data;
+
+      g_free (sample->name);
+      g_free (sample);
+    }
+
+  g_list_free (snapshot->stores);
+  g_list_free (snapshot->views);
+  g_free (snapshot);
+}
+
+/* JSON *********************************************************************/
+
+gchar *
+stats_json (DSGlobal * data)
+{
+  DSStatsSnapshot *snapshot;
+  JsonNode *node;
+  JsonObject *obj, *handlers, *stores, *views;
+  GList *list;
+  gchar *ret;
+  gint i, b;
+
+  g_return_val_if_fail (data->stats != NULL, NULL);
+
+  snapshot = stats_snapshot (data);
+
+  node = json_node_new (JSON_NODE_OBJECT);
+  obj = json_object_new ();
+  json_node_take_object (node, obj);
+
+  json_object_set_int_member (obj, "bytesIn", snapshot->bytes_in);
+  json_object_set_int_member (obj, "bytesOut", snapshot->bytes_out);
+
+  /* Requests per handler, the histogram lists the not empty buckets by upper bound in usec: */
+  handlers = json_object_new ();
+
+  for (i = 0; i < snapshot->handlers_numb; i++)
+    {
+      DSStatsHandler *total = &snapshot->totals[i];
+      JsonObject *hobj = json_object_new ();
+      JsonObject *histogram = json_object_new ();
+
+      json_object_set_int_member (hobj, "count", total->count);
+      json_object_set_int_member (hobj, "errors", total->errors);
+      json_object_set_int_member (hobj, "usec", total->usec);
+
+      for (b = 0; b < DS_STATS_BUCKETS; b++)
+	{
+	  gchar *le;
+
+	  if (!total->buckets[b])
+	    continue;
+
+	  le = b == DS_STATS_BUCKETS - 1 ? g_strdup ("+Inf")
+					 : g_strdup_printf ("%" G_GUINT64_FORMAT, ((guint64) 1) << b);
+	  json_object_set_int_member (histogram, le, total->buckets[b]);
+	  g_free (le);
+	}
+
+      json_object_set_object_member (hobj, "histogram", histogram);
+      json_object_set_object_member (handlers, snapshot->handlers[i], hobj);
+    }
+
+  json_object_set_object_member (obj, "handlers", handlers);
+
+  /* SQLite page cache: */
+  stores = json_object_new ();
+
+  for (list = snapshot->stores; list; list = list->next)
+    {
+      DSStatsStore *store = list->data;
+      JsonObject *sobj = json_object_new ();
+      gchar *key = g_strdup_printf ("%s/%s", store->type, store->name);
+
+      json_object_set_int_member (sobj, "cacheHit", store->cache_hit);
+      json_object_set_int_member (sobj, "cacheMiss", store->cache_miss);
+      json_object_set_object_member (stores, key, sobj);
+
+      g_free (key);
+    }
+
+  json_object_set_object_member (obj, "sqlite", stores);
+
+  /* Views: */
+  views = json_object_new ();
+
+  for (list = snapshot->views; list; list = list->next)
+    {
+      DSStatsViewSample *sample = list->data;
+      JsonObject *vobj = json_object_new ();
+
+      json_object_set_int_member (vobj, "mapped", sample->mapped);
+      json_object_set_int_member (vobj, "reduced", sample->reduced);
+
+      if (sample->has_rate == TRUE)
+	{
+	  json_object_set_double_member (vobj, "mapPerSecond", sample->map_rate);
+	  json_object_set_double_member (vobj, "reducePerSecond", sample->reduce_rate);
+	}
+
+      if (sample->lag >= 0)
+	json_object_set_int_member (vobj, "lag", sample->lag);
+      else
+	json_object_set_null_member (vobj, "lag");
+
+      json_object_set_boolean_member (vobj, "syncing", sample->syncing);
+      json_object_set_object_member (views, sample->name, vobj);
+    }
+
+  json_object_set_object_member (obj, "views", views);
+
+  ret = dupin_util_json_serialize (node);
+
+  json_node_free (node);
+  stats_snapshot_free (snapshot);
+
+  return ret;
+}
+
+/* PROMETHEUS ***************************************************************/
+
+/* Label values escaped as the text exposition format wants: */
+static void
+stats_label (GString * str, const gchar * name, const gchar * value)
+{
+  g_string_append_printf (str, "%s=\"", name);
+
+  for (; *value; value++)
+    {
+      if (*value == '\\' || *value == '"')
+	g_string_append_c (str, '\\');
+
+      if (*value == '\n')
+	g_string_append (str, "\\n");
+      else
+	g_string_append_c (str, *value);
+    }
+
+  g_string_append_c (str, '"');
+}
+
+static void
+stats_metric (GString * str, const gchar * name, const gchar * type,
+	      const gchar * help)
+{
+  g_string_append_printf (str, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+gchar *
+stats_prometheus (DSGlobal * data)
+{
+  DSStatsSnapshot *snapshot;
+  GString *str;
+  GList *list;
+  gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
+  gint i, b;
+
+  g_return_val_if_fail (data->stats != NULL, NULL);
+
+  snapshot = stats_snapshot (data);
+  str = g_string_new (NULL);
+
+  stats_metric (str, "dupin_http_received_bytes_total", "counter", "Bytes of the requests.");
+  g_string_append_printf (str, "dupin_http_received_bytes_total %" G_GUINT64_FORMAT "\n", snapshot->bytes_in);
+
+  stats_metric (str, "dupin_http_sent_bytes_total", "counter", "Bytes of the response bodies.");
+  g_string_append_printf (str, "dupin_http_sent_bytes_total %" G_GUINT64_FORMAT "\n", snapshot->bytes_out);
+
+  stats_metric (str, "dupin_http_request_errors_total", "counter", "Requests answered with an error status.");
+
+  for (i = 0; i < snapshot->handlers_numb; i++)
+    {
+      g_string_append (str, "dupin_http_request_errors_total{");
+      stats_label (str, "handler", snapshot->handlers[i]);
+      g_string_append_printf (str, "} %" G_GUINT64_FORMAT "\n", snapshot->totals[i].errors);
+    }
+
+  stats_metric (str, "dupin_http_request_duration_seconds", "histogram", "Time spent running the requests.");
+
+  for (i = 0; i < snapshot->handlers_numb; i++)
+    {
+      DSStatsHandler *total = &snapshot->totals[i];
+      guint64 cumulative = 0;
+
+      for (b = 0; b < DS_STATS_BUCKETS; b++)
+	{
+	  cumulative += total->buckets[b];
+
+	  g_string_append (str, "dupin_http_request_duration_seconds_bucket{");
+	  stats_label (str, "handler", snapshot->handlers[i]);
+
+	  if (b == DS_STATS_BUCKETS - 1)
+	    g_string_append (str, ",le=\"+Inf\"");
+	  else
+	    g_string_append_printf (str, ",le=\"%s\"",
+				    g_ascii_formatd (buf, sizeof (buf), "%g",
+						     (gdouble) (((guint64) 1) << b) / G_USEC_PER_SEC));
+
+	  g_string_append_printf (str, "} %" G_GUINT64_FORMAT "\n", cumulative);
+	}
+
+      g_string_append (str, "dupin_http_request_duration_seconds_sum{");
+      stats_label (str, "handler", snapshot->handlers[i]);
+      g_string_append_printf (str, "} %s\n",
+			      g_ascii_formatd (buf, sizeof (buf), "%.6f",
+					       (gdouble) total->usec / G_USEC_PER_SEC));
+
+      g_string_append (str, "dupin_http_request_duration_seconds_count{");
+      stats_label (str, "handler", snapshot->handlers[i]);
+      g_string_append_printf (str, "} %" G_GUINT64_FORMAT "\n", total->count);
+    }
+
+  stats_metric (str, "dupin_sqlite_cache_hits_total", "counter", "SQLite page cache hits.");
+
+  for (list = snapshot->stores; list; list = list->next)
+    {
+      DSStatsStore *store = list->data;
+
+      g_string_append (str, "dupin_sqlite_cache_hits_total{");
+      stats_label (str, "type", store->type);
+      g_string_append_c (str, ',');
+      stats_label (str, "name", store->name);
+      g_string_append_printf (str, "} %d\n", store->cache_hit);
+    }
+
+  stats_metric (str, "dupin_sqlite_cache_misses_total", "counter", "SQLite page cache misses.");
+
+  for (list = snapshot->stores; list; list = list->next)
+    {
+      DSStatsStore *store = list->data;
+
+      g_string_append (str, "dupin_sqlite_cache_misses_total{");
+      stats_label (str, "type", store->type);
+      g_string_append_c (str, ',');
+      stats_label (str, "name", store->name);
+      g_string_append_printf (str, "} %d\n", store->cache_miss);
+    }
+
+  stats_metric (str, "dupin_view_mapped_total", "counter", "Records mapped by the view.");
+
+  for (list = snapshot->views; list; list = list->next)
+    {
+      DSStatsViewSample *sample = list->data;
+
+      g_string_append (str, "dupin_view_mapped_total{");
+      stats_label (str, "view", sample->name);
+      g_string_append_printf (str, "} %" G_GSIZE_FORMAT "\n", sample->mapped);
+    }
+
+  stats_metric (str, "dupin_view_reduced_total", "counter", "Records reduced by the view.");
+
+  for (list = snapshot->views; list; list = list->next)
+    {
+      DSStatsViewSample *sample = list->data;
+
+      g_string_append (str, "dupin_view_reduced_total{");
+      stats_label (str, "view", sample->name);
+      g_string_append_printf (str, "} %" G_GSIZE_FORMAT "\n", sample->reduced);
+    }
+
+  stats_metric (str, "dupin_view_lag_records", "gauge", "Records of the parent not mapped by the view yet.");
+
+  for (list = snapshot->views; list; list = list->next)
+    {
+      DSStatsViewSample *sample = list->data;
+
+      if (sample->lag < 0)
+	continue;
+
+      g_string_append (str, "dupin_view_lag_records{");
+      stats_label (str, "view", sample->name);
+      g_string_append_printf (str, "} %" G_GSSIZE_FORMAT "\n", sample->lag);
+    }
+
+  stats_snapshot_free (snapshot);
+
+  return g_string_free (str, FALSE);
+}
+
+/* EOF */
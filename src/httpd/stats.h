@@ -0,0 +1,26 @@
+#ifndef _DS_STATS_H_
+#define _DS_STATS_H_
+
+#include "dupin.h"
+
+#include "configure.h"
+
+gboolean	stats_init		(DSGlobal *	data,
+					 GError **	error);
+
+void		stats_close		(DSGlobal *	data);
+
+/* The handler name must be a static string: */
+void		stats_request		(DSGlobal *	data,
+					 const gchar *	handler,
+					 gint64		usec,
+					 gsize		bytes_in,
+					 gsize		bytes_out,
+					 gboolean	error);
+
+gchar *		stats_json		(DSGlobal *	data);
+
+gchar *		stats_prometheus	(DSGlobal *	data);
+
+#endif
+/* EOF */
@@ -24,6 +24,14 @@ typedef enum
   DP_SQLITE_OPEN_CREATE
 } DupinSQLiteOpenType;
 
+/* Generated ID scheme: */
+typedef enum
+{
+  DP_ID_SCHEME_RANDOM,	/* MD5 of random bytes, checked against the store */
+  DP_ID_SCHEME_ULID,	/* time-ordered, 26 Crockford base32 chars */
+  DP_ID_SCHEME_UUIDV7	/* time-ordered, RFC 9562 UUID version 7 */
+} DupinIdScheme;
+
 /* Count type: */
 typedef enum
 {
@@ -135,6 +143,7 @@ typedef struct dupin_view_record_t	DupinViewRecord;
 typedef struct dupin_view_t		DupinView;
 typedef struct dupin_attachment_db_t		DupinAttachmentDB;
 typedef struct dupin_attachment_record_t	DupinAttachmentRecord;
+typedef struct dupin_attachment_upload_t	DupinAttachmentUpload;
 typedef struct dupin_webkit_t		DupinWebKit;
 typedef struct dupin_view_engine_t	DupinViewEngine;
 typedef struct dupin_linkb_t		DupinLinkB;
@@ -421,6 +430,10 @@ typedef struct dupin_link_record_t	DupinLinkRecord;
 #define REQUEST_WWW             "_www"
 #define REQUEST_QUIT            "_quit"
 #define REQUEST_STATUS          "_status"
+#define REQUEST_STATS           "_stats"
+#define REQUEST_STATS_FORMAT    "format"
+#define REQUEST_STATS_FORMAT_PROMETHEUS "prometheus"
+#define REQUEST_TRACE           "_trace"
 
 /* Changes API */
 
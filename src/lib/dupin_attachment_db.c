@@ -7,9 +7,22 @@
 #include "dupin_date.h"
 #include "dupin_attachment_db.h"
 
+#include "../httpd/configure.h"
+
 #include <stdlib.h>
 #include <string.h>
 
+/* NOTE - content shared by all attachment rows with the same hash, refs counts the Dupin rows
+          with external = DUPIN_ATTACHMENT_STORAGE_SHARED pointing to it and unreferenced content
+          is only deleted when the database is compacted */
+
+#define DUPIN_ATTACHMENT_DB_SQL_SHARED_CREATE \
+  "CREATE TABLE IF NOT EXISTS DupinBlobs (\n" \
+  "  hash      CHAR(255) NOT NULL PRIMARY KEY,\n" \
+  "  refs      INTEGER NOT NULL DEFAULT 0,\n" \
+  "  content   BLOB NOT NULL DEFAULT ''\n" \
+  ");"
+
 #define DUPIN_ATTACHMENT_DB_SQL_MAIN_CREATE \
   "CREATE TABLE IF NOT EXISTS Dupin (\n" \
   "  id        CHAR(255) NOT NULL,\n" \
@@ -18,22 +31,60 @@
   "  length    INTEGER DEFAULT 0,\n" \
   "  hash      CHAR(255),\n" \
   "  content   BLOB NOT NULL DEFAULT '',\n" \
+  "  external  INTEGER NOT NULL DEFAULT 0,\n" \
+  "  blob_hash CHAR(255),\n" \
   "  PRIMARY KEY(id, title)\n" \
-  ");"
+  ");\n" \
+  DUPIN_ATTACHMENT_DB_SQL_SHARED_CREATE
 
 #define DUPIN_ATTACHMENT_DB_SQL_CREATE_INDEX \
-  "CREATE INDEX IF NOT EXISTS DupinIdTitle ON Dupin (id, title);"
+  "CREATE INDEX IF NOT EXISTS DupinIdTitle ON Dupin (id, title);\n" \
+  "CREATE INDEX IF NOT EXISTS DupinHash ON Dupin (hash);\n" \
+  "CREATE INDEX IF NOT EXISTS DupinBlobHash ON Dupin (blob_hash);"
 
 #define DUPIN_ATTACHMENT_DB_SQL_DESC_CREATE \
   "CREATE TABLE IF NOT EXISTS DupinAttachmentDB (\n" \
   "  parent          CHAR(255) NOT NULL,\n" \
   "  creation_time   CHAR(255) NOT NULL DEFAULT '0'\n" \
   ");\n" \
-  "PRAGMA user_version = 2"
+  "PRAGMA user_version = 5"
+
+#define DUPIN_ATTACHMENT_DB_SQL_BLOB_HASH_ADD \
+  "ALTER TABLE Dupin ADD COLUMN blob_hash CHAR(255);\n" \
+  "CREATE INDEX IF NOT EXISTS DupinBlobHash ON Dupin (blob_hash);"
 
 #define DUPIN_ATTACHMENT_DB_SQL_DESC_UPGRADE_FROM_VERSION_1 \
   "ALTER TABLE DupinAttachmentDB ADD COLUMN creation_time CHAR(255) NOT NULL DEFAULT '0';\n" \
-  "PRAGMA user_version = 2"
+  "ALTER TABLE Dupin ADD COLUMN external INTEGER NOT NULL DEFAULT 0;\n" \
+  "CREATE INDEX IF NOT EXISTS DupinHash ON Dupin (hash);\n" \
+  DUPIN_ATTACHMENT_DB_SQL_SHARED_CREATE "\n" \
+  DUPIN_ATTACHMENT_DB_SQL_BLOB_HASH_ADD "\n" \
+  "PRAGMA user_version = 5"
+
+#define DUPIN_ATTACHMENT_DB_SQL_DESC_UPGRADE_FROM_VERSION_2 \
+  "ALTER TABLE Dupin ADD COLUMN external INTEGER NOT NULL DEFAULT 0;\n" \
+  "CREATE INDEX IF NOT EXISTS DupinHash ON Dupin (hash);\n" \
+  DUPIN_ATTACHMENT_DB_SQL_SHARED_CREATE "\n" \
+  DUPIN_ATTACHMENT_DB_SQL_BLOB_HASH_ADD "\n" \
+  "PRAGMA user_version = 5"
+
+#define DUPIN_ATTACHMENT_DB_SQL_DESC_UPGRADE_FROM_VERSION_3 \
+  DUPIN_ATTACHMENT_DB_SQL_SHARED_CREATE "\n" \
+  DUPIN_ATTACHMENT_DB_SQL_BLOB_HASH_ADD "\n" \
+  "PRAGMA user_version = 5"
+
+#define DUPIN_ATTACHMENT_DB_SQL_DESC_UPGRADE_FROM_VERSION_4 \
+  DUPIN_ATTACHMENT_DB_SQL_BLOB_HASH_ADD "\n" \
+  "PRAGMA user_version = 5"
+
+#define DUPIN_ATTACHMENT_DB_SQL_SHARED_RECLAIM \
+  "DELETE FROM DupinBlobs WHERE refs <= 0"
+
+#define DUPIN_ATTACHMENT_DB_SQL_EXTERNAL_REFS \
+  "SELECT count(*) FROM Dupin WHERE external = 1 " \
+  "  AND (blob_hash = '%q' OR (blob_hash IS NULL AND hash = '%q'))"
+
+static void dupin_attachment_db_external_remove_all (DupinAttachmentDB * attachment_db);
 
 gchar **
 dupin_get_attachment_dbs (Dupin * d)
@@ -46,11 +97,11 @@ dupin_get_attachment_dbs (Dupin * d)
 
   g_return_val_if_fail (d != NULL, NULL);
 
-  g_rw_lock_reader_lock (d->rwlock);
+  dupin_rwlock_reader_lock (d->rwlock);
 
   if (!(size = g_hash_table_size (d->attachment_dbs)))
     {
-      g_rw_lock_reader_unlock (d->rwlock);
+      dupin_rwlock_reader_unlock (d->rwlock);
       return NULL;
     }
 
@@ -63,7 +114,7 @@ dupin_get_attachment_dbs (Dupin * d)
 
   ret[i] = NULL;
 
-  g_rw_lock_reader_unlock (d->rwlock);
+  dupin_rwlock_reader_unlock (d->rwlock);
 
   return ret;
 }
@@ -73,10 +124,10 @@ dupin_attachment_db_exists (Dupin * d, gchar * attachment_db_name)
 {
   gboolean ret;
 
-  g_rw_lock_reader_lock (d->rwlock);
+  dupin_rwlock_reader_lock (d->rwlock);
   DupinAttachmentDB * attachment_db = g_hash_table_lookup (d->attachment_dbs, attachment_db_name);
   ret = ((attachment_db != NULL) && attachment_db->todelete == FALSE) ? TRUE : FALSE;
-  g_rw_lock_reader_unlock (d->rwlock);
+  dupin_rwlock_reader_unlock (d->rwlock);
 
   return ret;
 }
@@ -89,7 +140,7 @@ dupin_attachment_db_open (Dupin * d, gchar * attachment_db, GError ** error)
   g_return_val_if_fail (d != NULL, NULL);
   g_return_val_if_fail (attachment_db != NULL, NULL);
 
-  g_rw_lock_reader_lock (d->rwlock);
+  dupin_rwlock_reader_lock (d->rwlock);
 
   if (!(ret = g_hash_table_lookup (d->attachment_dbs, attachment_db)) || ret->todelete == TRUE)
     {
@@ -97,7 +148,7 @@ dupin_attachment_db_open (Dupin * d, gchar * attachment_db, GError ** error)
         g_set_error (error, dupin_error_quark (), DUPIN_ERROR_OPEN,
 		 "Attachment DB '%s' doesn't exist.", attachment_db);
 
-      g_rw_lock_reader_unlock (d->rwlock);
+      dupin_rwlock_reader_unlock (d->rwlock);
       return NULL;
     }
   else
@@ -109,7 +160,7 @@ dupin_attachment_db_open (Dupin * d, gchar * attachment_db, GError ** error)
 #endif
     }
 
-  g_rw_lock_reader_unlock (d->rwlock);
+  dupin_rwlock_reader_unlock (d->rwlock);
 
   return ret;
 }
@@ -134,14 +185,14 @@ dupin_attachment_db_new (Dupin * d,
 
   g_return_val_if_fail (dupin_database_exists (d, parent) == TRUE, NULL);
 
-  g_rw_lock_writer_lock (d->rwlock);
+  dupin_rwlock_writer_lock (d->rwlock);
 
   if ((ret = g_hash_table_lookup (d->attachment_dbs, attachment_db)))
     {
       if (error != NULL && *error != NULL)
         g_set_error (error, dupin_error_quark (), DUPIN_ERROR_OPEN,
 		   "Attachment DB '%s' already exist.", attachment_db);
-      g_rw_lock_writer_unlock (d->rwlock);
+      dupin_rwlock_writer_unlock (d->rwlock);
       return NULL;
     }
 
@@ -151,7 +202,7 @@ dupin_attachment_db_new (Dupin * d,
 
   if (!(ret = dupin_attachment_db_connect (d, attachment_db, path, DP_SQLITE_OPEN_CREATE, error)))
     {
-      g_rw_lock_writer_unlock (d->rwlock);
+      dupin_rwlock_writer_unlock (d->rwlock);
       g_free (path);
       return NULL;
     }
@@ -168,7 +219,7 @@ dupin_attachment_db_new (Dupin * d,
 
   if (dupin_attachment_db_begin_transaction (ret, error) < 0)
     {
-      g_rw_lock_writer_unlock (d->rwlock);
+      dupin_rwlock_writer_unlock (d->rwlock);
       dupin_attachment_db_disconnect (ret);
       return NULL;
     }
@@ -184,7 +235,7 @@ dupin_attachment_db_new (Dupin * d,
 
   if (sqlite3_exec (ret->db, str, NULL, NULL, &errmsg) != SQLITE_OK)
     {
-      g_rw_lock_writer_unlock (d->rwlock);
+      dupin_rwlock_writer_unlock (d->rwlock);
 
       if (error != NULL && *error != NULL)
         g_set_error (error, dupin_error_quark (), DUPIN_ERROR_OPEN, "%s",
@@ -199,14 +250,14 @@ dupin_attachment_db_new (Dupin * d,
 
   if (dupin_attachment_db_commit_transaction (ret, error) < 0)
     {
-      g_rw_lock_writer_unlock (d->rwlock);
+      dupin_rwlock_writer_unlock (d->rwlock);
       dupin_attachment_db_disconnect (ret);
       return NULL;
     }
 
   sqlite3_free (str);
 
-  g_rw_lock_writer_unlock (d->rwlock);
+  dupin_rwlock_writer_unlock (d->rwlock);
 
   if (dupin_attachment_db_p_update (ret, error) == FALSE)
     {
@@ -214,9 +265,9 @@ dupin_attachment_db_new (Dupin * d,
       return NULL;
     }
 
-  g_rw_lock_writer_lock (d->rwlock);
+  dupin_rwlock_writer_lock (d->rwlock);
   g_hash_table_insert (d->attachment_dbs, g_strdup (attachment_db), ret);
-  g_rw_lock_writer_unlock (d->rwlock);
+  dupin_rwlock_writer_unlock (d->rwlock);
 
   return ret;
 }
@@ -238,9 +289,9 @@ static void
 dupin_attachment_db_p_update_real (DupinAttachmentDBP * p,
 				   DupinAttachmentDB *  attachment_db)
 {
-  g_rw_lock_reader_lock (attachment_db->rwlock);
+  dupin_rwlock_reader_lock (attachment_db->rwlock);
   gboolean todelete = attachment_db->todelete;
-  g_rw_lock_reader_unlock (attachment_db->rwlock);
+  dupin_rwlock_reader_unlock (attachment_db->rwlock);
 
   if (todelete == TRUE)
     {
@@ -312,9 +363,9 @@ dupin_attachment_db_p_update (DupinAttachmentDB * attachment_db,
       return FALSE;
     }
 
-  g_rw_lock_reader_lock (attachment_db->rwlock);
+  dupin_rwlock_reader_lock (attachment_db->rwlock);
   gboolean todelete = attachment_db->todelete;
-  g_rw_lock_reader_unlock (attachment_db->rwlock);
+  dupin_rwlock_reader_unlock (attachment_db->rwlock);
 
   gboolean parent_exists = dupin_database_exists (attachment_db->d, update.parent);
 
@@ -328,9 +379,9 @@ dupin_attachment_db_p_update (DupinAttachmentDB * attachment_db,
           return FALSE;
         }
 
-      g_rw_lock_writer_lock (db->rwlock);
+      dupin_rwlock_writer_lock (db->rwlock);
       dupin_attachment_db_p_update_real (&db->attachment_dbs, attachment_db);
-      g_rw_lock_writer_unlock (db->rwlock);
+      dupin_rwlock_writer_unlock (db->rwlock);
 
       dupin_database_unref (db);
     }
@@ -360,7 +411,7 @@ dupin_attachment_db_ref (DupinAttachmentDB * attachment_db)
 {
   g_return_if_fail (attachment_db != NULL);
 
-  g_rw_lock_writer_lock (attachment_db->rwlock);
+  dupin_rwlock_writer_lock (attachment_db->rwlock);
 
   attachment_db->ref++;
 
@@ -368,7 +419,7 @@ dupin_attachment_db_ref (DupinAttachmentDB * attachment_db)
   fprintf(stderr,"dupin_attachment_db_ref: (%p) name=%s \t ref++=%d\n", g_thread_self (), attachment_db->name, (gint) attachment_db->ref);
 #endif
 
-  g_rw_lock_writer_unlock (attachment_db->rwlock);
+  dupin_rwlock_writer_unlock (attachment_db->rwlock);
 }
 
 void
@@ -380,7 +431,7 @@ dupin_attachment_db_unref (DupinAttachmentDB * attachment_db)
 
   d = attachment_db->d;
 
-  g_rw_lock_writer_lock (attachment_db->rwlock);
+  dupin_rwlock_writer_lock (attachment_db->rwlock);
 
   if (attachment_db->ref > 0)
     {
@@ -391,7 +442,7 @@ dupin_attachment_db_unref (DupinAttachmentDB * attachment_db)
 #endif
     }
 
-  g_rw_lock_writer_unlock (attachment_db->rwlock);
+  dupin_rwlock_writer_unlock (attachment_db->rwlock);
 
   if (attachment_db->todelete == TRUE)
     {
@@ -406,9 +457,9 @@ dupin_attachment_db_unref (DupinAttachmentDB * attachment_db)
               g_warning("dupin_attachment_db_unref: could not remove reference from parent for attachment db '%s'\n", attachment_db->name);
             }
 
-          g_rw_lock_writer_lock (d->rwlock);
+          dupin_rwlock_writer_lock (d->rwlock);
           g_hash_table_remove (d->attachment_dbs, attachment_db->name);
-          g_rw_lock_writer_unlock (d->rwlock);
+          dupin_rwlock_writer_unlock (d->rwlock);
         }
     }
 }
@@ -418,9 +469,9 @@ dupin_attachment_db_delete (DupinAttachmentDB * attachment_db, GError ** error)
 {
   g_return_val_if_fail (attachment_db != NULL, FALSE);
 
-  g_rw_lock_writer_lock (attachment_db->rwlock);
+  dupin_rwlock_writer_lock (attachment_db->rwlock);
   attachment_db->todelete = TRUE;
-  g_rw_lock_writer_unlock (attachment_db->rwlock);
+  dupin_rwlock_writer_unlock (attachment_db->rwlock);
 
   return TRUE;
 }
@@ -502,7 +553,14 @@ dupin_attachment_db_disconnect (DupinAttachmentDB * attachment_db)
     sqlite3_close (attachment_db->db);
 
   if (attachment_db->todelete == TRUE)
-    g_unlink (attachment_db->path);
+    {
+      g_unlink (attachment_db->path);
+
+      dupin_attachment_db_external_remove_all (attachment_db);
+    }
+
+  if (attachment_db->external_path)
+    g_free (attachment_db->external_path);
 
   if (attachment_db->name)
     g_free (attachment_db->name);
@@ -514,10 +572,7 @@ dupin_attachment_db_disconnect (DupinAttachmentDB * attachment_db)
     g_free (attachment_db->parent);
 
   if (attachment_db->rwlock)
-    {
-      g_rw_lock_clear (attachment_db->rwlock);
-      g_free (attachment_db->rwlock);
-    }
+    dupin_rwlock_free (attachment_db->rwlock);
 
   if (attachment_db->error_msg)
     g_free (attachment_db->error_msg);
@@ -528,6 +583,202 @@ dupin_attachment_db_disconnect (DupinAttachmentDB * attachment_db)
   g_free (attachment_db);
 }
 
+/* NOTE - content-addressed files are fanned out on the first two hash chars */
+
+gchar *
+dupin_attachment_db_external_file (DupinAttachmentDB * attachment_db,
+				   const gchar * hash)
+{
+  g_return_val_if_fail (attachment_db != NULL, NULL);
+  g_return_val_if_fail (hash != NULL, NULL);
+  g_return_val_if_fail (strlen (hash) > 2, NULL);
+
+  gchar prefix[3] = { hash[0], hash[1], '\0' };
+
+  return g_build_path (G_DIR_SEPARATOR_S, attachment_db->external_path, prefix, hash, NULL);
+}
+
+static int
+dupin_attachment_db_external_release_cb (void *data, int argc, char **argv, char **col)
+{
+  gsize *numb = data;
+
+  if (argv[0] && *argv[0])
+    *numb = (gsize) g_ascii_strtoll (argv[0], NULL, 10);
+
+  return 0;
+}
+
+/* NOTE - remove the file of the given hash once no row refers to it anymore, the count
+          also sees rows of a bulk transaction not yet committed on the same connection */
+
+gboolean
+dupin_attachment_db_external_release (DupinAttachmentDB * attachment_db,
+				      const gchar * hash)
+{
+  g_return_val_if_fail (attachment_db != NULL, FALSE);
+  g_return_val_if_fail (hash != NULL, FALSE);
+
+  gchar *errmsg;
+  gchar *tmp;
+  gsize numb = 0;
+
+  tmp = sqlite3_mprintf (DUPIN_ATTACHMENT_DB_SQL_EXTERNAL_REFS, hash, hash);
+
+  if (sqlite3_exec (attachment_db->db, tmp, dupin_attachment_db_external_release_cb, &numb, &errmsg) != SQLITE_OK)
+    {
+      g_warning ("dupin_attachment_db_external_release: %s", errmsg);
+
+      sqlite3_free (errmsg);
+      sqlite3_free (tmp);
+
+      return FALSE;
+    }
+
+  sqlite3_free (tmp);
+
+  if (numb > 0)
+    return TRUE;
+
+  gchar * file = dupin_attachment_db_external_file (attachment_db, hash);
+
+  if (file != NULL)
+    {
+      g_unlink (file);
+      g_free (file);
+    }
+
+  return TRUE;
+}
+
+/* NOTE - files left behind by inserts which failed or were rolled back as part of a bulk
+          transaction, called while compacting the parent database */
+
+gboolean
+dupin_attachment_db_external_sweep (DupinAttachmentDB * attachment_db)
+{
+  g_return_val_if_fail (attachment_db != NULL, FALSE);
+
+  GDir *dir, *subdir;
+  const gchar *prefix, *hash;
+  gboolean ret = TRUE;
+
+  dupin_rwlock_writer_lock (attachment_db->rwlock);
+
+  if (!(dir = g_dir_open (attachment_db->external_path, 0, NULL)))
+    {
+      dupin_rwlock_writer_unlock (attachment_db->rwlock);
+      return TRUE;
+    }
+
+  while (ret == TRUE
+         && (prefix = g_dir_read_name (dir)))
+    {
+      gchar * path = g_build_path (G_DIR_SEPARATOR_S, attachment_db->external_path, prefix, NULL);
+
+      if ((subdir = g_dir_open (path, 0, NULL)))
+        {
+          while ((hash = g_dir_read_name (subdir)))
+            {
+              /* NOTE - temporary files of g_file_set_contents() interrupted by a crash are named hash.XXXXXX */
+
+              if (strchr (hash, '.') != NULL)
+                {
+                  gchar * file = g_build_path (G_DIR_SEPARATOR_S, path, hash, NULL);
+                  g_unlink (file);
+                  g_free (file);
+                }
+              else if (dupin_attachment_db_external_release (attachment_db, hash) == FALSE)
+                {
+                  ret = FALSE;
+                  break;
+                }
+            }
+
+          g_dir_close (subdir);
+        }
+
+      g_free (path);
+    }
+
+  g_dir_close (dir);
+
+  dupin_rwlock_writer_unlock (attachment_db->rwlock);
+
+  return ret;
+}
+
+/* NOTE - drop shared content no row refers to anymore, called while compacting the parent database.
+          The writer lock keeps it out of the window between the INSERT OR IGNORE and the refs
+          update of a create, which would otherwise count a reference on a deleted row */
+
+gboolean
+dupin_attachment_db_shared_reclaim (DupinAttachmentDB * attachment_db)
+{
+  g_return_val_if_fail (attachment_db != NULL, FALSE);
+
+  gchar *errmsg;
+  gboolean ret = FALSE;
+
+  dupin_rwlock_writer_lock (attachment_db->rwlock);
+
+  if (dupin_attachment_db_begin_transaction (attachment_db, NULL) < 0)
+    goto dupin_attachment_db_shared_reclaim_end;
+
+  if (sqlite3_exec (attachment_db->db, DUPIN_ATTACHMENT_DB_SQL_SHARED_RECLAIM, NULL, NULL, &errmsg) != SQLITE_OK)
+    {
+      g_warning ("dupin_attachment_db_shared_reclaim: %s", errmsg);
+      sqlite3_free (errmsg);
+      dupin_attachment_db_rollback_transaction (attachment_db, NULL);
+      goto dupin_attachment_db_shared_reclaim_end;
+    }
+
+  if (dupin_attachment_db_commit_transaction (attachment_db, NULL) < 0)
+    goto dupin_attachment_db_shared_reclaim_end;
+
+  ret = TRUE;
+
+dupin_attachment_db_shared_reclaim_end:
+
+  dupin_rwlock_writer_unlock (attachment_db->rwlock);
+
+  return ret;
+}
+
+static void
+dupin_attachment_db_external_remove_all (DupinAttachmentDB * attachment_db)
+{
+  GDir *dir, *subdir;
+  const gchar *prefix, *hash;
+
+  if (!(dir = g_dir_open (attachment_db->external_path, 0, NULL)))
+    return;
+
+  while ((prefix = g_dir_read_name (dir)))
+    {
+      gchar * path = g_build_path (G_DIR_SEPARATOR_S, attachment_db->external_path, prefix, NULL);
+
+      if ((subdir = g_dir_open (path, 0, NULL)))
+        {
+          while ((hash = g_dir_read_name (subdir)))
+            {
+              gchar * file = g_build_path (G_DIR_SEPARATOR_S, path, hash, NULL);
+              g_unlink (file);
+              g_free (file);
+            }
+
+          g_dir_close (subdir);
+        }
+
+      g_rmdir (path);
+      g_free (path);
+    }
+
+  g_dir_close (dir);
+
+  g_rmdir (attachment_db->external_path);
+}
+
 static int
 dupin_attachment_db_connect_cb (void *data, int argc, char **argv, char **col)
 {
@@ -569,8 +820,12 @@ dupin_attachment_db_connect (Dupin * d, gchar * name, gchar * path,
   attachment_db->name = g_strdup (name);
   attachment_db->path = g_strdup (path);
 
-  attachment_db->rwlock = g_new0 (GRWLock, 1);
-  g_rw_lock_init (attachment_db->rwlock);
+  attachment_db->rwlock = dupin_rwlock_new ();
+
+  /* NOTE - large attachments live as content-addressed files next to the SQLite file */
+
+  attachment_db->external_path = g_strdup_printf ("%s%s", path, DUPIN_ATTACHMENT_DB_EXTERNAL_SUFFIX);
+  attachment_db->external_min_size = (d->conf != NULL) ? d->conf->limit_attachment_external_minsize : DS_LIMIT_ATTACHMENT_EXTERNAL_MINSIZE_DEFAULT;
 
   if (sqlite3_open_v2 (attachment_db->path, &attachment_db->db, dupin_util_dupin_mode_to_sqlite_mode (mode), NULL) != SQLITE_OK)
     {
@@ -583,6 +838,11 @@ dupin_attachment_db_connect (Dupin * d, gchar * name, gchar * path,
 
   sqlite3_busy_timeout (attachment_db->db, DUPIN_SQLITE_TIMEOUT);
 
+  dupin_iostats_attach (&attachment_db->iostats, attachment_db->db);
+
+  if (d->conf != NULL && d->conf->limit_slowrequest_threshold > 0)
+    dupin_timing_sqlite_profile (attachment_db->db);
+
   if (mode == DP_SQLITE_OPEN_CREATE)
     {
       if (sqlite3_exec (attachment_db->db, "PRAGMA journal_mode = WAL", NULL, NULL, &errmsg) != SQLITE_OK
@@ -653,6 +913,42 @@ dupin_attachment_db_connect (Dupin * d, gchar * name, gchar * path,
           return NULL;
         }
     }
+  else if (user_version == 2)
+    {
+      if (sqlite3_exec (attachment_db->db, DUPIN_ATTACHMENT_DB_SQL_DESC_UPGRADE_FROM_VERSION_2, NULL, NULL, &errmsg) != SQLITE_OK)
+        {
+          if (error != NULL && *error != NULL)
+            g_set_error (error, dupin_error_quark (), DUPIN_ERROR_OPEN, "%s",
+                   errmsg);
+          sqlite3_free (errmsg);
+          dupin_attachment_db_disconnect (attachment_db);
+          return NULL;
+        }
+    }
+  else if (user_version == 3)
+    {
+      if (sqlite3_exec (attachment_db->db, DUPIN_ATTACHMENT_DB_SQL_DESC_UPGRADE_FROM_VERSION_3, NULL, NULL, &errmsg) != SQLITE_OK)
+        {
+          if (error != NULL && *error != NULL)
+            g_set_error (error, dupin_error_quark (), DUPIN_ERROR_OPEN, "%s",
+                   errmsg);
+          sqlite3_free (errmsg);
+          dupin_attachment_db_disconnect (attachment_db);
+          return NULL;
+        }
+    }
+  else if (user_version == 4)
+    {
+      if (sqlite3_exec (attachment_db->db, DUPIN_ATTACHMENT_DB_SQL_DESC_UPGRADE_FROM_VERSION_4, NULL, NULL, &errmsg) != SQLITE_OK)
+        {
+          if (error != NULL && *error != NULL)
+            g_set_error (error, dupin_error_quark (), DUPIN_ERROR_OPEN, "%s",
+                   errmsg);
+          sqlite3_free (errmsg);
+          dupin_attachment_db_disconnect (attachment_db);
+          return NULL;
+        }
+    }
 
   gchar * cache_size = g_strdup_printf ("PRAGMA cache_size = %d", DUPIN_SQLITE_CACHE_SIZE); 
   if (sqlite3_exec (attachment_db->db, "PRAGMA temp_store = memory", NULL, NULL, &errmsg) != SQLITE_OK
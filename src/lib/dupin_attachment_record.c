@@ -7,6 +7,16 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#ifdef G_OS_UNIX
+#  include <unistd.h>
+#endif
+
+#ifdef HAVE_SYS_SENDFILE_H
+#  include <sys/sendfile.h>
+#endif
 
 #define DUPIN_ATTACHMENT_DB_SQL_EXISTS \
 	"SELECT count(*) FROM Dupin WHERE id = '%q' AND title = '%q' "
@@ -15,21 +25,45 @@
 	"SELECT count(*) AS c FROM Dupin AS d"
 
 #define DUPIN_ATTACHMENT_DB_SQL_READ \
-	"SELECT type, hash, length, ROWID AS rowid FROM Dupin WHERE id = '%q' AND title = '%q' "
+	"SELECT type, hash, blob_hash, length, external, ROWID AS rowid FROM Dupin WHERE id = '%q' AND title = '%q' "
 
 #define DUPIN_ATTACHMENT_DB_SQL_INSERT \
-        "INSERT INTO Dupin (id, title, type, length, hash, content) " \
-        "VALUES(?, ?, ?, ?, ?, ?)"
+        "INSERT INTO Dupin (id, title, type, length, hash, content, external, blob_hash) " \
+        "VALUES(?, ?, ?, ?, ?, ?, ?, ?)"
+
+#define DUPIN_ATTACHMENT_DB_SQL_SHARED_INSERT \
+        "INSERT OR IGNORE INTO DupinBlobs (hash, refs, content) VALUES(?, 0, ?)"
+
+#define DUPIN_ATTACHMENT_DB_SQL_SHARED_REF \
+        "UPDATE DupinBlobs SET refs = refs + 1 WHERE hash = '%q' "
+
+#define DUPIN_ATTACHMENT_DB_SQL_SHARED_READ \
+	"SELECT ROWID AS rowid FROM DupinBlobs WHERE hash = '%q' "
+
+/* NOTE - references to shared content are dropped in the same statement batch deleting the rows,
+          the storage key is COALESCE(blob_hash, hash) as rows older than blob_hash are keyed on hash */
 
 #define DUPIN_ATTACHMENT_DB_SQL_DELETE \
+        "UPDATE DupinBlobs SET refs = refs - 1 WHERE hash = " \
+        "  (SELECT COALESCE(blob_hash, hash) FROM Dupin WHERE id = '%q' AND title = '%q' AND external = 2);\n" \
         "DELETE FROM Dupin WHERE id = '%q' AND title = '%q' "
 
 #define DUPIN_ATTACHMENT_DB_SQL_DELETE_ALL \
+        "UPDATE DupinBlobs SET refs = refs - " \
+        "  (SELECT count(*) FROM Dupin WHERE id = '%q' AND external = 2 " \
+        "     AND COALESCE(Dupin.blob_hash, Dupin.hash) = DupinBlobs.hash) " \
+        "  WHERE hash IN (SELECT COALESCE(blob_hash, hash) FROM Dupin WHERE id = '%q' AND external = 2);\n" \
         "DELETE FROM Dupin WHERE id = '%q' "
 
 #define DUPIN_ATTACHMENT_DB_SQL_HASHES \
 	"SELECT group_concat(hash,'') AS h from Dupin where id = '%q' "
 
+#define DUPIN_ATTACHMENT_DB_SQL_EXTERNAL_HASH \
+	"SELECT COALESCE(blob_hash, hash) FROM Dupin WHERE id = '%q' AND title = '%q' AND external = 1 "
+
+#define DUPIN_ATTACHMENT_DB_SQL_EXTERNAL_HASHES \
+	"SELECT DISTINCT COALESCE(blob_hash, hash) FROM Dupin WHERE id = '%q' AND external = 1 "
+
 static DupinAttachmentRecord *dupin_attachment_record_read_real
 							(DupinAttachmentDB * attachment_db,
                                 		     	 gchar *        id,
@@ -52,28 +86,452 @@ gboolean dupin_attachment_record_get_aggregated_hash_real (DupinAttachmentDB * a
                                                   	   gchar **       hash,
                                                   	   gboolean       lock);
 
-/* NOTE - this is completely inefficient due we pass the whole BLOB in RAM and on the stack */
+/* NOTE - write content to its content-addressed file unless it is already there */
+
+static gboolean
+dupin_attachment_record_external_store (DupinAttachmentDB * attachment_db,
+                                        gchar *       hash,
+                                        gsize         length,
+                                        const void ** content)
+{
+  GError * error = NULL;
+  gchar * file = dupin_attachment_db_external_file (attachment_db, hash);
+
+  if (file == NULL)
+    return FALSE;
+
+  if (g_file_test (file, G_FILE_TEST_IS_REGULAR) == TRUE)
+    {
+      g_free (file);
+      return TRUE;
+    }
+
+  gchar * dir = g_path_get_dirname (file);
+
+  if (g_mkdir_with_parents (dir, 0755) != 0)
+    {
+      dupin_attachment_db_set_error (attachment_db, "Cannot create attachment storage directory");
+      g_free (dir);
+      g_free (file);
+      return FALSE;
+    }
+
+  g_free (dir);
+
+  /* NOTE - g_file_set_contents() writes to a temporary file and renames it, readers never see partial content */
+
+  if (g_file_set_contents (file, *content, length, &error) == FALSE)
+    {
+      dupin_attachment_db_set_error (attachment_db, (error != NULL) ? error->message : "Cannot write attachment file");
+
+      if (error != NULL)
+        g_error_free (error);
+
+      g_free (file);
+      return FALSE;
+    }
+
+  g_free (file);
+
+  return TRUE;
+}
+
+static int
+dupin_attachment_record_external_hashes_cb (void *data, int argc, char **argv, char **col)
+{
+  GList ** hashes = data;
+
+  if (argv[0] && *argv[0])
+    *hashes = g_list_prepend (*hashes, g_strdup (argv[0]));
+
+  return 0;
+}
+
+/* NOTE - files are released only once the delete is really committed, within a bulk
+          transaction they are kept and a later delete or insert of the same hash reuses them */
+
+static void
+dupin_attachment_record_external_release (DupinAttachmentDB * attachment_db,
+                                          GList *       hashes,
+                                          gboolean      committed)
+{
+  while (hashes)
+    {
+      if (committed == TRUE)
+        dupin_attachment_db_external_release (attachment_db, hashes->data);
+
+      g_free (hashes->data);
+      hashes = g_list_remove (hashes, hashes->data);
+    }
+}
+
+/* UPLOAD ******************************************************************/
+
+/* NOTE - an upload spools the incoming body to a file next to the databases and hashes it on the fly,
+          the attachment row is only written once the whole body arrived and the record revision
+          has been checked, so that no SQLite lock is held while waiting on the network */
+
+DupinAttachmentUpload *
+dupin_attachment_upload_new (Dupin *  d,
+                             GError ** error)
+{
+  g_return_val_if_fail (d != NULL, NULL);
+
+  DupinAttachmentUpload * upload;
+
+  upload = g_malloc0 (sizeof (DupinAttachmentUpload));
+
+  upload->d = d;
+  upload->path = g_build_path (G_DIR_SEPARATOR_S, d->path, DUPIN_ATTACHMENT_UPLOAD_PREFIX "XXXXXX", NULL);
+
+  if ((upload->fd = g_mkstemp (upload->path)) < 0)
+    {
+      if (error != NULL && *error != NULL)
+        g_set_error (error, dupin_error_quark (), DUPIN_ERROR_OPEN,
+                     "Cannot create upload file: %s", g_strerror (errno));
+
+      g_free (upload->path);
+      g_free (upload);
+      return NULL;
+    }
+
+  upload->checksum = g_checksum_new (DUPIN_ID_HASH_ALGO);
+  upload->blob_checksum = g_checksum_new (DUPIN_ATTACHMENT_BLOB_HASH_ALGO);
+
+  return upload;
+}
 
 gboolean
-dupin_attachment_record_create (DupinAttachmentDB * attachment_db,
-                                gchar *       id,
-                                gchar *       title,
-                                gsize         length,
-                                gchar *       type,
-                                const void ** content) // try to avoid to pass megabytes on stack
+dupin_attachment_upload_write (DupinAttachmentUpload * upload,
+                               const gchar * buf,
+                               gsize count,
+                               GError ** error)
+{
+  g_return_val_if_fail (upload != NULL, FALSE);
+  g_return_val_if_fail (upload->checksum != NULL, FALSE);
+  g_return_val_if_fail (upload->blob_checksum != NULL, FALSE);
+
+  gsize done = 0;
+
+  while (done < count)
+    {
+      gssize ret = write (upload->fd, buf + done, count - done);
+
+      if (ret < 0)
+        {
+          if (errno == EINTR)
+            continue;
+
+          if (error != NULL && *error != NULL)
+            g_set_error (error, dupin_error_quark (), DUPIN_ERROR_OPEN,
+                         "Cannot write upload file: %s", g_strerror (errno));
+
+          return FALSE;
+        }
+
+      done += ret;
+    }
+
+  g_checksum_update (upload->checksum, (const guchar *) buf, count);
+  g_checksum_update (upload->blob_checksum, (const guchar *) buf, count);
+  upload->length += count;
+
+  return TRUE;
+}
+
+gsize
+dupin_attachment_upload_get_length (DupinAttachmentUpload * upload)
+{
+  g_return_val_if_fail (upload != NULL, 0);
+
+  return upload->length;
+}
+
+const gchar *
+dupin_attachment_upload_get_hash (DupinAttachmentUpload * upload)
+{
+  g_return_val_if_fail (upload != NULL, NULL);
+
+  if (upload->hash == NULL)
+    {
+      upload->hash = g_strdup (g_checksum_get_string (upload->checksum));
+
+      g_checksum_free (upload->checksum);
+      upload->checksum = NULL;
+    }
+
+  return upload->hash;
+}
+
+const gchar *
+dupin_attachment_upload_get_blob_hash (DupinAttachmentUpload * upload)
+{
+  g_return_val_if_fail (upload != NULL, NULL);
+
+  if (upload->blob_hash == NULL)
+    {
+      upload->blob_hash = g_strdup (g_checksum_get_string (upload->blob_checksum));
+
+      g_checksum_free (upload->blob_checksum);
+      upload->blob_checksum = NULL;
+    }
+
+  return upload->blob_hash;
+}
+
+void
+dupin_attachment_upload_free (DupinAttachmentUpload * upload)
+{
+  g_return_if_fail (upload != NULL);
+
+  if (upload->fd >= 0)
+    close (upload->fd);
+
+  if (upload->path != NULL)
+    {
+      g_unlink (upload->path);
+      g_free (upload->path);
+    }
+
+  if (upload->checksum != NULL)
+    g_checksum_free (upload->checksum);
+
+  if (upload->hash != NULL)
+    g_free (upload->hash);
+
+  if (upload->blob_checksum != NULL)
+    g_checksum_free (upload->blob_checksum);
+
+  if (upload->blob_hash != NULL)
+    g_free (upload->blob_hash);
+
+  g_free (upload);
+}
+
+/* NOTE - move the spool file to its content-addressed place, the spool is simply dropped if the hash is already stored */
+
+static gboolean
+dupin_attachment_record_external_store_upload (DupinAttachmentDB * attachment_db,
+                                               DupinAttachmentUpload * upload)
+{
+  gchar * file = dupin_attachment_db_external_file (attachment_db, dupin_attachment_upload_get_blob_hash (upload));
+
+  if (file == NULL)
+    return FALSE;
+
+  if (g_file_test (file, G_FILE_TEST_IS_REGULAR) == TRUE)
+    {
+      g_free (file);
+      return TRUE;
+    }
+
+  gchar * dir = g_path_get_dirname (file);
+
+  if (g_mkdir_with_parents (dir, 0755) != 0)
+    {
+      dupin_attachment_db_set_error (attachment_db, "Cannot create attachment storage directory");
+      g_free (dir);
+      g_free (file);
+      return FALSE;
+    }
+
+  g_free (dir);
+
+  if (g_rename (upload->path, file) != 0)
+    {
+      dupin_attachment_db_set_error (attachment_db, "Cannot move uploaded attachment file");
+      g_free (file);
+      return FALSE;
+    }
+
+  g_free (upload->path);
+  upload->path = NULL;
+
+  g_free (file);
+
+  return TRUE;
+}
+
+/* NOTE - copy the spool file into the zeroblob() reserved for the shared content using incremental BLOB I/O */
+
+static gboolean
+dupin_attachment_record_blob_store_upload (DupinAttachmentDB * attachment_db,
+                                           DupinAttachmentUpload * upload,
+                                           sqlite3_int64 rowid)
+{
+  sqlite3_blob * blob = NULL;
+  gchar buf[DUPIN_ATTACHMENT_UPLOAD_BUFFER];
+  gsize offset = 0;
+
+  if (sqlite3_blob_open (attachment_db->db, "main", "DupinBlobs", "content", rowid, 1, &blob) != SQLITE_OK)
+    {
+      dupin_attachment_db_set_error (attachment_db, (gchar *) sqlite3_errmsg (attachment_db->db));
+      return FALSE;
+    }
+
+  while (offset < upload->length)
+    {
+      gssize ret = pread (upload->fd, buf, MIN (sizeof (buf), upload->length - offset), offset);
+
+      if (ret < 0 && errno == EINTR)
+        continue;
+
+      if (ret <= 0
+          || sqlite3_blob_write (blob, buf, ret, offset) != SQLITE_OK)
+        {
+          dupin_attachment_db_set_error (attachment_db, "Cannot copy uploaded attachment");
+          sqlite3_blob_close (blob);
+          return FALSE;
+        }
+
+      offset += ret;
+    }
+
+  sqlite3_blob_close (blob);
+
+  return TRUE;
+}
+
+/* NOTE - store content once per hash in DupinBlobs and count one more reference to it,
+          the content is only written (or copied from the upload spool) the first time.
+          Called with the attachment_db writer lock held, like the reclaim */
+
+static gboolean
+dupin_attachment_record_shared_store (DupinAttachmentDB * attachment_db,
+                                      gchar *       hash,
+                                      gsize         length,
+                                      const void ** content,
+                                      DupinAttachmentUpload * upload)
+{
+  gchar *query, *errmsg;
+  sqlite3_stmt *insertstmt;
+
+  query = sqlite3_mprintf (DUPIN_ATTACHMENT_DB_SQL_SHARED_INSERT);
+
+  if (sqlite3_prepare(attachment_db->db, query, strlen(query), &insertstmt, NULL) != SQLITE_OK)
+    {
+      g_error("dupin_attachment_record_shared_store: %s", sqlite3_errmsg (attachment_db->db));
+      sqlite3_free (query);
+      return FALSE;
+    }
+
+  sqlite3_bind_text (insertstmt, 1, hash, strlen(hash), SQLITE_STATIC);
+  if (upload != NULL)
+    sqlite3_bind_zeroblob (insertstmt, 2, length);
+  else
+    sqlite3_bind_blob (insertstmt, 2, (const void*)(*content), length, SQLITE_STATIC);
+
+  if (sqlite3_step (insertstmt) != SQLITE_DONE)
+    {
+      g_error("dupin_attachment_record_shared_store: %s", sqlite3_errmsg (attachment_db->db));
+      sqlite3_finalize (insertstmt);
+      sqlite3_free (query);
+      return FALSE;
+    }
+
+  sqlite3_finalize (insertstmt);
+  sqlite3_free (query);
+
+  if (upload != NULL
+      && sqlite3_changes (attachment_db->db) == 1
+      && dupin_attachment_record_blob_store_upload (attachment_db, upload,
+						    sqlite3_last_insert_rowid (attachment_db->db)) == FALSE)
+    return FALSE;
+
+  query = sqlite3_mprintf (DUPIN_ATTACHMENT_DB_SQL_SHARED_REF, hash);
+
+  if (sqlite3_exec (attachment_db->db, query, NULL, NULL, &errmsg) != SQLITE_OK)
+    {
+      g_error("dupin_attachment_record_shared_store: %s", errmsg);
+      sqlite3_free (errmsg);
+      sqlite3_free (query);
+      return FALSE;
+    }
+
+  sqlite3_free (query);
+
+  /* NOTE - the row ignored above has gone meanwhile, the caller rolls back */
+
+  if (sqlite3_changes (attachment_db->db) != 1)
+    {
+      g_warning ("dupin_attachment_record_shared_store: shared content %s vanished", hash);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+/* NOTE - this is completely inefficient due we pass the whole BLOB in RAM and on the stack,
+          uploads coming from the httpd are passed as a spool file instead */
+
+/* NOTE - the writer lock is held from storing the content till the row is inserted, a
+          concurrent delete would otherwise find no row and unlink the file just stored */
+
+static gboolean
+dupin_attachment_record_create_real (DupinAttachmentDB * attachment_db,
+                                     gchar *       id,
+                                     gchar *       title,
+                                     gsize         length,
+                                     gchar *       type,
+                                     const void ** content,
+                                     DupinAttachmentUpload * upload)
 {
   g_return_val_if_fail (attachment_db != NULL, FALSE);
   g_return_val_if_fail (id != NULL, FALSE);
   g_return_val_if_fail (title != NULL, FALSE);
   g_return_val_if_fail (length >= 0, FALSE);
   g_return_val_if_fail (type != NULL, FALSE);
-  g_return_val_if_fail (*content != NULL, FALSE);
+  g_return_val_if_fail (upload != NULL || *content != NULL, FALSE);
 
 //g_message("dupin_attachment_record_create:\n\tid=%s\n\ttitle=%s\n\tlength=%d\n\ttype=%s\n",id, title, (gint)length, type);
 
   gchar *query;
   sqlite3_stmt *insertstmt;
   gchar * md5=NULL;
+  gchar * key=NULL;
+  gboolean external = FALSE;
+
+  /* NOTE - md5 is the ETag reported to clients, key addresses the stored content */
+
+  if (upload != NULL)
+    {
+      md5 = g_strdup (dupin_attachment_upload_get_hash (upload));
+      key = g_strdup (dupin_attachment_upload_get_blob_hash (upload));
+    }
+  else
+    {
+      md5 = g_compute_checksum_for_string (DUPIN_ID_HASH_ALGO, *content, length); // inefficient of course
+      key = g_compute_checksum_for_string (DUPIN_ATTACHMENT_BLOB_HASH_ALGO, *content, length);
+    }
+
+  dupin_rwlock_writer_lock (attachment_db->rwlock);
+
+  /* NOTE - large attachments are stored once per hash outside SQLite, the row keeps hash and length only */
+
+  if (attachment_db->external_min_size > 0
+      && length >= attachment_db->external_min_size)
+    {
+      if ((upload != NULL && dupin_attachment_record_external_store_upload (attachment_db, upload) == FALSE)
+          || (upload == NULL && dupin_attachment_record_external_store (attachment_db, key, length, content) == FALSE))
+        {
+          dupin_rwlock_writer_unlock (attachment_db->rwlock);
+          g_free (md5);
+          g_free (key);
+          return FALSE;
+        }
+
+      external = TRUE;
+    }
+
+  if (dupin_attachment_db_begin_transaction (attachment_db, NULL) < 0)
+    goto dupin_attachment_record_create_real_error;
+
+  if (external == FALSE
+      && dupin_attachment_record_shared_store (attachment_db, key, length, content, upload) == FALSE)
+    {
+      dupin_attachment_db_rollback_transaction (attachment_db, NULL);
+      goto dupin_attachment_record_create_real_error;
+    }
 
   query = sqlite3_mprintf (DUPIN_ATTACHMENT_DB_SQL_INSERT);
 
@@ -81,50 +539,100 @@ dupin_attachment_record_create (DupinAttachmentDB * attachment_db,
     {
       g_error("dupin_attachment_record_create: %s", sqlite3_errmsg (attachment_db->db));
       sqlite3_free (query);
-      return FALSE;
+      dupin_attachment_db_rollback_transaction (attachment_db, NULL);
+      goto dupin_attachment_record_create_real_error;
     }
 
   sqlite3_bind_text (insertstmt, 1, id, strlen(id), SQLITE_STATIC);
   sqlite3_bind_text (insertstmt, 2, title, strlen(title), SQLITE_STATIC);
   sqlite3_bind_text (insertstmt, 3, type, strlen(type), SQLITE_STATIC);
   sqlite3_bind_int  (insertstmt, 4, length);
-  md5 = g_compute_checksum_for_string (DUPIN_ID_HASH_ALGO, *content, length); // inefficient of course
   sqlite3_bind_text (insertstmt, 5, md5, strlen(md5), SQLITE_STATIC);
-  sqlite3_bind_blob (insertstmt, 6, (const void*)(*content), length, SQLITE_STATIC);
+  sqlite3_bind_zeroblob (insertstmt, 6, 0);
+  sqlite3_bind_int  (insertstmt, 7, (external == TRUE) ? DUPIN_ATTACHMENT_STORAGE_FILE : DUPIN_ATTACHMENT_STORAGE_SHARED);
+  sqlite3_bind_text (insertstmt, 8, key, strlen(key), SQLITE_STATIC);
 
   if (sqlite3_step (insertstmt) != SQLITE_DONE)
     {
       g_error("dupin_attachment_record_create: %s", sqlite3_errmsg (attachment_db->db));
+      sqlite3_finalize (insertstmt);
       sqlite3_free (query);
-      g_free (md5);
-      return FALSE;
+      dupin_attachment_db_rollback_transaction (attachment_db, NULL);
+      goto dupin_attachment_record_create_real_error;
     }
 
   sqlite3_finalize (insertstmt);
 
   sqlite3_free (query);
+
+  if (dupin_attachment_db_commit_transaction (attachment_db, NULL) < 0)
+    {
+      dupin_attachment_db_rollback_transaction (attachment_db, NULL);
+      goto dupin_attachment_record_create_real_error;
+    }
+
+  dupin_rwlock_writer_unlock (attachment_db->rwlock);
   g_free (md5);
+  g_free (key);
 
   return TRUE;
+
+dupin_attachment_record_create_real_error:
+
+  /* NOTE - the file just stored is dropped unless another row already refers to it */
+
+  if (external == TRUE)
+    dupin_attachment_db_external_release (attachment_db, key);
+
+  dupin_rwlock_writer_unlock (attachment_db->rwlock);
+  g_free (md5);
+  g_free (key);
+
+  return FALSE;
 }
 
 gboolean
-dupin_attachment_record_delete (DupinAttachmentDB * attachment_db,
-                                gchar *        id,
-                                gchar *        title)
+dupin_attachment_record_create (DupinAttachmentDB * attachment_db,
+                                gchar *       id,
+                                gchar *       title,
+                                gsize         length,
+                                gchar *       type,
+                                const void ** content) // try to avoid to pass megabytes on stack
 {
-  g_return_val_if_fail (attachment_db != NULL, FALSE);
-  g_return_val_if_fail (id != NULL, FALSE);
-  g_return_val_if_fail (title != NULL, FALSE);
+  return dupin_attachment_record_create_real (attachment_db, id, title, length, type, content, NULL);
+}
 
+/* NOTE - deletes run under the writer lock, files are counted and unlinked while no
+          insert can be between storing a file and adding its row */
+
+static gboolean
+dupin_attachment_record_delete_real (DupinAttachmentDB * attachment_db,
+                                     gchar *        id,
+                                     gchar *        title)
+{
   gchar *query, *errmsg;
+  GList * hashes = NULL;
+  gint rc;
 
-  query = sqlite3_mprintf (DUPIN_ATTACHMENT_DB_SQL_DELETE, id, title);
+  query = sqlite3_mprintf (DUPIN_ATTACHMENT_DB_SQL_EXTERNAL_HASH, id, title);
+
+  if (sqlite3_exec (attachment_db->db, query, dupin_attachment_record_external_hashes_cb, &hashes, &errmsg) != SQLITE_OK)
+    {
+      g_error("dupin_attachment_record_delete: %s", errmsg);
+      sqlite3_free (errmsg);
+      sqlite3_free (query);
+      return FALSE;
+    }
+
+  sqlite3_free (query);
+
+  query = sqlite3_mprintf (DUPIN_ATTACHMENT_DB_SQL_DELETE, id, title, id, title);
 
 //g_message("dupin_attachment_record_delete: query=%s\n",query);
 
   if (dupin_attachment_db_begin_transaction (attachment_db, NULL) < 0)
     {
+      dupin_attachment_record_external_release (attachment_db, hashes, FALSE);
       sqlite3_free (query);
       return FALSE;
     }
@@ -135,35 +643,69 @@ dupin_attachment_record_delete (DupinAttachmentDB * attachment_db,
       sqlite3_free (errmsg);
       sqlite3_free (query);
       dupin_attachment_db_rollback_transaction (attachment_db, NULL);
+      dupin_attachment_record_external_release (attachment_db, hashes, FALSE);
       return FALSE;
     }
 
-  if (dupin_attachment_db_commit_transaction (attachment_db, NULL) < 0)
+  if ((rc = dupin_attachment_db_commit_transaction (attachment_db, NULL)) < 0)
     {
+      dupin_attachment_record_external_release (attachment_db, hashes, FALSE);
       sqlite3_free (query);
       return FALSE;
     }
 
+  dupin_attachment_record_external_release (attachment_db, hashes, (rc == 0) ? TRUE : FALSE);
+
   sqlite3_free (query);
 
   return TRUE;
 }
 
 gboolean
-dupin_attachment_record_delete_all (DupinAttachmentDB * attachment_db,
-                                    gchar *        id)
+dupin_attachment_record_delete (DupinAttachmentDB * attachment_db,
+                                gchar *        id,
+                                gchar *        title)
 {
   g_return_val_if_fail (attachment_db != NULL, FALSE);
   g_return_val_if_fail (id != NULL, FALSE);
+  g_return_val_if_fail (title != NULL, FALSE);
+
+  gboolean ret;
+
+  dupin_rwlock_writer_lock (attachment_db->rwlock);
+  ret = dupin_attachment_record_delete_real (attachment_db, id, title);
+  dupin_rwlock_writer_unlock (attachment_db->rwlock);
 
+  return ret;
+}
+
+static gboolean
+dupin_attachment_record_delete_all_real (DupinAttachmentDB * attachment_db,
+                                         gchar *        id)
+{
   gchar *query, *errmsg;
+  GList * hashes = NULL;
+  gint rc;
+
+  query = sqlite3_mprintf (DUPIN_ATTACHMENT_DB_SQL_EXTERNAL_HASHES, id);
+
+  if (sqlite3_exec (attachment_db->db, query, dupin_attachment_record_external_hashes_cb, &hashes, &errmsg) != SQLITE_OK)
+    {
+      g_error("dupin_attachment_record_delete_all: %s", errmsg);
+      sqlite3_free (errmsg);
+      sqlite3_free (query);
+      return FALSE;
+    }
+
+  sqlite3_free (query);
 
-  query = sqlite3_mprintf (DUPIN_ATTACHMENT_DB_SQL_DELETE_ALL, id);
+  query = sqlite3_mprintf (DUPIN_ATTACHMENT_DB_SQL_DELETE_ALL, id, id, id);
 
 //g_message("dupin_attachment_record_delete_all: query=%s\n",query);
 
   if (dupin_attachment_db_begin_transaction (attachment_db, NULL) < 0)
     {
+      dupin_attachment_record_external_release (attachment_db, hashes, FALSE);
       sqlite3_free (query);
       return FALSE;
     }
@@ -174,20 +716,40 @@ dupin_attachment_record_delete_all (DupinAttachmentDB * attachment_db,
       sqlite3_free (errmsg);
       sqlite3_free (query);
       dupin_attachment_db_rollback_transaction (attachment_db, NULL);
+      dupin_attachment_record_external_release (attachment_db, hashes, FALSE);
       return FALSE;
     }
 
-  if (dupin_attachment_db_commit_transaction (attachment_db, NULL) < 0)
+  if ((rc = dupin_attachment_db_commit_transaction (attachment_db, NULL)) < 0)
     {
+      dupin_attachment_record_external_release (attachment_db, hashes, FALSE);
       sqlite3_free (query);
       return FALSE;
     }
 
+  dupin_attachment_record_external_release (attachment_db, hashes, (rc == 0) ? TRUE : FALSE);
+
   sqlite3_free (query);
 
   return TRUE;
 }
 
+gboolean
+dupin_attachment_record_delete_all (DupinAttachmentDB * attachment_db,
+                                    gchar *        id)
+{
+  g_return_val_if_fail (attachment_db != NULL, FALSE);
+  g_return_val_if_fail (id != NULL, FALSE);
+
+  gboolean ret;
+
+  dupin_rwlock_writer_lock (attachment_db->rwlock);
+  ret = dupin_attachment_record_delete_all_real (attachment_db, id);
+  dupin_rwlock_writer_unlock (attachment_db->rwlock);
+
+  return ret;
+}
+
 gboolean
 dupin_attachment_record_exists (DupinAttachmentDB * attachment_db,
                                 gchar *        id,
@@ -333,10 +895,19 @@ dupin_attachment_record_read_cb (void *data, int argc, char **argv, char **col)
 	  record->hash = g_strdup (argv[i]);
 	  record->hash_len = strlen (argv[i]);
 	}
+      else if (!g_strcmp0 (col[i], "blob_hash") && argv[i])
+	{
+	  record->blob_hash = g_strdup (argv[i]);
+	}
       else if (!g_strcmp0 (col[i], "length") && argv[i])
 	{
 	  record->length = atoi(argv[i]);
         }
+      else if (!g_strcmp0 (col[i], "external") && argv[i])
+	{
+	  record->external = (atoi(argv[i]) == DUPIN_ATTACHMENT_STORAGE_FILE) ? TRUE : FALSE;
+	  record->shared = (atoi(argv[i]) == DUPIN_ATTACHMENT_STORAGE_SHARED) ? TRUE : FALSE;
+        }
       else if (!g_strcmp0 (col[i], "rowid") && argv[i])
 	{
 	  record->rowid = (gsize) g_ascii_strtoll (argv[i], NULL, 10);
@@ -663,6 +1234,7 @@ dupin_attachment_record_new (DupinAttachmentDB * attachment_db,
   record->title_len = strlen (title);
 
   record->blob = NULL;
+  record->external_fd = -1;
 
   return record;
 }
@@ -672,7 +1244,7 @@ dupin_attachment_record_close (DupinAttachmentRecord * record)
 {
   g_return_if_fail (record != NULL);
 
-  if (record->blob)
+  if (record->blob || record->external_fd >= 0)
     dupin_attachment_record_blob_close (record);
 
   if (record->attachment_db)
@@ -690,6 +1262,9 @@ dupin_attachment_record_close (DupinAttachmentRecord * record)
   if (record->hash)
     g_free (record->hash);
 
+  if (record->blob_hash)
+    g_free (record->blob_hash);
+
   g_free (record);
 }
 
@@ -741,6 +1316,14 @@ dupin_attachment_record_get_rowid (DupinAttachmentRecord * record)
   return record->rowid;
 }
 
+gboolean
+dupin_attachment_record_is_external (DupinAttachmentRecord * record)
+{
+  g_return_val_if_fail (record != NULL, FALSE);
+
+  return record->external;
+}
+
 JsonNode *
 dupin_attachment_record_get (DupinAttachmentRecord * record)
 {
@@ -806,12 +1389,82 @@ dupin_attachment_record_get_max_rowid (DupinAttachmentDB * attachment_db, gsize
   return TRUE;
 }
 
+static int
+dupin_attachment_record_shared_rowid_cb (void *data, int argc, char **argv, char **col)
+{
+  gsize *rowid = data;
+
+  if (argv[0])
+    *rowid = (gsize) g_ascii_strtoll (argv[0], NULL, 10);
+
+  return 0;
+}
+
 gboolean
 dupin_attachment_record_blob_open (DupinAttachmentRecord * record,
 				   gboolean read_write)
 {
   g_return_val_if_fail (record != NULL, FALSE);
   g_return_val_if_fail (record->blob == NULL, FALSE);
+  g_return_val_if_fail (record->external_fd < 0, FALSE);
+
+  if (record->external == TRUE)
+    {
+      /* NOTE - content-addressed files are shared between rows and never modified in place */
+
+      if (read_write == TRUE)
+        return FALSE;
+
+      gchar * file = dupin_attachment_db_external_file (record->attachment_db,
+                                                        (record->blob_hash != NULL) ? record->blob_hash : record->hash);
+
+      if (file == NULL
+          || (record->external_fd = g_open (file, O_RDONLY, 0)) < 0)
+        {
+          g_warning ("dupin_attachment_record_blob_open: cannot open %s: %s", file, g_strerror (errno));
+          g_free (file);
+          return FALSE;
+        }
+
+      g_free (file);
+
+      return TRUE;
+    }
+
+  /* NOTE - shared content is referenced by other rows and never modified in place either */
+
+  if (record->shared == TRUE)
+    {
+      gchar *query, *errmsg;
+      gsize rowid = 0;
+
+      if (read_write == TRUE)
+        return FALSE;
+
+      query = sqlite3_mprintf (DUPIN_ATTACHMENT_DB_SQL_SHARED_READ,
+                               (record->blob_hash != NULL) ? record->blob_hash : record->hash);
+
+      if (sqlite3_exec (record->attachment_db->db, query, dupin_attachment_record_shared_rowid_cb, &rowid, &errmsg) != SQLITE_OK)
+        {
+          g_error("dupin_attachment_record_blob_open: %s", errmsg);
+          sqlite3_free (errmsg);
+          sqlite3_free (query);
+          return FALSE;
+        }
+
+      sqlite3_free (query);
+
+      if (rowid == 0
+          || sqlite3_blob_open(record->attachment_db->db, "main", "DupinBlobs", "content",
+			       rowid, 0, &record->blob) != SQLITE_OK)
+        {
+          g_warning ("dupin_attachment_record_blob_open: cannot open shared content %s",
+                     (record->blob_hash != NULL) ? record->blob_hash : record->hash);
+          return FALSE;
+        }
+
+      return TRUE;
+    }
 
   if (sqlite3_blob_open(record->attachment_db->db, "main", "Dupin", "content",
 			dupin_attachment_record_get_rowid (record),
@@ -829,7 +1482,15 @@ gboolean
 dupin_attachment_record_blob_close (DupinAttachmentRecord * record)
 {
   g_return_val_if_fail (record != NULL, FALSE);
-  g_return_val_if_fail (record->blob != NULL, FALSE);
+  g_return_val_if_fail (record->blob != NULL || record->external_fd >= 0, FALSE);
+
+  if (record->external_fd >= 0)
+    {
+      close (record->external_fd);
+      record->external_fd = -1;
+
+      return TRUE;
+    }
 
   if (sqlite3_blob_close(record->blob) != SQLITE_OK)
     {
@@ -852,6 +1513,30 @@ dupin_attachment_record_blob_read (DupinAttachmentRecord * record,
 {
   g_return_val_if_fail (record != NULL, FALSE);
 
+  if (record->external_fd >= 0)
+    {
+      gssize rd;
+
+      if (offset >= record->length)
+        {
+          *bytes_read = 0;
+          return FALSE;
+        }
+
+      if (record->length - offset < count)
+        count = record->length - offset;
+
+      if ((rd = pread (record->external_fd, buf, count, offset)) <= 0)
+        {
+          *bytes_read = 0;
+          return FALSE;
+        }
+
+      *bytes_read = rd;
+
+      return TRUE;
+    }
+
   gint left = sqlite3_blob_bytes (record->blob) - offset;
 
   if (left > 0 && left < count)
@@ -868,6 +1553,65 @@ dupin_attachment_record_blob_read (DupinAttachmentRecord * record,
   return TRUE;
 }
 
+/* NOTE - send up to count bytes of an external attachment straight to out_fd without
+          copying them through user space; a non blocking out_fd which is not ready
+          returns TRUE with zero bytes_written */
+
+gboolean
+dupin_attachment_record_blob_sendfile (DupinAttachmentRecord * record,
+                                       gint out_fd,
+                                       gsize count,
+                                       gsize offset,
+                                       gsize *bytes_written,
+                                       GError **error)
+{
+  g_return_val_if_fail (record != NULL, FALSE);
+  g_return_val_if_fail (record->external_fd >= 0, FALSE);
+
+  gssize wr;
+
+  *bytes_written = 0;
+
+  if (offset >= record->length)
+    return FALSE;
+
+  if (record->length - offset < count)
+    count = record->length - offset;
+
+#ifdef HAVE_SYS_SENDFILE_H
+  off_t off = offset;
+
+  wr = sendfile (out_fd, record->external_fd, &off, count);
+#else
+  gchar buf[4096];
+  gssize rd;
+
+  if (count > sizeof (buf))
+    count = sizeof (buf);
+
+  if ((rd = pread (record->external_fd, buf, count, offset)) <= 0)
+    return FALSE;
+
+  wr = write (out_fd, buf, rd);
+#endif
+
+  if (wr < 0)
+    {
+      if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+        return TRUE;
+
+      if (error != NULL && *error != NULL)
+        g_set_error (error, dupin_error_quark (), DUPIN_ERROR_CRUD, "%s",
+		   g_strerror (errno));
+
+      return FALSE;
+    }
+
+  *bytes_written = wr;
+
+  return TRUE;
+}
+
 gboolean
 dupin_attachment_record_blob_write (DupinAttachmentRecord * record,
                                     const gchar *buf,
@@ -879,6 +1623,9 @@ dupin_attachment_record_blob_write (DupinAttachmentRecord * record,
   g_return_val_if_fail (record != NULL, FALSE);
   g_return_val_if_fail (buf != NULL, FALSE);
 
+  if (record->blob == NULL)
+    return FALSE;
+
   if (sqlite3_blob_write(record->blob, buf, count, offset) != SQLITE_OK)
     {
       return FALSE;
@@ -889,16 +1636,17 @@ dupin_attachment_record_blob_write (DupinAttachmentRecord * record,
 
 /* Insert */
 
-gboolean
-dupin_attachment_record_insert (DupinAttachmentDB * attachment_db,
-				gchar * id,
-				gchar * caller_mvcc,
-				GList * title_parts,
-			        gsize  attachment_body_size,	
-			        gchar * attachment_input_mime,
-                                const void ** attachment_body, // try to avoid to pass megabytes on stack
-                                GList ** response_list,
-                                GError ** error)
+static gboolean
+dupin_attachment_record_insert_real (DupinAttachmentDB * attachment_db,
+				     gchar * id,
+				     gchar * caller_mvcc,
+				     GList * title_parts,
+			             gsize  attachment_body_size,
+			             gchar * attachment_input_mime,
+                                     const void ** attachment_body, // try to avoid to pass megabytes on stack
+                                     DupinAttachmentUpload * attachment_upload,
+                                     GList ** response_list,
+                                     GError ** error)
 {
   g_return_val_if_fail (attachment_db != NULL, FALSE);
 
@@ -966,10 +1714,11 @@ dupin_attachment_record_insert (DupinAttachmentDB * attachment_db,
      JsonObject * obj = json_object_new ();
      json_node_take_object (obj_node, obj);
 
-     if ( dupin_attachment_record_create (attachment_db, id, title,
-                                          attachment_body_size,
-                                          attachment_input_mime,
-                                          attachment_body) == FALSE
+     if ( dupin_attachment_record_create_real (attachment_db, id, title,
+                                               attachment_body_size,
+                                               attachment_input_mime,
+                                               attachment_body,
+                                               attachment_upload) == FALSE
          || (!( record = dupin_record_create_with_id (db, obj_node, id, error))))
         {
           g_free (title);
@@ -1014,10 +1763,11 @@ dupin_attachment_record_insert (DupinAttachmentDB * attachment_db,
       obj_node = json_node_copy (record_node);
 
       if ( dupin_attachment_record_delete (attachment_db, id, title) == FALSE
-          || dupin_attachment_record_create (attachment_db, id, title,
-                                             attachment_body_size,
-                                             attachment_input_mime,
-                                             attachment_body) == FALSE
+          || dupin_attachment_record_create_real (attachment_db, id, title,
+                                                  attachment_body_size,
+                                                  attachment_input_mime,
+                                                  attachment_body,
+                                                  attachment_upload) == FALSE
           || dupin_record_update (record, obj_node, FALSE, error) == FALSE)
         {
           g_free (title);
@@ -1064,6 +1814,42 @@ dupin_attachment_record_insert (DupinAttachmentDB * attachment_db,
   return TRUE;
 }
 
+gboolean
+dupin_attachment_record_insert (DupinAttachmentDB * attachment_db,
+				gchar * id,
+				gchar * caller_mvcc,
+				GList * title_parts,
+			        gsize  attachment_body_size,
+			        gchar * attachment_input_mime,
+                                const void ** attachment_body, // try to avoid to pass megabytes on stack
+                                GList ** response_list,
+                                GError ** error)
+{
+  return dupin_attachment_record_insert_real (attachment_db, id, caller_mvcc, title_parts,
+					      attachment_body_size, attachment_input_mime,
+					      attachment_body, NULL,
+					      response_list, error);
+}
+
+gboolean
+dupin_attachment_record_insert_upload (DupinAttachmentDB * attachment_db,
+				       gchar * id,
+				       gchar * caller_mvcc,
+				       GList * title_parts,
+			               gchar * attachment_input_mime,
+                                       DupinAttachmentUpload * attachment_upload,
+                                       GList ** response_list,
+                                       GError ** error)
+{
+  g_return_val_if_fail (attachment_upload != NULL, FALSE);
+
+  return dupin_attachment_record_insert_real (attachment_db, id, caller_mvcc, title_parts,
+					      dupin_attachment_upload_get_length (attachment_upload),
+					      attachment_input_mime,
+					      NULL, attachment_upload,
+					      response_list, error);
+}
+
 /* Check wether or not the attachment has be modified */
 
 gboolean
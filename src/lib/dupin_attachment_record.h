@@ -94,6 +94,9 @@ gsize		dupin_attachment_record_get_length
 gsize 	        dupin_attachment_record_get_rowid
 					(DupinAttachmentRecord *	record);
 
+gboolean        dupin_attachment_record_is_external
+					(DupinAttachmentRecord *	record);
+
 JsonNode *
 		dupin_attachment_record_get
 					(DupinAttachmentRecord *	record);
@@ -113,6 +116,14 @@ gboolean	dupin_attachment_record_blob_read
                                          gsize *bytes_read,
                                          GError **error);
 
+gboolean	dupin_attachment_record_blob_sendfile
+					(DupinAttachmentRecord * record,
+					 gint out_fd,
+				         gsize count,
+                                         gsize offset,
+                                         gsize *bytes_written,
+                                         GError **error);
+
 gboolean	dupin_attachment_record_blob_write
 					(DupinAttachmentRecord * record,
 					 const gchar *buf,
@@ -138,6 +149,41 @@ gboolean	dupin_attachment_record_insert
                                 	 GList ** response_list,
 					 GError ** error);
 
+gboolean	dupin_attachment_record_insert_upload
+					(DupinAttachmentDB * attachment_db,
+                                	 gchar * id,
+                                	 gchar * caller_mvcc,
+                                	 GList * title_parts,
+                                	 gchar * attachment_input_mime,
+                                	 DupinAttachmentUpload * attachment_upload,
+                                	 GList ** response_list,
+					 GError ** error);
+
+/* Streaming upload of an attachment body: */
+
+DupinAttachmentUpload *
+		dupin_attachment_upload_new
+					(Dupin * d,
+					 GError ** error);
+
+gboolean	dupin_attachment_upload_write
+					(DupinAttachmentUpload * upload,
+					 const gchar * buf,
+					 gsize count,
+					 GError ** error);
+
+gsize		dupin_attachment_upload_get_length
+					(DupinAttachmentUpload * upload);
+
+const gchar *	dupin_attachment_upload_get_hash
+					(DupinAttachmentUpload * upload);
+
+const gchar *	dupin_attachment_upload_get_blob_hash
+					(DupinAttachmentUpload * upload);
+
+void		dupin_attachment_upload_free
+					(DupinAttachmentUpload * upload);
+
 gboolean	dupin_attachment_record_is_unmodified
 					(DupinAttachmentRecord * record,
                                 	 gchar *       title,
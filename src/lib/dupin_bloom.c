@@ -0,0 +1,381 @@
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "dupin_internal.h"
+#include "dupin_bloom.h"
+
+#include <string.h>
+
+/* NOTE - blocked layout: an ID hashes to one 512 bits block and sets all its bits there,
+          so a lookup touches a single cache line. The saved copy is trusted only if no
+          row was inserted since it was written, it is dropped once loaded so that a
+          crash leaves nothing stale behind. */
+
+#define DUPIN_BLOOM_BLOCK_BITS	(DUPIN_BLOOM_BLOCK_WORDS * 32)
+
+#define DUPIN_BLOOM_SQL_CREATE \
+  "CREATE TABLE IF NOT EXISTS DupinBloom (\n" \
+  "  bloom_id  INTEGER NOT NULL PRIMARY KEY,\n" \
+  "  max_rowid INTEGER NOT NULL,\n" \
+  "  items     INTEGER NOT NULL,\n" \
+  "  capacity  INTEGER NOT NULL,\n" \
+  "  bloom     BLOB NOT NULL\n" \
+  ");"
+
+#define DUPIN_BLOOM_SQL_READ \
+  "SELECT max_rowid, items, capacity, bloom FROM DupinBloom WHERE bloom_id = 0"
+
+#define DUPIN_BLOOM_SQL_INSERT \
+  "INSERT OR REPLACE INTO DupinBloom (bloom_id, max_rowid, items, capacity, bloom) VALUES (0, ?, ?, ?, ?)"
+
+#define DUPIN_BLOOM_SQL_DELETE \
+  "DELETE FROM DupinBloom"
+
+#define DUPIN_BLOOM_SQL_MAX_ROWID \
+  "SELECT max(ROWID) FROM Dupin"
+
+#define DUPIN_BLOOM_SQL_COUNT \
+  "SELECT count(DISTINCT id) FROM Dupin"
+
+#define DUPIN_BLOOM_SQL_IDS \
+  "SELECT DISTINCT id FROM Dupin"
+
+struct dupin_bloom_t
+{
+  guint32 *	words;
+  gsize		blocks;
+  gsize		capacity;
+
+  gboolean	persist;
+  gboolean	loaded;		/* from the saved copy rather than rebuilt */
+
+  gint		items;		/* atomic */
+  gint		misses;		/* atomic, lookups answered without SQL */
+};
+
+static guint64
+dupin_bloom_mix (guint64 h)
+{
+  h ^= h >> 33;
+  h *= G_GUINT64_CONSTANT (0xff51afd7ed558ccd);
+  h ^= h >> 33;
+  h *= G_GUINT64_CONSTANT (0xc4ceb9fe1a85ec53);
+  h ^= h >> 33;
+
+  return h;
+}
+
+/* NOTE - FNV-1a over the ID, then two independent finalizers: one picks the block,
+          the other provides the 7 x 9 bits positions inside it */
+
+static void
+dupin_bloom_hash (const gchar * id,
+		  guint64 *	block_hash,
+		  guint64 *	bits_hash)
+{
+  guint64 h = G_GUINT64_CONSTANT (0xcbf29ce484222325);
+
+  for (; *id; id++)
+    {
+      h ^= (guchar) *id;
+      h *= G_GUINT64_CONSTANT (0x100000001b3);
+    }
+
+  *block_hash = dupin_bloom_mix (h);
+  *bits_hash = dupin_bloom_mix (h ^ G_GUINT64_CONSTANT (0x9e3779b97f4a7c15));
+}
+
+static void
+dupin_bloom_alloc (DupinBloom * bloom,
+		   gsize	capacity)
+{
+  bloom->capacity = MAX (capacity, DUPIN_BLOOM_MIN_CAPACITY);
+  bloom->blocks = (bloom->capacity * DUPIN_BLOOM_BITS_PER_ID + DUPIN_BLOOM_BLOCK_BITS - 1) / DUPIN_BLOOM_BLOCK_BITS;
+  bloom->words = g_malloc0 (bloom->blocks * DUPIN_BLOOM_BLOCK_WORDS * sizeof (guint32));
+}
+
+static gint64
+dupin_bloom_query_int64 (sqlite3 *	db,
+			 const gchar *	query)
+{
+  sqlite3_stmt * stmt;
+  gint64 ret = -1;
+
+  if (sqlite3_prepare_v2 (db, query, -1, &stmt, NULL) != SQLITE_OK)
+    return -1;
+
+  if (sqlite3_step (stmt) == SQLITE_ROW)
+    ret = sqlite3_column_int64 (stmt, 0);
+
+  sqlite3_finalize (stmt);
+
+  return ret;
+}
+
+/* SAVED COPY *************************************************************/
+
+static gboolean
+dupin_bloom_load (DupinBloom *	bloom,
+		  sqlite3 *	db)
+{
+  sqlite3_stmt * stmt;
+  const guint32 * blob;
+  gint64 max_rowid, items, capacity;
+  gsize blob_len, i;
+  gboolean ret = FALSE;
+
+  /* NOTE - the table does not exist on stores opened before the filter was introduced */
+
+  if (sqlite3_prepare_v2 (db, DUPIN_BLOOM_SQL_READ, -1, &stmt, NULL) != SQLITE_OK)
+    return FALSE;
+
+  if (sqlite3_step (stmt) != SQLITE_ROW)
+    {
+      sqlite3_finalize (stmt);
+      return FALSE;
+    }
+
+  max_rowid = sqlite3_column_int64 (stmt, 0);
+  items = sqlite3_column_int64 (stmt, 1);
+  capacity = sqlite3_column_int64 (stmt, 2);
+  blob = sqlite3_column_blob (stmt, 3);
+  blob_len = sqlite3_column_bytes (stmt, 3);
+
+  if (blob != NULL
+      && max_rowid == MAX (dupin_bloom_query_int64 (db, DUPIN_BLOOM_SQL_MAX_ROWID), 0)
+      && items >= 0
+      && items <= capacity)
+    {
+      dupin_bloom_alloc (bloom, capacity);
+
+      if (blob_len == bloom->blocks * DUPIN_BLOOM_BLOCK_WORDS * sizeof (guint32))
+	{
+	  /* NOTE - words are saved little-endian, the file may move to another host */
+
+	  for (i = 0; i < bloom->blocks * DUPIN_BLOOM_BLOCK_WORDS; i++)
+	    {
+	      guint32 word;
+
+	      memcpy (&word, blob + i, sizeof (guint32));
+	      bloom->words[i] = GUINT32_FROM_LE (word);
+	    }
+
+	  bloom->items = (gint) items;
+	  ret = TRUE;
+	}
+      else
+	{
+	  g_free (bloom->words);
+	  bloom->words = NULL;
+	}
+    }
+
+  sqlite3_finalize (stmt);
+
+  if (bloom->persist == TRUE
+      && sqlite3_exec (db, DUPIN_BLOOM_SQL_DELETE, NULL, NULL, NULL) != SQLITE_OK)
+    g_warning ("dupin_bloom_load: cannot drop the saved filter: %s", sqlite3_errmsg (db));
+
+  return ret;
+}
+
+static void
+dupin_bloom_save (DupinBloom *	bloom,
+		  sqlite3 *	db)
+{
+  sqlite3_stmt * stmt;
+  guint32 * blob;
+  gsize i, words;
+
+  if (sqlite3_exec (db, DUPIN_BLOOM_SQL_CREATE, NULL, NULL, NULL) != SQLITE_OK
+      || sqlite3_prepare_v2 (db, DUPIN_BLOOM_SQL_INSERT, -1, &stmt, NULL) != SQLITE_OK)
+    {
+      g_warning ("dupin_bloom_save: %s", sqlite3_errmsg (db));
+      return;
+    }
+
+  words = bloom->blocks * DUPIN_BLOOM_BLOCK_WORDS;
+  blob = g_malloc (words * sizeof (guint32));
+
+  for (i = 0; i < words; i++)
+    blob[i] = GUINT32_TO_LE (g_atomic_int_get (&bloom->words[i]));
+
+  sqlite3_bind_int64 (stmt, 1, MAX (dupin_bloom_query_int64 (db, DUPIN_BLOOM_SQL_MAX_ROWID), 0));
+  sqlite3_bind_int64 (stmt, 2, g_atomic_int_get (&bloom->items));
+  sqlite3_bind_int64 (stmt, 3, bloom->capacity);
+  sqlite3_bind_blob (stmt, 4, blob, words * sizeof (guint32), g_free);
+
+  if (sqlite3_step (stmt) != SQLITE_DONE)
+    g_warning ("dupin_bloom_save: %s", sqlite3_errmsg (db));
+
+  sqlite3_finalize (stmt);
+}
+
+/* REBUILD ****************************************************************/
+
+static gboolean
+dupin_bloom_rebuild (DupinBloom *	bloom,
+		     sqlite3 *		db)
+{
+  sqlite3_stmt * stmt;
+  gint64 count;
+  gint rc;
+
+  /* NOTE - room for the store to double before the false positives rate degrades,
+	    a filter over capacity is resized at the next open */
+
+  count = dupin_bloom_query_int64 (db, DUPIN_BLOOM_SQL_COUNT);
+
+  dupin_bloom_alloc (bloom, MAX (count, 0) * 2);
+
+  if (sqlite3_prepare_v2 (db, DUPIN_BLOOM_SQL_IDS, -1, &stmt, NULL) != SQLITE_OK)
+    {
+      g_warning ("dupin_bloom_rebuild: %s", sqlite3_errmsg (db));
+      return FALSE;
+    }
+
+  while ((rc = sqlite3_step (stmt)) == SQLITE_ROW)
+    {
+      const gchar * id = (const gchar *) sqlite3_column_text (stmt, 0);
+
+      if (id != NULL)
+	dupin_bloom_add (bloom, id);
+    }
+
+  sqlite3_finalize (stmt);
+
+  if (rc != SQLITE_DONE)
+    {
+      g_warning ("dupin_bloom_rebuild: %s", sqlite3_errmsg (db));
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+/* PUBLIC *****************************************************************/
+
+DupinBloom *
+dupin_bloom_new (sqlite3 *	db,
+		 gboolean	persist)
+{
+  DupinBloom * bloom;
+  gint64 start = dupin_trace_begin ();
+
+  g_return_val_if_fail (db != NULL, NULL);
+
+  bloom = g_malloc0 (sizeof (DupinBloom));
+
+  bloom->persist = persist;
+
+  /* NOTE - a partial filter would give false misses, the store goes without one instead */
+
+  if ((bloom->loaded = dupin_bloom_load (bloom, db)) == FALSE
+      && dupin_bloom_rebuild (bloom, db) == FALSE)
+    {
+      g_free (bloom->words);
+      g_free (bloom);
+      return NULL;
+    }
+
+  dupin_trace_end ("bloom", bloom->loaded == TRUE ? "load" : "rebuild", NULL, start);
+
+  return bloom;
+}
+
+void
+dupin_bloom_free (DupinBloom *	bloom,
+		  sqlite3 *	db)
+{
+  g_return_if_fail (bloom != NULL);
+
+  if (bloom->persist == TRUE
+      && db != NULL)
+    dupin_bloom_save (bloom, db);
+
+  g_free (bloom->words);
+  g_free (bloom);
+}
+
+void
+dupin_bloom_add (DupinBloom *	bloom,
+		 const gchar *	id)
+{
+  guint64 block_hash, bits_hash;
+  guint32 * block;
+  guint i;
+
+  g_return_if_fail (id != NULL);
+
+  if (bloom == NULL)
+    return;
+
+  dupin_bloom_hash (id, &block_hash, &bits_hash);
+
+  block = bloom->words + (block_hash % bloom->blocks) * DUPIN_BLOOM_BLOCK_WORDS;
+
+  for (i = 0; i < DUPIN_BLOOM_HASHES; i++)
+    {
+      guint bit = (bits_hash >> (i * 9)) & (DUPIN_BLOOM_BLOCK_BITS - 1);
+
+      g_atomic_int_or (&block[bit >> 5], 1U << (bit & 31));
+    }
+
+  g_atomic_int_inc (&bloom->items);
+}
+
+gboolean
+dupin_bloom_may_contain (DupinBloom *	bloom,
+			 const gchar *	id)
+{
+  guint64 block_hash, bits_hash;
+  guint32 * block;
+  guint i;
+
+  /* NOTE - without a filter every ID may be there */
+
+  if (bloom == NULL
+      || id == NULL)
+    return TRUE;
+
+  dupin_bloom_hash (id, &block_hash, &bits_hash);
+
+  block = bloom->words + (block_hash % bloom->blocks) * DUPIN_BLOOM_BLOCK_WORDS;
+
+  for (i = 0; i < DUPIN_BLOOM_HASHES; i++)
+    {
+      guint bit = (bits_hash >> (i * 9)) & (DUPIN_BLOOM_BLOCK_BITS - 1);
+
+      if (!(g_atomic_int_get (&block[bit >> 5]) & (1U << (bit & 31))))
+	{
+	  g_atomic_int_inc (&bloom->misses);
+	  return FALSE;
+	}
+    }
+
+  return TRUE;
+}
+
+JsonNode *
+dupin_bloom_stats (DupinBloom * bloom)
+{
+  JsonNode * node;
+  JsonObject * obj;
+
+  g_return_val_if_fail (bloom != NULL, NULL);
+
+  node = json_node_new (JSON_NODE_OBJECT);
+  obj = json_object_new ();
+  json_node_take_object (node, obj);
+
+  json_object_set_int_member (obj, "items", g_atomic_int_get (&bloom->items));
+  json_object_set_int_member (obj, "capacity", bloom->capacity);
+  json_object_set_int_member (obj, "size", bloom->blocks * DUPIN_BLOOM_BLOCK_WORDS * sizeof (guint32));
+  json_object_set_int_member (obj, "misses", g_atomic_int_get (&bloom->misses));
+  json_object_set_boolean_member (obj, "loaded", bloom->loaded);
+
+  return node;
+}
+
+/* EOF */
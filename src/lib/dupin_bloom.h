@@ -0,0 +1,42 @@
+#ifndef _DUPIN_BLOOM_H_
+#define _DUPIN_BLOOM_H_
+
+#include <dupin.h>
+#include <sqlite3.h>
+#include <json-glib/json-glib.h>
+
+G_BEGIN_DECLS
+
+/* NOTE - the filter holds every ID ever inserted into the Dupin table of a store, so a miss
+          is definite and the SQL lookup can be skipped. Purged or compacted away IDs stay
+          in as harmless false positives until the filter is next rebuilt. */
+
+#define DUPIN_BLOOM_BLOCK_WORDS		16	/* 512 bits, one cache line */
+#define DUPIN_BLOOM_HASHES		7	/* bits set per ID, all in the same block */
+#define DUPIN_BLOOM_BITS_PER_ID		10	/* ~1% false positives at capacity */
+#define DUPIN_BLOOM_MIN_CAPACITY	65536
+
+typedef struct dupin_bloom_t DupinBloom;
+
+/* Loads the filter saved at the last close, or rebuilds it from the Dupin table.
+   NULL if neither worked, a NULL filter may contain any ID: */
+DupinBloom *	dupin_bloom_new		(sqlite3 *	db,
+					 gboolean	persist);
+
+/* Saves the filter into db first when it was created with persist: */
+void		dupin_bloom_free	(DupinBloom *	bloom,
+					 sqlite3 *	db);
+
+void		dupin_bloom_add		(DupinBloom *	bloom,
+					 const gchar *	id);
+
+gboolean	dupin_bloom_may_contain	(DupinBloom *	bloom,
+					 const gchar *	id);
+
+JsonNode *	dupin_bloom_stats	(DupinBloom *	bloom);
+
+G_END_DECLS
+
+#endif
+
+/* EOF */
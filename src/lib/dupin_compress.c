@@ -0,0 +1,474 @@
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "dupin_internal.h"
+#include "dupin_compress.h"
+
+#include <string.h>
+
+#ifdef HAVE_ZSTD
+#  include <zstd.h>
+#  include <zdict.h>
+#endif
+
+/* NOTE - each store keeps the dictionaries it ever trained, rows compressed with an older
+          one stay readable and the Zstd frame header tells which dictionary to use */
+
+#define DUPIN_COMPRESS_SQL_CREATE \
+  "CREATE TABLE IF NOT EXISTS DupinCompressDict (\n" \
+  "  dict_id   INTEGER NOT NULL PRIMARY KEY,\n" \
+  "  dict      BLOB NOT NULL\n" \
+  ");"
+
+#define DUPIN_COMPRESS_SQL_READ \
+  "SELECT dict_id, dict FROM DupinCompressDict ORDER BY ROWID"
+
+#define DUPIN_COMPRESS_SQL_INSERT \
+  "INSERT OR REPLACE INTO DupinCompressDict (dict_id, dict) VALUES (?, ?)"
+
+struct dupin_compress_t
+{
+  GRWLock	rwlock;
+
+  gboolean	enabled;
+  gint		level;
+  gsize		dict_size;
+
+#ifdef HAVE_ZSTD
+  ZSTD_CDict *	cdict;		/* latest trained dictionary, NULL if none */
+  GHashTable *	ddicts;		/* dict_id -> ZSTD_DDict */
+#endif
+};
+
+#ifdef HAVE_ZSTD
+
+/* NOTE - compression contexts are expensive to create, one per thread is kept around */
+
+static void
+dupin_compress_cctx_free (gpointer cctx)
+{
+  ZSTD_freeCCtx (cctx);
+}
+
+static void
+dupin_compress_dctx_free (gpointer dctx)
+{
+  ZSTD_freeDCtx (dctx);
+}
+
+static void
+dupin_compress_ddict_free (gpointer ddict)
+{
+  ZSTD_freeDDict (ddict);
+}
+
+static GPrivate dupin_compress_cctx = G_PRIVATE_INIT (dupin_compress_cctx_free);
+static GPrivate dupin_compress_dctx = G_PRIVATE_INIT (dupin_compress_dctx_free);
+
+static ZSTD_CCtx *
+dupin_compress_get_cctx (void)
+{
+  ZSTD_CCtx * cctx = g_private_get (&dupin_compress_cctx);
+
+  if (cctx == NULL)
+    {
+      cctx = ZSTD_createCCtx ();
+      g_private_set (&dupin_compress_cctx, cctx);
+    }
+
+  return cctx;
+}
+
+static ZSTD_DCtx *
+dupin_compress_get_dctx (void)
+{
+  ZSTD_DCtx * dctx = g_private_get (&dupin_compress_dctx);
+
+  if (dctx == NULL)
+    {
+      dctx = ZSTD_createDCtx ();
+      g_private_set (&dupin_compress_dctx, dctx);
+    }
+
+  return dctx;
+}
+
+static void
+dupin_compress_add_dict (DupinCompress * compress,
+			 guint dict_id,
+			 const void * dict,
+			 gsize dict_len)
+{
+  ZSTD_DDict * ddict = ZSTD_createDDict (dict, dict_len);
+  ZSTD_CDict * cdict = ZSTD_createCDict (dict, dict_len, compress->level);
+
+  g_rw_lock_writer_lock (&compress->rwlock);
+
+  g_hash_table_replace (compress->ddicts, GUINT_TO_POINTER (dict_id), ddict);
+
+  if (compress->cdict != NULL)
+    ZSTD_freeCDict (compress->cdict);
+
+  compress->cdict = cdict;
+
+  g_rw_lock_writer_unlock (&compress->rwlock);
+}
+
+static void
+dupin_compress_load (DupinCompress * compress,
+		     sqlite3 * db)
+{
+  sqlite3_stmt * stmt;
+
+  /* NOTE - the table does not exist on stores which never had compression enabled */
+
+  if (sqlite3_prepare_v2 (db, DUPIN_COMPRESS_SQL_READ, -1, &stmt, NULL) != SQLITE_OK)
+    return;
+
+  while (sqlite3_step (stmt) == SQLITE_ROW)
+    {
+      dupin_compress_add_dict (compress,
+			       (guint) sqlite3_column_int64 (stmt, 0),
+			       sqlite3_column_blob (stmt, 1),
+			       sqlite3_column_bytes (stmt, 1));
+    }
+
+  sqlite3_finalize (stmt);
+}
+
+#endif
+
+DupinCompress *
+dupin_compress_new (sqlite3 *	db,
+		    gboolean	enabled,
+		    gint	level,
+		    gsize	dict_size)
+{
+  DupinCompress * compress;
+
+  g_return_val_if_fail (db != NULL, NULL);
+
+  compress = g_malloc0 (sizeof (DupinCompress));
+
+  g_rw_lock_init (&compress->rwlock);
+
+  compress->enabled = enabled;
+  compress->level = level;
+  compress->dict_size = dict_size;
+
+#ifdef HAVE_ZSTD
+  compress->ddicts = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, dupin_compress_ddict_free);
+
+  if (enabled == TRUE
+      && sqlite3_exec (db, DUPIN_COMPRESS_SQL_CREATE, NULL, NULL, NULL) != SQLITE_OK)
+    g_warning ("dupin_compress_new: cannot create dictionary table: %s", sqlite3_errmsg (db));
+
+  dupin_compress_load (compress, db);
+#else
+  if (enabled == TRUE)
+    {
+      g_warning ("dupin_compress_new: compression requested but not built in (configure --with-zstd)");
+      compress->enabled = FALSE;
+    }
+#endif
+
+  return compress;
+}
+
+void
+dupin_compress_free (DupinCompress * compress)
+{
+  g_return_if_fail (compress != NULL);
+
+#ifdef HAVE_ZSTD
+  if (compress->cdict != NULL)
+    ZSTD_freeCDict (compress->cdict);
+
+  g_hash_table_destroy (compress->ddicts);
+#endif
+
+  g_rw_lock_clear (&compress->rwlock);
+
+  g_free (compress);
+}
+
+gboolean
+dupin_compress_is_encoded (const gchar * str,
+			   gsize	 str_len)
+{
+  if (str == NULL
+      || str_len < DUPIN_COMPRESS_PREFIX_LEN)
+    return FALSE;
+
+  return strncmp (str, DUPIN_COMPRESS_PREFIX, DUPIN_COMPRESS_PREFIX_LEN) ? FALSE : TRUE;
+}
+
+/* NOTE - returns NULL when the object must be stored as plain JSON */
+
+gchar *
+dupin_compress_encode (DupinCompress * compress,
+		       const gchar *   obj,
+		       gsize	       obj_len,
+		       gsize *	       encoded_len)
+{
+#ifdef HAVE_ZSTD
+  gchar * buf;
+  gchar * b64;
+  gchar * ret;
+  gsize bound;
+  size_t size;
+
+  if (compress == NULL
+      || compress->enabled == FALSE
+      || obj == NULL)
+    return NULL;
+
+  bound = ZSTD_compressBound (obj_len);
+  buf = g_malloc (bound);
+
+  g_rw_lock_reader_lock (&compress->rwlock);
+
+  if (compress->cdict != NULL)
+    size = ZSTD_compress_usingCDict (dupin_compress_get_cctx (), buf, bound, obj, obj_len, compress->cdict);
+  else
+    size = ZSTD_compressCCtx (dupin_compress_get_cctx (), buf, bound, obj, obj_len, compress->level);
+
+  g_rw_lock_reader_unlock (&compress->rwlock);
+
+  /* NOTE - small objects do not pay back the base64 overhead */
+
+  if (ZSTD_isError (size)
+      || DUPIN_COMPRESS_PREFIX_LEN + ((size + 2) / 3) * 4 >= obj_len)
+    {
+      g_free (buf);
+      return NULL;
+    }
+
+  b64 = g_base64_encode ((const guchar *) buf, size);
+  g_free (buf);
+
+  ret = g_strconcat (DUPIN_COMPRESS_PREFIX, b64, NULL);
+  g_free (b64);
+
+  if (encoded_len != NULL)
+    *encoded_len = strlen (ret);
+
+  return ret;
+#else
+  return NULL;
+#endif
+}
+
+gchar *
+dupin_compress_decode (DupinCompress * compress,
+		       const gchar *   str,
+		       gsize	       str_len,
+		       gsize *	       obj_len,
+		       GError **       error)
+{
+#ifdef HAVE_ZSTD
+  gchar * b64;
+  guchar * buf;
+  gchar * obj;
+  gsize size;
+  unsigned long long len;
+  unsigned dict_id;
+  ZSTD_DDict * ddict = NULL;
+  size_t ret;
+#endif
+
+  g_return_val_if_fail (dupin_compress_is_encoded (str, str_len) == TRUE, NULL);
+
+#ifdef HAVE_ZSTD
+
+  b64 = g_strndup (str + DUPIN_COMPRESS_PREFIX_LEN, str_len - DUPIN_COMPRESS_PREFIX_LEN);
+  buf = g_base64_decode (b64, &size);
+  g_free (b64);
+
+  len = ZSTD_getFrameContentSize (buf, size);
+
+  if (len == ZSTD_CONTENTSIZE_ERROR
+      || len == ZSTD_CONTENTSIZE_UNKNOWN)
+    {
+      g_set_error (error, dupin_error_quark (), DUPIN_ERROR_CRUD,
+		   "Invalid compressed object");
+      g_free (buf);
+      return NULL;
+    }
+
+  dict_id = ZSTD_getDictID_fromFrame (buf, size);
+
+  obj = g_malloc (len + 1);
+
+  if (compress != NULL)
+    g_rw_lock_reader_lock (&compress->rwlock);
+
+  if (dict_id != 0
+      && (compress == NULL
+          || !(ddict = g_hash_table_lookup (compress->ddicts, GUINT_TO_POINTER (dict_id)))))
+    {
+      if (compress != NULL)
+        g_rw_lock_reader_unlock (&compress->rwlock);
+
+      g_set_error (error, dupin_error_quark (), DUPIN_ERROR_CRUD,
+		   "Missing compression dictionary %u", dict_id);
+      g_free (buf);
+      g_free (obj);
+      return NULL;
+    }
+
+  if (ddict != NULL)
+    ret = ZSTD_decompress_usingDDict (dupin_compress_get_dctx (), obj, len, buf, size, ddict);
+  else
+    ret = ZSTD_decompressDCtx (dupin_compress_get_dctx (), obj, len, buf, size);
+
+  if (compress != NULL)
+    g_rw_lock_reader_unlock (&compress->rwlock);
+
+  g_free (buf);
+
+  if (ZSTD_isError (ret))
+    {
+      g_set_error (error, dupin_error_quark (), DUPIN_ERROR_CRUD,
+		   "Cannot decompress object: %s", ZSTD_getErrorName (ret));
+      g_free (obj);
+      return NULL;
+    }
+
+  obj[ret] = '\0';
+
+  if (obj_len != NULL)
+    *obj_len = ret;
+
+  return obj;
+#else
+  g_set_error (error, dupin_error_quark (), DUPIN_ERROR_CRUD,
+	       "Compressed object found but compression is not built in");
+  return NULL;
+#endif
+}
+
+/* NOTE - train a new dictionary out of the latest objects of the store, called while compacting */
+
+gboolean
+dupin_compress_train (DupinCompress * compress,
+		      sqlite3 *	      db,
+		      const gchar *   samples_query)
+{
+#ifdef HAVE_ZSTD
+  sqlite3_stmt * stmt;
+  GString * samples;
+  GArray * sizes;
+  gchar * dict;
+  size_t dict_len;
+  guint dict_id;
+#endif
+
+  g_return_val_if_fail (db != NULL, FALSE);
+  g_return_val_if_fail (samples_query != NULL, FALSE);
+
+#ifdef HAVE_ZSTD
+
+  if (compress == NULL
+      || compress->enabled == FALSE
+      || compress->dict_size == 0)
+    return FALSE;
+
+  if (sqlite3_prepare_v2 (db, samples_query, -1, &stmt, NULL) != SQLITE_OK)
+    {
+      g_warning ("dupin_compress_train: %s", sqlite3_errmsg (db));
+      return FALSE;
+    }
+
+  samples = g_string_new (NULL);
+  sizes = g_array_new (FALSE, FALSE, sizeof (size_t));
+
+  while (sqlite3_step (stmt) == SQLITE_ROW)
+    {
+      const gchar * str = (const gchar *) sqlite3_column_text (stmt, 0);
+      gsize str_len = sqlite3_column_bytes (stmt, 0);
+      size_t sample_len;
+
+      if (str == NULL || str_len == 0)
+        continue;
+
+      if (dupin_compress_is_encoded (str, str_len) == TRUE)
+        {
+          gsize obj_len = 0;
+          gchar * obj = dupin_compress_decode (compress, str, str_len, &obj_len, NULL);
+
+          if (obj == NULL)
+            continue;
+
+          g_string_append_len (samples, obj, obj_len);
+          sample_len = obj_len;
+          g_free (obj);
+        }
+      else
+        {
+          g_string_append_len (samples, str, str_len);
+          sample_len = str_len;
+        }
+
+      g_array_append_val (sizes, sample_len);
+    }
+
+  sqlite3_finalize (stmt);
+
+  /* NOTE - with too little data zstd cannot build a dictionary worth using */
+
+  if (samples->len < compress->dict_size * 10)
+    {
+      g_string_free (samples, TRUE);
+      g_array_free (sizes, TRUE);
+      return FALSE;
+    }
+
+  dict = g_malloc (compress->dict_size);
+
+  dict_len = ZDICT_trainFromBuffer (dict, compress->dict_size,
+				    samples->str, (const size_t *) sizes->data, sizes->len);
+
+  g_string_free (samples, TRUE);
+  g_array_free (sizes, TRUE);
+
+  if (ZDICT_isError (dict_len)
+      || !(dict_id = ZDICT_getDictID (dict, dict_len)))
+    {
+      g_free (dict);
+      return FALSE;
+    }
+
+  if (sqlite3_exec (db, DUPIN_COMPRESS_SQL_CREATE, NULL, NULL, NULL) != SQLITE_OK
+      || sqlite3_prepare_v2 (db, DUPIN_COMPRESS_SQL_INSERT, -1, &stmt, NULL) != SQLITE_OK)
+    {
+      g_warning ("dupin_compress_train: %s", sqlite3_errmsg (db));
+      g_free (dict);
+      return FALSE;
+    }
+
+  sqlite3_bind_int64 (stmt, 1, dict_id);
+  sqlite3_bind_blob (stmt, 2, dict, dict_len, SQLITE_STATIC);
+
+  if (sqlite3_step (stmt) != SQLITE_DONE)
+    {
+      g_warning ("dupin_compress_train: %s", sqlite3_errmsg (db));
+      sqlite3_finalize (stmt);
+      g_free (dict);
+      return FALSE;
+    }
+
+  sqlite3_finalize (stmt);
+
+  dupin_compress_add_dict (compress, dict_id, dict, dict_len);
+
+  g_free (dict);
+
+  return TRUE;
+#else
+  return FALSE;
+#endif
+}
+
+/* EOF */
@@ -0,0 +1,48 @@
+#ifndef _DUPIN_COMPRESS_H_
+#define _DUPIN_COMPRESS_H_
+
+#include <dupin.h>
+#include <sqlite3.h>
+
+G_BEGIN_DECLS
+
+/* NOTE - compressed JSON bodies are stored as text so that the existing SQL statements
+          keep working, the prefix never starts a serialized JSON object */
+
+#define DUPIN_COMPRESS_PREFIX		"zstd:"
+#define DUPIN_COMPRESS_PREFIX_LEN	5
+
+#define DUPIN_COMPRESS_SAMPLES_MAX	4096
+
+typedef struct dupin_compress_t	DupinCompress;
+
+DupinCompress *	dupin_compress_new		(sqlite3 *	db,
+						 gboolean	enabled,
+						 gint		level,
+						 gsize		dict_size);
+
+void		dupin_compress_free		(DupinCompress * compress);
+
+gboolean	dupin_compress_is_encoded	(const gchar *	str,
+						 gsize		str_len);
+
+gchar *		dupin_compress_encode		(DupinCompress * compress,
+						 const gchar *	obj,
+						 gsize		obj_len,
+						 gsize *	encoded_len);
+
+gchar *		dupin_compress_decode		(DupinCompress * compress,
+						 const gchar *	str,
+						 gsize		str_len,
+						 gsize *	obj_len,
+						 GError **	error);
+
+gboolean	dupin_compress_train		(DupinCompress * compress,
+						 sqlite3 *	db,
+						 const gchar *	samples_query);
+
+G_END_DECLS
+
+#endif
+
+/* EOF */
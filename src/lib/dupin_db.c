@@ -7,6 +7,8 @@
 #include "dupin_date.h"
 #include "dupin_db.h"
 
+#include "../httpd/configure.h"
+
 #include <stdlib.h>
 #include <string.h>
 
@@ -32,6 +34,13 @@
   "CREATE INDEX IF NOT EXISTS DupinObj ON Dupin (obj);\n" \
   "CREATE INDEX IF NOT EXISTS DupinIdRevHead ON Dupin (id,rev_head);"
 
+#define DUPIN_DB_SQL_DROP_INDEX \
+  "DROP INDEX IF EXISTS DupinId;\n" \
+  "DROP INDEX IF EXISTS DupinIdRev;\n" \
+  "DROP INDEX IF EXISTS DupinType;\n" \
+  "DROP INDEX IF EXISTS DupinObj;\n" \
+  "DROP INDEX IF EXISTS DupinIdRevHead;"
+
 #define DUPIN_DB_SQL_DESC_CREATE \
   "CREATE TABLE IF NOT EXISTS DupinDB (\n" \
   "  total_doc_ins   INTEGER NOT NULL DEFAULT 0,\n" \
@@ -65,6 +74,14 @@
 #define DUPIN_DB_SQL_TOTAL \
         "SELECT count(*) AS c FROM Dupin AS d WHERE d.rev_head = 'TRUE' "
 
+#define DUPIN_DB_SQL_UPDATE_TOTALS \
+        "UPDATE DupinDB SET " \
+        "total_doc_ins = (SELECT count(*) FROM Dupin WHERE rev_head = 'TRUE' AND deleted = 'FALSE'), " \
+        "total_doc_del = (SELECT count(*) FROM Dupin WHERE rev_head = 'TRUE' AND deleted = 'TRUE')"
+
+#define DUPIN_DB_SQL_COMPRESS_SAMPLES \
+        "SELECT obj FROM Dupin WHERE rev_head = 'TRUE' AND deleted = 'FALSE' ORDER BY seq DESC LIMIT %d"
+
 #define DUPIN_DB_COMPACT_COUNT 1000
 
 gchar **
@@ -78,11 +95,11 @@ dupin_get_databases (Dupin * d)
 
   g_return_val_if_fail (d != NULL, NULL);
 
-  g_rw_lock_reader_lock (d->rwlock);
+  dupin_rwlock_reader_lock (d->rwlock);
 
   if (!(size = g_hash_table_size (d->dbs)))
     {
-      g_rw_lock_reader_unlock (d->rwlock);
+      dupin_rwlock_reader_unlock (d->rwlock);
       return NULL;
     }
 
@@ -95,7 +112,7 @@ dupin_get_databases (Dupin * d)
 
   ret[i] = NULL;
 
-  g_rw_lock_reader_unlock (d->rwlock);
+  dupin_rwlock_reader_unlock (d->rwlock);
 
   return ret;
 }
@@ -105,10 +122,10 @@ dupin_database_exists (Dupin * d, gchar * db_name)
 {
   gboolean ret;
 
-  g_rw_lock_reader_lock (d->rwlock);
+  dupin_rwlock_reader_lock (d->rwlock);
   DupinDB * db = g_hash_table_lookup (d->dbs, db_name);
   ret = ((db != NULL) && db->todelete == FALSE) ? TRUE : FALSE;
-  g_rw_lock_reader_unlock (d->rwlock);
+  dupin_rwlock_reader_unlock (d->rwlock);
 
   return ret;
 }
@@ -121,7 +138,7 @@ dupin_database_open (Dupin * d, gchar * db, GError ** error)
   g_return_val_if_fail (d != NULL, NULL);
   g_return_val_if_fail (db != NULL, NULL);
 
-  g_rw_lock_reader_lock (d->rwlock);
+  dupin_rwlock_reader_lock (d->rwlock);
 
   if (!(ret = g_hash_table_lookup (d->dbs, db)) || ret->todelete == TRUE)
     {
@@ -129,7 +146,7 @@ dupin_database_open (Dupin * d, gchar * db, GError ** error)
         g_set_error (error, dupin_error_quark (), DUPIN_ERROR_OPEN,
 		 "Database '%s' doesn't exist.", db);
 
-      g_rw_lock_reader_unlock (d->rwlock);
+      dupin_rwlock_reader_unlock (d->rwlock);
       return NULL;
     }
   else
@@ -141,7 +158,7 @@ dupin_database_open (Dupin * d, gchar * db, GError ** error)
 #endif
     }
 
-  g_rw_lock_reader_unlock (d->rwlock);
+  dupin_rwlock_reader_unlock (d->rwlock);
 
   return ret;
 }
@@ -160,14 +177,14 @@ dupin_database_new (Dupin * d, gchar * dbname, GError ** error)
   g_return_val_if_fail (dbname != NULL, NULL);
   g_return_val_if_fail (dupin_util_is_valid_db_name (dbname) == TRUE, NULL);
 
-  g_rw_lock_writer_lock (d->rwlock);
+  dupin_rwlock_writer_lock (d->rwlock);
 
   if ((ret = g_hash_table_lookup (d->dbs, dbname)))
     {
       if (error != NULL && *error != NULL)
         g_set_error (error, dupin_error_quark (), DUPIN_ERROR_OPEN,
 		   "Database '%s' already exist.", dbname);
-      g_rw_lock_writer_unlock (d->rwlock);
+      dupin_rwlock_writer_unlock (d->rwlock);
       return NULL;
     }
 
@@ -177,7 +194,7 @@ dupin_database_new (Dupin * d, gchar * dbname, GError ** error)
 
   if (!(ret = dupin_db_connect (d, dbname, path, DP_SQLITE_OPEN_CREATE, error)))
     {
-      g_rw_lock_writer_unlock (d->rwlock);
+      dupin_rwlock_writer_unlock (d->rwlock);
       g_free (path);
       return NULL;
     }
@@ -194,7 +211,7 @@ dupin_database_new (Dupin * d, gchar * dbname, GError ** error)
 
   if (dupin_database_begin_transaction (ret, error) < 0)
     {
-      g_rw_lock_writer_unlock (d->rwlock);
+      dupin_rwlock_writer_unlock (d->rwlock);
       dupin_db_disconnect (ret);
       return NULL;
     }
@@ -207,7 +224,7 @@ dupin_database_new (Dupin * d, gchar * dbname, GError ** error)
 
   if (sqlite3_exec (ret->db, str, NULL, NULL, &errmsg) != SQLITE_OK)
     {
-      g_rw_lock_writer_unlock (d->rwlock);
+      dupin_rwlock_writer_unlock (d->rwlock);
       if (error != NULL && *error != NULL)
         g_set_error (error, dupin_error_quark (), DUPIN_ERROR_OPEN, "%s",
                        errmsg);
@@ -221,7 +238,7 @@ dupin_database_new (Dupin * d, gchar * dbname, GError ** error)
 
   if (dupin_database_commit_transaction (ret, error) < 0)
     {
-      g_rw_lock_writer_unlock (d->rwlock);
+      dupin_rwlock_writer_unlock (d->rwlock);
       dupin_db_disconnect (ret);
       return NULL;
     }
@@ -229,7 +246,7 @@ dupin_database_new (Dupin * d, gchar * dbname, GError ** error)
   /* NOTE - the respective map and reduce threads will add +1 top the these values */
   sqlite3_free (str);
 
-  g_rw_lock_writer_unlock (d->rwlock);
+  dupin_rwlock_writer_unlock (d->rwlock);
 
   /* NOTE - create one default link base and attachment database named after the main database */
 
@@ -273,7 +290,7 @@ dupin_database_ref (DupinDB * db)
 {
   g_return_if_fail (db != NULL);
 
-  g_rw_lock_writer_lock (db->rwlock);
+  dupin_rwlock_writer_lock (db->rwlock);
 
   db->ref++;
 
@@ -281,7 +298,7 @@ dupin_database_ref (DupinDB * db)
   fprintf(stderr,"dupin_database_ref: (%p) name=%s \t ref++=%d\n", g_thread_self (), db->name, (gint) db->ref);
 #endif
 
-  g_rw_lock_writer_unlock (db->rwlock);
+  dupin_rwlock_writer_unlock (db->rwlock);
 }
 
 void
@@ -293,7 +310,7 @@ dupin_database_unref (DupinDB * db)
 
   d = db->d;
 
-  g_rw_lock_writer_lock (db->rwlock);
+  dupin_rwlock_writer_lock (db->rwlock);
 
   if (db->ref > 0)
     {
@@ -304,7 +321,7 @@ dupin_database_unref (DupinDB * db)
 #endif
     }
 
-  g_rw_lock_writer_unlock (db->rwlock);
+  dupin_rwlock_writer_unlock (db->rwlock);
 
   if (db->todelete == TRUE &&
       dupin_database_is_compacting (db) == FALSE)
@@ -321,9 +338,9 @@ dupin_database_unref (DupinDB * db)
           if (db->default_attachment_db != NULL)
             dupin_attachment_db_unref (db->default_attachment_db);
 
-          g_rw_lock_writer_lock (d->rwlock);
+          dupin_rwlock_writer_lock (d->rwlock);
           g_hash_table_remove (d->dbs, db->name);
-          g_rw_lock_writer_unlock (d->rwlock);
+          dupin_rwlock_writer_unlock (d->rwlock);
         }
     }
 }
@@ -348,9 +365,9 @@ dupin_database_delete (DupinDB * db, GError ** error)
       return FALSE;
     }
 
-  g_rw_lock_writer_lock (db->rwlock);
+  dupin_rwlock_writer_lock (db->rwlock);
   db->todelete = TRUE;
-  g_rw_lock_writer_unlock (db->rwlock);
+  dupin_rwlock_writer_unlock (db->rwlock);
 
   return TRUE;
 }
@@ -362,6 +379,16 @@ dupin_database_get_name (DupinDB * db)
   return db->name;
 }
 
+/* NOTE - the sequence changes whenever the content may have changed, it starts at a
+          random value so that a store deleted and created again does not repeat it */
+
+guint
+dupin_database_get_update_seq (DupinDB * db)
+{
+  g_return_val_if_fail (db != NULL, 0);
+  return (guint) g_atomic_int_get ((gint *) &db->update_seq);
+}
+
 gsize
 dupin_database_get_size (DupinDB * db)
 {
@@ -375,6 +402,29 @@ dupin_database_get_size (DupinDB * db)
   return (gsize) st.st_size;
 }
 
+/* NOTE - contention of the store lock and SQLite I/O of the store connection */
+
+JsonNode *
+dupin_database_get_stats (DupinDB * db)
+{
+  JsonNode * node;
+  JsonObject * obj;
+
+  g_return_val_if_fail (db != NULL, NULL);
+
+  node = json_node_new (JSON_NODE_OBJECT);
+  obj = json_object_new ();
+  json_node_take_object (node, obj);
+
+  json_object_set_member (obj, "lock", dupin_rwlock_stats (db->rwlock));
+  json_object_set_member (obj, "io", dupin_iostats_stats (&db->iostats, db->db, db->path));
+
+  if (db->bloom != NULL)
+    json_object_set_member (obj, "bloom", dupin_bloom_stats (db->bloom));
+
+  return node;
+}
+
 static int
 dupin_database_get_creation_time_cb (void *data, int argc, char **argv, char **col)
 {
@@ -425,7 +475,8 @@ dupin_database_generate_id_real (DupinDB * db,
 
       if (id != NULL)
         {
-          if (dupin_record_exists_real (db, id, FALSE) == TRUE)
+          if (dupin_util_generate_id_is_unique () == FALSE
+              && dupin_record_exists_real (db, id, FALSE) == TRUE)
 	    {
               g_free (id);
 	    }
@@ -459,6 +510,12 @@ dupin_db_disconnect (DupinDB * db)
   g_message("dupin_db_disconnect: total number of changes for '%s' database: %d\n", db->name, (gint)sqlite3_total_changes (db->db));
 #endif
 
+  if (db->compress)
+    dupin_compress_free (db->compress);
+
+  if (db->bloom)
+    dupin_bloom_free (db->bloom, db->db);
+
   if (db->db)
     sqlite3_close (db->db);
 
@@ -478,10 +535,7 @@ dupin_db_disconnect (DupinDB * db)
     g_free (db->default_attachment_db_name);
 
   if (db->rwlock)
-    {
-      g_rw_lock_clear (db->rwlock);
-      g_free (db->rwlock);
-    }
+    dupin_rwlock_free (db->rwlock);
 
   if (db->views.views)
     g_free (db->views.views);
@@ -525,6 +579,8 @@ dupin_db_connect (Dupin * d, gchar * name, gchar * path,
 
   db->d = d;
 
+  db->update_seq = g_random_int ();
+
   db->name = g_strdup (name);
   db->path = g_strdup (path);
 
@@ -535,8 +591,7 @@ dupin_db_connect (Dupin * d, gchar * name, gchar * path,
   db->topurge = FALSE;
   db->compact_processed_count = 0;
 
-  db->rwlock = g_new0 (GRWLock, 1);
-  g_rw_lock_init (db->rwlock);
+  db->rwlock = dupin_rwlock_new ();
 
   if (sqlite3_open_v2 (db->path, &db->db, dupin_util_dupin_mode_to_sqlite_mode (mode), NULL) != SQLITE_OK)
     {
@@ -549,6 +604,11 @@ dupin_db_connect (Dupin * d, gchar * name, gchar * path,
 
   sqlite3_busy_timeout (db->db, DUPIN_SQLITE_TIMEOUT);
 
+  dupin_iostats_attach (&db->iostats, db->db);
+
+  if (d->conf != NULL && d->conf->limit_slowrequest_threshold > 0)
+    dupin_timing_sqlite_profile (db->db);
+
   if (mode == DP_SQLITE_OPEN_CREATE)
     {
       if (sqlite3_exec (db->db, "PRAGMA journal_mode = WAL", NULL, NULL, &errmsg) != SQLITE_OK
@@ -685,9 +745,22 @@ dupin_db_connect (Dupin * d, gchar * name, gchar * path,
       return NULL;
     }
 
-  /* NOTE - we know this is inefficient, but we need it till proper Elastic search or lucene used as frontend */
+  /* NOTE - compressed revisions are always readable, new ones are compressed only if configured */
 
-  sqlite3_create_function(db->db, "filterBy", 5, SQLITE_ANY, d, dupin_sqlite_json_filterby, NULL, NULL);
+  db->compress = dupin_compress_new (db->db,
+				     (d->conf != NULL && d->conf->sqlite_db_compress != NULL
+				      && g_regex_match (d->conf->sqlite_db_compress, name, 0, NULL)) ? TRUE : FALSE,
+				     (d->conf != NULL) ? d->conf->limit_compress_level : DS_LIMIT_COMPRESS_LEVEL_DEFAULT,
+				     (d->conf != NULL) ? d->conf->limit_compress_dictsize : DS_LIMIT_COMPRESS_DICTSIZE_DEFAULT);
+
+  /* NOTE - we know this is inefficient, but we need it till proper Elastic search or lucene used as frontend,
+            filterBy() gets the compressor to decode compressed revisions */
+
+  sqlite3_create_function(db->db, "filterBy", 5, SQLITE_ANY, db->compress, dupin_sqlite_json_filterby, NULL, NULL);
+
+  /* NOTE - definite misses of dupin_record_exists () are answered without SQL */
+
+  db->bloom = dupin_bloom_new (db->db, (mode != DP_SQLITE_OPEN_READONLY) ? TRUE : FALSE);
 
   return db;
 }
@@ -764,6 +837,8 @@ dupin_database_rollback_transaction (DupinDB * db, GError ** error)
   g_message ("dupin_database_rollback_transaction: database %s transaction rollback", db->name);
 #endif
 
+  g_atomic_int_inc ((gint *) &db->update_seq);
+
   return 0;
 }
 
@@ -805,6 +880,8 @@ dupin_database_commit_transaction (DupinDB * db, GError ** error)
   g_message ("dupin_database_commit_transaction: database %s transaction commit", db->name);
 #endif
 
+  g_atomic_int_inc ((gint *) &db->update_seq);
+
   return 0;
 }
 
@@ -840,6 +917,85 @@ dupin_database_count (DupinDB * db, DupinCountType type)
     }
 }
 
+/* NOTE - initial load of an empty database: the secondary indexes are dropped (the
+          UNIQUE (id, rev) one still serves the lookups of the inserts), the totals are
+          not maintained by every insert and the file is written without syncing and
+          with an exclusive lock; everything is rebuilt at the end */
+
+gboolean
+dupin_database_begin_initial_load (DupinDB * db, GError ** error)
+{
+  gchar * errmsg = NULL;
+
+  g_return_val_if_fail (db != NULL, FALSE);
+
+  dupin_rwlock_writer_lock (db->rwlock);
+
+  if (sqlite3_exec (db->db, "PRAGMA synchronous = OFF", NULL, NULL, &errmsg) != SQLITE_OK
+      || sqlite3_exec (db->db, "PRAGMA locking_mode = EXCLUSIVE", NULL, NULL, &errmsg) != SQLITE_OK
+      || sqlite3_exec (db->db, DUPIN_DB_SQL_DROP_INDEX, NULL, NULL, &errmsg) != SQLITE_OK)
+    {
+      dupin_rwlock_writer_unlock (db->rwlock);
+
+      if (error != NULL && *error != NULL)
+        g_set_error (error, dupin_error_quark (), DUPIN_ERROR_OPEN, "Cannot start initial load: %s",
+		   errmsg);
+      dupin_database_set_error (db, errmsg);
+      sqlite3_free (errmsg);
+      return FALSE;
+    }
+
+  db->initial_load = TRUE;
+
+  dupin_rwlock_writer_unlock (db->rwlock);
+
+  return TRUE;
+}
+
+gboolean
+dupin_database_end_initial_load (DupinDB * db, GError ** error)
+{
+  gchar * errmsg = NULL;
+
+  g_return_val_if_fail (db != NULL, FALSE);
+
+  dupin_rwlock_writer_lock (db->rwlock);
+
+  db->initial_load = FALSE;
+
+  /* NOTE - the indexes dropped at the beginning are gone for good, so they must not be
+            rebuilt inside a transaction still open, which a close would roll back */
+
+  if (sqlite3_get_autocommit (db->db) == 0
+      && sqlite3_exec (db->db, "COMMIT", NULL, NULL, &errmsg) != SQLITE_OK)
+    {
+      sqlite3_free (errmsg);
+      errmsg = NULL;
+
+      sqlite3_exec (db->db, "ROLLBACK", NULL, NULL, NULL);
+    }
+
+  if (sqlite3_exec (db->db, DUPIN_DB_SQL_CREATE_INDEX, NULL, NULL, &errmsg) != SQLITE_OK
+      || sqlite3_exec (db->db, DUPIN_DB_SQL_UPDATE_TOTALS, NULL, NULL, &errmsg) != SQLITE_OK
+      || sqlite3_exec (db->db, "ANALYZE Dupin", NULL, NULL, &errmsg) != SQLITE_OK
+      || sqlite3_exec (db->db, "PRAGMA synchronous = NORMAL", NULL, NULL, &errmsg) != SQLITE_OK
+      || sqlite3_exec (db->db, "PRAGMA locking_mode = NORMAL", NULL, NULL, &errmsg) != SQLITE_OK)
+    {
+      dupin_rwlock_writer_unlock (db->rwlock);
+
+      if (error != NULL && *error != NULL)
+        g_set_error (error, dupin_error_quark (), DUPIN_ERROR_OPEN, "Cannot finish initial load: %s",
+		   errmsg);
+      dupin_database_set_error (db, errmsg);
+      sqlite3_free (errmsg);
+      return FALSE;
+    }
+
+  dupin_rwlock_writer_unlock (db->rwlock);
+
+  return TRUE;
+}
+
 static int
 dupin_database_get_max_rowid_cb (void *data, int argc, char **argv,
                                   char **col)
@@ -1303,9 +1459,9 @@ dupin_database_thread_compact (DupinDB * db, gsize count)
   gchar * errmsg;
   GList *results, *list;
 
-  g_rw_lock_reader_lock (db->rwlock);
+  dupin_rwlock_reader_lock (db->rwlock);
   gboolean topurge = db->topurge;
-  g_rw_lock_reader_unlock (db->rwlock);
+  dupin_rwlock_reader_unlock (db->rwlock);
 
   gboolean ret = TRUE;
 
@@ -1482,16 +1638,19 @@ dupin_database_compact_func (gpointer data, gpointer user_data)
   g_message("dupin_database_compact_func(%p) started\n",g_thread_self ());
 #endif
 
-  g_rw_lock_writer_lock (db->rwlock);
+  dupin_rwlock_writer_lock (db->rwlock);
   db->tocompact = TRUE;
   db->compact_thread = g_thread_self ();
   db->compact_processed_count = 0;
-  g_rw_lock_writer_unlock (db->rwlock);
+  dupin_rwlock_writer_unlock (db->rwlock);
 
   while (db->todelete == FALSE)
     {
+      gint64 span = dupin_trace_begin ();
       gboolean compact_operation = dupin_database_thread_compact (db, DUPIN_DB_COMPACT_COUNT);
 
+      dupin_trace_end ("compact", "dupin_database_thread_compact", db->name, span);
+
       if (compact_operation == FALSE)
         {
 #if DEBUG
@@ -1518,6 +1677,12 @@ dupin_database_compact_func (gpointer data, gpointer user_data)
       	      dupin_database_rollback_transaction (db, NULL);
     	    }
 
+          /* NOTE - retrain the compression dictionary on what is left, VACUUM then rewrites pages anyway */
+
+          gchar * samples_query = sqlite3_mprintf (DUPIN_DB_SQL_COMPRESS_SAMPLES, DUPIN_COMPRESS_SAMPLES_MAX);
+          dupin_compress_train (db->compress, db->db, samples_query);
+          sqlite3_free (samples_query);
+
 #if DEBUG
           g_message("dupin_database_compact_func: VACUUM and ANALYZE\n");
 #endif
@@ -1537,6 +1702,11 @@ dupin_database_compact_func (gpointer data, gpointer user_data)
               dupin_attachment_db_rollback_transaction (db->default_attachment_db, NULL);
             }
 
+          /* NOTE - attachments content deduplicated by hash is removed once unreferenced */
+
+          dupin_attachment_db_shared_reclaim (db->default_attachment_db);
+          dupin_attachment_db_external_sweep (db->default_attachment_db);
+
 #if DEBUG
           g_message("dupin_database_compact_func: VACUUM and ANALYZE attachments database\n");
 #endif
@@ -1557,11 +1727,11 @@ dupin_database_compact_func (gpointer data, gpointer user_data)
   g_message("dupin_database_compact_func(%p) finished and database is compacted\n",g_thread_self ());
 #endif
 
-  g_rw_lock_writer_lock (db->rwlock);
+  dupin_rwlock_writer_lock (db->rwlock);
   db->tocompact = FALSE;
   db->topurge = FALSE;
   db->compact_thread = NULL;
-  g_rw_lock_writer_unlock (db->rwlock);
+  dupin_rwlock_writer_unlock (db->rwlock);
 
   dupin_database_unref (db);
 }
@@ -1586,9 +1756,9 @@ dupin_database_compact (DupinDB * db,
 
       GError * error=NULL;
 
-      g_rw_lock_writer_lock (db->rwlock);
+      dupin_rwlock_writer_lock (db->rwlock);
       db->topurge = purge;
-      g_rw_lock_writer_unlock (db->rwlock);
+      dupin_rwlock_writer_unlock (db->rwlock);
 
       if (!db->compact_thread)
         {
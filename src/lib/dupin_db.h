@@ -46,8 +46,13 @@ gboolean	dupin_database_delete	(DupinDB *	db,
 
 const gchar *	dupin_database_get_name	(DupinDB *	db);
 
+guint		dupin_database_get_update_seq
+					(DupinDB *	db);
+
 gsize		dupin_database_get_size	(DupinDB *	db);
 
+JsonNode *	dupin_database_get_stats	(DupinDB *	db);
+
 gboolean	dupin_database_get_creation_time
 					(DupinDB * db,
 					 gsize * creation_time);
@@ -80,6 +85,14 @@ DupinLinkB *	dupin_database_get_default_linkbase
 gboolean	dupin_database_get_max_rowid	(DupinDB *	db,
 					         gsize * max_rowid);
 
+gboolean	dupin_database_begin_initial_load
+					(DupinDB *	db,
+					 GError **	error);
+
+gboolean	dupin_database_end_initial_load
+					(DupinDB *	db,
+					 GError **	error);
+
 gboolean        dupin_database_get_total_changes
                                         (DupinDB *              db,
                                          gsize *                total,
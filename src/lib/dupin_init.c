@@ -31,8 +31,10 @@ dupin_init (DSGlobal *data, GError ** error)
 
   d->conf = data; /* we just copy point from caller */
 
-  d->rwlock = g_new0 (GRWLock, 1);
-  g_rw_lock_init (d->rwlock);
+  dupin_trace_set_enabled (d->conf->trace);
+  dupin_util_set_id_scheme (d->conf->id_scheme);
+
+  d->rwlock = dupin_rwlock_new ();
 
   d->path = g_strdup (d->conf->sqlite_path);
 
@@ -97,6 +99,14 @@ dupin_init (DSGlobal *data, GError ** error)
       gchar *path;
       gchar *name;
 
+      if (g_str_has_prefix (filename, DUPIN_ATTACHMENT_UPLOAD_PREFIX) == TRUE)
+        {
+          path = g_build_path (G_DIR_SEPARATOR_S, d->path, filename, NULL);
+          g_unlink (path);
+          g_free (path);
+          continue;
+        }
+
       if (g_str_has_suffix (filename, DUPIN_DB_SUFFIX) == FALSE)
 	continue;
 
@@ -416,10 +426,7 @@ dupin_shutdown (Dupin * d)
     g_free (d->path);
 
   if (d->rwlock)
-    {
-      g_rw_lock_clear (d->rwlock);
-      g_free (d->rwlock);
-    }
+    dupin_rwlock_free (d->rwlock);
 
   g_free (d);
 }
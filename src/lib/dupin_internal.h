@@ -13,6 +13,12 @@
 
 #include <glib/gstdio.h>
 #include <sqlite3.h>
+#include "dupin_compress.h"
+#include "dupin_timing.h"
+#include "dupin_trace.h"
+#include "dupin_rwlock.h"
+#include "dupin_iostats.h"
+#include "dupin_bloom.h"
 
 #include <json-glib/json-glib.h>
 #include <json-glib/json-gobject.h>
@@ -38,12 +44,29 @@
 #define DUPIN_ATTACHMENT_DB_SUFFIX	".attachments.dupin"
 #define DUPIN_ATTACHMENT_DB_SUFFIX_LEN	18
 
+/* NOTE - directory next to the attachments database holding content-addressed files */
+#define DUPIN_ATTACHMENT_DB_EXTERNAL_SUFFIX	".blobs"
+
+/* NOTE - where the content of an attachment row lives, stored in the Dupin.external column */
+#define DUPIN_ATTACHMENT_STORAGE_INLINE		0	/* Dupin.content, rows written before deduplication */
+#define DUPIN_ATTACHMENT_STORAGE_FILE		1	/* content-addressed file in the .blobs directory */
+#define DUPIN_ATTACHMENT_STORAGE_SHARED		2	/* DupinBlobs row shared by all rows with the same hash */
+
+/* NOTE - files and DupinBlobs rows are keyed on Dupin.blob_hash, collisions must not be feasible
+          since rows with the same key share one body. Dupin.hash stays MD5 for the ETag, rows
+          stored before blob_hash existed have it NULL and keep using hash as key */
+#define DUPIN_ATTACHMENT_BLOB_HASH_ALGO		G_CHECKSUM_SHA256
+
+/* NOTE - spool files of attachments being uploaded, removed at startup if left over */
+#define DUPIN_ATTACHMENT_UPLOAD_PREFIX		".upload-"
+#define DUPIN_ATTACHMENT_UPLOAD_BUFFER		65536
+
 #define DUPIN_LINKB_SUFFIX	".linkb.dupin"
 #define DUPIN_LINKB_SUFFIX_LEN	12
 
 struct dupin_t
 {
-  GRWLock *     rwlock;
+  DupinRWLock * rwlock;
 
   gchar *	path;
   GHashTable *	dbs;
@@ -95,7 +118,7 @@ struct dupin_view_p_t
 struct dupin_db_t
 {
   Dupin *	d;
-  GRWLock *     rwlock;
+  DupinRWLock * rwlock;
 
   gchar *	name;
   gchar *	path;
@@ -105,6 +128,10 @@ struct dupin_db_t
   gboolean	todelete;
 
   sqlite3 *	db;
+  DupinIOStats	iostats;
+
+  DupinCompress * compress;
+  DupinBloom *	bloom;		/* IDs in the Dupin table, NULL if unavailable */
 
   DupinViewP	views;
   DupinAttachmentDBP	attachment_dbs;
@@ -123,16 +150,20 @@ struct dupin_db_t
 
   gboolean	topurge;
 
+  gboolean	initial_load;	/* totals rebuilt at the end, see dupin_database_begin_initial_load () */
+
   gchar *       error_msg;
   gchar *       warning_msg;
 
   gsize		creation_time;
+
+  guint		update_seq;	/* bumped at every commit and rollback */
 };
 
 struct dupin_linkb_t
 {
   Dupin *	d;
-  GRWLock *     rwlock;
+  DupinRWLock * rwlock;
 
   gchar *	name;
   gchar *	path;
@@ -145,6 +176,10 @@ struct dupin_linkb_t
   gboolean	todelete;
 
   sqlite3 *	db;
+  DupinIOStats	iostats;
+
+  DupinCompress * compress;
+  DupinBloom *	bloom;		/* IDs in the Dupin table, NULL if unavailable */
 
   DupinViewP	views;
   /* no attacthments for link bases */
@@ -166,12 +201,14 @@ struct dupin_linkb_t
   gchar *       warning_msg;
 
   gsize		creation_time;
+
+  guint		update_seq;	/* bumped at every commit and rollback */
 };
 
 struct dupin_view_t
 {
   Dupin *	d;
-  GRWLock *     rwlock;
+  DupinRWLock * rwlock;
 
   gchar *	name;
   gchar *	path;
@@ -207,6 +244,7 @@ struct dupin_view_t
   GMutex *      mutex;
 
   sqlite3 *	db;
+  DupinIOStats	iostats;
 
   DupinViewEngine * engine;
 
@@ -218,6 +256,8 @@ struct dupin_view_t
   gchar *       warning_msg;
 
   gsize		creation_time;
+
+  guint		update_seq;	/* bumped at every commit and rollback */
 };
 
 /* WebKit specific JavaScript */
@@ -253,7 +293,7 @@ struct dupin_view_engine_t
 struct dupin_attachment_db_t
 {
   Dupin *	d;
-  GRWLock *     rwlock;
+  DupinRWLock * rwlock;
 
   gchar *	name;
   gchar *	path;
@@ -265,11 +305,15 @@ struct dupin_attachment_db_t
   gboolean	todelete;
 
   sqlite3 *	db;
+  DupinIOStats	iostats;
 
   gchar *       error_msg;
   gchar *       warning_msg;
 
   gsize		creation_time;
+
+  gchar *	external_path;
+  gsize		external_min_size;
 };
 
 struct dupin_attachment_record_t
@@ -286,10 +330,32 @@ struct dupin_attachment_record_t
   gsize		type_len;
   gchar *	hash;
   gsize		hash_len;
+  gchar *	blob_hash;	/* storage key, NULL on rows keyed on hash */
 
   gsize		rowid;
 
   sqlite3_blob * blob;
+
+  gboolean	external;
+  gint		external_fd;
+
+  gboolean	shared;
+};
+
+struct dupin_attachment_upload_t
+{
+  Dupin *	d;
+
+  gchar *	path;
+  gint		fd;
+
+  gsize		length;
+
+  GChecksum *	checksum;
+  gchar *	hash;
+
+  GChecksum *	blob_checksum;
+  gchar *	blob_hash;
 };
 
 typedef struct dupin_record_rev_t DupinRecordRev;
@@ -429,6 +495,21 @@ DupinAttachmentDB *	dupin_attachment_db_connect
 void		dupin_attachment_db_disconnect
 				(DupinAttachmentDB *	attachment_db);
 
+gchar *		dupin_attachment_db_external_file
+				(DupinAttachmentDB *	attachment_db,
+				 const gchar *		hash);
+
+/* Called with the attachment_db writer lock held: */
+gboolean	dupin_attachment_db_external_release
+				(DupinAttachmentDB *	attachment_db,
+				 const gchar *		hash);
+
+gboolean	dupin_attachment_db_external_sweep
+				(DupinAttachmentDB *	attachment_db);
+
+gboolean	dupin_attachment_db_shared_reclaim
+				(DupinAttachmentDB *	attachment_db);
+
 gchar *		dupin_database_generate_id_real
 				(DupinDB *	db,
 				 GError **	error,
@@ -0,0 +1,83 @@
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "dupin_internal.h"
+#include "dupin_iostats.h"
+
+static int
+dupin_iostats_wal_hook (void * arg, sqlite3 * db, const char * name, int frames)
+{
+  DupinIOStats * iostats = arg;
+  int log = 0, ckpt = 0;
+  gint64 start, usec;
+  int rc;
+
+  /* Called with the connection mutex, by one writer at a time: */
+  iostats->wal_frames = frames;
+
+  if (frames < DUPIN_IOSTATS_AUTOCHECKPOINT)
+    return SQLITE_OK;
+
+  start = g_get_monotonic_time ();
+  rc = sqlite3_wal_checkpoint_v2 (db, name, SQLITE_CHECKPOINT_PASSIVE, &log, &ckpt);
+  usec = g_get_monotonic_time () - start;
+
+  iostats->checkpoints++;
+  iostats->checkpoint_usec += usec;
+
+  if (usec > (gint64) iostats->checkpoint_max_usec)
+    iostats->checkpoint_max_usec = usec;
+
+  if (rc != SQLITE_OK || ckpt < log)
+    iostats->checkpoint_stalls++;
+
+  return SQLITE_OK;
+}
+
+void
+dupin_iostats_attach (DupinIOStats * iostats, sqlite3 * db)
+{
+  g_return_if_fail (iostats != NULL);
+  g_return_if_fail (db != NULL);
+
+  sqlite3_wal_hook (db, dupin_iostats_wal_hook, iostats);
+}
+
+JsonNode *
+dupin_iostats_stats (DupinIOStats * iostats, sqlite3 * db, const gchar * path)
+{
+  JsonNode * node;
+  JsonObject * obj;
+  struct stat st;
+  gchar * wal;
+  int cur, high;
+
+  g_return_val_if_fail (iostats != NULL, NULL);
+
+  node = json_node_new (JSON_NODE_OBJECT);
+  obj = json_object_new ();
+  json_node_take_object (node, obj);
+
+  if (db != NULL
+      && sqlite3_db_status (db, SQLITE_DBSTATUS_CACHE_MISS, &cur, &high, 0) == SQLITE_OK)
+    json_object_set_int_member (obj, "pages_read", cur);
+
+  if (db != NULL
+      && sqlite3_db_status (db, SQLITE_DBSTATUS_CACHE_WRITE, &cur, &high, 0) == SQLITE_OK)
+    json_object_set_int_member (obj, "pages_written", cur);
+
+  wal = g_strdup_printf ("%s-wal", path);
+  json_object_set_int_member (obj, "wal_size", g_stat (wal, &st) == 0 ? (gint64) st.st_size : 0);
+  g_free (wal);
+
+  json_object_set_int_member (obj, "wal_frames", iostats->wal_frames);
+  json_object_set_int_member (obj, "checkpoints", iostats->checkpoints);
+  json_object_set_int_member (obj, "checkpoint_stalls", iostats->checkpoint_stalls);
+  json_object_set_int_member (obj, "checkpoint_usec", iostats->checkpoint_usec);
+  json_object_set_int_member (obj, "checkpoint_max_usec", iostats->checkpoint_max_usec);
+
+  return node;
+}
+
+/* EOF */
@@ -0,0 +1,38 @@
+#ifndef _DUPIN_IOSTATS_H_
+#define _DUPIN_IOSTATS_H_
+
+#include <dupin.h>
+#include <sqlite3.h>
+#include <json-glib/json-glib.h>
+
+G_BEGIN_DECLS
+
+/* NOTE - the WAL hook replaces the SQLite automatic checkpoint with an equivalent
+          passive one, timed and counted: a checkpoint which cannot copy back the
+          whole WAL because of readers is a stall */
+
+#define DUPIN_IOSTATS_AUTOCHECKPOINT	1000	/* frames, as SQLite default */
+
+typedef struct dupin_iostats_t DupinIOStats;
+struct dupin_iostats_t
+{
+  gint		wal_frames;
+
+  guint		checkpoints;
+  guint		checkpoint_stalls;
+  guint64	checkpoint_usec;
+  guint64	checkpoint_max_usec;
+};
+
+void		dupin_iostats_attach	(DupinIOStats *	iostats,
+					 sqlite3 *	db);
+
+JsonNode *	dupin_iostats_stats	(DupinIOStats *	iostats,
+					 sqlite3 *	db,
+					 const gchar *	path);
+
+G_END_DECLS
+
+#endif
+
+/* EOF */
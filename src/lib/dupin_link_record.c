@@ -312,6 +312,9 @@ dupin_link_record_exists_real (DupinLinkB * linkb, gchar * id, gboolean lock)
   gchar * errmsg;
   gsize numb = 0;
 
+  if (dupin_bloom_may_contain (linkb->bloom, id) == FALSE)
+    return FALSE;
+
   tmp = sqlite3_mprintf (DUPIN_LINKB_SQL_EXISTS, id);
 
   if (sqlite3_exec (linkb->db, tmp, dupin_link_record_exists_real_cb, &numb, &errmsg) != SQLITE_OK)
@@ -460,6 +463,10 @@ dupin_link_record_create_with_id_real (DupinLinkB * linkb, JsonNode * obj_node,
 
 //g_message("dupin_link_record_create_with_id_real: query=%s\n", tmp);
 
+  /* NOTE - added before the row can be seen by readers, a failed insert just leaves a false positive */
+
+  dupin_bloom_add (linkb->bloom, id);
+
   if (sqlite3_exec (linkb->db, tmp, NULL, NULL, &errmsg) != SQLITE_OK)
     {
       if (error != NULL && *error != NULL)
@@ -2256,13 +2263,31 @@ dupin_link_record_get_revision_node (DupinLinkRecord * record, gchar * mvcc)
 
   JsonParser * parser = json_parser_new();
 
-  if (!json_parser_load_from_data (parser, r->obj_serialized, r->obj_serialized_len, &error))
+  if (dupin_compress_is_encoded (r->obj_serialized, r->obj_serialized_len) == TRUE)
     {
-      if (error != NULL)
+      gsize obj_len = 0;
+      gchar * obj = dupin_compress_decode (record->linkb->compress, r->obj_serialized, r->obj_serialized_len, &obj_len, &error);
+
+      if (obj == NULL)
         {
-          dupin_linkbase_set_error (record->linkb, error->message);
+          if (error != NULL)
+            {
+              dupin_linkbase_set_error (record->linkb, error->message);
+            }
+
+          goto dupin_link_record_get_revision_error;
         }
 
+      json_parser_load_from_data (parser, obj, obj_len, &error);
+      g_free (obj);
+    }
+  else
+    json_parser_load_from_data (parser, r->obj_serialized, r->obj_serialized_len, &error);
+
+  if (error != NULL)
+    {
+      dupin_linkbase_set_error (record->linkb, error->message);
+
       goto dupin_link_record_get_revision_error;
     }
 
@@ -2501,6 +2526,21 @@ dupin_link_record_add_revision_obj (DupinLinkRecord * record,
   r = g_malloc0 (sizeof (DupinLinkRecordRev));
   r->revision = rev;
 
+  /* NOTE - the hash is computed on the plain JSON above, only the stored form is compressed */
+
+  if (obj_serialized != NULL)
+    {
+      gsize compressed_len = 0;
+      gchar * compressed = dupin_compress_encode (record->linkb->compress, obj_serialized, obj_serialized_len, &compressed_len);
+
+      if (compressed != NULL)
+        {
+          g_free (obj_serialized);
+          obj_serialized = compressed;
+          obj_serialized_len = compressed_len;
+        }
+    }
+
   r->obj = obj_node_copy;
   r->obj_serialized = obj_serialized;
   r->obj_serialized_len = obj_serialized_len;
@@ -3520,9 +3560,9 @@ dupin_link_record_insert_bulk (DupinLinkB * linkb,
       return FALSE;
     }
 
-  g_rw_lock_writer_lock (linkb->d->rwlock);
+  dupin_rwlock_writer_lock (linkb->d->rwlock);
   linkb->d->bulk_transaction = TRUE;
-  g_rw_lock_writer_unlock (linkb->d->rwlock);
+  dupin_rwlock_writer_unlock (linkb->d->rwlock);
 
   for (n = nodes; n != NULL; n = n->next)
     {
@@ -3537,9 +3577,9 @@ dupin_link_record_insert_bulk (DupinLinkB * linkb,
 
           dupin_linkbase_rollback_transaction (linkb, NULL);
 
-          g_rw_lock_writer_lock (linkb->d->rwlock);
+          dupin_rwlock_writer_lock (linkb->d->rwlock);
           linkb->d->bulk_transaction = FALSE;
-          g_rw_lock_writer_unlock (linkb->d->rwlock);
+          dupin_rwlock_writer_unlock (linkb->d->rwlock);
 
           return FALSE;
         }
@@ -3587,9 +3627,9 @@ dupin_link_record_insert_bulk (DupinLinkB * linkb,
 
   if (linkb->d->super_bulk_transaction == FALSE)
     {
-      g_rw_lock_writer_lock (linkb->d->rwlock);
+      dupin_rwlock_writer_lock (linkb->d->rwlock);
       linkb->d->bulk_transaction = FALSE;
-      g_rw_lock_writer_unlock (linkb->d->rwlock);
+      dupin_rwlock_writer_unlock (linkb->d->rwlock);
     }
 
   if (dupin_linkbase_commit_transaction (linkb, NULL) < 0)
@@ -9,6 +9,8 @@
 #include "dupin_link_record.h"
 #include "dupin_view.h"
 
+#include "../httpd/configure.h"
+
 #include <stdlib.h>
 #include <string.h>
 
@@ -92,6 +94,9 @@
 #define DUPIN_LINKB_SQL_TOTAL \
         "SELECT count(*) AS c FROM Dupin AS d WHERE d.rev_head = 'TRUE' "
 
+#define DUPIN_LINKB_SQL_COMPRESS_SAMPLES \
+        "SELECT obj FROM Dupin WHERE rev_head = 'TRUE' AND deleted = 'FALSE' ORDER BY seq DESC LIMIT %d"
+
 #define DUPIN_LINKB_COMPACT_COUNT 1000
 #define DUPIN_LINKB_CHECK_COUNT   1000
 
@@ -106,11 +111,11 @@ dupin_get_linkbases (Dupin * d)
 
   g_return_val_if_fail (d != NULL, NULL);
 
-  g_rw_lock_reader_lock (d->rwlock);
+  dupin_rwlock_reader_lock (d->rwlock);
 
   if (!(size = g_hash_table_size (d->linkbs)))
     {
-      g_rw_lock_reader_unlock (d->rwlock);
+      dupin_rwlock_reader_unlock (d->rwlock);
       return NULL;
     }
 
@@ -123,7 +128,7 @@ dupin_get_linkbases (Dupin * d)
 
   ret[i] = NULL;
 
-  g_rw_lock_reader_unlock (d->rwlock);
+  dupin_rwlock_reader_unlock (d->rwlock);
 
   return ret;
 }
@@ -133,10 +138,10 @@ dupin_linkbase_exists (Dupin * d, gchar * linkb_name)
 {
   gboolean ret;
 
-  g_rw_lock_reader_lock (d->rwlock);
+  dupin_rwlock_reader_lock (d->rwlock);
   DupinLinkB * linkb = g_hash_table_lookup (d->linkbs, linkb_name); 
   ret = ((linkb != NULL) && linkb->todelete == FALSE) ? TRUE : FALSE;
-  g_rw_lock_reader_unlock (d->rwlock);
+  dupin_rwlock_reader_unlock (d->rwlock);
 
   return ret;
 }
@@ -149,7 +154,7 @@ dupin_linkbase_open (Dupin * d, gchar * linkb, GError ** error)
   g_return_val_if_fail (d != NULL, NULL);
   g_return_val_if_fail (linkb != NULL, NULL);
 
-  g_rw_lock_reader_lock (d->rwlock);
+  dupin_rwlock_reader_lock (d->rwlock);
 
   if (!(ret = g_hash_table_lookup (d->linkbs, linkb)) || ret->todelete == TRUE)
     {
@@ -157,7 +162,7 @@ dupin_linkbase_open (Dupin * d, gchar * linkb, GError ** error)
         g_set_error (error, dupin_error_quark (), DUPIN_ERROR_OPEN,
 		 "Linkbase '%s' doesn't exist.", linkb);
 
-      g_rw_lock_reader_unlock (d->rwlock);
+      dupin_rwlock_reader_unlock (d->rwlock);
       return NULL;
     }
   else
@@ -169,7 +174,7 @@ dupin_linkbase_open (Dupin * d, gchar * linkb, GError ** error)
 #endif
     }
 
-  g_rw_lock_reader_unlock (d->rwlock);
+  dupin_rwlock_reader_unlock (d->rwlock);
 
   return ret;
 }
@@ -197,14 +202,14 @@ dupin_linkbase_new (Dupin * d,
   else
     return NULL;
 
-  g_rw_lock_writer_lock (d->rwlock);
+  dupin_rwlock_writer_lock (d->rwlock);
 
   if ((ret = g_hash_table_lookup (d->linkbs, linkb)))
     {
       if (error != NULL && *error != NULL)
         g_set_error (error, dupin_error_quark (), DUPIN_ERROR_OPEN,
 		   "Linkbase '%s' already exist.", linkb);
-      g_rw_lock_writer_unlock (d->rwlock);
+      dupin_rwlock_writer_unlock (d->rwlock);
       return NULL;
     }
 
@@ -214,7 +219,7 @@ dupin_linkbase_new (Dupin * d,
 
   if (!(ret = dupin_linkb_connect (d, linkb, path, DP_SQLITE_OPEN_CREATE, error)))
     {
-      g_rw_lock_writer_unlock (d->rwlock);
+      dupin_rwlock_writer_unlock (d->rwlock);
       g_free (path);
       return NULL;
     }
@@ -232,7 +237,7 @@ dupin_linkbase_new (Dupin * d,
 
   if (dupin_linkbase_begin_transaction (ret, error) < 0)
     {
-      g_rw_lock_writer_unlock (d->rwlock);
+      dupin_rwlock_writer_unlock (d->rwlock);
       dupin_linkb_disconnect (ret);
       return NULL;
     }
@@ -247,7 +252,7 @@ dupin_linkbase_new (Dupin * d,
 
   if (sqlite3_exec (ret->db, str, NULL, NULL, &errmsg) != SQLITE_OK)
     {
-      g_rw_lock_writer_unlock (d->rwlock);
+      dupin_rwlock_writer_unlock (d->rwlock);
 
       if (error != NULL && *error != NULL)
         g_set_error (error, dupin_error_quark (), DUPIN_ERROR_OPEN, "%s", errmsg);
@@ -261,14 +266,14 @@ dupin_linkbase_new (Dupin * d,
 
   if (dupin_linkbase_commit_transaction (ret, error) < 0)
     {
-      g_rw_lock_writer_unlock (d->rwlock);
+      dupin_rwlock_writer_unlock (d->rwlock);
       dupin_linkb_disconnect (ret);
       return NULL;
     }
 
   sqlite3_free (str);
 
-  g_rw_lock_writer_unlock (d->rwlock);
+  dupin_rwlock_writer_unlock (d->rwlock);
 
   if (dupin_linkbase_p_update (ret, error) == FALSE)
     {
@@ -276,9 +281,9 @@ dupin_linkbase_new (Dupin * d,
       return NULL;
     }
 
-  g_rw_lock_writer_lock (d->rwlock);
+  dupin_rwlock_writer_lock (d->rwlock);
   g_hash_table_insert (d->linkbs, g_strdup (linkb), ret);
-  g_rw_lock_writer_unlock (d->rwlock);
+  dupin_rwlock_writer_unlock (d->rwlock);
 
   return ret;
 }
@@ -303,9 +308,9 @@ static void
 dupin_linkbase_p_update_real (DupinLinkBP * p,
 			      DupinLinkB * linkb)
 {
-  g_rw_lock_reader_lock (linkb->rwlock);
+  dupin_rwlock_reader_lock (linkb->rwlock);
   gboolean todelete = linkb->todelete;
-  g_rw_lock_reader_unlock (linkb->rwlock);
+  dupin_rwlock_reader_unlock (linkb->rwlock);
 
   if (todelete == TRUE)
     {
@@ -377,9 +382,9 @@ dupin_linkbase_p_update (DupinLinkB * linkb, GError ** error)
 
   if (update.isdb == TRUE)
     {
-      g_rw_lock_reader_lock (linkb->rwlock);
+      dupin_rwlock_reader_lock (linkb->rwlock);
       gboolean todelete = linkb->todelete;
-      g_rw_lock_reader_unlock (linkb->rwlock);
+      dupin_rwlock_reader_unlock (linkb->rwlock);
 
       gboolean parent_exists = dupin_database_exists (linkb->d, update.parent);
 
@@ -393,9 +398,9 @@ dupin_linkbase_p_update (DupinLinkB * linkb, GError ** error)
               return FALSE;
             }
 
-          g_rw_lock_writer_lock (db->rwlock);
+          dupin_rwlock_writer_lock (db->rwlock);
           dupin_linkbase_p_update_real (&db->linkbs, linkb);
-          g_rw_lock_writer_unlock (db->rwlock);
+          dupin_rwlock_writer_unlock (db->rwlock);
 
           dupin_database_unref (db);
         }
@@ -464,7 +469,7 @@ dupin_linkbase_ref (DupinLinkB * linkb)
 {
   g_return_if_fail (linkb != NULL);
 
-  g_rw_lock_writer_lock (linkb->rwlock);
+  dupin_rwlock_writer_lock (linkb->rwlock);
 
   linkb->ref++;
 
@@ -472,7 +477,7 @@ dupin_linkbase_ref (DupinLinkB * linkb)
   fprintf(stderr,"dupin_linkbase_ref: (%p) name=%s \t ref++=%d\n", g_thread_self (), linkb->name, (gint) linkb->ref);
 #endif
 
-  g_rw_lock_writer_unlock (linkb->rwlock);
+  dupin_rwlock_writer_unlock (linkb->rwlock);
 }
 
 void
@@ -484,7 +489,7 @@ dupin_linkbase_unref (DupinLinkB * linkb)
 
   d = linkb->d;
 
-  g_rw_lock_writer_lock (linkb->rwlock);
+  dupin_rwlock_writer_lock (linkb->rwlock);
 
   if (linkb->ref > 0)
     {
@@ -495,7 +500,7 @@ dupin_linkbase_unref (DupinLinkB * linkb)
 #endif
     }
 
-  g_rw_lock_writer_unlock (linkb->rwlock);
+  dupin_rwlock_writer_unlock (linkb->rwlock);
 
   if (linkb->todelete == TRUE &&
       dupin_linkbase_is_compacting (linkb) == FALSE &&
@@ -512,9 +517,9 @@ dupin_linkbase_unref (DupinLinkB * linkb)
               g_warning("dupin_linkbase_unref: could not remove reference from parent for linkbase '%s'\n", linkb->name);
             }
 
-          g_rw_lock_writer_lock (d->rwlock);
+          dupin_rwlock_writer_lock (d->rwlock);
           g_hash_table_remove (d->linkbs, linkb->name);
-          g_rw_lock_writer_unlock (d->rwlock);
+          dupin_rwlock_writer_unlock (d->rwlock);
         }
     }
 }
@@ -524,9 +529,9 @@ dupin_linkbase_delete (DupinLinkB * linkb, GError ** error)
 {
   g_return_val_if_fail (linkb != NULL, FALSE);
 
-  g_rw_lock_writer_lock (linkb->rwlock);
+  dupin_rwlock_writer_lock (linkb->rwlock);
   linkb->todelete = TRUE;
-  g_rw_lock_writer_unlock (linkb->rwlock);
+  dupin_rwlock_writer_unlock (linkb->rwlock);
 
   return TRUE;
 }
@@ -538,6 +543,13 @@ dupin_linkbase_get_name (DupinLinkB * linkb)
   return linkb->name;
 }
 
+guint
+dupin_linkbase_get_update_seq (DupinLinkB * linkb)
+{
+  g_return_val_if_fail (linkb != NULL, 0);
+  return (guint) g_atomic_int_get ((gint *) &linkb->update_seq);
+}
+
 gsize
 dupin_linkbase_get_size (DupinLinkB * linkb)
 {
@@ -551,6 +563,27 @@ dupin_linkbase_get_size (DupinLinkB * linkb)
   return (gsize) st.st_size;
 }
 
+JsonNode *
+dupin_linkbase_get_stats (DupinLinkB * linkb)
+{
+  JsonNode * node;
+  JsonObject * obj;
+
+  g_return_val_if_fail (linkb != NULL, NULL);
+
+  node = json_node_new (JSON_NODE_OBJECT);
+  obj = json_object_new ();
+  json_node_take_object (node, obj);
+
+  json_object_set_member (obj, "lock", dupin_rwlock_stats (linkb->rwlock));
+  json_object_set_member (obj, "io", dupin_iostats_stats (&linkb->iostats, linkb->db, linkb->path));
+
+  if (linkb->bloom != NULL)
+    json_object_set_member (obj, "bloom", dupin_bloom_stats (linkb->bloom));
+
+  return node;
+}
+
 static int
 dupin_linkbase_get_creation_time_cb (void *data, int argc, char **argv, char **col)
 {
@@ -601,7 +634,8 @@ dupin_linkbase_generate_id_real (DupinLinkB * linkb,
 
       if (id != NULL)
         {   
-          if (dupin_link_record_exists_real (linkb, id, FALSE) == TRUE)
+          if (dupin_util_generate_id_is_unique () == FALSE
+              && dupin_link_record_exists_real (linkb, id, FALSE) == TRUE)
             { 
               g_free (id);
             }
@@ -651,6 +685,12 @@ dupin_linkb_disconnect (DupinLinkB * linkb)
   g_message("dupin_linkb_disconnect: total number of changes for '%s' linkbase: %d\n", linkb->name, (gint)sqlite3_total_changes (linkb->db));
 #endif
 
+  if (linkb->compress)
+    dupin_compress_free (linkb->compress);
+
+  if (linkb->bloom)
+    dupin_bloom_free (linkb->bloom, linkb->db);
+
   if (linkb->db)
     sqlite3_close (linkb->db);
 
@@ -667,10 +707,7 @@ dupin_linkb_disconnect (DupinLinkB * linkb)
     g_free (linkb->parent);
 
   if (linkb->rwlock)
-    {
-      g_rw_lock_clear (linkb->rwlock);
-      g_free (linkb->rwlock);
-    }
+    dupin_rwlock_free (linkb->rwlock);
 
   if (linkb->views.views)
     g_free (linkb->views.views);
@@ -711,6 +748,8 @@ dupin_linkb_connect (Dupin * d, gchar * name, gchar * path,
 
   linkb->d = d;
 
+  linkb->update_seq = g_random_int ();
+
   linkb->name = g_strdup (name);
   linkb->path = g_strdup (path);
 
@@ -721,8 +760,7 @@ dupin_linkb_connect (Dupin * d, gchar * name, gchar * path,
   linkb->tocheck = FALSE;
   linkb->check_processed_count = 0;
 
-  linkb->rwlock = g_new0 (GRWLock, 1);
-  g_rw_lock_init (linkb->rwlock);
+  linkb->rwlock = dupin_rwlock_new ();
 
   if (sqlite3_open_v2 (linkb->path, &linkb->db, dupin_util_dupin_mode_to_sqlite_mode (mode), NULL) != SQLITE_OK)
     {
@@ -735,6 +773,11 @@ dupin_linkb_connect (Dupin * d, gchar * name, gchar * path,
 
   sqlite3_busy_timeout (linkb->db, DUPIN_SQLITE_TIMEOUT);
 
+  dupin_iostats_attach (&linkb->iostats, linkb->db);
+
+  if (d->conf != NULL && d->conf->limit_slowrequest_threshold > 0)
+    dupin_timing_sqlite_profile (linkb->db);
+
   if (mode == DP_SQLITE_OPEN_CREATE)
     {
       if (sqlite3_exec (linkb->db, "PRAGMA journal_mode = WAL", NULL, NULL, &errmsg) != SQLITE_OK
@@ -883,9 +926,20 @@ dupin_linkb_connect (Dupin * d, gchar * name, gchar * path,
       return NULL;
     }
 
-  /* NOTE - we know this is inefficient, but we need it till proper Elastic search or lucene used as frontend */
+  /* NOTE - compressed revisions are always readable, new ones are compressed only if configured */
+
+  linkb->compress = dupin_compress_new (linkb->db,
+					(d->conf != NULL && d->conf->sqlite_linkb_compress != NULL
+					 && g_regex_match (d->conf->sqlite_linkb_compress, name, 0, NULL)) ? TRUE : FALSE,
+					(d->conf != NULL) ? d->conf->limit_compress_level : DS_LIMIT_COMPRESS_LEVEL_DEFAULT,
+					(d->conf != NULL) ? d->conf->limit_compress_dictsize : DS_LIMIT_COMPRESS_DICTSIZE_DEFAULT);
 
-  sqlite3_create_function(linkb->db, "filterBy", 5, SQLITE_ANY, d, dupin_sqlite_json_filterby, NULL, NULL);
+  /* NOTE - we know this is inefficient, but we need it till proper Elastic search or lucene used as frontend,
+            filterBy() gets the compressor to decode compressed revisions */
+
+  sqlite3_create_function(linkb->db, "filterBy", 5, SQLITE_ANY, linkb->compress, dupin_sqlite_json_filterby, NULL, NULL);
+
+  linkb->bloom = dupin_bloom_new (linkb->db, (mode != DP_SQLITE_OPEN_READONLY) ? TRUE : FALSE);
 
   return linkb;
 }
@@ -962,6 +1016,8 @@ dupin_linkbase_rollback_transaction (DupinLinkB * linkb, GError ** error)
   g_message ("dupin_linkbase_rollback_transaction: linkbase %s transaction rollback", linkb->name);
 #endif
 
+  g_atomic_int_inc ((gint *) &linkb->update_seq);
+
   return 0;
 }
 
@@ -1003,6 +1059,8 @@ dupin_linkbase_commit_transaction (DupinLinkB * linkb, GError ** error)
   g_message ("dupin_linkbase_commit_transaction: linkbase %s transaction commit", linkb->name);
 #endif
 
+  g_atomic_int_inc ((gint *) &linkb->update_seq);
+
   return 0;
 }
 
@@ -1587,9 +1645,9 @@ dupin_linkbase_thread_compact (DupinLinkB * linkb, gsize count)
   gchar * errmsg;
   GList *results, *list;
 
-  g_rw_lock_reader_lock (linkb->rwlock);
+  dupin_rwlock_reader_lock (linkb->rwlock);
   gboolean topurge = linkb->topurge;
-  g_rw_lock_reader_unlock (linkb->rwlock);
+  dupin_rwlock_reader_unlock (linkb->rwlock);
 
   gboolean ret = TRUE;
 
@@ -1766,16 +1824,19 @@ dupin_linkbase_compact_func (gpointer data, gpointer user_data)
   g_message("dupin_linkbase_compact_func(%p) started\n",g_thread_self ());
 #endif
 
-  g_rw_lock_writer_lock (linkb->rwlock);
+  dupin_rwlock_writer_lock (linkb->rwlock);
   linkb->tocompact = TRUE;
   linkb->compact_thread = g_thread_self ();
   linkb->compact_processed_count = 0;
-  g_rw_lock_writer_unlock (linkb->rwlock);
+  dupin_rwlock_writer_unlock (linkb->rwlock);
 
   while (linkb->todelete == FALSE)
     {
+      gint64 span = dupin_trace_begin ();
       gboolean compact_operation = dupin_linkbase_thread_compact (linkb, DUPIN_LINKB_COMPACT_COUNT);
 
+      dupin_trace_end ("compact", "dupin_linkbase_thread_compact", linkb->name, span);
+
       if (compact_operation == FALSE)
         {
 #if DEBUG
@@ -1802,6 +1863,12 @@ dupin_linkbase_compact_func (gpointer data, gpointer user_data)
               dupin_linkbase_rollback_transaction (linkb, NULL);
             }
 
+          /* NOTE - retrain the compression dictionary on what is left, VACUUM then rewrites pages anyway */
+
+          gchar * samples_query = sqlite3_mprintf (DUPIN_LINKB_SQL_COMPRESS_SAMPLES, DUPIN_COMPRESS_SAMPLES_MAX);
+          dupin_compress_train (linkb->compress, linkb->db, samples_query);
+          sqlite3_free (samples_query);
+
 #if DEBUG
           g_message("dupin_linkbase_compact_func: VACUUM and ANALYZE\n");
 #endif
@@ -1822,11 +1889,11 @@ dupin_linkbase_compact_func (gpointer data, gpointer user_data)
   g_message("dupin_linkbase_compact_func(%p) finished and linkbase is compacted\n",g_thread_self ());
 #endif
 
-  g_rw_lock_writer_lock (linkb->rwlock);
+  dupin_rwlock_writer_lock (linkb->rwlock);
   linkb->tocompact = FALSE;
   linkb->topurge = FALSE;
   linkb->compact_thread = NULL;
-  g_rw_lock_writer_unlock (linkb->rwlock);
+  dupin_rwlock_writer_unlock (linkb->rwlock);
 
   dupin_linkbase_unref (linkb);
 }
@@ -1851,9 +1918,9 @@ dupin_linkbase_compact (DupinLinkB * linkb,
 
       GError * error = NULL;
 
-      g_rw_lock_writer_lock (linkb->rwlock);
+      dupin_rwlock_writer_lock (linkb->rwlock);
       linkb->topurge = purge;
-      g_rw_lock_writer_unlock (linkb->rwlock);
+      dupin_rwlock_writer_unlock (linkb->rwlock);
 
       if (!linkb->compact_thread)
         {
@@ -2097,11 +2164,11 @@ dupin_linkbase_check_func (gpointer data, gpointer user_data)
   g_message("dupin_linkbase_check_func(%p) started\n",g_thread_self ());
 #endif
 
-  g_rw_lock_writer_lock (linkb->rwlock);
+  dupin_rwlock_writer_lock (linkb->rwlock);
   linkb->tocheck = TRUE;
   linkb->check_thread = g_thread_self ();
   linkb->check_processed_count = 0;
-  g_rw_lock_writer_unlock (linkb->rwlock);
+  dupin_rwlock_writer_unlock (linkb->rwlock);
 
   while (linkb->todelete == FALSE)
     {
@@ -2157,10 +2224,10 @@ dupin_linkbase_check_func (gpointer data, gpointer user_data)
   g_message("dupin_linkbase_check_func(%p) finished and linkbase is checked\n",g_thread_self ());
 #endif
 
-  g_rw_lock_writer_lock (linkb->rwlock);
+  dupin_rwlock_writer_lock (linkb->rwlock);
   linkb->tocheck = FALSE;
   linkb->check_thread = NULL;
-  g_rw_lock_writer_unlock (linkb->rwlock);
+  dupin_rwlock_writer_unlock (linkb->rwlock);
 
   dupin_linkbase_unref (linkb);
 }
@@ -54,8 +54,13 @@ gboolean	dupin_linkbase_delete	(DupinLinkB *	linkb,
 
 const gchar *	dupin_linkbase_get_name	(DupinLinkB *	linkb);
 
+guint		dupin_linkbase_get_update_seq
+					(DupinLinkB *	linkb);
+
 gsize		dupin_linkbase_get_size	(DupinLinkB *	linkb);
 
+JsonNode *	dupin_linkbase_get_stats	(DupinLinkB *	linkb);
+
 gboolean	dupin_linkbase_get_creation_time
 					(DupinLinkB * linkb,
 					 gsize * creation_time);
@@ -83,6 +83,9 @@ dupin_record_exists_real (DupinDB * db, gchar * id, gboolean lock)
   gchar * errmsg;
   gsize numb = 0;
 
+  if (dupin_bloom_may_contain (db->bloom, id) == FALSE)
+    return FALSE;
+
   tmp = sqlite3_mprintf (DUPIN_DB_SQL_EXISTS, id);
 
   if (sqlite3_exec (db->db, tmp, dupin_record_exists_real_cb, &numb, &errmsg) != SQLITE_OK)
@@ -171,6 +174,10 @@ dupin_record_create_with_id_real (DupinDB * db, JsonNode * obj_node,
       return NULL;
     }
 
+  /* NOTE - added before the row can be seen by readers, a failed insert just leaves a false positive */
+
+  dupin_bloom_add (db->bloom, id);
+
   if (sqlite3_exec (db->db, tmp, NULL, NULL, &errmsg) != SQLITE_OK)
     {
       if (error != NULL && *error != NULL)
@@ -185,36 +192,40 @@ dupin_record_create_with_id_real (DupinDB * db, JsonNode * obj_node,
     }
 
   sqlite3_free (tmp);
+  tmp = NULL;
 
-  /* NOTE - update totals */
+  /* NOTE - update totals, unless they are rebuilt at the end of an initial load */
 
-  if (sqlite3_exec (db->db, DUPIN_DB_SQL_GET_TOTALS, dupin_record_select_total_cb, &t, NULL) != SQLITE_OK)
+  if (db->initial_load == FALSE)
     {
-      if (error != NULL && *error != NULL)
-        g_set_error (error, dupin_error_quark (), DUPIN_ERROR_CRUD, "%s",
-		   errmsg);
+      if (sqlite3_exec (db->db, DUPIN_DB_SQL_GET_TOTALS, dupin_record_select_total_cb, &t, NULL) != SQLITE_OK)
+        {
+          if (error != NULL && *error != NULL)
+            g_set_error (error, dupin_error_quark (), DUPIN_ERROR_CRUD, "%s",
+		       errmsg);
 
-      dupin_record_close (record);
-      sqlite3_free (errmsg);
-      dupin_database_rollback_transaction (db, error);
-      return NULL;
-    }
+          dupin_record_close (record);
+          sqlite3_free (errmsg);
+          dupin_database_rollback_transaction (db, error);
+          return NULL;
+        }
 
-  t.total_doc_ins++;
+      t.total_doc_ins++;
 
-  tmp = sqlite3_mprintf (DUPIN_DB_SQL_SET_TOTALS, (gint)t.total_doc_ins, (gint)t.total_doc_del);
+      tmp = sqlite3_mprintf (DUPIN_DB_SQL_SET_TOTALS, (gint)t.total_doc_ins, (gint)t.total_doc_del);
 
-  if (sqlite3_exec (db->db, tmp, NULL, NULL, &errmsg) != SQLITE_OK)
-    {
-      if (error != NULL && *error != NULL)
-        g_set_error (error, dupin_error_quark (), DUPIN_ERROR_CRUD, "%s",
-		   errmsg);
+      if (sqlite3_exec (db->db, tmp, NULL, NULL, &errmsg) != SQLITE_OK)
+        {
+          if (error != NULL && *error != NULL)
+            g_set_error (error, dupin_error_quark (), DUPIN_ERROR_CRUD, "%s",
+		       errmsg);
 
-      dupin_record_close (record);
-      sqlite3_free (errmsg);
-      sqlite3_free (tmp);
-      dupin_database_rollback_transaction (db, error);
-      return NULL;
+          dupin_record_close (record);
+          sqlite3_free (errmsg);
+          sqlite3_free (tmp);
+          dupin_database_rollback_transaction (db, error);
+          return NULL;
+        }
     }
 
   if (dupin_database_commit_transaction (db, error) < 0)
@@ -1483,14 +1494,32 @@ dupin_record_get_revision_node (DupinRecord * record, gchar * mvcc)
 
   JsonParser * parser = json_parser_new();
 
-  /* we do not check any parsing error due we stored earlier, we assume it is sane */
-  if (!json_parser_load_from_data (parser, r->obj_serialized, r->obj_serialized_len, &error))
+  if (dupin_compress_is_encoded (r->obj_serialized, r->obj_serialized_len) == TRUE)
     {
-      if (error != NULL)
+      gsize obj_len = 0;
+      gchar * obj = dupin_compress_decode (record->db->compress, r->obj_serialized, r->obj_serialized_len, &obj_len, &error);
+
+      if (obj == NULL)
         {
-          dupin_database_set_error (record->db, error->message);
+          if (error != NULL)
+            {
+              dupin_database_set_error (record->db, error->message);
+            }
+
+          goto dupin_record_get_revision_error;
         }
 
+      json_parser_load_from_data (parser, obj, obj_len, &error);
+      g_free (obj);
+    }
+  else
+    json_parser_load_from_data (parser, r->obj_serialized, r->obj_serialized_len, &error);
+
+  /* we do not check any parsing error due we stored earlier, we assume it is sane */
+  if (error != NULL)
+    {
+      dupin_database_set_error (record->db, error->message);
+
       goto dupin_record_get_revision_error;
     }
 
@@ -1731,6 +1760,21 @@ dupin_record_add_revision_obj (DupinRecord * record,
       && record->last->type)
     r->type = g_strdup (record->last->type);
 
+  /* NOTE - the hash is computed on the plain JSON above, only the stored form is compressed */
+
+  if (obj_serialized != NULL)
+    {
+      gsize compressed_len = 0;
+      gchar * compressed = dupin_compress_encode (record->db->compress, obj_serialized, obj_serialized_len, &compressed_len);
+
+      if (compressed != NULL)
+        {
+          g_free (obj_serialized);
+          obj_serialized = compressed;
+          obj_serialized_len = compressed_len;
+        }
+    }
+
   r->obj = obj_node_copy;
   r->obj_serialized = obj_serialized;
   r->obj_serialized_len = obj_serialized_len;
@@ -2817,9 +2861,9 @@ dupin_record_insert_bulk (DupinDB * db,
       return FALSE;
     }
 
-  g_rw_lock_writer_lock (db->d->rwlock);
+  dupin_rwlock_writer_lock (db->d->rwlock);
   db->d->bulk_transaction = TRUE;
-  g_rw_lock_writer_unlock (db->d->rwlock);
+  dupin_rwlock_writer_unlock (db->d->rwlock);
  
   for (n = nodes; n != NULL; n = n->next)
     {
@@ -2838,9 +2882,9 @@ dupin_record_insert_bulk (DupinDB * db,
 
           dupin_database_rollback_transaction (db, NULL);
 
-          g_rw_lock_writer_lock (db->d->rwlock);
+          dupin_rwlock_writer_lock (db->d->rwlock);
           db->d->bulk_transaction = FALSE;
-          g_rw_lock_writer_unlock (db->d->rwlock);
+          dupin_rwlock_writer_unlock (db->d->rwlock);
 
           return FALSE;
         }
@@ -2887,9 +2931,9 @@ dupin_record_insert_bulk (DupinDB * db,
 
   if (db->d->super_bulk_transaction == FALSE)
     {
-      g_rw_lock_writer_lock (db->d->rwlock);
+      dupin_rwlock_writer_lock (db->d->rwlock);
       db->d->bulk_transaction = FALSE;
-      g_rw_lock_writer_unlock (db->d->rwlock);
+      dupin_rwlock_writer_unlock (db->d->rwlock);
     }
 
   if (dupin_linkbase_commit_transaction (dupin_database_get_default_linkbase (db), NULL) < 0)
@@ -0,0 +1,152 @@
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "dupin_internal.h"
+#include "dupin_rwlock.h"
+
+DupinRWLock *
+dupin_rwlock_new (void)
+{
+  DupinRWLock * rwlock;
+
+  rwlock = g_malloc0 (sizeof (DupinRWLock));
+
+  g_rw_lock_init (&rwlock->lock);
+  g_mutex_init (&rwlock->mutex);
+
+  return rwlock;
+}
+
+void
+dupin_rwlock_free (DupinRWLock * rwlock)
+{
+  if (!rwlock)
+    return;
+
+  g_rw_lock_clear (&rwlock->lock);
+  g_mutex_clear (&rwlock->mutex);
+  g_free (rwlock);
+}
+
+/* CONTENTION *************************************************************/
+
+static gint64
+dupin_rwlock_wait_begin (DupinRWLock * rwlock)
+{
+  gint waiters = g_atomic_int_add (&rwlock->waiters, 1) + 1;
+  gint max;
+
+  while (waiters > (max = g_atomic_int_get (&rwlock->max_waiters)))
+    {
+      if (g_atomic_int_compare_and_exchange (&rwlock->max_waiters, max, waiters) == TRUE)
+	break;
+    }
+
+  return g_get_monotonic_time ();
+}
+
+static void
+dupin_rwlock_wait_end (DupinRWLock * rwlock, gint64 start)
+{
+  gint64 usec = g_get_monotonic_time () - start;
+
+  g_atomic_int_add (&rwlock->waiters, -1);
+
+  g_mutex_lock (&rwlock->mutex);
+
+  rwlock->contended++;
+  rwlock->wait_usec += usec;
+
+  if (usec > (gint64) rwlock->wait_max_usec)
+    rwlock->wait_max_usec = usec;
+
+  g_mutex_unlock (&rwlock->mutex);
+
+  /* The request being executed by this thread, if any: */
+  dupin_timing_add (DP_TIMING_LOCK, usec);
+}
+
+/* LOCKING ****************************************************************/
+
+void
+dupin_rwlock_reader_lock (DupinRWLock * rwlock)
+{
+  gint64 start;
+
+  if (g_rw_lock_reader_trylock (&rwlock->lock) == TRUE)
+    return;
+
+  start = dupin_rwlock_wait_begin (rwlock);
+  g_rw_lock_reader_lock (&rwlock->lock);
+  dupin_rwlock_wait_end (rwlock, start);
+}
+
+void
+dupin_rwlock_reader_unlock (DupinRWLock * rwlock)
+{
+  g_rw_lock_reader_unlock (&rwlock->lock);
+}
+
+void
+dupin_rwlock_writer_lock (DupinRWLock * rwlock)
+{
+  gint64 start;
+
+  if (g_rw_lock_writer_trylock (&rwlock->lock) == FALSE)
+    {
+      start = dupin_rwlock_wait_begin (rwlock);
+      g_rw_lock_writer_lock (&rwlock->lock);
+      dupin_rwlock_wait_end (rwlock, start);
+    }
+
+  rwlock->writer_since = g_get_monotonic_time ();
+}
+
+void
+dupin_rwlock_writer_unlock (DupinRWLock * rwlock)
+{
+  gint64 usec = g_get_monotonic_time () - rwlock->writer_since;
+
+  rwlock->writes++;
+  rwlock->hold_usec += usec;
+
+  if (usec > (gint64) rwlock->hold_max_usec)
+    rwlock->hold_max_usec = usec;
+
+  g_rw_lock_writer_unlock (&rwlock->lock);
+}
+
+/* STATS ******************************************************************/
+
+JsonNode *
+dupin_rwlock_stats (DupinRWLock * rwlock)
+{
+  JsonNode * node;
+  JsonObject * obj;
+
+  g_return_val_if_fail (rwlock != NULL, NULL);
+
+  node = json_node_new (JSON_NODE_OBJECT);
+  obj = json_object_new ();
+  json_node_take_object (node, obj);
+
+  g_mutex_lock (&rwlock->mutex);
+
+  json_object_set_int_member (obj, "contended", rwlock->contended);
+  json_object_set_int_member (obj, "wait_usec", rwlock->wait_usec);
+  json_object_set_int_member (obj, "wait_max_usec", rwlock->wait_max_usec);
+
+  g_mutex_unlock (&rwlock->mutex);
+
+  json_object_set_int_member (obj, "waiters", g_atomic_int_get (&rwlock->waiters));
+  json_object_set_int_member (obj, "max_waiters", g_atomic_int_get (&rwlock->max_waiters));
+
+  json_object_set_int_member (obj, "writes", rwlock->writes);
+  json_object_set_int_member (obj, "hold_usec", rwlock->hold_usec);
+  json_object_set_int_member (obj, "hold_max_usec", rwlock->hold_max_usec);
+
+  return node;
+}
+
+/* EOF */
@@ -0,0 +1,50 @@
+#ifndef _DUPIN_RWLOCK_H_
+#define _DUPIN_RWLOCK_H_
+
+#include <dupin.h>
+#include <json-glib/json-glib.h>
+
+G_BEGIN_DECLS
+
+/* NOTE - a GRWLock with contention accounting: the waits are measured only when the
+          trylock fails, the hold time only for writers since they are exclusive */
+
+typedef struct dupin_rwlock_t DupinRWLock;
+struct dupin_rwlock_t
+{
+  GRWLock	lock;
+
+  gint		waiters;
+  gint		max_waiters;
+
+  GMutex	mutex;		/* the wait counters, taken by waiting threads only */
+  guint64	contended;
+  guint64	wait_usec;
+  guint64	wait_max_usec;
+
+  /* Updated under the writer lock: */
+  gint64	writer_since;
+  guint64	writes;
+  guint64	hold_usec;
+  guint64	hold_max_usec;
+};
+
+DupinRWLock *	dupin_rwlock_new		(void);
+
+void		dupin_rwlock_free		(DupinRWLock *	rwlock);
+
+void		dupin_rwlock_reader_lock	(DupinRWLock *	rwlock);
+
+void		dupin_rwlock_reader_unlock	(DupinRWLock *	rwlock);
+
+void		dupin_rwlock_writer_lock	(DupinRWLock *	rwlock);
+
+void		dupin_rwlock_writer_unlock	(DupinRWLock *	rwlock);
+
+JsonNode *	dupin_rwlock_stats		(DupinRWLock *	rwlock);
+
+G_END_DECLS
+
+#endif
+
+/* EOF */
@@ -0,0 +1,133 @@
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "dupin_internal.h"
+#include "dupin_timing.h"
+
+#include <string.h>
+
+static const gchar * dupin_timing_phase_names[DP_TIMING_PHASES] = {
+  "parse",
+  "lock",
+  "sql",
+  "json",
+  "write"
+};
+
+static GPrivate dupin_timing_current = G_PRIVATE_INIT (NULL);
+
+DupinTiming *
+dupin_timing_new (void)
+{
+  DupinTiming * timing;
+
+  timing = g_malloc0 (sizeof (DupinTiming));
+
+  timing->start = g_get_monotonic_time ();
+  timing->statements = g_array_new (FALSE, FALSE, sizeof (DupinTimingStatement));
+
+  return timing;
+}
+
+void
+dupin_timing_free (DupinTiming * timing)
+{
+  guint i;
+
+  if (!timing)
+    return;
+
+  for (i = 0; i < timing->statements->len; i++)
+    g_free (g_array_index (timing->statements, DupinTimingStatement, i).sql);
+
+  g_array_free (timing->statements, TRUE);
+  g_free (timing);
+}
+
+void
+dupin_timing_set_current (DupinTiming * timing)
+{
+  g_private_set (&dupin_timing_current, timing);
+}
+
+DupinTiming *
+dupin_timing_get_current (void)
+{
+  return g_private_get (&dupin_timing_current);
+}
+
+void
+dupin_timing_add (DupinTimingPhase phase, gint64 usec)
+{
+  DupinTiming * timing;
+
+  g_return_if_fail (phase < DP_TIMING_PHASES);
+
+  if ((timing = g_private_get (&dupin_timing_current)))
+    timing->phases[phase] += usec;
+}
+
+const gchar *
+dupin_timing_phase_name (DupinTimingPhase phase)
+{
+  g_return_val_if_fail (phase < DP_TIMING_PHASES, NULL);
+
+  return dupin_timing_phase_names[phase];
+}
+
+/* SQLITE *****************************************************************/
+
+/* NOTE - the profile callback runs when a statement finishes, while its handle is
+          still alive: it is found again through its SQL text pointer, which is the
+          same one sqlite3_sql() returns */
+
+static void
+dupin_timing_sqlite_profile_cb (void * arg, const char * sql,
+				sqlite3_uint64 nsec)
+{
+  DupinTiming * timing;
+  DupinTimingStatement statement;
+  sqlite3_stmt * stmt;
+
+  if (!(timing = g_private_get (&dupin_timing_current)))
+    return;
+
+  timing->phases[DP_TIMING_SQL] += nsec / 1000;
+
+  if (timing->statements->len >= DUPIN_TIMING_STATEMENTS_MAX)
+    {
+      timing->statements_dropped++;
+      return;
+    }
+
+  memset (&statement, 0, sizeof (DupinTimingStatement));
+
+  statement.sql = sql != NULL ? g_strndup (sql, DUPIN_TIMING_SQL_MAX_LEN) : g_strdup ("");
+  statement.usec = nsec / 1000;
+
+  for (stmt = sqlite3_next_stmt ((sqlite3 *) arg, NULL); stmt;
+       stmt = sqlite3_next_stmt ((sqlite3 *) arg, stmt))
+    {
+      if (sql == NULL || sqlite3_sql (stmt) != sql)
+	continue;
+
+      statement.fullscan_step = sqlite3_stmt_status (stmt, SQLITE_STMTSTATUS_FULLSCAN_STEP, 1);
+      statement.sort = sqlite3_stmt_status (stmt, SQLITE_STMTSTATUS_SORT, 1);
+      statement.autoindex = sqlite3_stmt_status (stmt, SQLITE_STMTSTATUS_AUTOINDEX, 1);
+      statement.vm_step = sqlite3_stmt_status (stmt, SQLITE_STMTSTATUS_VM_STEP, 1);
+      break;
+    }
+
+  g_array_append_val (timing->statements, statement);
+}
+
+void
+dupin_timing_sqlite_profile (sqlite3 * db)
+{
+  g_return_if_fail (db != NULL);
+
+  sqlite3_profile (db, dupin_timing_sqlite_profile_cb, db);
+}
+
+/* EOF */
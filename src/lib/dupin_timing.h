@@ -0,0 +1,68 @@
+#ifndef _DUPIN_TIMING_H_
+#define _DUPIN_TIMING_H_
+
+#include <dupin.h>
+#include <sqlite3.h>
+
+G_BEGIN_DECLS
+
+/* NOTE - a timing context belongs to one request and is made current for the thread
+          executing it, library code adds to whatever context is current (if any) */
+
+typedef enum
+{
+  DP_TIMING_PARSE = 0,
+  DP_TIMING_LOCK,
+  DP_TIMING_SQL,
+  DP_TIMING_JSON,
+  DP_TIMING_WRITE,
+
+  DP_TIMING_PHASES
+} DupinTimingPhase;
+
+#define DUPIN_TIMING_STATEMENTS_MAX	64
+#define DUPIN_TIMING_SQL_MAX_LEN	256
+
+typedef struct dupin_timing_statement_t DupinTimingStatement;
+struct dupin_timing_statement_t
+{
+  gchar *	sql;
+  gint64	usec;
+
+  /* sqlite3_stmt_status() counters: */
+  gint		fullscan_step;
+  gint		sort;
+  gint		autoindex;
+  gint		vm_step;
+};
+
+typedef struct dupin_timing_t DupinTiming;
+struct dupin_timing_t
+{
+  gint64	start;
+  gint64	phases[DP_TIMING_PHASES];	/* usec */
+
+  GArray *	statements;	/* DupinTimingStatement */
+  guint		statements_dropped;
+};
+
+DupinTiming *	dupin_timing_new		(void);
+
+void		dupin_timing_free		(DupinTiming *	timing);
+
+void		dupin_timing_set_current	(DupinTiming *	timing);
+
+DupinTiming *	dupin_timing_get_current	(void);
+
+void		dupin_timing_add		(DupinTimingPhase phase,
+						 gint64		usec);
+
+const gchar *	dupin_timing_phase_name		(DupinTimingPhase phase);
+
+void		dupin_timing_sqlite_profile	(sqlite3 *	db);
+
+G_END_DECLS
+
+#endif
+
+/* EOF */
@@ -0,0 +1,265 @@
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "dupin_internal.h"
+#include "dupin_trace.h"
+#include "dupin_utils.h"
+
+#include <string.h>
+#include <unistd.h>
+
+/* NOTE - each thread records into its own ring, the mutex of a ring is only contended
+          while it is dumped. A ring outlives its thread until the next dump or clear,
+          so the spans of pool workers which already exited are not lost. */
+
+typedef struct dupin_trace_event_t DupinTraceEvent;
+struct dupin_trace_event_t
+{
+  const gchar *	category;
+  const gchar *	name;
+  gchar *	arg;
+  gint64	ts;
+  gint64	dur;
+};
+
+typedef struct dupin_trace_buffer_t DupinTraceBuffer;
+struct dupin_trace_buffer_t
+{
+  GMutex	mutex;
+
+  guint		tid;
+  const gchar *	thread_name;	/* category of the first span */
+  gboolean	orphan;		/* its thread exited */
+
+  DupinTraceEvent events[DUPIN_TRACE_BUFFER_EVENTS];
+  guint		events_numb;	/* total recorded, the ring position is modulo */
+};
+
+static void dupin_trace_buffer_orphan (DupinTraceBuffer * buffer);
+
+static gint dupin_trace_enabled = 0;
+
+static GMutex dupin_trace_mutex;
+static GList * dupin_trace_buffers = NULL;
+static guint dupin_trace_tid = 0;
+
+static GPrivate dupin_trace_current = G_PRIVATE_INIT ((GDestroyNotify) dupin_trace_buffer_orphan);
+
+void
+dupin_trace_set_enabled (gboolean enabled)
+{
+  g_atomic_int_set (&dupin_trace_enabled, enabled == TRUE ? 1 : 0);
+}
+
+gboolean
+dupin_trace_is_enabled (void)
+{
+  return g_atomic_int_get (&dupin_trace_enabled) ? TRUE : FALSE;
+}
+
+gint64
+dupin_trace_begin (void)
+{
+  if (!g_atomic_int_get (&dupin_trace_enabled))
+    return 0;
+
+  return g_get_monotonic_time ();
+}
+
+/* BUFFERS ****************************************************************/
+
+static void
+dupin_trace_buffer_free (DupinTraceBuffer * buffer)
+{
+  guint i;
+
+  for (i = 0; i < DUPIN_TRACE_BUFFER_EVENTS; i++)
+    g_free (buffer->events[i].arg);
+
+  g_mutex_clear (&buffer->mutex);
+  g_free (buffer);
+}
+
+static void
+dupin_trace_buffer_orphan (DupinTraceBuffer * buffer)
+{
+  g_mutex_lock (&dupin_trace_mutex);
+  buffer->orphan = TRUE;
+  g_mutex_unlock (&dupin_trace_mutex);
+}
+
+static DupinTraceBuffer *
+dupin_trace_buffer_get (const gchar * category)
+{
+  DupinTraceBuffer * buffer;
+
+  if ((buffer = g_private_get (&dupin_trace_current)))
+    return buffer;
+
+  buffer = g_malloc0 (sizeof (DupinTraceBuffer));
+  g_mutex_init (&buffer->mutex);
+  buffer->thread_name = category;
+
+  g_mutex_lock (&dupin_trace_mutex);
+  buffer->tid = ++dupin_trace_tid;
+  dupin_trace_buffers = g_list_prepend (dupin_trace_buffers, buffer);
+  g_mutex_unlock (&dupin_trace_mutex);
+
+  g_private_set (&dupin_trace_current, buffer);
+  return buffer;
+}
+
+/* Called with dupin_trace_mutex locked: */
+static void
+dupin_trace_buffers_drop_orphans (void)
+{
+  GList *list, *next;
+
+  for (list = dupin_trace_buffers; list; list = next)
+    {
+      DupinTraceBuffer * buffer = list->data;
+
+      next = list->next;
+
+      if (buffer->orphan == FALSE)
+	continue;
+
+      dupin_trace_buffers = g_list_delete_link (dupin_trace_buffers, list);
+      dupin_trace_buffer_free (buffer);
+    }
+}
+
+void
+dupin_trace_end (const gchar * category, const gchar * name, const gchar * arg,
+		 gint64 start)
+{
+  DupinTraceBuffer * buffer;
+  DupinTraceEvent * event;
+  gint64 now;
+
+  if (!start)
+    return;
+
+  now = g_get_monotonic_time ();
+
+  buffer = dupin_trace_buffer_get (category);
+
+  g_mutex_lock (&buffer->mutex);
+
+  event = &buffer->events[buffer->events_numb % DUPIN_TRACE_BUFFER_EVENTS];
+  buffer->events_numb++;
+
+  g_free (event->arg);
+
+  event->category = category;
+  event->name = name;
+  event->arg = g_strdup (arg);
+  event->ts = start;
+  event->dur = now - start;
+
+  g_mutex_unlock (&buffer->mutex);
+}
+
+void
+dupin_trace_clear (void)
+{
+  GList *list;
+
+  g_mutex_lock (&dupin_trace_mutex);
+
+  dupin_trace_buffers_drop_orphans ();
+
+  for (list = dupin_trace_buffers; list; list = list->next)
+    {
+      DupinTraceBuffer * buffer = list->data;
+      guint i;
+
+      g_mutex_lock (&buffer->mutex);
+
+      for (i = 0; i < DUPIN_TRACE_BUFFER_EVENTS; i++)
+	{
+	  g_free (buffer->events[i].arg);
+	  buffer->events[i].arg = NULL;
+	}
+
+      buffer->events_numb = 0;
+
+      g_mutex_unlock (&buffer->mutex);
+    }
+
+  g_mutex_unlock (&dupin_trace_mutex);
+}
+
+/* DUMP *******************************************************************/
+
+static void
+dupin_trace_dump_string (GString * str, const gchar * value)
+{
+  gchar *tmp = dupin_util_json_strescape (value);
+
+  g_string_append_printf (str, "\"%s\"", tmp);
+  g_free (tmp);
+}
+
+gchar *
+dupin_trace_dump (void)
+{
+  GString *str;
+  GList *list;
+  gboolean first = TRUE;
+  gint pid = getpid ();
+
+  str = g_string_new ("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+  g_mutex_lock (&dupin_trace_mutex);
+
+  for (list = dupin_trace_buffers; list; list = list->next)
+    {
+      DupinTraceBuffer * buffer = list->data;
+      guint i, from;
+
+      g_mutex_lock (&buffer->mutex);
+
+      g_string_append_printf (str, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,\"tid\":%u,\"args\":{\"name\":",
+			      first == TRUE ? "" : ",", pid, buffer->tid);
+      dupin_trace_dump_string (str, buffer->thread_name);
+      g_string_append (str, "}}");
+      first = FALSE;
+
+      from = buffer->events_numb > DUPIN_TRACE_BUFFER_EVENTS ? buffer->events_numb - DUPIN_TRACE_BUFFER_EVENTS : 0;
+
+      for (i = from; i < buffer->events_numb; i++)
+	{
+	  DupinTraceEvent * event = &buffer->events[i % DUPIN_TRACE_BUFFER_EVENTS];
+
+	  g_string_append_printf (str, ",{\"ph\":\"X\",\"pid\":%d,\"tid\":%u,\"ts\":%" G_GINT64_FORMAT ",\"dur\":%" G_GINT64_FORMAT ",\"cat\":",
+				  pid, buffer->tid, event->ts, event->dur);
+	  dupin_trace_dump_string (str, event->category);
+	  g_string_append (str, ",\"name\":");
+	  dupin_trace_dump_string (str, event->name);
+
+	  if (event->arg != NULL)
+	    {
+	      g_string_append (str, ",\"args\":{\"name\":");
+	      dupin_trace_dump_string (str, event->arg);
+	      g_string_append (str, "}");
+	    }
+
+	  g_string_append (str, "}");
+	}
+
+      g_mutex_unlock (&buffer->mutex);
+    }
+
+  /* The spans of the exited threads are dumped once: */
+  dupin_trace_buffers_drop_orphans ();
+
+  g_mutex_unlock (&dupin_trace_mutex);
+
+  g_string_append (str, "]}");
+
+  return g_string_free (str, FALSE);
+}
+
+/* EOF */
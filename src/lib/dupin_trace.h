@@ -0,0 +1,35 @@
+#ifndef _DUPIN_TRACE_H_
+#define _DUPIN_TRACE_H_
+
+#include <dupin.h>
+
+G_BEGIN_DECLS
+
+/* NOTE - spans are recorded only while tracing is enabled, otherwise
+          dupin_trace_begin() is a single atomic read returning zero and
+          dupin_trace_end() ignores a zero start */
+
+#define DUPIN_TRACE_BUFFER_EVENTS	8192	/* per thread, the oldest are overwritten */
+
+void		dupin_trace_set_enabled	(gboolean	enabled);
+
+gboolean	dupin_trace_is_enabled	(void);
+
+gint64		dupin_trace_begin	(void);
+
+/* The category and the name must be static strings, the argument is copied: */
+void		dupin_trace_end		(const gchar *	category,
+					 const gchar *	name,
+					 const gchar *	arg,
+					 gint64		start);
+
+void		dupin_trace_clear	(void);
+
+/* Chrome trace event format, see chrome://tracing: */
+gchar *		dupin_trace_dump	(void);
+
+G_END_DECLS
+
+#endif
+
+/* EOF */
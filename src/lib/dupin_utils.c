@@ -116,6 +116,99 @@ dupin_util_is_valid_absolute_uri (gchar * uri)
 
 /* see also http://engineering.twitter.com/2010/06/announcing-snowflake.html */
 
+/* NOTE - the time-ordered schemes are a 48 bits millisecond timestamp followed by a
+          random part. Within the same millisecond the random part is incremented, so the
+          IDs of the process are strictly increasing and unique without asking the store,
+          and new records land at the end of the DupinId index. A new millisecond draws a
+          new random part with its top bit cleared, the increments never overflow in practice;
+          if they do the timestamp is moved on by one. */
+
+static DupinIdScheme dupin_util_id_scheme = DP_ID_SCHEME_RANDOM;
+
+static GMutex dupin_util_id_mutex;
+static guint64 dupin_util_id_ms = 0;
+static guint16 dupin_util_id_rand_hi = 0;
+static guint64 dupin_util_id_rand_lo = 0;
+
+void
+dupin_util_set_id_scheme (DupinIdScheme scheme)
+{
+  dupin_util_id_scheme = scheme;
+}
+
+gboolean
+dupin_util_generate_id_is_unique (void)
+{
+  return dupin_util_id_scheme != DP_ID_SCHEME_RANDOM ? TRUE : FALSE;
+}
+
+static gchar *
+dupin_util_generate_id_time_ordered (DupinIdScheme scheme)
+{
+  /* UUIDv7 keeps 74 of the 80 random bits, version and variant take the others: */
+  guint16 rand_hi_max = (scheme == DP_ID_SCHEME_UUIDV7) ? 0x3ff : 0xffff;
+  guint64 ms = (guint64) (g_get_real_time () / 1000);
+  guint64 rand_lo;
+  guint16 rand_hi;
+
+  g_mutex_lock (&dupin_util_id_mutex);
+
+  if (ms > dupin_util_id_ms)
+    {
+      dupin_util_id_ms = ms;
+
+      sqlite3_randomness (sizeof (dupin_util_id_rand_hi), &dupin_util_id_rand_hi);
+      sqlite3_randomness (sizeof (dupin_util_id_rand_lo), &dupin_util_id_rand_lo);
+
+      dupin_util_id_rand_hi &= rand_hi_max >> 1;
+    }
+
+  else if (++dupin_util_id_rand_lo == 0
+	   && ++dupin_util_id_rand_hi > rand_hi_max)
+    {
+      dupin_util_id_ms++;
+      dupin_util_id_rand_hi = 0;
+    }
+
+  ms = dupin_util_id_ms;
+  rand_hi = dupin_util_id_rand_hi;
+  rand_lo = dupin_util_id_rand_lo;
+
+  g_mutex_unlock (&dupin_util_id_mutex);
+
+  if (scheme == DP_ID_SCHEME_UUIDV7)
+    {
+      /* 48 bits timestamp, 4 bits version, 12 bits rand_a, 2 bits variant, 62 bits rand_b: */
+      guint16 rand_a = (guint16) ((rand_hi << 2) | (rand_lo >> 62));
+
+      return g_strdup_printf ("%08x-%04x-%04x-%04x-%012" G_GINT64_MODIFIER "x",
+			      (guint32) (ms >> 16), (guint) (ms & 0xffff),
+			      0x7000 | (rand_a & 0x0fff),
+			      (guint) (0x8000 | ((rand_lo >> 48) & 0x3fff)),
+			      rand_lo & G_GUINT64_CONSTANT (0xffffffffffff));
+    }
+  else
+    {
+      /* ULID, 26 chars of 5 bits: 10 for the timestamp, 16 for the random part */
+      static const gchar crockford[] = "0123456789ABCDEFGHJKMNPQRSTVWXYZ";
+      gchar * ulid = g_malloc (27);
+      gint i;
+
+      for (i = 9; i >= 0; i--, ms >>= 5)
+	ulid[i] = crockford[ms & 0x1f];
+
+      for (i = 25; i >= 10; i--)
+	{
+	  ulid[i] = crockford[rand_lo & 0x1f];
+	  rand_lo = (rand_lo >> 5) | ((guint64) (rand_hi & 0x1f) << 59);
+	  rand_hi >>= 5;
+	}
+
+      ulid[26] = '\0';
+      return ulid;
+    }
+}
+
 /* TODO - rework this function to be network portable (indep. of NTP) and sequential etc */
 /* roughly we want an ID which is unique per thread, machine/server and sequential, and sortable */
 
@@ -124,6 +217,9 @@ dupin_util_generate_id (GError **  error)
 {
   gchar guid[32];
 
+  if (dupin_util_id_scheme != DP_ID_SCHEME_RANDOM)
+    return dupin_util_generate_id_time_ordered (dupin_util_id_scheme);
+
   static const unsigned char rchars[] =
 	"abcdefghijklmnopqrstuvwxyz"
 	"0123456789";
@@ -256,6 +352,7 @@ dupin_util_json_serialize (JsonNode * node)
     }
   else
     {
+      gint64 start = g_get_monotonic_time ();
       JsonGenerator * gen = json_generator_new();
 
       if (gen == NULL)
@@ -269,6 +366,8 @@ dupin_util_json_serialize (JsonNode * node)
       node_serialized = json_generator_to_data (gen,NULL);
 
       g_object_unref (gen);
+
+      dupin_timing_add (DP_TIMING_JSON, g_get_monotonic_time () - start);
     }
 
   return node_serialized;
@@ -1026,10 +1125,12 @@ dupin_sqlite_json_filterby_strfreev (void *p)
 
 /* filterBy (fields, fields_format, filter_op, obj, filter_values) */
 
+/* NOTE - the user data is the DupinCompress of the store, NULL if its rows are never compressed */
+
 void
 dupin_sqlite_json_filterby (sqlite3_context *ctx, int argc, sqlite3_value **argv)
 {
-  //Dupin * d = (Dupin *)sqlite3_user_data (ctx);
+  DupinCompress * compress = (DupinCompress *)sqlite3_user_data (ctx);
 
   gchar *fields = NULL;
   gchar *op;
@@ -1098,20 +1199,44 @@ dupin_sqlite_json_filterby (sqlite3_context *ctx, int argc, sqlite3_value **argv
   obj_node = (JsonNode *)sqlite3_get_auxdata(ctx, 3);
   if (obj_node == NULL)
     {
+      gchar * obj_decoded = NULL;
+      gsize obj_len = strlen (obj);
+
+      /* NOTE - compressed revisions are zstd: + base64, filter on the JSON they hold */
+
+      if (dupin_compress_is_encoded (obj, obj_len) == TRUE)
+        {
+          if (!(obj_decoded = dupin_compress_decode (compress, obj, obj_len, &obj_len, NULL)))
+            {
+              sqlite3_result_int(ctx, 0);
+              return;
+            }
+
+          obj = obj_decoded;
+        }
+
       JsonParser *parser = json_parser_new ();
 
       if (parser == NULL)
         {
           //sqlite3_result_error(ctx, "Cannot create parser to parse obj body.\n", -1);
+          if (obj_decoded != NULL)
+            g_free (obj_decoded);
           return;
         }
 
-      if (!json_parser_load_from_data (parser, obj, strlen(obj), NULL))
+      if (!json_parser_load_from_data (parser, obj, obj_len, NULL))
         {
           //sqlite3_result_error(ctx, "Cannot parse obj body.\n", -1);
+          if (obj_decoded != NULL)
+            g_free (obj_decoded);
+          g_object_unref (parser);
           return;
         }
 
+      if (obj_decoded != NULL)
+        g_free (obj_decoded);
+
       obj_node = json_parser_get_root (parser);
 
       if (obj_node == NULL)
@@ -2443,6 +2568,41 @@ dupin_util_http_if_modified_since (gchar * header_if_modified_since,
   return changed;
 }
 
+/* NOTE - If-Range carries either a strong entity tag or a HTTP date and the range
+          is honoured only on exact match, see http://tools.ietf.org/html/rfc2616#section-14.27 */
+
+gboolean
+dupin_util_http_if_range (gchar * header_if_range,
+                          gchar * etag,
+                          gsize last_modified)
+{
+  if (header_if_range == NULL)
+    return TRUE;
+
+  /* Weak entity tags never match */
+  if (!strncmp (header_if_range, "W/", 2))
+    return FALSE;
+
+  if (header_if_range[0] == '"')
+    {
+      gsize len = strlen (header_if_range);
+
+      if (etag == NULL
+          || len != strlen (etag) + 2
+          || header_if_range[len - 1] != '"'
+          || strncmp (header_if_range + 1, etag, len - 2))
+        return FALSE;
+
+      return TRUE;
+    }
+
+  gsize modified = 0;
+
+  if (dupin_date_string_to_timestamp (header_if_range, &modified) == FALSE)
+    return FALSE;
+
+  return (dupin_date_timestamp_cmp (modified, last_modified) == 0) ? TRUE : FALSE;
+}
 
 
 
@@ -92,6 +92,11 @@ gboolean	dupin_util_is_valid_obj		(JsonObject *obj);
 
 gchar *		dupin_util_generate_id		(GError **  error);
 
+void		dupin_util_set_id_scheme	(DupinIdScheme	scheme);
+
+gboolean	dupin_util_generate_id_is_unique
+						(void);
+
 gboolean	dupin_util_is_valid_view_engine_lang
 						(gchar *	lang);
 
@@ -168,6 +173,10 @@ gboolean       dupin_util_http_if_modified_since
 						(gchar * header_if_modified_since,
 						 gsize last_modified);
 
+gboolean       dupin_util_http_if_range		(gchar * header_if_range,
+						 gchar * etag,
+						 gsize last_modified);
+
 /* k/v pairs for argument lists */
 
 typedef struct dupin_keyvalue_t    dupin_keyvalue_t;
@@ -106,6 +106,9 @@ See http://wiki.apache.org/couchdb/Introduction_to_CouchDB_views
 #define DUPIN_VIEW_SQL_COUNT \
 	"SELECT count(id) as c FROM Dupin"
 
+#define DUPIN_VIEW_SQL_GET_SYNC_MAP_ID \
+	"SELECT sync_map_id as c FROM DupinView LIMIT 1"
+
 #define DUPIN_VIEW_SQL_GET_RECORD \
         "SELECT parent, isdb, islinkb, language, map, reduce, output, output_isdb, output_islinkb FROM DupinView LIMIT 1"
 
@@ -124,11 +127,11 @@ dupin_get_views (Dupin * d)
 
   g_return_val_if_fail (d != NULL, NULL);
 
-  g_rw_lock_reader_lock (d->rwlock);
+  dupin_rwlock_reader_lock (d->rwlock);
 
   if (!(size = g_hash_table_size (d->views)))
     {
-      g_rw_lock_reader_unlock (d->rwlock);
+      dupin_rwlock_reader_unlock (d->rwlock);
       return NULL;
     }
 
@@ -141,7 +144,7 @@ dupin_get_views (Dupin * d)
 
   ret[i] = NULL;
 
-  g_rw_lock_reader_unlock (d->rwlock);
+  dupin_rwlock_reader_unlock (d->rwlock);
 
   return ret;
 }
@@ -152,10 +155,10 @@ dupin_view_exists (Dupin * d,
 {
   gboolean ret;
 
-  g_rw_lock_reader_lock (d->rwlock);
+  dupin_rwlock_reader_lock (d->rwlock);
   DupinView * view = g_hash_table_lookup (d->views, view_name);
   ret = ((view != NULL) && view->todelete == FALSE) ? TRUE : FALSE;
-  g_rw_lock_reader_unlock (d->rwlock);
+  dupin_rwlock_reader_unlock (d->rwlock);
 
   return ret;
 }
@@ -168,7 +171,7 @@ dupin_view_open (Dupin * d, gchar * view, GError ** error)
   g_return_val_if_fail (d != NULL, NULL);
   g_return_val_if_fail (view != NULL, NULL);
 
-  g_rw_lock_reader_lock (d->rwlock);
+  dupin_rwlock_reader_lock (d->rwlock);
 
   if (!(ret = g_hash_table_lookup (d->views, view)) || ret->todelete == TRUE)
     {
@@ -176,7 +179,7 @@ dupin_view_open (Dupin * d, gchar * view, GError ** error)
         g_set_error (error, dupin_error_quark (), DUPIN_ERROR_OPEN,
 		 "View '%s' doesn't exist.", view);
 
-      g_rw_lock_reader_unlock (d->rwlock);
+      dupin_rwlock_reader_unlock (d->rwlock);
       return NULL;
     }
   else
@@ -188,7 +191,7 @@ dupin_view_open (Dupin * d, gchar * view, GError ** error)
 #endif
     }
 
-  g_rw_lock_reader_unlock (d->rwlock);
+  dupin_rwlock_reader_unlock (d->rwlock);
 
   return ret;
 }
@@ -271,14 +274,14 @@ dupin_view_new (Dupin * d,
         }
     }
 
-  g_rw_lock_writer_lock (d->rwlock);
+  dupin_rwlock_writer_lock (d->rwlock);
 
   if ((ret = g_hash_table_lookup (d->views, view)))
     {
       if (error != NULL && *error != NULL)
         g_set_error (error, dupin_error_quark (), DUPIN_ERROR_OPEN,
 		   "View '%s' already exist.", view);
-      g_rw_lock_writer_unlock (d->rwlock);
+      dupin_rwlock_writer_unlock (d->rwlock);
       return NULL;
     }
 
@@ -288,7 +291,7 @@ dupin_view_new (Dupin * d,
 
   if (!(ret = dupin_view_connect (d, view, path, DP_SQLITE_OPEN_CREATE, error)))
     {
-      g_rw_lock_writer_unlock (d->rwlock);
+      dupin_rwlock_writer_unlock (d->rwlock);
       g_free (path);
       return NULL;
     }
@@ -305,7 +308,7 @@ dupin_view_new (Dupin * d,
 
   if (ret->engine == NULL)
     {
-      g_rw_lock_writer_unlock (d->rwlock);
+      dupin_rwlock_writer_unlock (d->rwlock);
       dupin_view_disconnect (ret);
       return NULL;
     }
@@ -317,7 +320,7 @@ dupin_view_new (Dupin * d,
   ret->output_is_db = output_is_db;
   ret->output_is_linkb = output_is_linkb;
 
-  g_rw_lock_writer_unlock (d->rwlock);
+  dupin_rwlock_writer_unlock (d->rwlock);
 
   if (dupin_view_begin_transaction (ret, error) < 0)
     {
@@ -387,9 +390,9 @@ dupin_view_new (Dupin * d,
       return NULL;
     }
 
-  g_rw_lock_writer_lock (d->rwlock);
+  dupin_rwlock_writer_lock (d->rwlock);
   g_hash_table_insert (d->views, g_strdup (view), ret);
-  g_rw_lock_writer_unlock (d->rwlock);
+  dupin_rwlock_writer_unlock (d->rwlock);
 
   dupin_view_sync (ret);
   return ret;
@@ -400,9 +403,9 @@ dupin_view_new (Dupin * d,
 static void
 dupin_view_p_update_real (DupinViewP * p, DupinView * view)
 {
-  g_rw_lock_reader_lock (view->rwlock);
+  dupin_rwlock_reader_lock (view->rwlock);
   gboolean todelete = view->todelete;
-  g_rw_lock_reader_unlock (view->rwlock);
+  dupin_rwlock_reader_unlock (view->rwlock);
 
   if (todelete == TRUE)
     {
@@ -541,9 +544,9 @@ dupin_view_p_update (DupinView * view,
           return FALSE;
         }
 
-      g_rw_lock_writer_lock (db->rwlock);
+      dupin_rwlock_writer_lock (db->rwlock);
       dupin_view_p_update_real (&db->views, view);
-      g_rw_lock_writer_unlock (db->rwlock);
+      dupin_rwlock_writer_unlock (db->rwlock);
 
       dupin_database_unref (db);
       }
@@ -567,9 +570,9 @@ dupin_view_p_update (DupinView * view,
           return FALSE;
         }
 
-      g_rw_lock_writer_lock (linkb->rwlock);
+      dupin_rwlock_writer_lock (linkb->rwlock);
       dupin_view_p_update_real (&linkb->views, view);
-      g_rw_lock_writer_unlock (linkb->rwlock);
+      dupin_rwlock_writer_unlock (linkb->rwlock);
 
       dupin_linkbase_unref (linkb);
     }
@@ -593,9 +596,9 @@ dupin_view_p_update (DupinView * view,
           return FALSE;
         }
 
-      g_rw_lock_writer_lock (v->rwlock);
+      dupin_rwlock_writer_lock (v->rwlock);
       dupin_view_p_update_real (&v->views, view);
-      g_rw_lock_writer_unlock (v->rwlock);
+      dupin_rwlock_writer_unlock (v->rwlock);
 
       dupin_view_unref (v);
     }
@@ -877,7 +880,8 @@ dupin_view_generate_id (DupinView * view,
 
       if (id != NULL)
         {   
-          if (dupin_view_record_exists_real (view, id, FALSE) == TRUE)
+          if (dupin_util_generate_id_is_unique () == FALSE
+              && dupin_view_record_exists_real (view, id, FALSE) == TRUE)
             { 
               g_free (id);
             }
@@ -980,7 +984,7 @@ dupin_view_ref (DupinView * view)
 {
   g_return_if_fail (view != NULL);
 
-  g_rw_lock_writer_lock (view->rwlock);
+  dupin_rwlock_writer_lock (view->rwlock);
 
   view->ref++;
 
@@ -988,7 +992,7 @@ dupin_view_ref (DupinView * view)
   fprintf(stderr,"dupin_view_ref: (%p) name=%s \t ref++=%d\n", g_thread_self (), view->name, (gint) view->ref);
 #endif
 
-  g_rw_lock_writer_unlock (view->rwlock);
+  dupin_rwlock_writer_unlock (view->rwlock);
 }
 
 void
@@ -1000,7 +1004,7 @@ dupin_view_unref (DupinView * view)
 
   d = view->d;
 
-  g_rw_lock_writer_lock (view->rwlock);
+  dupin_rwlock_writer_lock (view->rwlock);
 
   if (view->ref > 0)
     {
@@ -1011,31 +1015,31 @@ dupin_view_unref (DupinView * view)
 #endif
     }
 
-  g_rw_lock_writer_unlock (view->rwlock);
+  dupin_rwlock_writer_unlock (view->rwlock);
 
   if (view->todelete == TRUE &&
       dupin_view_is_syncing (view) == FALSE)
     {
-      g_rw_lock_reader_lock (view->rwlock);
+      dupin_rwlock_reader_lock (view->rwlock);
 
       if (view->ref > 0)
         {
-          g_rw_lock_reader_unlock (view->rwlock);
+          dupin_rwlock_reader_unlock (view->rwlock);
 
           g_warning ("dupin_view_unref: (thread=%p) view %s flagged for deletion but can't free it due ref is %d\n", g_thread_self (), view->name, (gint) view->ref);
 	}
       else
         {
-          g_rw_lock_reader_unlock (view->rwlock);
+          dupin_rwlock_reader_unlock (view->rwlock);
 
 	  if (dupin_view_p_update (view, NULL) == FALSE)
             {
               g_warning("dupin_view_unref: could not remove reference from parent for view '%s'\n", view->name);
             }
 
-          g_rw_lock_writer_lock (d->rwlock);
+          dupin_rwlock_writer_lock (d->rwlock);
           g_hash_table_remove (d->views, view->name);
-          g_rw_lock_writer_unlock (d->rwlock);
+          dupin_rwlock_writer_unlock (d->rwlock);
 	}
     }
 }
@@ -1045,9 +1049,9 @@ dupin_view_delete (DupinView * view, GError ** error)
 {
   g_return_val_if_fail (view != NULL, FALSE);
 
-  g_rw_lock_writer_lock (view->rwlock);
+  dupin_rwlock_writer_lock (view->rwlock);
   view->todelete = TRUE;
-  g_rw_lock_writer_unlock (view->rwlock);
+  dupin_rwlock_writer_unlock (view->rwlock);
 
   return TRUE;
 }
@@ -1057,9 +1061,9 @@ dupin_view_force_quit (DupinView * view, GError ** error)
 {
   g_return_val_if_fail (view != NULL, FALSE);
 
-  g_rw_lock_writer_lock (view->rwlock);
+  dupin_rwlock_writer_lock (view->rwlock);
   view->sync_toquit = TRUE;
-  g_rw_lock_writer_unlock (view->rwlock);
+  dupin_rwlock_writer_unlock (view->rwlock);
 
   return TRUE;
 }
@@ -1071,6 +1075,13 @@ dupin_view_get_name (DupinView * view)
   return view->name;
 }
 
+guint
+dupin_view_get_update_seq (DupinView * view)
+{
+  g_return_val_if_fail (view != NULL, 0);
+  return (guint) g_atomic_int_get ((gint *) &view->update_seq);
+}
+
 const gchar *
 dupin_view_get_parent (DupinView * view)
 {
@@ -1140,6 +1151,24 @@ dupin_view_get_size (DupinView * view)
   return (gsize) st.st_size;
 }
 
+JsonNode *
+dupin_view_get_stats (DupinView * view)
+{
+  JsonNode * node;
+  JsonObject * obj;
+
+  g_return_val_if_fail (view != NULL, NULL);
+
+  node = json_node_new (JSON_NODE_OBJECT);
+  obj = json_object_new ();
+  json_node_take_object (node, obj);
+
+  json_object_set_member (obj, "lock", dupin_rwlock_stats (view->rwlock));
+  json_object_set_member (obj, "io", dupin_iostats_stats (&view->iostats, view->db, view->path));
+
+  return node;
+}
+
 static int
 dupin_view_get_creation_time_cb (void *data, int argc, char **argv, char **col)
 {
@@ -1163,11 +1192,11 @@ dupin_view_get_creation_time (DupinView * view, gsize * creation_time)
 
   /* get creation time out of view */
   query = "SELECT creation_time as creation_time FROM DupinView";
-  g_rw_lock_reader_lock (view->rwlock);
+  dupin_rwlock_reader_lock (view->rwlock);
 
   if (sqlite3_exec (view->db, query, dupin_view_get_creation_time_cb, creation_time, &errmsg) != SQLITE_OK)
     {
-      g_rw_lock_reader_unlock (view->rwlock);
+      dupin_rwlock_reader_unlock (view->rwlock);
 
       g_error("dupin_view_get_creation_time: %s", errmsg);
       sqlite3_free (errmsg);
@@ -1175,7 +1204,7 @@ dupin_view_get_creation_time (DupinView * view, gsize * creation_time)
       return FALSE;
     }
 
-  g_rw_lock_reader_unlock (view->rwlock);
+  dupin_rwlock_reader_unlock (view->rwlock);
 
   return TRUE;
 }
@@ -1221,10 +1250,7 @@ dupin_view_disconnect (DupinView * view)
     }
 
   if (view->rwlock)
-    {
-      g_rw_lock_clear (view->rwlock);
-      g_free (view->rwlock);
-    }
+    dupin_rwlock_free (view->rwlock);
 
   if (view->views.views)
     g_free (view->views.views);
@@ -1263,6 +1289,8 @@ dupin_view_connect (Dupin * d, gchar * name, gchar * path,
 
   view = g_malloc0 (sizeof (DupinView));
 
+  view->update_seq = g_random_int ();
+
   view->tosync = FALSE;
 
   view->sync_map_processed_count = 0;
@@ -1282,8 +1310,7 @@ dupin_view_connect (Dupin * d, gchar * name, gchar * path,
   view->mutex = g_new0 (GMutex, 1);
   g_mutex_init (view->mutex);
 
-  view->rwlock = g_new0 (GRWLock, 1);
-  g_rw_lock_init (view->rwlock);
+  view->rwlock = dupin_rwlock_new ();
 
   if (sqlite3_open_v2 (view->path, &view->db, dupin_util_dupin_mode_to_sqlite_mode (mode), NULL) != SQLITE_OK)
     {
@@ -1296,6 +1323,11 @@ dupin_view_connect (Dupin * d, gchar * name, gchar * path,
 
   sqlite3_busy_timeout (view->db, DUPIN_SQLITE_TIMEOUT);
 
+  dupin_iostats_attach (&view->iostats, view->db);
+
+  if (d->conf != NULL && d->conf->limit_slowrequest_threshold > 0)
+    dupin_timing_sqlite_profile (view->db);
+
   /* NOTE - set simple collation functions for views - see http://wiki.apache.org/couchdb/View_collation */
 
   if (sqlite3_create_collation (view->db, "dupincmp", SQLITE_UTF8,  view->collation_parser, dupin_util_collation) != SQLITE_OK)
@@ -1477,7 +1509,9 @@ dupin_view_connect (Dupin * d, gchar * name, gchar * path,
 
   /* NOTE - we know this is inefficient, but we need it till proper Elastic search or lucene used as frontend */
 
-  sqlite3_create_function(view->db, "filterBy", 5, SQLITE_ANY, d, dupin_sqlite_json_filterby, NULL, NULL);
+  /* NOTE - view rows are never compressed, no compressor needed */
+
+  sqlite3_create_function(view->db, "filterBy", 5, SQLITE_ANY, NULL, dupin_sqlite_json_filterby, NULL, NULL);
 
   return view;
 }
@@ -1547,6 +1581,8 @@ dupin_view_rollback_transaction (DupinView * view, GError ** error)
   //g_message ("dupin_view_rollback_transaction: view %s transaction rollback", view->name);
 #endif
 
+  g_atomic_int_inc ((gint *) &view->update_seq);
+
   return 0;
 }
 
@@ -1579,6 +1615,8 @@ dupin_view_commit_transaction (DupinView * view, GError ** error)
   //g_message ("dupin_view_commit_transaction: view %s transaction commit", view->name);
 #endif
 
+  g_atomic_int_inc ((gint *) &view->update_seq);
+
   return 0;
 }
 
@@ -1600,19 +1638,37 @@ dupin_view_count (DupinView * view)
 
   g_return_val_if_fail (view != NULL, 0);
 
-  g_rw_lock_reader_lock (view->rwlock);
+  dupin_rwlock_reader_lock (view->rwlock);
 
   if (sqlite3_exec (view->db, DUPIN_VIEW_SQL_COUNT, dupin_view_count_cb, &size, NULL) !=
       SQLITE_OK)
     {
-      g_rw_lock_reader_unlock (view->rwlock);
+      dupin_rwlock_reader_unlock (view->rwlock);
       return 0;
     }
 
-  g_rw_lock_reader_unlock (view->rwlock);
+  dupin_rwlock_reader_unlock (view->rwlock);
   return size;
 }
 
+/* The last rowid of the parent processed by the map, see dupin_view_sync_thread_map_db () */
+gsize
+dupin_view_get_sync_map_rowid (DupinView * view)
+{
+  gsize rowid = 0;
+
+  g_return_val_if_fail (view != NULL, 0);
+
+  dupin_rwlock_reader_lock (view->rwlock);
+
+  if (sqlite3_exec (view->db, DUPIN_VIEW_SQL_GET_SYNC_MAP_ID, dupin_view_count_cb, &rowid, NULL) !=
+      SQLITE_OK)
+    rowid = 0;
+
+  dupin_rwlock_reader_unlock (view->rwlock);
+  return rowid;
+}
+
 /* NOTE - we always bulk insert using the latest revision and update the records only if modified (so we reduce revisions too) */
 
 JsonNode *
@@ -1711,8 +1767,12 @@ dupin_view_sync_thread_real_map (DupinView * view, GList * list)
 
       gchar * id = g_strdup ( (gchar *)json_node_get_string ( json_array_get_element ( json_node_get_array (data->pid), 0) ) );
 
+      gint64 span = dupin_trace_begin ();
+
       array_node = dupin_view_engine_record_map (view->engine, data->obj);
 
+      dupin_trace_end ("map", "dupin_view_engine_record_map", id, span);
+
       if (array_node != NULL && 
           json_node_get_node_type (array_node) == JSON_NODE_ARRAY)
 	{
@@ -1757,14 +1817,18 @@ dupin_view_sync_thread_real_map (DupinView * view, GList * list)
 	      if (response_node != NULL)
 	        json_node_free (response_node);
 
+	      span = dupin_trace_begin ();
+
 	      dupin_view_record_save_map (view,
 					  data->pid,
 					  key_node,
 					  node);
 
-              g_rw_lock_writer_lock (view->rwlock);
+	      dupin_trace_end ("map", "dupin_view_record_save_map", id, span);
+
+              dupin_rwlock_writer_lock (view->rwlock);
               view->sync_map_processed_count++;
-              g_rw_lock_writer_unlock (view->rwlock);
+              dupin_rwlock_writer_unlock (view->rwlock);
 
 	      dupin_view_p_record_insert (&view->views, id, mapped_result_obj);
             }
@@ -1815,11 +1879,11 @@ dupin_view_remap (DupinView * view,
 
       gchar * query = sqlite3_mprintf ("SELECT pid, id AS vid FROM DupinPid2Id WHERE id IS NOT (SELECT id FROM Dupin WHERE id=vid) LIMIT %" G_GSIZE_FORMAT, count);
 
-      g_rw_lock_reader_lock (view->rwlock);
+      dupin_rwlock_reader_lock (view->rwlock);
 
       if (sqlite3_exec (view->db, query, dupin_view_remap_cb, pids_to_remap, &errmsg) != SQLITE_OK)
         {
-          g_rw_lock_reader_unlock (view->rwlock);
+          dupin_rwlock_reader_unlock (view->rwlock);
 
           g_error ("dupin_view_remap: %s", errmsg);
           sqlite3_free (errmsg);
@@ -1832,7 +1896,7 @@ dupin_view_remap (DupinView * view,
           return NULL;
         }
 
-      g_rw_lock_reader_unlock (view->rwlock);
+      dupin_rwlock_reader_unlock (view->rwlock);
 
       sqlite3_free (query);
 
@@ -1914,11 +1978,11 @@ dupin_view_sync_thread_map_db (DupinView * view,
 
       query = "SELECT sync_map_id as c FROM DupinView LIMIT 1";
 
-      g_rw_lock_reader_lock (view->rwlock);
+      dupin_rwlock_reader_lock (view->rwlock);
 
       if (sqlite3_exec (view->db, query, dupin_view_sync_cb, &sync_map_id, &errmsg) != SQLITE_OK)
         {
-          g_rw_lock_reader_unlock (view->rwlock);
+          dupin_rwlock_reader_unlock (view->rwlock);
 
           g_error("dupin_view_sync_thread_map_db: %s", errmsg);
           sqlite3_free (errmsg);
@@ -1928,7 +1992,7 @@ dupin_view_sync_thread_map_db (DupinView * view,
           return FALSE;
         }
 
-      g_rw_lock_reader_unlock (view->rwlock);
+      dupin_rwlock_reader_unlock (view->rwlock);
 
       if (sync_map_id != NULL)
         start_rowid = (gsize) g_ascii_strtoll (sync_map_id, NULL, 10)+1;
@@ -1949,9 +2013,9 @@ dupin_view_sync_thread_map_db (DupinView * view,
     }
 
 #if DUPIN_VIEW_DEBUG
-  g_rw_lock_reader_lock (view->rwlock);
+  dupin_rwlock_reader_lock (view->rwlock);
   gsize sync_map_processed_count = view->sync_map_processed_count;
-  g_rw_lock_reader_unlock (view->rwlock);
+  dupin_rwlock_reader_unlock (view->rwlock);
 
   g_message("dupin_view_sync_thread_map_db(%p/%s)    g_list_length (results) = %d start_rowid=%d - mapped %d\n", g_thread_self (), view->name, (gint) g_list_length (results), (gint)start_rowid, (gint)sync_map_processed_count);
 #endif
@@ -2051,11 +2115,11 @@ dupin_view_sync_thread_map_db (DupinView * view,
       if (sync_map_id != NULL)
         g_free (sync_map_id);
 
-      g_rw_lock_writer_lock (view->rwlock);
+      dupin_rwlock_writer_lock (view->rwlock);
 
       if (dupin_view_begin_transaction (view, NULL) < 0)
         {
-          g_rw_lock_writer_unlock (view->rwlock);
+          dupin_rwlock_writer_unlock (view->rwlock);
           sqlite3_free (str);
 
           dupin_database_unref (db);
@@ -2065,7 +2129,7 @@ dupin_view_sync_thread_map_db (DupinView * view,
 
       if (sqlite3_exec (view->db, str, NULL, NULL, &errmsg) != SQLITE_OK)
         {
-          g_rw_lock_writer_unlock (view->rwlock);
+          dupin_rwlock_writer_unlock (view->rwlock);
           sqlite3_free (str);
 
           dupin_database_unref (db);
@@ -2080,7 +2144,7 @@ dupin_view_sync_thread_map_db (DupinView * view,
 
       if (dupin_view_commit_transaction (view, NULL) < 0)
         {
-          g_rw_lock_writer_unlock (view->rwlock);
+          dupin_rwlock_writer_unlock (view->rwlock);
           sqlite3_free (str);
 
           dupin_database_unref (db);
@@ -2088,7 +2152,7 @@ dupin_view_sync_thread_map_db (DupinView * view,
           return FALSE;
         }
 
-      g_rw_lock_writer_unlock (view->rwlock);
+      dupin_rwlock_writer_unlock (view->rwlock);
 
       sqlite3_free (str);
     }
@@ -2162,11 +2226,11 @@ dupin_view_sync_thread_map_linkb (DupinView * view, gsize count)
 
       query = "SELECT sync_map_id as c FROM DupinView LIMIT 1";
 
-      g_rw_lock_reader_lock (view->rwlock);
+      dupin_rwlock_reader_lock (view->rwlock);
 
       if (sqlite3_exec (view->db, query, dupin_view_sync_cb, &sync_map_id, &errmsg) != SQLITE_OK)
         {
-          g_rw_lock_reader_unlock (view->rwlock);
+          dupin_rwlock_reader_unlock (view->rwlock);
 
           g_error("dupin_view_sync_thread_map_linkb: %s", errmsg);
           sqlite3_free (errmsg);
@@ -2176,7 +2240,7 @@ dupin_view_sync_thread_map_linkb (DupinView * view, gsize count)
           return FALSE;
         }
 
-      g_rw_lock_reader_unlock (view->rwlock);
+      dupin_rwlock_reader_unlock (view->rwlock);
 
       if (sync_map_id != NULL)
         start_rowid = (gsize) g_ascii_strtoll (sync_map_id, NULL, 10)+1;
@@ -2198,9 +2262,9 @@ dupin_view_sync_thread_map_linkb (DupinView * view, gsize count)
     }
 
 #if DUPIN_VIEW_DEBUG
-  g_rw_lock_reader_lock (view->rwlock);
+  dupin_rwlock_reader_lock (view->rwlock);
   gsize sync_map_processed_count = view->sync_map_processed_count;
-  g_rw_lock_reader_unlock (view->rwlock);
+  dupin_rwlock_reader_unlock (view->rwlock);
 
   g_message("dupin_view_sync_thread_map_linkb(%p/%s)    g_list_length (results) = %d start_rowid=%d - mapped %d\n", g_thread_self (), view->name, (gint) g_list_length (results), (gint)start_rowid, (gint)sync_map_processed_count);
 #endif
@@ -2314,11 +2378,11 @@ dupin_view_sync_thread_map_linkb (DupinView * view, gsize count)
       if (sync_map_id != NULL)
         g_free (sync_map_id);
 
-      g_rw_lock_writer_lock (view->rwlock);
+      dupin_rwlock_writer_lock (view->rwlock);
 
       if (dupin_view_begin_transaction (view, NULL) < 0)
         {
-          g_rw_lock_writer_unlock (view->rwlock);
+          dupin_rwlock_writer_unlock (view->rwlock);
           sqlite3_free (str);
 
           dupin_linkbase_unref (linkb);
@@ -2328,7 +2392,7 @@ dupin_view_sync_thread_map_linkb (DupinView * view, gsize count)
 
       if (sqlite3_exec (view->db, str, NULL, NULL, &errmsg) != SQLITE_OK)
         {
-          g_rw_lock_writer_unlock (view->rwlock);
+          dupin_rwlock_writer_unlock (view->rwlock);
           sqlite3_free (str);
 
           dupin_linkbase_unref (linkb);
@@ -2343,7 +2407,7 @@ dupin_view_sync_thread_map_linkb (DupinView * view, gsize count)
 
       if (dupin_view_commit_transaction (view, NULL) < 0)
         {
-          g_rw_lock_writer_unlock (view->rwlock);
+          dupin_rwlock_writer_unlock (view->rwlock);
           sqlite3_free (str);
 
           dupin_linkbase_unref (linkb);
@@ -2351,7 +2415,7 @@ dupin_view_sync_thread_map_linkb (DupinView * view, gsize count)
           return FALSE;
         }
 
-      g_rw_lock_writer_unlock (view->rwlock);
+      dupin_rwlock_writer_unlock (view->rwlock);
 
       sqlite3_free (str);
     }
@@ -2424,11 +2488,11 @@ dupin_view_sync_thread_map_view (DupinView * view, gsize count)
 
       query = "SELECT sync_map_id as c FROM DupinView LIMIT 1";
 
-      g_rw_lock_reader_lock (view->rwlock);
+      dupin_rwlock_reader_lock (view->rwlock);
 
       if (sqlite3_exec (view->db, query, dupin_view_sync_cb, &sync_map_id, &errmsg) != SQLITE_OK)
         {
-          g_rw_lock_reader_unlock (view->rwlock);
+          dupin_rwlock_reader_unlock (view->rwlock);
 
           g_error("dupin_view_sync_thread_map_view: %s", errmsg);
           sqlite3_free (errmsg);
@@ -2438,7 +2502,7 @@ dupin_view_sync_thread_map_view (DupinView * view, gsize count)
           return FALSE;
         }
 
-      g_rw_lock_reader_unlock (view->rwlock);
+      dupin_rwlock_reader_unlock (view->rwlock);
 
       if (sync_map_id != NULL)
         start_rowid = (gsize) g_ascii_strtoll (sync_map_id, NULL, 10)+1;
@@ -2459,9 +2523,9 @@ dupin_view_sync_thread_map_view (DupinView * view, gsize count)
     }
 
 #if DUPIN_VIEW_DEBUG
-  g_rw_lock_reader_lock (view->rwlock);
+  dupin_rwlock_reader_lock (view->rwlock);
   gsize sync_map_processed_count = view->sync_map_processed_count;
-  g_rw_lock_reader_unlock (view->rwlock);
+  dupin_rwlock_reader_unlock (view->rwlock);
 
   g_message("dupin_view_sync_thread_map_view(%p/%s)    g_list_length (results) = %d\n", g_thread_self (), view->name, (gint) g_list_length (results) );
 #endif
@@ -2546,11 +2610,11 @@ dupin_view_sync_thread_map_view (DupinView * view, gsize count)
       g_message("dupin_view_sync_thread_map_view() view %s query=%s\n",view->name, str);
 #endif
 
-      g_rw_lock_writer_lock (view->rwlock);
+      dupin_rwlock_writer_lock (view->rwlock);
 
       if (dupin_view_begin_transaction (view, NULL) < 0)
         {
-          g_rw_lock_writer_unlock (view->rwlock);
+          dupin_rwlock_writer_unlock (view->rwlock);
           sqlite3_free (str);
 
           dupin_view_unref (v);
@@ -2560,7 +2624,7 @@ dupin_view_sync_thread_map_view (DupinView * view, gsize count)
 
       if (sqlite3_exec (view->db, str, NULL, NULL, &errmsg) != SQLITE_OK)
         {
-          g_rw_lock_writer_unlock (view->rwlock);
+          dupin_rwlock_writer_unlock (view->rwlock);
           sqlite3_free (str);
 
           dupin_view_unref (v);
@@ -2575,7 +2639,7 @@ dupin_view_sync_thread_map_view (DupinView * view, gsize count)
 
       if (dupin_view_commit_transaction (view, NULL) < 0)
         {
-          g_rw_lock_writer_unlock (view->rwlock);
+          dupin_rwlock_writer_unlock (view->rwlock);
           sqlite3_free (str);
 
           dupin_view_unref (v);
@@ -2583,7 +2647,7 @@ dupin_view_sync_thread_map_view (DupinView * view, gsize count)
           return FALSE;
         }
 
-      g_rw_lock_writer_unlock (view->rwlock);
+      dupin_rwlock_writer_unlock (view->rwlock);
 
       sqlite3_free (str);
     }
@@ -2605,14 +2669,27 @@ dupin_view_sync_thread_map_view (DupinView * view, gsize count)
 static gboolean
 dupin_view_sync_thread_map (DupinView * view, gsize count)
 {
+  gint64 span = dupin_trace_begin ();
+  gboolean ret;
+
   if (view->parent_is_db == TRUE)
-    return dupin_view_sync_thread_map_db (view, count);
+    {
+      ret = dupin_view_sync_thread_map_db (view, count);
+      dupin_trace_end ("map", "dupin_view_sync_thread_map_db", view->name, span);
+      return ret;
+    }
 
   /* TODO - unimplemented */
   if (view->parent_is_linkb == TRUE)
-    return dupin_view_sync_thread_map_linkb (view, count);
+    {
+      ret = dupin_view_sync_thread_map_linkb (view, count);
+      dupin_trace_end ("map", "dupin_view_sync_thread_map_linkb", view->name, span);
+      return ret;
+    }
 
-  return dupin_view_sync_thread_map_view (view, count);
+  ret = dupin_view_sync_thread_map_view (view, count);
+  dupin_trace_end ("map", "dupin_view_sync_thread_map_view", view->name, span);
+  return ret;
 }
 
 static int
@@ -2652,11 +2729,11 @@ dupin_view_sync_record_update (DupinView * view, gchar * previous_rowid, gint re
 
   replace_rowid_str = g_strdup_printf ("%d", (gint)replace_rowid);
 
-  g_rw_lock_writer_lock (view->rwlock);
+  dupin_rwlock_writer_lock (view->rwlock);
 
   if (dupin_view_begin_transaction (view, NULL) < 0)
     {
-      g_rw_lock_writer_unlock (view->rwlock);
+      dupin_rwlock_writer_unlock (view->rwlock);
       g_free (replace_rowid_str);
       if (pid_serialized)
         g_free (pid_serialized);
@@ -2677,7 +2754,7 @@ dupin_view_sync_record_update (DupinView * view, gchar * previous_rowid, gint re
 
   if (sqlite3_exec (view->db, query, NULL, NULL, &errmsg) != SQLITE_OK)
     {
-      g_rw_lock_writer_unlock (view->rwlock);
+      dupin_rwlock_writer_unlock (view->rwlock);
       sqlite3_free (query);
       g_free (replace_rowid_str);
       if (pid_serialized)
@@ -2708,7 +2785,7 @@ dupin_view_sync_record_update (DupinView * view, gchar * previous_rowid, gint re
 
   if (sqlite3_exec (view->db, query, NULL, NULL, &errmsg) != SQLITE_OK)
     {
-      g_rw_lock_writer_unlock (view->rwlock);
+      dupin_rwlock_writer_unlock (view->rwlock);
       sqlite3_free (query);
       g_free (replace_rowid_str);
       if (pid_serialized)
@@ -2739,7 +2816,7 @@ dupin_view_sync_record_update (DupinView * view, gchar * previous_rowid, gint re
 
   if (sqlite3_exec (view->db, query, NULL, NULL, &errmsg) != SQLITE_OK)
     {
-      g_rw_lock_writer_unlock (view->rwlock);
+      dupin_rwlock_writer_unlock (view->rwlock);
       sqlite3_free (query);
       g_free (replace_rowid_str);
       if (pid_serialized)
@@ -2763,7 +2840,7 @@ dupin_view_sync_record_update (DupinView * view, gchar * previous_rowid, gint re
 
   if (sqlite3_exec (view->db, query, dupin_view_sync_record_update_cb, &id, &errmsg) != SQLITE_OK)
     {
-      g_rw_lock_writer_unlock (view->rwlock);
+      dupin_rwlock_writer_unlock (view->rwlock);
       sqlite3_free (query);
       g_free (replace_rowid_str);
       if (pid_serialized)
@@ -2808,7 +2885,7 @@ dupin_view_sync_record_update (DupinView * view, gchar * previous_rowid, gint re
 
           if (sqlite3_exec (view->db, query, NULL, NULL, &errmsg) != SQLITE_OK)
             {
-              g_rw_lock_writer_unlock (view->rwlock);
+              dupin_rwlock_writer_unlock (view->rwlock);
 
               g_error("dupin_view_sync_record_update: %s", errmsg);
               sqlite3_free (errmsg);
@@ -2832,7 +2909,7 @@ dupin_view_sync_record_update (DupinView * view, gchar * previous_rowid, gint re
 
   if (dupin_view_commit_transaction (view, NULL) < 0)
     {
-      g_rw_lock_writer_unlock (view->rwlock);
+      dupin_rwlock_writer_unlock (view->rwlock);
 
       g_free (id);
       if (pid_serialized)
@@ -2841,7 +2918,7 @@ dupin_view_sync_record_update (DupinView * view, gchar * previous_rowid, gint re
       return;
     }
 
-  g_rw_lock_writer_unlock (view->rwlock);
+  dupin_rwlock_writer_unlock (view->rwlock);
 
   g_free (id);
   if (pid_serialized)
@@ -2886,11 +2963,11 @@ dupin_view_sync_thread_reduce (DupinView * view,
 
   /* get last position we reduced and get anything up to count after that */
   query = "SELECT sync_reduce_id as c FROM DupinView LIMIT 1";
-  g_rw_lock_reader_lock (view->rwlock);
+  dupin_rwlock_reader_lock (view->rwlock);
 
   if (sqlite3_exec (view->db, query, dupin_view_sync_cb, &sync_reduce_id, &errmsg) != SQLITE_OK)
     {
-      g_rw_lock_reader_unlock (view->rwlock);
+      dupin_rwlock_reader_unlock (view->rwlock);
 
       g_error("dupin_view_sync_thread_reduce: %s", errmsg);
       sqlite3_free (errmsg);
@@ -2900,7 +2977,7 @@ dupin_view_sync_thread_reduce (DupinView * view,
 
   previous_sync_reduce_id = g_strdup (sync_reduce_id);
 
-  g_rw_lock_reader_unlock (view->rwlock);
+  dupin_rwlock_reader_unlock (view->rwlock);
 
   gsize start_rowid = (sync_reduce_id != NULL) ? (gsize) g_ascii_strtoll (sync_reduce_id, NULL, 10)+1 : 1;
 
@@ -2921,10 +2998,10 @@ dupin_view_sync_thread_reduce (DupinView * view,
   if (g_list_length (results) != count)
     ret = FALSE;
 
-  g_rw_lock_reader_lock (view->rwlock);
+  dupin_rwlock_reader_lock (view->rwlock);
   gsize sync_reduce_processed_count = view->sync_reduce_processed_count;
   gsize sync_reduce_total_records = view->sync_reduce_total_records;
-  g_rw_lock_reader_unlock (view->rwlock);
+  dupin_rwlock_reader_unlock (view->rwlock);
 
 #if DUPIN_VIEW_DEBUG
   g_message("dupin_view_sync_thread_reduce(%p/%s)    g_list_length (results) = %d start_rowid=%d - reduced %d of total to reduce=%d\n", g_thread_self (), view->name, (gint) g_list_length (results), (gint)start_rowid, (gint)sync_reduce_processed_count, (gint)sync_reduce_total_records );
@@ -3123,10 +3200,10 @@ dupin_view_sync_thread_reduce (DupinView * view,
           g_free (value_string);
           json_node_free (pid_node);
 
-          g_rw_lock_writer_lock (view->rwlock);
+          dupin_rwlock_writer_lock (view->rwlock);
           view->sync_reduce_processed_count++;
           sync_reduce_processed_count = view->sync_reduce_processed_count;
-          g_rw_lock_writer_unlock (view->rwlock);
+          dupin_rwlock_writer_unlock (view->rwlock);
         }
       else
         {
@@ -3144,10 +3221,10 @@ dupin_view_sync_thread_reduce (DupinView * view,
 
   dupin_view_record_get_list_close (results);
 
-  g_rw_lock_reader_lock (view->rwlock);
+  dupin_rwlock_reader_lock (view->rwlock);
   sync_reduce_processed_count = view->sync_reduce_processed_count;
   sync_reduce_total_records = view->sync_reduce_total_records;
-  g_rw_lock_reader_unlock (view->rwlock);
+  dupin_rwlock_reader_unlock (view->rwlock);
 
 #if DUPIN_VIEW_DEBUG
   g_message("dupin_view_sync_thread_reduce(%p/%s) finished last_reduce_rowid=%s - reduced %d of total to reduce=%d\n", g_thread_self (), view->name, sync_reduce_id, (gint)sync_reduce_processed_count, (gint)sync_reduce_total_records);
@@ -3162,11 +3239,11 @@ dupin_view_sync_thread_reduce (DupinView * view,
   g_message("dupin_view_sync_thread_reduce() view %s query=%s\n",view->name, str);
 #endif
 
-  g_rw_lock_writer_lock (view->rwlock);
+  dupin_rwlock_writer_lock (view->rwlock);
 
   if (dupin_view_begin_transaction (view, NULL) < 0)
     {
-      g_rw_lock_writer_unlock (view->rwlock);
+      dupin_rwlock_writer_unlock (view->rwlock);
       sqlite3_free (str);
 
       return FALSE;
@@ -3174,7 +3251,7 @@ dupin_view_sync_thread_reduce (DupinView * view,
 
   if (sqlite3_exec (view->db, str, NULL, NULL, &errmsg) != SQLITE_OK)
     {
-      g_rw_lock_writer_unlock (view->rwlock);
+      dupin_rwlock_writer_unlock (view->rwlock);
       sqlite3_free (str);
 
       g_error("dupin_view_sync_thread_reduce: %s", errmsg);
@@ -3187,13 +3264,13 @@ dupin_view_sync_thread_reduce (DupinView * view,
 
   if (dupin_view_commit_transaction (view, NULL) < 0)
     {
-      g_rw_lock_writer_unlock (view->rwlock);
+      dupin_rwlock_writer_unlock (view->rwlock);
       sqlite3_free (str);
 
       return FALSE;
     }
 
-  g_rw_lock_writer_unlock (view->rwlock);
+  dupin_rwlock_writer_unlock (view->rwlock);
 
   sqlite3_free (str);
 
@@ -3246,11 +3323,11 @@ dupin_view_sync_total_rereduce (DupinView * view, struct dupin_view_sync_total_r
 
   tmp = sqlite3_mprintf (DUPIN_VIEW_SQL_TOTAL_REREDUCE);
 
-  g_rw_lock_reader_lock (view->rwlock);
+  dupin_rwlock_reader_lock (view->rwlock);
 
   if (sqlite3_exec (view->db, tmp, dupin_view_sync_total_rereduce_cb, rere, &errmsg) != SQLITE_OK)
     {
-      g_rw_lock_reader_unlock (view->rwlock);
+      dupin_rwlock_reader_unlock (view->rwlock);
       sqlite3_free (tmp);
 
       g_error("dupin_view_sync_total_rereduce: %s", errmsg);
@@ -3259,7 +3336,7 @@ dupin_view_sync_total_rereduce (DupinView * view, struct dupin_view_sync_total_r
       return FALSE;
     }
 
-  g_rw_lock_reader_unlock (view->rwlock);
+  dupin_rwlock_reader_unlock (view->rwlock);
 
   sqlite3_free (tmp);
 
@@ -3280,17 +3357,17 @@ dupin_view_sync_map_func (gpointer data, gpointer user_data)
 
   dupin_view_ref (view);
 
-  g_rw_lock_writer_lock (view->rwlock);
+  dupin_rwlock_writer_lock (view->rwlock);
   view->sync_map_thread = g_thread_self ();
   view->sync_map_processed_count = 0;
   gsize sync_map_processed_count = view->sync_map_processed_count;
-  g_rw_lock_writer_unlock (view->rwlock);
+  dupin_rwlock_writer_unlock (view->rwlock);
 
-  g_rw_lock_reader_lock (view->rwlock);
+  dupin_rwlock_reader_lock (view->rwlock);
   gboolean sync_toquit = view->sync_toquit;
   gboolean todelete = view->todelete;
   GThread * sync_reduce_thread = view->sync_reduce_thread;
-  g_rw_lock_reader_unlock (view->rwlock);
+  dupin_rwlock_reader_unlock (view->rwlock);
 
 #if DUPIN_VIEW_DEBUG
   g_message("dupin_view_sync_map_func(%p/%s) started\n",g_thread_self (), view->name);
@@ -3300,10 +3377,10 @@ dupin_view_sync_map_func (gpointer data, gpointer user_data)
     {
       gboolean map_operation = dupin_view_sync_thread_map (view, VIEW_SYNC_COUNT);
 
-      g_rw_lock_reader_lock (view->rwlock);
+      dupin_rwlock_reader_lock (view->rwlock);
       sync_map_processed_count = view->sync_map_processed_count;
       sync_reduce_thread = view->sync_reduce_thread;
-      g_rw_lock_reader_unlock (view->rwlock);
+      dupin_rwlock_reader_unlock (view->rwlock);
 
 #if DUPIN_VIEW_DEBUG
   g_message("dupin_view_sync_map_func(%p/%s) map_operation=%d\n", g_thread_self (), view->name, map_operation);
@@ -3332,10 +3409,10 @@ dupin_view_sync_map_func (gpointer data, gpointer user_data)
           break;
         }
 
-      g_rw_lock_reader_lock (view->rwlock);
+      dupin_rwlock_reader_lock (view->rwlock);
       sync_toquit = view->sync_toquit;
       todelete = view->todelete;
-      g_rw_lock_reader_unlock (view->rwlock);
+      dupin_rwlock_reader_unlock (view->rwlock);
     }
 
 #if DUPIN_VIEW_DEBUG
@@ -3359,20 +3436,20 @@ dupin_view_sync_map_func (gpointer data, gpointer user_data)
       g_message("dupin_view_sync_map_func(%p/%s): ANALYZE\n", g_thread_self (), view->name);
 #endif
 
-      g_rw_lock_writer_lock (view->rwlock);
+      dupin_rwlock_writer_lock (view->rwlock);
       if (sqlite3_exec (view->db, "ANALYZE Dupin", NULL, NULL, &errmsg) != SQLITE_OK)
         {
-          g_rw_lock_writer_unlock (view->rwlock);
+          dupin_rwlock_writer_unlock (view->rwlock);
           g_error ("dupin_view_sync_reduce_func: %s", errmsg);
           sqlite3_free (errmsg);
         }
-      g_rw_lock_writer_unlock (view->rwlock);
+      dupin_rwlock_writer_unlock (view->rwlock);
     }
 
-  g_rw_lock_writer_lock (view->rwlock);
+  dupin_rwlock_writer_lock (view->rwlock);
   view->tosync = FALSE;
   view->sync_map_thread = NULL;
-  g_rw_lock_writer_unlock (view->rwlock);
+  dupin_rwlock_writer_unlock (view->rwlock);
 
   dupin_view_unref (view);
 
@@ -3402,14 +3479,14 @@ dupin_view_sync_reduce_func (gpointer data, gpointer user_data)
 
   dupin_view_ref (view);
 
-  g_rw_lock_writer_lock (view->rwlock);
+  dupin_rwlock_writer_lock (view->rwlock);
   view->tosync = TRUE;
   view->sync_reduce_thread = g_thread_self ();
   view->sync_reduce_processed_count = 0;
   gsize sync_reduce_processed_count = view->sync_reduce_processed_count;
   view->sync_reduce_total_records = 0;
   gsize sync_reduce_total_records = view->sync_reduce_total_records;
-  g_rw_lock_writer_unlock (view->rwlock);
+  dupin_rwlock_writer_unlock (view->rwlock);
 
   gboolean rereduce = FALSE;
 
@@ -3427,11 +3504,11 @@ dupin_view_sync_reduce_func (gpointer data, gpointer user_data)
 
   query = "SELECT sync_rereduce as c FROM DupinView LIMIT 1";
 
-  g_rw_lock_reader_lock (view->rwlock);
+  dupin_rwlock_reader_lock (view->rwlock);
 
   if (sqlite3_exec (view->db, query, dupin_view_rereduce_cb, &rereduce, &errmsg) != SQLITE_OK)
     {
-      g_rw_lock_reader_unlock (view->rwlock);
+      dupin_rwlock_reader_unlock (view->rwlock);
 
       g_error("dupin_view_sync_reduce_func: %s", errmsg);
       sqlite3_free (errmsg);
@@ -3441,14 +3518,14 @@ dupin_view_sync_reduce_func (gpointer data, gpointer user_data)
       return;
     }
 
-  g_rw_lock_reader_unlock (view->rwlock);
+  dupin_rwlock_reader_unlock (view->rwlock);
 
-  g_rw_lock_reader_lock (view->rwlock);
+  dupin_rwlock_reader_lock (view->rwlock);
   gboolean sync_toquit = view->sync_toquit;
   gboolean todelete = view->todelete;
   GThread * sync_map_thread = view->sync_map_thread;
   gsize sync_map_processed_count = view->sync_map_processed_count;
-  g_rw_lock_reader_unlock (view->rwlock);
+  dupin_rwlock_reader_unlock (view->rwlock);
 
   while (sync_toquit == FALSE && todelete == FALSE)
     {
@@ -3500,12 +3577,12 @@ dupin_view_sync_reduce_func (gpointer data, gpointer user_data)
 	  g_mutex_unlock (view->mutex);
         }
 
-      g_rw_lock_reader_lock (view->rwlock);
+      dupin_rwlock_reader_lock (view->rwlock);
       sync_map_thread = view->sync_map_thread;
       sync_map_processed_count = view->sync_map_processed_count;
       sync_reduce_total_records = view->sync_reduce_total_records;
       sync_reduce_processed_count = view->sync_reduce_processed_count;
-      g_rw_lock_reader_unlock (view->rwlock);
+      dupin_rwlock_reader_unlock (view->rwlock);
 
 #if DUPIN_VIEW_DEBUG
       g_message("dupin_view_sync_reduce_func(%p/%s) sync_map_processed_count=%d > sync_reduce_total_records=%d - rereduce=%d\n",g_thread_self (), view->name, (gint)sync_map_processed_count,(gint)sync_reduce_total_records, (gint)rereduce);
@@ -3514,23 +3591,28 @@ dupin_view_sync_reduce_func (gpointer data, gpointer user_data)
       if (sync_map_processed_count > sync_reduce_total_records /* got a new bunch to work on */
 	  || rereduce)
         {
-          g_rw_lock_writer_lock (view->rwlock);
+          dupin_rwlock_writer_lock (view->rwlock);
           view->sync_reduce_total_records = (rereduce) ? rere_matching.total : sync_map_processed_count;
           sync_reduce_total_records = view->sync_reduce_total_records;
-          g_rw_lock_writer_unlock (view->rwlock);
+          dupin_rwlock_writer_unlock (view->rwlock);
 
 #if DUPIN_VIEW_DEBUG
           g_message("dupin_view_sync_reduce_func(%p/%s) got new records to REDUCE (rereduce=%d, sync_reduce_total_records=%d)\n",g_thread_self (), view->name, (gint)rereduce, (gint)sync_reduce_total_records);
 #endif
 
 	  gboolean reduce_error = FALSE;
-          while (dupin_view_sync_thread_reduce (view, VIEW_SYNC_COUNT, rereduce, rere_matching.first_matching_key, &reduce_error) == TRUE)
+	  gboolean reduce_operation;
+
+	  do
 	    {
-	      if (reduce_error == TRUE)
-	        {
-		  break;
-		}
+	      gint64 span = dupin_trace_begin ();
+
+	      reduce_operation = dupin_view_sync_thread_reduce (view, VIEW_SYNC_COUNT, rereduce, rere_matching.first_matching_key, &reduce_error);
+
+	      dupin_trace_end ("reduce", rereduce == TRUE ? "dupin_view_sync_thread_rereduce" : "dupin_view_sync_thread_reduce",
+			       view->name, span);
 	    }
+	  while (reduce_operation == TRUE && reduce_error == FALSE);
 
 	  if (reduce_error == TRUE)
 	    {
@@ -3538,10 +3620,10 @@ dupin_view_sync_reduce_func (gpointer data, gpointer user_data)
               break;
 	    }
 
-          g_rw_lock_writer_lock (view->rwlock);
+          dupin_rwlock_writer_lock (view->rwlock);
           sync_reduce_processed_count = view->sync_reduce_processed_count;
           sync_reduce_total_records = view->sync_reduce_total_records;
-          g_rw_lock_writer_unlock (view->rwlock);
+          dupin_rwlock_writer_unlock (view->rwlock);
 
 #if DUPIN_VIEW_DEBUG
           g_message("dupin_view_sync_reduce_func(%p/%s) Reduced %d records of %d\n", g_thread_self (), view->name, (gint)sync_reduce_processed_count, (gint)sync_reduce_total_records);
@@ -3578,11 +3660,11 @@ dupin_view_sync_reduce_func (gpointer data, gpointer user_data)
 	      g_message("dupin_view_sync_reduce_func(%p/%s) Going to re-reduce\n", g_thread_self (), view->name);
 #endif
 
-              g_rw_lock_writer_lock (view->rwlock);
+              dupin_rwlock_writer_lock (view->rwlock);
 
 	      if (dupin_view_begin_transaction (view, NULL) < 0)
                 {
-                  g_rw_lock_writer_unlock (view->rwlock);
+                  dupin_rwlock_writer_unlock (view->rwlock);
 
                   break;
                 }
@@ -3594,7 +3676,7 @@ dupin_view_sync_reduce_func (gpointer data, gpointer user_data)
 
               if (sqlite3_exec (view->db, query, NULL, NULL, &errmsg) != SQLITE_OK)
                 {
-                  g_rw_lock_writer_unlock (view->rwlock);
+                  dupin_rwlock_writer_unlock (view->rwlock);
 
                   g_error("dupin_view_sync_reduce_func: %s", errmsg);
                   sqlite3_free (errmsg);
@@ -3606,12 +3688,12 @@ dupin_view_sync_reduce_func (gpointer data, gpointer user_data)
 
 	      if (dupin_view_commit_transaction (view, NULL) < 0)
                 {
-                  g_rw_lock_writer_unlock (view->rwlock);
+                  dupin_rwlock_writer_unlock (view->rwlock);
 
                   break;
                 }
 
-              g_rw_lock_writer_unlock (view->rwlock);
+              dupin_rwlock_writer_unlock (view->rwlock);
             }
           else
             {
@@ -3622,18 +3704,18 @@ dupin_view_sync_reduce_func (gpointer data, gpointer user_data)
 
               query = "UPDATE DupinView SET sync_rereduce = 'FALSE'";
 
-              g_rw_lock_writer_lock (view->rwlock);
+              dupin_rwlock_writer_lock (view->rwlock);
 
 	      if (dupin_view_begin_transaction (view, NULL) < 0)
                 {
-                  g_rw_lock_writer_unlock (view->rwlock);
+                  dupin_rwlock_writer_unlock (view->rwlock);
 
                   break;
                 }
 
               if (sqlite3_exec (view->db, query, NULL, NULL, &errmsg) != SQLITE_OK)
                 {
-                  g_rw_lock_writer_unlock (view->rwlock);
+                  dupin_rwlock_writer_unlock (view->rwlock);
 
                   g_error("dupin_view_sync_reduce_func: %s", errmsg);
                   sqlite3_free (errmsg);
@@ -3645,21 +3727,21 @@ dupin_view_sync_reduce_func (gpointer data, gpointer user_data)
 
 	      if (dupin_view_commit_transaction (view, NULL) < 0)
                 {
-                  g_rw_lock_writer_unlock (view->rwlock);
+                  dupin_rwlock_writer_unlock (view->rwlock);
 
                   break;
                 }
 
-              g_rw_lock_writer_unlock (view->rwlock);
+              dupin_rwlock_writer_unlock (view->rwlock);
 
 	      break; /* both terminated, amen */
             }
         }
 
-      g_rw_lock_reader_lock (view->rwlock);
+      dupin_rwlock_reader_lock (view->rwlock);
       sync_toquit = view->sync_toquit;
       todelete = view->todelete;
-      g_rw_lock_reader_unlock (view->rwlock);
+      dupin_rwlock_reader_unlock (view->rwlock);
     }
 
   if (rere_matching.first_matching_key != NULL)
@@ -3675,20 +3757,20 @@ dupin_view_sync_reduce_func (gpointer data, gpointer user_data)
   g_message("dupin_view_sync_reduce_func: view %s VACUUM and ANALYZE\n", view->name);
 #endif
 
-  g_rw_lock_writer_lock (view->rwlock);
+  dupin_rwlock_writer_lock (view->rwlock);
   if (sqlite3_exec (view->db, "VACUUM", NULL, NULL, &errmsg) != SQLITE_OK
       || sqlite3_exec (view->db, "ANALYZE Dupin", NULL, NULL, &errmsg) != SQLITE_OK)
     {
-      g_rw_lock_writer_unlock (view->rwlock);
+      dupin_rwlock_writer_unlock (view->rwlock);
       g_error ("dupin_view_sync_reduce_func: %s", errmsg);
       sqlite3_free (errmsg);
     }
-  g_rw_lock_writer_unlock (view->rwlock);
+  dupin_rwlock_writer_unlock (view->rwlock);
 
-  g_rw_lock_writer_lock (view->rwlock);
+  dupin_rwlock_writer_lock (view->rwlock);
   view->tosync = FALSE;
   view->sync_reduce_thread = NULL;
-  g_rw_lock_writer_unlock (view->rwlock);
+  dupin_rwlock_writer_unlock (view->rwlock);
 
   dupin_view_unref (view);
 
@@ -3705,10 +3787,10 @@ dupin_view_sync_reduce_func (gpointer data, gpointer user_data)
 void
 dupin_view_sync (DupinView * view)
 {
-  g_rw_lock_reader_lock (view->rwlock);
+  dupin_rwlock_reader_lock (view->rwlock);
   GThread * sync_map_thread = view->sync_map_thread;
   GThread * sync_reduce_thread = view->sync_reduce_thread;
-  g_rw_lock_reader_unlock (view->rwlock);
+  dupin_rwlock_reader_unlock (view->rwlock);
 
   if (dupin_view_is_syncing (view))
     {
@@ -3765,13 +3847,13 @@ dupin_view_is_syncing (DupinView * view)
 
   gboolean ret = FALSE;
 
-  g_rw_lock_reader_lock (view->rwlock);
+  dupin_rwlock_reader_lock (view->rwlock);
 
   if (view->sync_map_thread
       || view->sync_reduce_thread)
     ret = TRUE;
 
-  g_rw_lock_reader_unlock (view->rwlock);
+  dupin_rwlock_reader_unlock (view->rwlock);
 
   return ret;
 }
@@ -3786,9 +3868,9 @@ dupin_view_is_sync (DupinView * view)
 
   /* TODO - distinguish between tosync because of insert / update or because of explicit view/_sync method call */
 
-  g_rw_lock_reader_lock (view->rwlock);
+  dupin_rwlock_reader_lock (view->rwlock);
   gboolean tosync = view->tosync;
-  g_rw_lock_reader_unlock (view->rwlock);
+  dupin_rwlock_reader_unlock (view->rwlock);
 
   return tosync ? FALSE : TRUE;
 }
@@ -3801,9 +3883,9 @@ dupin_view_compact_func (gpointer data, gpointer user_data)
   DupinView * view = (DupinView*) data;
   gchar * errmsg;
 
-  g_rw_lock_reader_lock (view->rwlock);
+  dupin_rwlock_reader_lock (view->rwlock);
   gboolean todelete = view->todelete;
-  g_rw_lock_reader_unlock (view->rwlock);
+  dupin_rwlock_reader_unlock (view->rwlock);
 
   if (todelete == TRUE)
     {
@@ -3822,7 +3904,7 @@ dupin_view_compact_func (gpointer data, gpointer user_data)
   //g_message("dupin_view_compact_func(%p) started\n",g_thread_self ());
 #endif
 
-  g_rw_lock_writer_lock (view->rwlock);
+  dupin_rwlock_writer_lock (view->rwlock);
 
   view->tocompact = TRUE;
   view->compact_thread = g_thread_self ();
@@ -3856,7 +3938,7 @@ dupin_view_compact_func (gpointer data, gpointer user_data)
   view->tocompact = FALSE;
   view->compact_thread = NULL;
 
-  g_rw_lock_writer_unlock (view->rwlock);
+  dupin_rwlock_writer_unlock (view->rwlock);
 
   dupin_view_unref (view);
 }
@@ -3866,9 +3948,9 @@ dupin_view_compact (DupinView * view)
 {
   g_return_if_fail (view != NULL);
 
-  g_rw_lock_reader_lock (view->rwlock);
+  dupin_rwlock_reader_lock (view->rwlock);
   GThread * compact_thread = view->compact_thread;
-  g_rw_lock_reader_unlock (view->rwlock);
+  dupin_rwlock_reader_unlock (view->rwlock);
 
   if (dupin_view_is_compacting (view))
     {
@@ -3905,9 +3987,9 @@ dupin_view_is_compacting (DupinView * view)
 {
   g_return_val_if_fail (view != NULL, FALSE);
 
-  g_rw_lock_reader_lock (view->rwlock);
+  dupin_rwlock_reader_lock (view->rwlock);
   GThread * compact_thread = view->compact_thread;
-  g_rw_lock_reader_unlock (view->rwlock);
+  dupin_rwlock_reader_unlock (view->rwlock);
 
   if (compact_thread)
     return TRUE;
@@ -3923,9 +4005,9 @@ dupin_view_is_compacted (DupinView * view)
   if (dupin_view_is_compacting (view))
     return FALSE;
 
-  g_rw_lock_reader_lock (view->rwlock);
+  dupin_rwlock_reader_lock (view->rwlock);
   gboolean tocompact = view->tocompact;
-  g_rw_lock_reader_unlock (view->rwlock);
+  dupin_rwlock_reader_unlock (view->rwlock);
 
   return tocompact ? FALSE : TRUE;
 }
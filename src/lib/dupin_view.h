@@ -81,6 +81,9 @@ gboolean        dupin_view_force_quit   (DupinView *    view,
 
 const gchar *	dupin_view_get_name	(DupinView *	view);
 
+guint		dupin_view_get_update_seq
+					(DupinView *	view);
+
 const gchar *	dupin_view_get_parent	(DupinView *	view);
 
 gboolean	dupin_view_get_parent_is_db
@@ -102,12 +105,17 @@ DupinViewEngine *
 
 gsize		dupin_view_get_size	(DupinView *	view);
 
+JsonNode *	dupin_view_get_stats	(DupinView *	view);
+
 gboolean	dupin_view_get_creation_time
 					(DupinView * view,
 					 gsize * creation_time);
 
 gsize		dupin_view_count	(DupinView *	view);
 
+gsize		dupin_view_get_sync_map_rowid
+					(DupinView *	view);
+
 gboolean	dupin_view_is_sync	(DupinView *	view);
 
 gboolean	dupin_view_is_syncing	(DupinView *	view);
@@ -0,0 +1,48 @@
+#!/bin/sh
+#
+# Filtered listings of a compressed database against a running dupin_server
+# whose configuration compresses the databases used here:
+#
+#   <SQLiteDBCompress>dp_compressed_.*</SQLiteDBCompress>
+#
+#   sh filterby_compressed.sh [http://localhost:8088]
+#
+# filterBy() runs inside SQLite on the stored revisions, so it has to decode
+# the zstd: rows itself before matching.
+
+URL=${1:-http://localhost:8088}
+DB=dp_compressed_$$
+FAILED=0
+
+check ()
+{
+  if [ "$2" = "$3" ]; then
+    echo "ok   - $1"
+  else
+    echo "FAIL - $1: expected '$3', got '$2'"
+    FAILED=1
+  fi
+}
+
+rows ()
+{
+  curl -s "$URL/$DB/_all_docs?$1" | grep -o '"id"' | wc -l | tr -d ' '
+}
+
+code=`curl -s -o /dev/null -w '%{http_code}' -X PUT "$URL/$DB"`
+check "create database" "$code" 201
+
+code=`curl -s -o /dev/null -w '%{http_code}' -X POST -H 'Content-Type: application/json' \
+  --data-binary '{"docs":[{"_id":"a","color":"red","n":1},{"_id":"b","color":"blue","n":2},{"_id":"c","color":"red","n":3}]}' \
+  "$URL/$DB/_bulk_docs"`
+check "store documents" "$code" 201
+
+check "unfiltered listing" "`rows`" 3
+check "filter_op=equals" "`rows 'filter_by=color&filter_op=equals&filter_value=red'`" 2
+check "filter_op=starts_with" "`rows 'filter_by=color&filter_op=starts_with&filter_value=bl'`" 1
+check "filter_op=present" "`rows 'filter_by=n&filter_op=present'`" 3
+check "no match" "`rows 'filter_by=color&filter_op=equals&filter_value=green'`" 0
+
+curl -s -o /dev/null -X DELETE "$URL/$DB"
+
+exit $FAILED
@@ -0,0 +1,75 @@
+#!/bin/sh
+#
+# Chunked request bodies against a running dupin_server:
+#
+#   sh httpd_chunked.sh [http://localhost:8088]
+#
+# The request target and the headers must survive the chunk framing, so a
+# chunked _bulk_docs POST has to land on the right database and a chunked
+# attachment PUT has to keep its Content-Type.
+
+URL=${1:-http://localhost:8088}
+DB=dp_chunked_$$
+FAILED=0
+
+check ()
+{
+  if [ "$2" = "$3" ]; then
+    echo "ok   - $1"
+  else
+    echo "FAIL - $1: expected '$3', got '$2'"
+    FAILED=1
+  fi
+}
+
+code=`curl -s -o /dev/null -w '%{http_code}' -X PUT "$URL/$DB"`
+check "create database" "$code" 201
+
+# curl frames the body itself once Transfer-Encoding is set:
+code=`printf '{"docs":[{"_id":"a","n":1},{"_id":"b","n":2},{"_id":"c","n":3}]}' \
+  | curl -s -o /dev/null -w '%{http_code}' -X POST \
+      -H 'Transfer-Encoding: chunked' -H 'Content-Type: application/json' \
+      --data-binary @- "$URL/$DB/_bulk_docs"`
+check "chunked _bulk_docs POST" "$code" 201
+
+rows=`curl -s "$URL/$DB/_all_docs" | sed -n 's/.*"total_rows":[ ]*\([0-9]*\).*/\1/p'`
+check "chunked _bulk_docs documents stored" "$rows" 3
+
+code=`printf 'hello, chunked world' \
+  | curl -s -o /dev/null -w '%{http_code}' -X PUT \
+      -H 'Transfer-Encoding: chunked' -H 'Content-Type: text/x-dupin-test' \
+      --data-binary @- "$URL/$DB/d/hello.txt"`
+check "chunked attachment PUT" "$code" 201
+
+type=`curl -s -D - -o /dev/null "$URL/$DB/d/hello.txt" | tr -d '\r' \
+  | sed -n 's/^[Cc]ontent-[Tt]ype: *//p'`
+check "chunked attachment Content-Type" "$type" text/x-dupin-test
+
+body=`curl -s "$URL/$DB/d/hello.txt"`
+check "chunked attachment body" "$body" 'hello, chunked world'
+
+# Hand framed: the first chunk and a split size line arrive with the header
+if command -v nc > /dev/null 2>&1; then
+  host=`echo "$URL" | sed 's,^http://,,; s,[:/].*,,'`
+  port=`echo "$URL" | sed -n 's,^http://[^:/]*:\([0-9]*\).*,\1,p'`
+  status=`{ printf 'POST /%s/_bulk_docs HTTP/1.1\r\nHost: %s\r\nContent-Type: application/json\r\nTransfer-Encoding: chunked\r\n\r\n' "$DB" "$host"; \
+	    printf '9\r\n{"docs":[\r\nd'; sleep 1; \
+	    printf ';ext=1\r\n{"_id":"d"}]}\r\n0\r\nX-Trailer: 1\r\n\r\n'; sleep 1; } \
+	  | nc "$host" "${port:-80}" | head -1 | tr -d '\r' | cut -d' ' -f2`
+  check "hand framed chunked _bulk_docs POST" "$status" 201
+
+  # A small GET must be answered while the client keeps the connection open,
+  # not once it closes its side after the sleep:
+  start=`date +%s`
+  reply=`{ printf 'GET /%s HTTP/1.1\r\nHost: %s\r\n\r\n' "$DB" "$host"; sleep 4; } \
+	 | nc "$host" "${port:-80}" \
+	 | { IFS= read -r line; echo "$line" | tr -d '\r' | cut -d' ' -f2; date +%s; }`
+  status=`echo "$reply" | sed -n 1p`
+  elapsed=$((`echo "$reply" | sed -n 2p` - start))
+  check "GET on a connection held open" "$status" 200
+  check "GET answered before the client closes" "`[ $elapsed -lt 3 ] && echo yes`" yes
+fi
+
+curl -s -o /dev/null -X DELETE "$URL/$DB"
+
+exit $FAILED
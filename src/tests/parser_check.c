@@ -0,0 +1,177 @@
+#include <glib.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include "parser.h"
+
+/* NOTE - the header arrives in pieces of any size, so every request is parsed
+          once whole and once growing by one byte at a time, as the receive
+          buffer does when the socket gives one byte per read */
+
+#define REQUEST \
+  "GET /db/doc?rev=1 HTTP/1.1\r\n" \
+  "Host: localhost\r\n" \
+  "Accept :  application/json \t\r\n" \
+  "continuation without colon\r\n" \
+  "\r\n"
+
+#define BODY "{\"a\":1}"
+
+static gint failed = 0;
+
+static void
+check (const gchar * what, gboolean ok)
+{
+  if (ok == TRUE)
+    printf ("ok   - %s\n", what);
+  else
+    {
+      printf ("FAIL - %s\n", what);
+      failed = 1;
+    }
+}
+
+static gboolean
+span_is (gchar * buf, DSParserSpan * span, const gchar * str)
+{
+  return parser_span_equal (buf, span, str, strlen (str));
+}
+
+/* Parses str, all at once or growing by one byte: */
+static DSParserStatus
+parse (DSParser * parser, gchar * buf, const gchar * str, gboolean bytewise,
+       gsize * incomplete)
+{
+  DSParserStatus status = PARSER_INCOMPLETE;
+  gsize len = strlen (str);
+  gsize i;
+
+  memset (parser, 0, sizeof (DSParser));
+  memcpy (buf, str, len);
+
+  *incomplete = 0;
+
+  if (bytewise == FALSE)
+    return parser_parse (parser, buf, len);
+
+  for (i = 1; i <= len; i++)
+    {
+      if ((status = parser_parse (parser, buf, i)) != PARSER_INCOMPLETE)
+	break;
+
+      (*incomplete)++;
+    }
+
+  return status;
+}
+
+static void
+check_request (gboolean bytewise)
+{
+  gchar buf[PARSER_BUFFER_SIZE];
+  const gchar *mode = bytewise == TRUE ? "bytewise" : "whole";
+  gchar *what;
+  DSParser parser;
+  DSParserStatus status;
+  gsize incomplete;
+
+  status = parse (&parser, buf, REQUEST BODY, bytewise, &incomplete);
+
+  what = g_strdup_printf ("%s: done", mode);
+  check (what, status == PARSER_DONE);
+  g_free (what);
+
+  if (bytewise == TRUE)
+    check ("bytewise: incomplete till the empty line", incomplete == strlen (REQUEST) - 1);
+
+  what = g_strdup_printf ("%s: header size excludes the body", mode);
+  check (what, parser.size == strlen (REQUEST));
+  g_free (what);
+
+  what = g_strdup_printf ("%s: request line", mode);
+  check (what, span_is (buf, &parser.method, "GET")
+		 && span_is (buf, &parser.target, "/db/doc?rev=1")
+		 && span_is (buf, &parser.version, "HTTP/1.1")
+		 && !strcmp (buf + parser.request_line.offset, "GET /db/doc?rev=1 HTTP/1.1"));
+  g_free (what);
+
+  what = g_strdup_printf ("%s: headers trimmed, lines without colon ignored", mode);
+  check (what, parser.headers_numb == 2
+		 && span_is (buf, &parser.headers[0].name, "Host")
+		 && !strcmp (buf + parser.headers[0].value.offset, "localhost")
+		 && parser_span_equal_nocase (buf, &parser.headers[1].name, "accept", 6) == TRUE
+		 && !strcmp (buf + parser.headers[1].value.offset, "application/json"));
+  g_free (what);
+
+  what = g_strdup_printf ("%s: body untouched", mode);
+  check (what, !memcmp (buf + parser.size, BODY, strlen (BODY)));
+  g_free (what);
+}
+
+static void
+check_short (void)
+{
+  gchar buf[PARSER_BUFFER_SIZE];
+  DSParser parser;
+  DSParserStatus status;
+  gsize incomplete;
+
+  status = parse (&parser, buf, "GET / HTTP/1.0", FALSE, &incomplete);
+  check ("request line without end of line", status == PARSER_INCOMPLETE
+					     && parser.request_line.len == 0);
+
+  status = parse (&parser, buf, "GET / HTTP/1.0\r\nHost: a\r\n\r", FALSE, &incomplete);
+  check ("empty line split before its LF", status == PARSER_INCOMPLETE
+					   && parser.headers_numb == 1);
+
+  status = parse (&parser, buf, "", FALSE, &incomplete);
+  check ("empty buffer", status == PARSER_INCOMPLETE);
+
+  status = parse (&parser, buf, "GET / HTTP/1.0\nHost: a\n\n", TRUE, &incomplete);
+  check ("bare LF line endings", status == PARSER_DONE
+				 && parser.size == 24
+				 && parser.headers_numb == 1);
+}
+
+static void
+check_errors (void)
+{
+  gchar buf[PARSER_BUFFER_SIZE];
+  GString *str;
+  DSParser parser;
+  DSParserStatus status;
+  gsize incomplete;
+  guint i;
+
+  status = parse (&parser, buf, "GET /\r\n\r\n", FALSE, &incomplete);
+  check ("request line without version", status == PARSER_ERROR);
+
+  status = parse (&parser, buf, "GET / HTTP/1.1 x\r\n\r\n", TRUE, &incomplete);
+  check ("request line with extra field", status == PARSER_ERROR);
+
+  str = g_string_new ("GET / HTTP/1.1\r\n");
+
+  for (i = 0; i <= PARSER_MAX_HEADERS; i++)
+    g_string_append_printf (str, "X-%d: %d\r\n", i, i);
+
+  g_string_append (str, "\r\n");
+
+  status = parse (&parser, buf, str->str, TRUE, &incomplete);
+  check ("one header more than PARSER_MAX_HEADERS", status == PARSER_TOO_MANY_HEADERS);
+
+  g_string_free (str, TRUE);
+}
+
+int
+main (int argc, char **argv)
+{
+  check_request (FALSE);
+  check_request (TRUE);
+  check_short ();
+  check_errors ();
+
+  return failed;
+}
+
+/* EOF */
@@ -0,0 +1,632 @@
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <dupin.h>
+#include "configure.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+/* NOTE - synthetic benchmark of the storage paths: a corpus of generated documents is
+          loaded into scratch databases and views under a temporary directory (or
+          --path) and every measure is printed as one JSON object, so that results
+          of different releases can be compared */
+
+#define DUPIN_BENCH_DB_SINGLE		"bench_single"
+#define DUPIN_BENCH_DB_BULK		"bench_bulk"
+#define DUPIN_BENCH_VIEW_MAP		"bench_view_map"
+#define DUPIN_BENCH_VIEW_REDUCE		"bench_view_reduce"
+
+#define DUPIN_BENCH_MAP \
+  "function(doc) { emit(doc.category, doc.n); }"
+
+#define DUPIN_BENCH_REDUCE \
+  "function(keys, values, rereduce) { return sum(values); }"
+
+#define DUPIN_BENCH_SYNC_POLL		(G_USEC_PER_SEC / 100)
+
+/* Global variables: */
+DSGlobal *d_conf = NULL;
+Dupin *d = NULL;
+GError *error = NULL;
+
+typedef struct _dupin_bench_options {
+	gint docs;
+	gint fields;
+	gint field_size;
+	gint categories;
+	gint bulk_size;
+	gint reads;
+	gint page_size;
+	gint queries;
+	gchar * path;
+	gchar * output;
+	gboolean keep;
+} dupin_bench_options;
+
+dupin_bench_options options;
+
+static void
+dupin_bench_usage (char *argv[])
+{
+  printf("usage:\n"
+	 "   %s [options] [<dupin-configuration-file>]\n"
+	 , argv[0]);
+  puts("\n"
+       "options:\n"
+       "   --help                           this usage statement\n"
+       "   --docs NUM                       documents of the corpus. Default is 10000.\n"
+       "   --fields NUM                     string fields of every document. Default is 8.\n"
+       "   --field_size NUM                 characters of every string field. Default is 16.\n"
+       "   --categories NUM                 distinct keys emitted by the views. Default is 16.\n"
+       "   --bulk_size NUM                  documents per bulk insert. Default is 100.\n"
+       "   --reads NUM                      random dupin_record_read calls. Default is 10000.\n"
+       "   --page_size NUM                  rows per _all_docs page. Default is 100.\n"
+       "   --queries NUM                    keyed and range view queries. Default is 1000.\n"
+       "   --path DIR                       directory of the scratch databases. Default is a new temporary directory.\n"
+       "   --output FILE                    write the JSON results to FILE instead of stdout\n"
+       "   --keep                           do not delete the scratch databases and views\n"
+);
+}
+
+static gint
+dupin_bench_parse_number (char **argv, gint i)
+{
+  gint value;
+
+  if (!argv[i+1] || (value = atoi (argv[i+1])) <= 0)
+    {
+      fprintf (stderr, "%s needs a positive number\n", argv[i]);
+      exit (EXIT_FAILURE);
+    }
+
+  return value;
+}
+
+static gint
+dupin_bench_parse_options (int argc, char **argv,
+			   dupin_bench_options * options)
+{
+  gint i = 1;
+
+  options->docs = 10000;
+  options->fields = 8;
+  options->field_size = 16;
+  options->categories = 16;
+  options->bulk_size = 100;
+  options->reads = 10000;
+  options->page_size = 100;
+  options->queries = 1000;
+  options->path = NULL;
+  options->output = NULL;
+  options->keep = FALSE;
+
+  while (i < argc && g_str_has_prefix (argv[i], "--"))
+    {
+      if (!g_strcmp0 (argv[i], "--help"))
+        {
+	  dupin_bench_usage (argv);
+	  exit (EXIT_SUCCESS);
+	}
+      else if (!g_strcmp0 (argv[i], "--docs"))
+	options->docs = dupin_bench_parse_number (argv, i++);
+      else if (!g_strcmp0 (argv[i], "--fields"))
+	options->fields = dupin_bench_parse_number (argv, i++);
+      else if (!g_strcmp0 (argv[i], "--field_size"))
+	options->field_size = dupin_bench_parse_number (argv, i++);
+      else if (!g_strcmp0 (argv[i], "--categories"))
+	options->categories = dupin_bench_parse_number (argv, i++);
+      else if (!g_strcmp0 (argv[i], "--bulk_size"))
+	options->bulk_size = dupin_bench_parse_number (argv, i++);
+      else if (!g_strcmp0 (argv[i], "--reads"))
+	options->reads = dupin_bench_parse_number (argv, i++);
+      else if (!g_strcmp0 (argv[i], "--page_size"))
+	options->page_size = dupin_bench_parse_number (argv, i++);
+      else if (!g_strcmp0 (argv[i], "--queries"))
+	options->queries = dupin_bench_parse_number (argv, i++);
+      else if (!g_strcmp0 (argv[i], "--path") && argv[i+1])
+	options->path = g_strdup (argv[++i]);
+      else if (!g_strcmp0 (argv[i], "--output") && argv[i+1])
+	options->output = argv[++i];
+      else if (!g_strcmp0 (argv[i], "--keep"))
+	options->keep = TRUE;
+      else
+        {
+	  fprintf (stderr, "unknown command line option: %s\n", argv[i]);
+	  exit (EXIT_FAILURE);
+	}
+
+      i++;
+    }
+
+  return i;
+}
+
+/* NOTE - corpus generation */
+
+static JsonNode *
+dupin_bench_document (GRand * rand, gint n)
+{
+  JsonNode * node = json_node_new (JSON_NODE_OBJECT);
+  JsonObject * obj = json_object_new ();
+  gchar * category;
+  gchar * value;
+  gint i, j;
+
+  json_node_take_object (node, obj);
+
+  category = g_strdup_printf ("cat_%d", n % options.categories);
+  json_object_set_string_member (obj, "category", category);
+  g_free (category);
+
+  json_object_set_int_member (obj, "n", n);
+
+  value = g_malloc0 (options.field_size + 1);
+
+  for (i = 0; i < options.fields; i++)
+    {
+      gchar name[32];
+
+      for (j = 0; j < options.field_size; j++)
+        value[j] = 'a' + g_rand_int_range (rand, 0, 26);
+
+      g_snprintf (name, sizeof (name), "f%d", i);
+      json_object_set_string_member (obj, name, value);
+    }
+
+  g_free (value);
+
+  return node;
+}
+
+/* NOTE - measures */
+
+static gint
+dupin_bench_compare (gconstpointer a, gconstpointer b)
+{
+  gint64 x = *(const gint64 *) a;
+  gint64 y = *(const gint64 *) b;
+
+  return (x > y) - (x < y);
+}
+
+/* Latency percentiles of the samples (usec), sorted in place: */
+static JsonObject *
+dupin_bench_latencies (GArray * samples, gint64 elapsed)
+{
+  JsonObject * obj = json_object_new ();
+  gint64 * v = (gint64 *) samples->data;
+  guint n = samples->len;
+
+  json_object_set_int_member (obj, "count", n);
+  json_object_set_double_member (obj, "seconds", (gdouble) elapsed / G_USEC_PER_SEC);
+
+  if (n == 0)
+    return obj;
+
+  g_array_sort (samples, dupin_bench_compare);
+
+  json_object_set_double_member (obj, "per_second", elapsed > 0 ? (gdouble) n * G_USEC_PER_SEC / elapsed : 0);
+  json_object_set_int_member (obj, "p50_usec", v[(n - 1) * 50 / 100]);
+  json_object_set_int_member (obj, "p90_usec", v[(n - 1) * 90 / 100]);
+  json_object_set_int_member (obj, "p99_usec", v[(n - 1) * 99 / 100]);
+  json_object_set_int_member (obj, "max_usec", v[n - 1]);
+
+  return obj;
+}
+
+static JsonObject *
+dupin_bench_throughput (gint count, gint64 elapsed)
+{
+  JsonObject * obj = json_object_new ();
+
+  json_object_set_int_member (obj, "count", count);
+  json_object_set_double_member (obj, "seconds", (gdouble) elapsed / G_USEC_PER_SEC);
+  json_object_set_double_member (obj, "per_second", elapsed > 0 ? (gdouble) count * G_USEC_PER_SEC / elapsed : 0);
+
+  return obj;
+}
+
+static gboolean
+dupin_bench_insert_single (DupinDB * db, GRand * rand, GPtrArray * ids, JsonObject * results)
+{
+  gint64 start = g_get_monotonic_time ();
+  gint i;
+
+  for (i = 0; i < options.docs; i++)
+    {
+      JsonNode * node = dupin_bench_document (rand, i);
+      DupinRecord * record;
+
+      if (!(record = dupin_record_create (db, node, &error)))
+        {
+          json_node_free (node);
+          fprintf (stderr, "Error: cannot insert document %d: %s\n", i, dupin_database_get_error (db));
+          return FALSE;
+        }
+
+      g_ptr_array_add (ids, g_strdup (dupin_record_get_id (record)));
+
+      dupin_record_close (record);
+      json_node_free (node);
+    }
+
+  json_object_set_object_member (results, "insert_single",
+				 dupin_bench_throughput (options.docs, g_get_monotonic_time () - start));
+
+  return TRUE;
+}
+
+static gboolean
+dupin_bench_insert_bulk (DupinDB * db, GRand * rand, JsonObject * results)
+{
+  gint64 elapsed = 0;
+  gint i = 0;
+  JsonObject * obj;
+
+  while (i < options.docs)
+    {
+      JsonNode * node = json_node_new (JSON_NODE_OBJECT);
+      JsonObject * bulk = json_object_new ();
+      JsonArray * docs = json_array_new ();
+      GList * response_list = NULL;
+      gint64 start;
+      gboolean res;
+      gint j;
+
+      json_node_take_object (node, bulk);
+      json_object_set_array_member (bulk, REQUEST_POST_BULK_DOCS_DOCS, docs);
+
+      for (j = 0; j < options.bulk_size && i < options.docs; j++, i++)
+        json_array_add_element (docs, dupin_bench_document (rand, i));
+
+      /* NOTE - the corpus generation is not measured */
+      start = g_get_monotonic_time ();
+      res = dupin_record_insert_bulk (db, node, &response_list, FALSE, FALSE, &error);
+      elapsed += g_get_monotonic_time () - start;
+
+      while (response_list)
+        {
+          json_node_free (response_list->data);
+          response_list = g_list_remove (response_list, response_list->data);
+        }
+
+      json_node_free (node);
+
+      if (res == FALSE)
+        {
+          fprintf (stderr, "Error: cannot insert bulk: %s\n", dupin_database_get_error (db));
+          return FALSE;
+        }
+    }
+
+  obj = dupin_bench_throughput (options.docs, elapsed);
+  json_object_set_int_member (obj, "bulk_size", options.bulk_size);
+  json_object_set_object_member (results, "insert_bulk", obj);
+
+  return TRUE;
+}
+
+static gboolean
+dupin_bench_read (DupinDB * db, GRand * rand, GPtrArray * ids, JsonObject * results)
+{
+  GArray * samples = g_array_sized_new (FALSE, FALSE, sizeof (gint64), options.reads);
+  gint64 elapsed = 0;
+  gint i;
+
+  for (i = 0; i < options.reads; i++)
+    {
+      gchar * id = g_ptr_array_index (ids, g_rand_int_range (rand, 0, ids->len));
+      DupinRecord * record;
+      gint64 start = g_get_monotonic_time ();
+      gint64 usec;
+
+      if (!(record = dupin_record_read (db, id, &error)))
+        {
+          g_array_free (samples, TRUE);
+          fprintf (stderr, "Error: cannot read document %s\n", id);
+          return FALSE;
+        }
+
+      dupin_record_close (record);
+
+      usec = g_get_monotonic_time () - start;
+      elapsed += usec;
+      g_array_append_val (samples, usec);
+    }
+
+  json_object_set_object_member (results, "read", dupin_bench_latencies (samples, elapsed));
+  g_array_free (samples, TRUE);
+
+  return TRUE;
+}
+
+static gboolean
+dupin_bench_all_docs (DupinDB * db, JsonObject * results)
+{
+  GArray * samples = g_array_new (FALSE, FALSE, sizeof (gint64));
+  gint64 elapsed = 0;
+  guint offset = 0;
+  JsonObject * obj;
+
+  while (TRUE)
+    {
+      GList * list = NULL;
+      gint64 start = g_get_monotonic_time ();
+      gint64 usec;
+      guint rows;
+
+      if (dupin_record_get_list (db, options.page_size, offset, 0, 0, NULL, NULL, NULL, TRUE, DP_COUNT_EXIST, DP_ORDERBY_ID, FALSE, NULL, DP_FILTERBY_EQUALS,
+				 NULL, DP_FIELDS_FORMAT_DOTTED, DP_FILTERBY_EQUALS, NULL, &list, &error) == FALSE)
+        {
+          g_array_free (samples, TRUE);
+          fprintf (stderr, "Error: cannot list documents at offset %d\n", offset);
+          return FALSE;
+        }
+
+      usec = g_get_monotonic_time () - start;
+
+      rows = g_list_length (list);
+      dupin_record_get_list_close (list);
+
+      if (rows == 0)
+        break;
+
+      elapsed += usec;
+      g_array_append_val (samples, usec);
+
+      offset += rows;
+    }
+
+  obj = dupin_bench_latencies (samples, elapsed);
+  json_object_set_int_member (obj, "page_size", options.page_size);
+  json_object_set_int_member (obj, "rows", offset);
+  json_object_set_object_member (results, "all_docs_paging", obj);
+
+  g_array_free (samples, TRUE);
+
+  return TRUE;
+}
+
+/* The view is built by the sync threads of libdupin, its build time is polled: */
+static DupinView *
+dupin_bench_view_build (gchar * name, gchar * reduce, gchar * member, JsonObject * results)
+{
+  DupinView * view;
+  gint64 start = g_get_monotonic_time ();
+  JsonObject * obj;
+
+  if (!(view = dupin_view_new (d, name, DUPIN_BENCH_DB_BULK, TRUE, FALSE,
+			       DP_VIEW_ENGINE_LANG_JAVASCRIPT, DUPIN_BENCH_MAP, reduce,
+			       NULL, FALSE, FALSE, &error)))
+    {
+      fprintf (stderr, "Error: cannot create view %s\n", name);
+      return NULL;
+    }
+
+  while (dupin_view_is_sync (view) == FALSE)
+    g_usleep (DUPIN_BENCH_SYNC_POLL);
+
+  obj = json_object_new ();
+  json_object_set_double_member (obj, "seconds", (gdouble) (g_get_monotonic_time () - start) / G_USEC_PER_SEC);
+  json_object_set_int_member (obj, "rows", dupin_view_count (view));
+  json_object_set_object_member (results, member, obj);
+
+  return view;
+}
+
+static gboolean
+dupin_bench_view_query (DupinView * view, GRand * rand, gboolean range, JsonObject * results)
+{
+  GArray * samples = g_array_sized_new (FALSE, FALSE, sizeof (gint64), options.queries);
+  gint64 elapsed = 0;
+  gint i;
+
+  for (i = 0; i < options.queries; i++)
+    {
+      gint first = g_rand_int_range (rand, 0, options.categories);
+      gint last = range ? g_rand_int_range (rand, first, options.categories) : first;
+      gchar * str;
+      gchar * start_key;
+      gchar * end_key;
+      GList * list = NULL;
+      gint64 start;
+      gint64 usec;
+      gboolean res;
+
+      str = g_strdup_printf ("\"cat_%d\"", first);
+      start_key = dupin_util_json_string_normalize (str);
+      g_free (str);
+
+      str = g_strdup_printf ("\"cat_%d\"", last);
+      end_key = dupin_util_json_string_normalize (str);
+      g_free (str);
+
+      start = g_get_monotonic_time ();
+      res = dupin_view_record_get_list (view, options.page_size, 0, 0, 0, DP_ORDERBY_KEY, FALSE,
+					NULL, start_key, end_key, TRUE, NULL, NULL, TRUE,
+					NULL, DP_FIELDS_FORMAT_DOTTED, DP_FILTERBY_EQUALS, NULL, &list, &error);
+      usec = g_get_monotonic_time () - start;
+
+      g_free (start_key);
+      g_free (end_key);
+
+      if (res == FALSE)
+        {
+          g_array_free (samples, TRUE);
+          fprintf (stderr, "Error: cannot query view %s\n", dupin_view_get_name (view));
+          return FALSE;
+        }
+
+      dupin_view_record_get_list_close (list);
+
+      elapsed += usec;
+      g_array_append_val (samples, usec);
+    }
+
+  json_object_set_object_member (results, range ? "view_query_range" : "view_query_key",
+				 dupin_bench_latencies (samples, elapsed));
+  g_array_free (samples, TRUE);
+
+  return TRUE;
+}
+
+int
+main (int argc, char *argv[])
+{
+  DupinDB * db_single = NULL;
+  DupinDB * db_bulk = NULL;
+  DupinView * view_map = NULL;
+  DupinView * view_reduce = NULL;
+  GPtrArray * ids;
+  GRand * rand;
+  JsonNode * node;
+  JsonObject * results;
+  gchar * output;
+  gboolean tmp_path = FALSE;
+  gint ret = EXIT_FAILURE;
+  gint i;
+
+#if !GLIB_CHECK_VERSION (2, 31, 0)
+  // better make double-sure glib itself is initialized properly.
+  if (!g_thread_supported ())
+        g_thread_init (NULL);
+#endif
+
+  g_type_init();
+
+  /* NOTE - parse this command options, what is left is for configure_init () */
+  i = dupin_bench_parse_options (argc, argv, &options);
+
+  argv[i - 1] = argv[0];
+
+  if (!(d_conf = configure_init (argc - i + 1, argv + i - 1, &error)))
+    {
+      fprintf (stderr, "Error: %s\n", (error) ? error->message : DUPIN_UNKNOWN_ERROR);
+      dupin_bench_usage (argv);
+      exit (EXIT_FAILURE);
+    }
+
+  if (options.path == NULL)
+    {
+      if (!(options.path = g_dir_make_tmp ("dupin_bench_XXXXXX", &error)))
+        {
+          fprintf (stderr, "Error: %s\n", (error) ? error->message : DUPIN_UNKNOWN_ERROR);
+          exit (EXIT_FAILURE);
+        }
+
+      tmp_path = TRUE;
+    }
+
+  g_free (d_conf->sqlite_path);
+  d_conf->sqlite_path = g_strdup (options.path);
+
+  if (!(d = dupin_init (d_conf, &error)))
+    {
+      fprintf (stderr, "Error: %s\n", (error) ? error->message : DUPIN_UNKNOWN_ERROR);
+      exit (EXIT_FAILURE);
+    }
+
+  rand = g_rand_new_with_seed (0);
+  ids = g_ptr_array_new_with_free_func (g_free);
+
+  node = json_node_new (JSON_NODE_OBJECT);
+  results = json_object_new ();
+  json_node_take_object (node, results);
+
+  json_object_set_string_member (results, "version", VERSION);
+  json_object_set_int_member (results, "docs", options.docs);
+  json_object_set_int_member (results, "fields", options.fields);
+  json_object_set_int_member (results, "field_size", options.field_size);
+  json_object_set_int_member (results, "categories", options.categories);
+
+  if (!(db_single = dupin_database_new (d, DUPIN_BENCH_DB_SINGLE, &error))
+      || !(db_bulk = dupin_database_new (d, DUPIN_BENCH_DB_BULK, &error)))
+    {
+      fprintf (stderr, "Error: cannot create the databases\n");
+      goto dupin_bench_end;
+    }
+
+  if (dupin_bench_insert_single (db_single, rand, ids, results) == FALSE
+      || dupin_bench_insert_bulk (db_bulk, rand, results) == FALSE
+      || dupin_bench_read (db_single, rand, ids, results) == FALSE
+      || dupin_bench_all_docs (db_bulk, results) == FALSE)
+    goto dupin_bench_end;
+
+  if (!(view_map = dupin_bench_view_build (DUPIN_BENCH_VIEW_MAP, NULL, "view_map_build", results))
+      || !(view_reduce = dupin_bench_view_build (DUPIN_BENCH_VIEW_REDUCE, DUPIN_BENCH_REDUCE, "view_reduce_build", results)))
+    goto dupin_bench_end;
+
+  if (dupin_bench_view_query (view_map, rand, FALSE, results) == FALSE
+      || dupin_bench_view_query (view_map, rand, TRUE, results) == FALSE)
+    goto dupin_bench_end;
+
+  output = dupin_util_json_serialize (node);
+
+  if (options.output != NULL)
+    {
+      if (g_file_set_contents (options.output, output, -1, &error) == FALSE)
+        fprintf (stderr, "Error: %s\n", (error) ? error->message : DUPIN_UNKNOWN_ERROR);
+      else
+        ret = EXIT_SUCCESS;
+    }
+  else
+    {
+      fprintf (stdout, "%s\n", output);
+      ret = EXIT_SUCCESS;
+    }
+
+  g_free (output);
+
+dupin_bench_end:
+
+  if (view_reduce)
+    {
+      if (options.keep == FALSE)
+        dupin_view_delete (view_reduce, NULL);
+      dupin_view_unref (view_reduce);
+    }
+
+  if (view_map)
+    {
+      if (options.keep == FALSE)
+        dupin_view_delete (view_map, NULL);
+      dupin_view_unref (view_map);
+    }
+
+  if (db_bulk)
+    {
+      if (options.keep == FALSE)
+        dupin_database_delete (db_bulk, NULL);
+      dupin_database_unref (db_bulk);
+    }
+
+  if (db_single)
+    {
+      if (options.keep == FALSE)
+        dupin_database_delete (db_single, NULL);
+      dupin_database_unref (db_single);
+    }
+
+  dupin_shutdown (d);
+
+  if (tmp_path == TRUE && options.keep == FALSE)
+    g_rmdir (options.path);
+
+  json_node_free (node);
+  g_ptr_array_free (ids, TRUE);
+  g_rand_free (rand);
+
+  g_free (options.path);
+
+  configure_free (d_conf);
+
+  if (error != NULL)
+    g_error_free (error);
+
+  return ret;
+}
+
+/* EOF */
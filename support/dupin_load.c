@@ -0,0 +1,886 @@
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <dupin.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#ifdef G_OS_UNIX
+#  include <sys/types.h>
+#  include <sys/socket.h>
+#  include <netinet/in.h>
+#  include <netdb.h>
+#  include <errno.h>
+#  include <unistd.h>
+#endif
+
+/* NOTE - end-to-end load generator for a running dupin server: N worker threads
+          issue a weighted mix of requests (or replay the requests of a server
+          log) and the latencies are reported per endpoint as one JSON object.
+
+          The server answers with "Connection: close", so every request opens
+          its own connection and a worker is one concurrent client */
+
+#define DUPIN_LOAD_BUFFER_SIZE		8192
+
+typedef enum
+{
+  DUPIN_LOAD_GET_RECORD = 0,
+  DUPIN_LOAD_PUT_RECORD,
+  DUPIN_LOAD_BULK_DOCS,
+  DUPIN_LOAD_ALL_DOCS,
+  DUPIN_LOAD_VIEW,
+  DUPIN_LOAD_CHANGES,
+  DUPIN_LOAD_OTHER,
+
+  DUPIN_LOAD_ENDPOINTS
+} dupin_load_endpoint;
+
+static const gchar * dupin_load_endpoint_names[DUPIN_LOAD_ENDPOINTS] = {
+  "GET record",
+  "PUT record",
+  "POST _bulk_docs",
+  "GET _all_docs",
+  "GET view",
+  "GET _changes",
+  "other"
+};
+
+/* Option names of the mix weights, in endpoint order: */
+static const gchar * dupin_load_mix_names[DUPIN_LOAD_OTHER] = {
+  "get", "put", "bulk", "all_docs", "view", "changes"
+};
+
+typedef struct _dupin_load_options {
+	gchar * host;
+	gchar * port;
+	gchar * db;
+	gchar * view;
+	gchar * replay;
+	gchar * output;
+	gint connections;
+	gint requests;
+	gint duration;
+	gint seed_docs;
+	gint bulk_size;
+	gint page_size;
+	gint mix[DUPIN_LOAD_OTHER];
+	gint mix_total;
+	gboolean no_setup;
+} dupin_load_options;
+
+typedef struct _dupin_load_request {
+	gchar * method;
+	gchar * uri;
+	dupin_load_endpoint endpoint;
+} dupin_load_request;
+
+typedef struct _dupin_load_worker {
+	GThread * thread;
+	gint id;
+	GRand * rand;
+	gint sequence;
+	GArray * samples[DUPIN_LOAD_ENDPOINTS];
+	gint errors[DUPIN_LOAD_ENDPOINTS];
+} dupin_load_worker;
+
+/* Global variables: */
+dupin_load_options options;
+struct addrinfo * address = NULL;
+GPtrArray * replay = NULL;
+volatile gint next_request = 0;
+gint64 deadline = 0;
+
+static void
+dupin_load_usage (char *argv[])
+{
+  printf("usage:\n"
+	 "   %s [options]\n"
+	 , argv[0]);
+  puts("\n"
+       "options:\n"
+       "   --help                           this usage statement\n"
+       "   --host HOST                      server address. Default is 127.0.0.1.\n"
+       "   --port PORT                      server port. Default is 8088.\n"
+       "   --connections NUM                concurrent connections. Default is 8.\n"
+       "   --requests NUM                   requests to send. Default is 10000.\n"
+       "   --duration SECONDS               send requests for SECONDS instead of a fixed number\n"
+       "   --mix get=N,put=N,bulk=N,all_docs=N,view=N,changes=N\n"
+       "                                    relative weights of the requests. Default is\n"
+       "                                    get=60,put=10,bulk=5,all_docs=10,view=10,changes=5.\n"
+       "   --db NAME                        database of the requests. Default is dupin_load.\n"
+       "   --view NAME                      view of the view requests. Default is <db>_view.\n"
+       "   --seed_docs NUM                  documents created before the run. Default is 1000.\n"
+       "   --bulk_size NUM                  documents per _bulk_docs request. Default is 100.\n"
+       "   --page_size NUM                  limit of the _all_docs, view and _changes requests. Default is 100.\n"
+       "   --no_setup                       do not create and seed the database and the view\n"
+       "   --replay FILE                    replay the requests of a dupin server log instead of the mix\n"
+       "   --output FILE                    write the JSON results to FILE instead of stdout\n"
+);
+}
+
+static gint
+dupin_load_parse_number (char **argv, gint i)
+{
+  gint value;
+
+  if (!argv[i+1] || (value = atoi (argv[i+1])) <= 0)
+    {
+      fprintf (stderr, "%s needs a positive number\n", argv[i]);
+      exit (EXIT_FAILURE);
+    }
+
+  return value;
+}
+
+static gboolean
+dupin_load_parse_mix (gchar * mix)
+{
+  gchar ** weights = g_strsplit (mix, ",", -1);
+  gboolean ret;
+  gint i, j;
+
+  memset (options.mix, 0, sizeof (options.mix));
+  options.mix_total = 0;
+
+  for (i = 0; weights[i] != NULL; i++)
+    {
+      gchar * value = strchr (weights[i], '=');
+
+      if (value == NULL)
+        break;
+
+      *value++ = '\0';
+
+      for (j = 0; j < DUPIN_LOAD_OTHER; j++)
+        if (!g_strcmp0 (weights[i], dupin_load_mix_names[j]))
+          break;
+
+      if (j == DUPIN_LOAD_OTHER || atoi (value) < 0)
+        break;
+
+      options.mix[j] = atoi (value);
+      options.mix_total += options.mix[j];
+    }
+
+  ret = (weights[i] == NULL && options.mix_total > 0) ? TRUE : FALSE;
+
+  g_strfreev (weights);
+
+  return ret;
+}
+
+static void
+dupin_load_parse_options (int argc, char **argv)
+{
+  gint i;
+
+  options.host = "127.0.0.1";
+  options.port = "8088";
+  options.db = "dupin_load";
+  options.view = NULL;
+  options.replay = NULL;
+  options.output = NULL;
+  options.connections = 8;
+  options.requests = 10000;
+  options.duration = 0;
+  options.seed_docs = 1000;
+  options.bulk_size = 100;
+  options.page_size = 100;
+  options.no_setup = FALSE;
+
+  dupin_load_parse_mix ("get=60,put=10,bulk=5,all_docs=10,view=10,changes=5");
+
+  for (i = 1; i < argc; i++)
+    {
+      if (!g_strcmp0 (argv[i], "--help"))
+        {
+	  dupin_load_usage (argv);
+	  exit (EXIT_SUCCESS);
+	}
+      else if (!g_strcmp0 (argv[i], "--host") && argv[i+1])
+	options.host = argv[++i];
+      else if (!g_strcmp0 (argv[i], "--port") && argv[i+1])
+	options.port = argv[++i];
+      else if (!g_strcmp0 (argv[i], "--db") && argv[i+1])
+	options.db = argv[++i];
+      else if (!g_strcmp0 (argv[i], "--view") && argv[i+1])
+	options.view = argv[++i];
+      else if (!g_strcmp0 (argv[i], "--replay") && argv[i+1])
+	options.replay = argv[++i];
+      else if (!g_strcmp0 (argv[i], "--output") && argv[i+1])
+	options.output = argv[++i];
+      else if (!g_strcmp0 (argv[i], "--connections"))
+	options.connections = dupin_load_parse_number (argv, i++);
+      else if (!g_strcmp0 (argv[i], "--requests"))
+	options.requests = dupin_load_parse_number (argv, i++);
+      else if (!g_strcmp0 (argv[i], "--duration"))
+	options.duration = dupin_load_parse_number (argv, i++);
+      else if (!g_strcmp0 (argv[i], "--seed_docs"))
+	options.seed_docs = dupin_load_parse_number (argv, i++);
+      else if (!g_strcmp0 (argv[i], "--bulk_size"))
+	options.bulk_size = dupin_load_parse_number (argv, i++);
+      else if (!g_strcmp0 (argv[i], "--page_size"))
+	options.page_size = dupin_load_parse_number (argv, i++);
+      else if (!g_strcmp0 (argv[i], "--no_setup"))
+	options.no_setup = TRUE;
+      else if (!g_strcmp0 (argv[i], "--mix") && argv[i+1])
+        {
+	  if (dupin_load_parse_mix (argv[++i]) == FALSE)
+	    {
+	      fprintf (stderr, "invalid --mix: %s\n", argv[i]);
+	      exit (EXIT_FAILURE);
+	    }
+	}
+      else
+        {
+	  fprintf (stderr, "unknown command line option: %s\n", argv[i]);
+	  dupin_load_usage (argv);
+	  exit (EXIT_FAILURE);
+	}
+    }
+}
+
+/* HTTP client ***************************************************************/
+
+/* Returns the status code of the response, or -1 if the server cannot be reached: */
+static gint
+dupin_load_http (const gchar * method, const gchar * uri, const gchar * body)
+{
+  gchar buffer[DUPIN_LOAD_BUFFER_SIZE];
+  gsize body_size = body != NULL ? strlen (body) : 0;
+  GString * request;
+  gssize done;
+  gsize sent = 0;
+  gint status = 0;
+  gint fd;
+
+  if ((fd = socket (address->ai_family, address->ai_socktype, address->ai_protocol)) < 0)
+    return -1;
+
+  if (connect (fd, address->ai_addr, address->ai_addrlen) < 0)
+    {
+      close (fd);
+      return -1;
+    }
+
+  request = g_string_new (NULL);
+  g_string_append_printf (request, "%s %s HTTP/1.1\r\n"
+				   "Host: %s:%s\r\n"
+				   "Connection: close\r\n", method, uri, options.host, options.port);
+
+  if (body != NULL)
+    g_string_append_printf (request, "Content-Type: application/json\r\n"
+				     "Content-Length: %" G_GSIZE_FORMAT "\r\n", body_size);
+
+  g_string_append (request, "\r\n");
+
+  if (body != NULL)
+    g_string_append_len (request, body, body_size);
+
+  while (sent < request->len)
+    {
+      if ((done = send (fd, request->str + sent, request->len - sent, 0)) < 0)
+        {
+	  if (errno == EINTR)
+	    continue;
+
+	  g_string_free (request, TRUE);
+	  close (fd);
+	  return -1;
+	}
+
+      sent += done;
+    }
+
+  g_string_free (request, TRUE);
+
+  /* NOTE - the latency covers the whole response, only the status line is parsed */
+
+  while ((done = recv (fd, buffer, sizeof (buffer) - 1, 0)) != 0)
+    {
+      if (done < 0)
+        {
+	  if (errno == EINTR)
+	    continue;
+
+	  status = -1;
+	  break;
+	}
+
+      if (status == 0)
+        {
+	  buffer[done] = '\0';
+
+	  if (g_str_has_prefix (buffer, "HTTP/1.") && done > 12)
+	    status = atoi (buffer + 9);
+	}
+    }
+
+  close (fd);
+
+  return status;
+}
+
+/* Workload ******************************************************************/
+
+static gchar *
+dupin_load_document (GRand * rand, const gchar * id)
+{
+  GString * doc = g_string_new ("{");
+  gint i;
+
+  if (id != NULL)
+    g_string_append_printf (doc, "\"" REQUEST_OBJ_ID "\": \"%s\", ", id);
+
+  g_string_append_printf (doc, "\"category\": \"cat_%d\", \"n\": %d, \"text\": \"",
+			  g_rand_int_range (rand, 0, 16), g_rand_int (rand));
+
+  for (i = 0; i < 32; i++)
+    g_string_append_c (doc, 'a' + g_rand_int_range (rand, 0, 26));
+
+  g_string_append (doc, "\"}");
+
+  return g_string_free (doc, FALSE);
+}
+
+static gchar *
+dupin_load_bulk (GRand * rand, const gchar * prefix, gint first, gint count)
+{
+  GString * bulk = g_string_new ("{\"" REQUEST_POST_BULK_DOCS_DOCS "\": [");
+  gint i;
+
+  for (i = 0; i < count; i++)
+    {
+      gchar * id = prefix != NULL ? g_strdup_printf ("%s%d", prefix, first + i) : NULL;
+      gchar * doc = dupin_load_document (rand, id);
+
+      if (i > 0)
+        g_string_append (bulk, ", ");
+
+      g_string_append (bulk, doc);
+
+      g_free (doc);
+      g_free (id);
+    }
+
+  g_string_append (bulk, "]}");
+
+  return g_string_free (bulk, FALSE);
+}
+
+/* The database, its view and the documents read by the GET requests: */
+static gboolean
+dupin_load_setup (void)
+{
+  GRand * rand = g_rand_new_with_seed (0);
+  gchar * uri;
+  gchar * body;
+  gint status;
+  gint i;
+
+  uri = g_strdup_printf ("/%s", options.db);
+  status = dupin_load_http ("PUT", uri, NULL);
+  g_free (uri);
+
+  /* NOTE - 412 means the database is there already */
+  if (status != 201 && status != 412)
+    {
+      fprintf (stderr, "Error: cannot create the database %s (status %d)\n", options.db, status);
+      g_rand_free (rand);
+      return FALSE;
+    }
+
+  uri = g_strdup_printf ("/%s/" REQUEST_POST_BULK_DOCS, options.db);
+
+  for (i = 0; i < options.seed_docs; i += options.bulk_size)
+    {
+      body = dupin_load_bulk (rand, "load_", i, MIN (options.bulk_size, options.seed_docs - i));
+      status = dupin_load_http ("POST", uri, body);
+      g_free (body);
+
+      if (status != 201 && status != 200)
+        {
+          fprintf (stderr, "Error: cannot seed the database %s (status %d)\n", options.db, status);
+          g_free (uri);
+          g_rand_free (rand);
+          return FALSE;
+	}
+    }
+
+  g_free (uri);
+  g_rand_free (rand);
+
+  if (options.mix[DUPIN_LOAD_VIEW] == 0)
+    return TRUE;
+
+  uri = g_strdup_printf ("/" REQUEST_VIEWS "/%s", options.view);
+  body = g_strdup_printf ("{\"parent\": {\"name\": \"%s\", \"is_db\": true}, "
+			  "\"language\": \"javascript\", "
+			  "\"map\": \"function(doc) { emit(doc.category, doc.n); }\"}", options.db);
+  status = dupin_load_http ("PUT", uri, body);
+  g_free (body);
+  g_free (uri);
+
+  if (status != 201 && status != 412)
+    {
+      fprintf (stderr, "Error: cannot create the view %s (status %d)\n", options.view, status);
+      return FALSE;
+    }
+
+  /* NOTE - the view queries should not measure the first view build */
+  uri = g_strdup_printf ("/" REQUEST_VIEWS "/%s/" REQUEST_SYNC, options.view);
+  dupin_load_http ("GET", uri, NULL);
+  g_free (uri);
+
+  return TRUE;
+}
+
+static dupin_load_endpoint
+dupin_load_pick (dupin_load_worker * worker)
+{
+  gint value = g_rand_int_range (worker->rand, 0, options.mix_total);
+  gint i;
+
+  for (i = 0; i < DUPIN_LOAD_OTHER; i++)
+    {
+      if (value < options.mix[i])
+        return i;
+
+      value -= options.mix[i];
+    }
+
+  return DUPIN_LOAD_GET_RECORD;
+}
+
+static gint
+dupin_load_mix_request (dupin_load_worker * worker, dupin_load_endpoint endpoint)
+{
+  gchar * uri = NULL;
+  gchar * body = NULL;
+  gchar * id;
+  gint status;
+
+  switch (endpoint)
+    {
+    case DUPIN_LOAD_GET_RECORD:
+      uri = g_strdup_printf ("/%s/load_%d", options.db, g_rand_int_range (worker->rand, 0, MAX (options.seed_docs, 1)));
+      status = dupin_load_http ("GET", uri, NULL);
+      break;
+
+    case DUPIN_LOAD_PUT_RECORD:
+      id = g_strdup_printf ("load_%d_%d_%d", worker->id, g_rand_int (worker->rand), worker->sequence++);
+      uri = g_strdup_printf ("/%s/%s", options.db, id);
+      body = dupin_load_document (worker->rand, NULL);
+      status = dupin_load_http ("PUT", uri, body);
+      g_free (id);
+      break;
+
+    case DUPIN_LOAD_BULK_DOCS:
+      uri = g_strdup_printf ("/%s/" REQUEST_POST_BULK_DOCS, options.db);
+      body = dupin_load_bulk (worker->rand, NULL, 0, options.bulk_size);
+      status = dupin_load_http ("POST", uri, body);
+      break;
+
+    case DUPIN_LOAD_ALL_DOCS:
+      uri = g_strdup_printf ("/%s/" REQUEST_ALL_DOCS "?" REQUEST_GET_ALL_DOCS_LIMIT "=%d&" REQUEST_GET_ALL_DOCS_OFFSET "=%d", options.db, options.page_size,
+			     g_rand_int_range (worker->rand, 0, MAX (options.seed_docs, 1)));
+      status = dupin_load_http ("GET", uri, NULL);
+      break;
+
+    case DUPIN_LOAD_VIEW:
+      uri = g_strdup_printf ("/" REQUEST_VIEWS "/%s/" REQUEST_ALL_DOCS "?" REQUEST_GET_ALL_DOCS_KEY "=%%22cat_%d%%22&" REQUEST_GET_ALL_DOCS_LIMIT "=%d",
+			     options.view, g_rand_int_range (worker->rand, 0, 16), options.page_size);
+      status = dupin_load_http ("GET", uri, NULL);
+      break;
+
+    case DUPIN_LOAD_CHANGES:
+    default:
+      uri = g_strdup_printf ("/%s/" REQUEST_ALL_CHANGES "?" REQUEST_GET_ALL_CHANGES_SINCE "=%d&" REQUEST_GET_ALL_DOCS_LIMIT "=%d",
+			     options.db, g_rand_int_range (worker->rand, 0, MAX (options.seed_docs, 1)), options.page_size);
+      status = dupin_load_http ("GET", uri, NULL);
+      break;
+    }
+
+  g_free (uri);
+  g_free (body);
+
+  return status;
+}
+
+/* Replay ********************************************************************/
+
+static dupin_load_endpoint
+dupin_load_classify (const gchar * method, const gchar * uri)
+{
+  gchar * path = g_strndup (uri, strcspn (uri, "?"));
+  gchar ** parts = g_strsplit (path[0] == '/' ? path + 1 : path, "/", -1);
+  guint len = g_strv_length (parts);
+  dupin_load_endpoint endpoint = DUPIN_LOAD_OTHER;
+
+  if (len == 0 || parts[0][0] == '\0')
+    endpoint = DUPIN_LOAD_OTHER;
+
+  else if (!g_strcmp0 (method, "POST") && !g_strcmp0 (parts[len - 1], REQUEST_POST_BULK_DOCS))
+    endpoint = DUPIN_LOAD_BULK_DOCS;
+
+  else if (!g_strcmp0 (method, "GET") && !g_strcmp0 (parts[0], REQUEST_VIEWS) && len > 1)
+    endpoint = DUPIN_LOAD_VIEW;
+
+  else if (!g_strcmp0 (method, "GET") && !g_strcmp0 (parts[len - 1], REQUEST_ALL_CHANGES))
+    endpoint = DUPIN_LOAD_CHANGES;
+
+  else if (!g_strcmp0 (method, "GET") && !g_strcmp0 (parts[len - 1], REQUEST_ALL_DOCS))
+    endpoint = DUPIN_LOAD_ALL_DOCS;
+
+  else if (len == 2 && parts[0][0] != '_' && parts[1][0] != '_')
+    {
+      if (!g_strcmp0 (method, "GET"))
+        endpoint = DUPIN_LOAD_GET_RECORD;
+      else if (!g_strcmp0 (method, "PUT"))
+        endpoint = DUPIN_LOAD_PUT_RECORD;
+    }
+
+  g_strfreev (parts);
+  g_free (path);
+
+  return endpoint;
+}
+
+static void
+dupin_load_request_free (dupin_load_request * request)
+{
+  g_free (request->method);
+  g_free (request->uri);
+  g_free (request);
+}
+
+/* The request lines of the ISTANCE_HTTPD_CLIENT_CONNECT entries of the log: */
+static gboolean
+dupin_load_replay_read (gchar * file)
+{
+  GIOChannel * io;
+  JsonParser * parser;
+  GError * error = NULL;
+  gchar * line;
+  gsize length;
+
+  if (!(io = g_io_channel_new_file (file, "r", &error)))
+    {
+      fprintf (stderr, "Error: %s\n", error->message);
+      g_error_free (error);
+      return FALSE;
+    }
+
+  parser = json_parser_new ();
+  replay = g_ptr_array_new_with_free_func ((GDestroyNotify) dupin_load_request_free);
+
+  while (g_io_channel_read_line (io, &line, &length, NULL, NULL) == G_IO_STATUS_NORMAL)
+    {
+      JsonObject * obj;
+      const gchar * request_line;
+      gchar ** parts;
+
+      if (json_parser_load_from_data (parser, line, length, NULL) == FALSE
+          || json_node_get_node_type (json_parser_get_root (parser)) != JSON_NODE_OBJECT)
+        {
+          g_free (line);
+	  continue;
+	}
+
+      g_free (line);
+
+      obj = json_node_get_object (json_parser_get_root (parser));
+
+      if (g_strcmp0 (json_object_get_string_member (obj, "type"), "ISTANCE_HTTPD_CLIENT_CONNECT")
+	  || !json_object_has_member (obj, "request"))
+        continue;
+
+      request_line = json_object_get_string_member (obj, "request");
+      parts = g_strsplit (request_line, " ", 3);
+
+      if (g_strv_length (parts) >= 2)
+        {
+          dupin_load_request * request = g_malloc0 (sizeof (dupin_load_request));
+
+          request->method = g_strdup (parts[0]);
+          request->uri = g_strdup (parts[1]);
+          request->endpoint = dupin_load_classify (request->method, request->uri);
+
+          g_ptr_array_add (replay, request);
+	}
+
+      g_strfreev (parts);
+    }
+
+  g_object_unref (parser);
+  g_io_channel_shutdown (io, FALSE, NULL);
+  g_io_channel_unref (io);
+
+  if (replay->len == 0)
+    {
+      fprintf (stderr, "Error: no requests found in %s - the log needs the info verbosity\n", file);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+/* NOTE - the log keeps the request line and not the body, a synthetic body is
+          sent for the PUT and POST requests */
+static gint
+dupin_load_replay_request (dupin_load_worker * worker, dupin_load_request * request)
+{
+  gchar * body = NULL;
+  gint status;
+
+  if (request->endpoint == DUPIN_LOAD_BULK_DOCS)
+    body = dupin_load_bulk (worker->rand, NULL, 0, options.bulk_size);
+
+  else if (!g_strcmp0 (request->method, "PUT") || !g_strcmp0 (request->method, "POST"))
+    body = dupin_load_document (worker->rand, NULL);
+
+  status = dupin_load_http (request->method, request->uri, body);
+
+  g_free (body);
+
+  return status;
+}
+
+/* Workers *******************************************************************/
+
+static gpointer
+dupin_load_worker_run (gpointer user_data)
+{
+  dupin_load_worker * worker = user_data;
+
+  while (TRUE)
+    {
+      dupin_load_request * request = NULL;
+      dupin_load_endpoint endpoint;
+      gint n = g_atomic_int_add (&next_request, 1);
+      gint64 start;
+      gint64 usec;
+      gint status;
+
+      if (deadline != 0)
+        {
+          if (g_get_monotonic_time () >= deadline)
+	    break;
+	}
+      else if (n >= options.requests)
+        break;
+
+      if (replay != NULL)
+        {
+	  request = g_ptr_array_index (replay, n % replay->len);
+	  endpoint = request->endpoint;
+	}
+      else
+        endpoint = dupin_load_pick (worker);
+
+      start = g_get_monotonic_time ();
+
+      status = request != NULL ? dupin_load_replay_request (worker, request)
+			       : dupin_load_mix_request (worker, endpoint);
+
+      usec = g_get_monotonic_time () - start;
+
+      if (status < 200 || status >= 400)
+        worker->errors[endpoint]++;
+
+      g_array_append_val (worker->samples[endpoint], usec);
+    }
+
+  return NULL;
+}
+
+/* Report ********************************************************************/
+
+static gint
+dupin_load_compare (gconstpointer a, gconstpointer b)
+{
+  gint64 x = *(const gint64 *) a;
+  gint64 y = *(const gint64 *) b;
+
+  return (x > y) - (x < y);
+}
+
+static JsonObject *
+dupin_load_report (GArray * samples, gint errors, gint64 elapsed)
+{
+  JsonObject * obj = json_object_new ();
+  gint64 * v;
+  guint n = samples->len;
+
+  g_array_sort (samples, dupin_load_compare);
+  v = (gint64 *) samples->data;
+
+  json_object_set_int_member (obj, "count", n);
+  json_object_set_int_member (obj, "errors", errors);
+  json_object_set_double_member (obj, "per_second", elapsed > 0 ? (gdouble) n * G_USEC_PER_SEC / elapsed : 0);
+  json_object_set_int_member (obj, "p50_usec", v[(n - 1) * 500 / 1000]);
+  json_object_set_int_member (obj, "p99_usec", v[(n - 1) * 990 / 1000]);
+  json_object_set_int_member (obj, "p999_usec", v[(n - 1) * 999 / 1000]);
+  json_object_set_int_member (obj, "max_usec", v[n - 1]);
+
+  return obj;
+}
+
+int
+main (int argc, char *argv[])
+{
+  dupin_load_worker * workers;
+  struct addrinfo hints;
+  JsonNode * node;
+  JsonObject * results;
+  JsonObject * endpoints;
+  GArray * all;
+  gint64 start;
+  gint64 elapsed;
+  gint errors = 0;
+  gint ret = EXIT_SUCCESS;
+  gchar * output;
+  gint i, j;
+
+#if !GLIB_CHECK_VERSION (2, 31, 0)
+  // better make double-sure glib itself is initialized properly.
+  if (!g_thread_supported ())
+        g_thread_init (NULL);
+#endif
+
+  g_type_init();
+
+  dupin_load_parse_options (argc, argv);
+
+  if (options.view == NULL)
+    options.view = g_strdup_printf ("%s_view", options.db);
+
+  memset (&hints, 0, sizeof (hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+
+  if ((i = getaddrinfo (options.host, options.port, &hints, &address)) != 0)
+    {
+      fprintf (stderr, "Error: %s:%s: %s\n", options.host, options.port, gai_strerror (i));
+      exit (EXIT_FAILURE);
+    }
+
+  if (options.replay != NULL)
+    {
+      if (dupin_load_replay_read (options.replay) == FALSE)
+        exit (EXIT_FAILURE);
+    }
+  else if (options.no_setup == FALSE
+	   && dupin_load_setup () == FALSE)
+    exit (EXIT_FAILURE);
+
+  workers = g_malloc0 (sizeof (dupin_load_worker) * options.connections);
+
+  start = g_get_monotonic_time ();
+
+  if (options.duration > 0)
+    deadline = start + (gint64) options.duration * G_USEC_PER_SEC;
+
+  for (i = 0; i < options.connections; i++)
+    {
+      workers[i].id = i;
+      workers[i].rand = g_rand_new ();
+
+      for (j = 0; j < DUPIN_LOAD_ENDPOINTS; j++)
+        workers[i].samples[j] = g_array_new (FALSE, FALSE, sizeof (gint64));
+
+#if GLIB_CHECK_VERSION (2,31,8)
+      workers[i].thread = g_thread_new ("dupin_load_worker", dupin_load_worker_run, &workers[i]);
+#else
+      workers[i].thread = g_thread_create (dupin_load_worker_run, &workers[i], TRUE, NULL);
+#endif
+    }
+
+  for (i = 0; i < options.connections; i++)
+    g_thread_join (workers[i].thread);
+
+  elapsed = g_get_monotonic_time () - start;
+
+  /* The samples of the workers are merged per endpoint: */
+  node = json_node_new (JSON_NODE_OBJECT);
+  results = json_object_new ();
+  json_node_take_object (node, results);
+
+  endpoints = json_object_new ();
+  all = g_array_new (FALSE, FALSE, sizeof (gint64));
+
+  for (j = 0; j < DUPIN_LOAD_ENDPOINTS; j++)
+    {
+      GArray * samples = g_array_new (FALSE, FALSE, sizeof (gint64));
+      gint endpoint_errors = 0;
+
+      for (i = 0; i < options.connections; i++)
+        {
+          g_array_append_vals (samples, workers[i].samples[j]->data, workers[i].samples[j]->len);
+          endpoint_errors += workers[i].errors[j];
+	}
+
+      if (samples->len > 0)
+        {
+          g_array_append_vals (all, samples->data, samples->len);
+          errors += endpoint_errors;
+
+          json_object_set_object_member (endpoints, dupin_load_endpoint_names[j],
+					 dupin_load_report (samples, endpoint_errors, elapsed));
+	}
+
+      g_array_free (samples, TRUE);
+    }
+
+  json_object_set_string_member (results, "mode", replay != NULL ? "replay" : "mix");
+  json_object_set_int_member (results, "connections", options.connections);
+  json_object_set_double_member (results, "seconds", (gdouble) elapsed / G_USEC_PER_SEC);
+
+  if (all->len > 0)
+    json_object_set_object_member (results, "total", dupin_load_report (all, errors, elapsed));
+
+  json_object_set_object_member (results, "endpoints", endpoints);
+
+  output = dupin_util_json_serialize (node);
+
+  if (options.output != NULL)
+    {
+      GError * error = NULL;
+
+      if (g_file_set_contents (options.output, output, -1, &error) == FALSE)
+        {
+          fprintf (stderr, "Error: %s\n", error->message);
+          g_error_free (error);
+          ret = EXIT_FAILURE;
+	}
+    }
+  else
+    fprintf (stdout, "%s\n", output);
+
+  g_free (output);
+  g_array_free (all, TRUE);
+  json_node_free (node);
+
+  for (i = 0; i < options.connections; i++)
+    {
+      for (j = 0; j < DUPIN_LOAD_ENDPOINTS; j++)
+        g_array_free (workers[i].samples[j], TRUE);
+
+      g_rand_free (workers[i].rand);
+    }
+
+  g_free (workers);
+
+  if (replay != NULL)
+    g_ptr_array_free (replay, TRUE);
+
+  freeaddrinfo (address);
+
+  return ret;
+}
+
+/* EOF */
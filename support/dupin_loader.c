@@ -34,6 +34,9 @@
 
 #define DUPIN_LOADER_MAX_BULK_TX_NUM	10000
 
+#define DUPIN_LOADER_CHUNK_LINES	256	/* lines handed to a parser thread at once */
+#define DUPIN_LOADER_CHUNKS_PER_THREAD	4	/* parsed chunks waiting for the writer */
+
 /* Global variables: */
 DSGlobal *d_conf = NULL;
 Dupin *d = NULL;
@@ -59,10 +62,40 @@ typedef struct _dupin_loader_options {
 	gboolean use_latest_revision;
 	gboolean ignore_updates_if_unmodified;
 	gchar * context_id;
+	gint parser_threads;
+	gboolean initial_load;
 } dupin_loader_options;
 
 dupin_loader_options options;
 
+/* NOTE - the input is loaded by a pipeline: the reader thread splits it in chunks of
+          lines, the parser threads turn them into JSON nodes (and context_id) and the
+          main thread writes the chunks in input order, within the bulk transactions */
+
+typedef struct _dupin_loader_chunk {
+	guint seq;
+	guint first_line;
+	GPtrArray * lines;
+	JsonNode ** nodes;
+	gchar ** context_ids;
+	gchar ** errors;
+	gchar * read_error;
+	gboolean eof;
+} dupin_loader_chunk;
+
+typedef struct _dupin_loader_pipeline {
+	GThread * reader;
+	GThreadPool * parsers;
+	GMutex mutex;
+	GCond cond;
+	GHashTable * parsed;	/* seq -> chunk */
+	guint in_flight;
+	guint max_in_flight;
+	gint quit;
+} dupin_loader_pipeline;
+
+dupin_loader_pipeline pipeline;
+
 Dupin * dupin_loader_init (DSGlobal *data, GError ** error);
 
 void dupin_loader_shutdown (Dupin * d);
@@ -71,7 +104,13 @@ GQuark dupin_loader_error_quark (void);
 
 gchar * dupin_loader_extract_context_id (JsonNode * node);
 
-static JsonNode * dupin_loader_read_json_object (gchar * line);
+static JsonNode * dupin_loader_read_json_object (JsonParser * parser, gchar * line, gchar ** error_msg);
+
+static void dupin_loader_pipeline_start (void);
+static void dupin_loader_pipeline_stop (void);
+static dupin_loader_chunk * dupin_loader_pipeline_next (guint seq);
+static void dupin_loader_chunk_free (dupin_loader_chunk * chunk);
+static gboolean dupin_loader_insert (JsonNode * json_object_node, gchar * context_id, gint * bulk_tx_num_count);
 
 void dupin_loader_set_error (gchar * msg);
 void dupin_loader_clear_error (void);
@@ -96,10 +135,12 @@ dupin_loader_usage (char *argv[])
        "   --use-latest-revision            allows to force update of records always using (implicitly) the latest revision. On new record insertions is ignored.\n"
        "   --ignore-updates-if-unmodified   update records only if they contain a change respect to current record (i.e. no duplicate revisions are created). On new record insertions and deletions is ignored.\n"
        "   --create-db                      force (re)creation of database if it doesn't exist\n"
+       "   --initial-load                   fast load into an empty database: indexes and totals are rebuilt at the end, no disk syncing and exclusive locking meanwhile\n"
        "   --verbose                        verbose logging, more than normal logging\n"
        "   --silent                         silent, prints only errors\n"
        "   --version                        prints version information\n"
        "   --context_id ID                  the context_id to use to create the links if --links is used\n"
+       "   --parser_threads NUM             how many threads parse the input while the records are written. Default is one per processor.\n"
        "   \n"
        "   When the --links option is specified without --context_id each input JSON object must have a 'context_id' field, including bulks.\n"
 );
@@ -131,6 +172,12 @@ dupin_loader_parse_options (int argc, char **argv,
   options->strict_links = FALSE;
   options->use_latest_revision = FALSE;
   options->ignore_updates_if_unmodified = FALSE;
+  options->initial_load = FALSE;
+#if GLIB_CHECK_VERSION (2,36,0)
+  options->parser_threads = g_get_num_processors ();
+#else
+  options->parser_threads = 1;
+#endif
 
   if (argc > 1)
     {
@@ -199,11 +246,30 @@ dupin_loader_parse_options (int argc, char **argv,
 		   argc_left-=2;
 		   i++;
 		 }
+               else if (!g_strcmp0 (argv[i], "--parser_threads"))
+                 {
+                   if (argv[i+1])
+                     {
+		       options->parser_threads = atoi (argv[i+1]);
+		       if (options->parser_threads <= 0)
+		         {
+		           fprintf (stderr, "parser_threads is not valid: %s\n", argv[i+1]);
+		           exit (EXIT_FAILURE);
+		         }
+                     }
+		   argc_left-=2;
+		   i++;
+		 }
                else if (!g_strcmp0 (argv[i], "--create-db"))
                  {
 		   options->create_db = TRUE;
 		   argc_left--;
 		 }
+               else if (!g_strcmp0 (argv[i], "--initial-load"))
+                 {
+		   options->initial_load = TRUE;
+		   argc_left--;
+		 }
                else if (!g_strcmp0 (argv[i], "--silent"))
                  {
 		   options->silent = TRUE;
@@ -262,6 +328,32 @@ void dupin_loader_close (void)
       g_io_channel_unref (io);
     }
 
+  /* NOTE - a load stopped early leaves its last batch in an open transaction: it is committed
+            here, the indexes rebuilt below would otherwise be rolled back with it at close */
+
+  if (d && db && d->bulk_transaction == TRUE)
+    {
+      dupin_rwlock_writer_lock (d->rwlock);
+      d->bulk_transaction = FALSE;
+      d->super_bulk_transaction = FALSE;
+      dupin_rwlock_writer_unlock (d->rwlock);
+
+      if (dupin_linkbase_commit_transaction (dupin_database_get_default_linkbase (db), NULL) < 0)
+        dupin_linkbase_rollback_transaction (dupin_database_get_default_linkbase (db), NULL);
+
+      if (dupin_attachment_db_commit_transaction (dupin_database_get_default_attachment_db (db), NULL) < 0)
+        dupin_attachment_db_rollback_transaction (dupin_database_get_default_attachment_db (db), NULL);
+
+      if (dupin_database_commit_transaction (db, NULL) < 0)
+        dupin_database_rollback_transaction (db, NULL);
+    }
+
+  /* NOTE - indexes and totals are rebuilt even if the load did not complete */
+
+  if (db && db->initial_load == TRUE
+      && dupin_database_end_initial_load (db, NULL) == FALSE)
+    dupin_loader_set_error (dupin_database_get_error (db));
+
   if (db)
     dupin_database_unref (db);
 
@@ -304,10 +396,6 @@ static void dupin_loader_sig_int (int sig)
 int
 main (int argc, char *argv[])
 {
-  gchar *line;
-  gsize last;
-  GIOStatus status;
-
 #ifdef HAVE_LOCALE
   /* initialize locale */
   setlocale(LC_CTYPE,"");
@@ -343,6 +431,14 @@ main (int argc, char *argv[])
       exit (EXIT_FAILURE);
     }
 
+  if (options.initial_load == TRUE
+      && options.links == TRUE)
+    {
+      fprintf (stderr, "option initial-load can only be used for loading documents\n");
+      dupin_loader_usage (argv);
+      exit (EXIT_FAILURE);
+    }
+
   //g_message("db_name=%s\n", db_name);
   //g_message("json_data_file=%s\n", json_data_file);
   //g_message("bulk=%d\n", options.bulk);
@@ -439,159 +535,97 @@ main (int argc, char *argv[])
         }
     }
  
-  g_rw_lock_writer_lock (d->rwlock);
-  d->super_bulk_transaction = TRUE;
-  g_rw_lock_writer_unlock (d->rwlock);
-
-  gint bulk_tx_num_count=1;
-
-  while (TRUE)
+  if (options.initial_load == TRUE)
     {
-      GList * response_list=NULL;
-
-      status = g_io_channel_read_line (io, &line, NULL, &last, &error);
+      gsize max_rowid;
 
-      if (status == G_IO_STATUS_ERROR)
-	{
-	  fprintf (stderr, "Error: %s\n", (error) ? error->message : DUPIN_UNKNOWN_ERROR);
-
-          if (error != NULL)
-            g_error_free (error);
+      if (dupin_database_get_max_rowid (db, &max_rowid) == FALSE
+          || max_rowid != 0)
+        {
+          dupin_loader_set_error ("Initial load is only possible into an empty database");
+          goto dupin_loader_end;
+        }
 
-	  break;
-	}
+      if (dupin_database_begin_initial_load (db, NULL) == FALSE)
+        {
+          dupin_loader_set_error (dupin_database_get_error (db));
+          goto dupin_loader_end;
+        }
+    }
 
-      if (status == G_IO_STATUS_AGAIN)
-	continue;
+  dupin_rwlock_writer_lock (d->rwlock);
+  d->super_bulk_transaction = TRUE;
+  dupin_rwlock_writer_unlock (d->rwlock);
 
-      if (status == G_IO_STATUS_EOF)
-	break;
+  gint bulk_tx_num_count=1;
+  guint seq;
 
-      JsonNode * json_object_node = dupin_loader_read_json_object (line);
+  dupin_loader_pipeline_start ();
 
-      if (json_object_node == NULL)
-        goto dupin_loader_end;
+  for (seq = 0; ; seq++)
+    {
+      dupin_loader_chunk * chunk = dupin_loader_pipeline_next (seq);
+      guint i;
 
-      gboolean res;
-      gchar * context_id = NULL;
-      if (options.bulk == TRUE)
+      for (i = 0; i < chunk->lines->len; i++)
         {
-//g_message ("dupin_loader: bulk_tx_num_count=%d options.bulk_tx_num=%d\n", bulk_tx_num_count, options.bulk_tx_num);
-
-	  if (bulk_tx_num_count == options.bulk_tx_num)
-	    {
-              g_rw_lock_writer_lock (d->rwlock);
-              d->super_bulk_transaction = FALSE;
-              g_rw_lock_writer_unlock (d->rwlock);
+          gchar * msg;
 
-//g_message ("dupin_loader: super_bulk_transaction FALSE bulk_tx_num_count=%d\n", bulk_tx_num_count);
-	    }
+          gchar * context_id = NULL;
 
-          if (options.links == TRUE)
+          if (chunk->errors[i] == NULL
+              && options.links == TRUE)
             {
-	      if (options.context_id != NULL)
-                context_id = g_strdup (options.context_id);
-
-              if (context_id == NULL)
-                context_id = dupin_loader_extract_context_id (json_object_node);
+              context_id = (options.context_id != NULL) ? options.context_id : chunk->context_ids[i];
 
               if (context_id == NULL
                   || dupin_link_record_util_is_valid_context_id (context_id) == FALSE)
-                {
-                  dupin_loader_set_error ("Not a valid context_id specified");
-                  goto dupin_loader_end;
-                }
-
-//g_message("context_id = %s\n", context_id);
-
-	      res =  dupin_link_record_insert_bulk (dupin_database_get_default_linkbase (db), json_object_node, context_id, &response_list,
-						    options.strict_links, options.use_latest_revision, options.ignore_updates_if_unmodified, &error);
-
-	      g_free (context_id); 
+                chunk->errors[i] = g_strdup ("Not a valid context_id specified");
             }
-          else
-            res = dupin_record_insert_bulk (db, json_object_node, &response_list, options.use_latest_revision, options.ignore_updates_if_unmodified, &error);
-
-	  if (bulk_tx_num_count == options.bulk_tx_num)
-	    {
-              g_rw_lock_writer_lock (d->rwlock);
-              d->super_bulk_transaction = TRUE;
-              g_rw_lock_writer_unlock (d->rwlock);
-
-	      bulk_tx_num_count = 1;
 
-//g_message ("dupin_loader: super_bulk_transaction TRUE bulk_tx_num_count=%d\n", bulk_tx_num_count);
-	    }
-	  else
-	    {
-	      bulk_tx_num_count++;
-	    }
-        }
-      else
-       {
-          if (options.links == TRUE)
+          if (chunk->errors[i] != NULL)
             {
-	      if (options.context_id != NULL)
-                context_id = g_strdup (options.context_id);
+              msg = g_strdup_printf ("line %d: %s", chunk->first_line + i, chunk->errors[i]);
+              dupin_loader_set_error (msg);
+              g_free (msg);
 
-              if (context_id == NULL)
-                context_id = dupin_loader_extract_context_id (json_object_node);
-
-              if (context_id == NULL
-                  || dupin_link_record_util_is_valid_context_id (context_id) == FALSE)
-                {
-                  dupin_loader_set_error ("Not a valid context_id specified");
-                  goto dupin_loader_end;
-                }
+              dupin_loader_chunk_free (chunk);
+              dupin_loader_pipeline_stop ();
+              goto dupin_loader_end;
+            }
 
-	      res = dupin_link_record_insert (dupin_database_get_default_linkbase (db), json_object_node, NULL, NULL, context_id,
-					      DP_LINK_TYPE_ANY, &response_list, options.strict_links, options.use_latest_revision, options.ignore_updates_if_unmodified, &error);
+//g_message("context_id = %s\n", context_id);
 
-	      g_free (context_id); 
+          if (dupin_loader_insert (chunk->nodes[i], context_id, &bulk_tx_num_count) == FALSE)
+            {
+              msg = g_strdup_printf ("line %d: %s", chunk->first_line + i, dupin_loader_get_error ());
+              dupin_loader_set_error (msg);
+              g_free (msg);
             }
-          else
-            res = dupin_record_insert (db, json_object_node, NULL, NULL, &response_list, options.use_latest_revision, options.ignore_updates_if_unmodified, &error);
-       }
-
-      if (res == TRUE)
-        {
-//g_message("bulk=%d\n", options.bulk);
-
-#if 0
-      {
-      gchar * str = dupin_util_json_serialize (json_object_node);
-      g_message("%s", str);
-      g_free (str);
-      }
-#endif
-        }
-      else
-        {
-          if (options.links == TRUE)
-            dupin_loader_set_error (dupin_linkbase_get_error (dupin_database_get_default_linkbase (db)));
-          else
-            dupin_loader_set_error (dupin_database_get_error (db));
         }
 
-      while (response_list)
+      if (chunk->read_error != NULL)
+	fprintf (stderr, "Error: %s\n", chunk->read_error);
+
+      if (chunk->eof == TRUE)
         {
-          json_node_free (response_list->data);
-          response_list = g_list_remove (response_list, response_list->data);
+          dupin_loader_chunk_free (chunk);
+          break;
         }
 
-      json_node_free (json_object_node);
-
-      g_free (line);
+      dupin_loader_chunk_free (chunk);
     }
 
+  dupin_loader_pipeline_stop ();
+
   /* NOTE - make sure last uncommited changes are commited */
 
   if (d->bulk_transaction == TRUE
       && bulk_tx_num_count < options.bulk_tx_num)
     {
-      g_rw_lock_writer_lock (d->rwlock);
+      dupin_rwlock_writer_lock (d->rwlock);
       d->bulk_transaction = FALSE;
-      g_rw_lock_writer_unlock (d->rwlock);
+      dupin_rwlock_writer_unlock (d->rwlock);
 
       if (dupin_linkbase_commit_transaction (dupin_database_get_default_linkbase (db), NULL) < 0)
         {
@@ -649,23 +683,304 @@ dupin_loader_extract_context_id (JsonNode * node)
   return context_id;
 }
 
-static JsonNode *
-dupin_loader_read_json_object (gchar * line)
+/* NOTE - insert one input line, called by the main thread only; returns FALSE with
+          the loader error set if the record has not been inserted, context_id is
+          already checked */
+
+static gboolean
+dupin_loader_insert (JsonNode * json_object_node, gchar * context_id, gint * bulk_tx_num_count)
 {
-  JsonNode * json_object_node = NULL;
-  GError *error = NULL;
+  GList * response_list=NULL;
+  gboolean res;
+
+  if (options.bulk == TRUE)
+    {
+//g_message ("dupin_loader: bulk_tx_num_count=%d options.bulk_tx_num=%d\n", *bulk_tx_num_count, options.bulk_tx_num);
+
+      if (*bulk_tx_num_count == options.bulk_tx_num)
+	{
+          dupin_rwlock_writer_lock (d->rwlock);
+          d->super_bulk_transaction = FALSE;
+          dupin_rwlock_writer_unlock (d->rwlock);
+
+//g_message ("dupin_loader: super_bulk_transaction FALSE bulk_tx_num_count=%d\n", *bulk_tx_num_count);
+	}
+
+      if (options.links == TRUE)
+	res =  dupin_link_record_insert_bulk (dupin_database_get_default_linkbase (db), json_object_node, context_id, &response_list,
+					      options.strict_links, options.use_latest_revision, options.ignore_updates_if_unmodified, &error);
+      else
+        res = dupin_record_insert_bulk (db, json_object_node, &response_list, options.use_latest_revision, options.ignore_updates_if_unmodified, &error);
+
+      if (*bulk_tx_num_count == options.bulk_tx_num)
+	{
+          dupin_rwlock_writer_lock (d->rwlock);
+          d->super_bulk_transaction = TRUE;
+          dupin_rwlock_writer_unlock (d->rwlock);
 
-  JsonParser *parser = json_parser_new ();
+	  *bulk_tx_num_count = 1;
 
-  if (parser == NULL)
+//g_message ("dupin_loader: super_bulk_transaction TRUE bulk_tx_num_count=%d\n", *bulk_tx_num_count);
+	}
+      else
+	{
+	  (*bulk_tx_num_count)++;
+	}
+    }
+  else
     {
-      dupin_loader_set_error ("Cannot parse JSON object");
-      goto dupin_loader_read_json_object_end;
+      if (options.links == TRUE)
+	res = dupin_link_record_insert (dupin_database_get_default_linkbase (db), json_object_node, NULL, NULL, context_id,
+					DP_LINK_TYPE_ANY, &response_list, options.strict_links, options.use_latest_revision, options.ignore_updates_if_unmodified, &error);
+      else
+        res = dupin_record_insert (db, json_object_node, NULL, NULL, &response_list, options.use_latest_revision, options.ignore_updates_if_unmodified, &error);
+    }
+
+  if (res == FALSE)
+    {
+      if (options.links == TRUE)
+        dupin_loader_set_error (dupin_linkbase_get_error (dupin_database_get_default_linkbase (db)));
+      else
+        dupin_loader_set_error (dupin_database_get_error (db));
+    }
+
+  while (response_list)
+    {
+      json_node_free (response_list->data);
+      response_list = g_list_remove (response_list, response_list->data);
+    }
+
+  return res;
+}
+
+/* NOTE - pipeline sub-routines */
+
+static dupin_loader_chunk *
+dupin_loader_chunk_new (guint seq, guint first_line)
+{
+  dupin_loader_chunk * chunk = g_malloc0 (sizeof (dupin_loader_chunk));
+
+  chunk->seq = seq;
+  chunk->first_line = first_line;
+  chunk->lines = g_ptr_array_new_with_free_func (g_free);
+
+  return chunk;
+}
+
+static void
+dupin_loader_chunk_free (dupin_loader_chunk * chunk)
+{
+  guint i;
+
+  for (i = 0; i < chunk->lines->len; i++)
+    {
+      if (chunk->nodes != NULL && chunk->nodes[i] != NULL)
+        json_node_free (chunk->nodes[i]);
+
+      if (chunk->context_ids != NULL && chunk->context_ids[i] != NULL)
+        g_free (chunk->context_ids[i]);
+
+      if (chunk->errors != NULL && chunk->errors[i] != NULL)
+        g_free (chunk->errors[i]);
+    }
+
+  g_free (chunk->nodes);
+  g_free (chunk->context_ids);
+  g_free (chunk->errors);
+
+  if (chunk->read_error != NULL)
+    g_free (chunk->read_error);
+
+  g_ptr_array_free (chunk->lines, TRUE);
+
+  g_free (chunk);
+}
+
+/* Waits for a free slot and gives the chunk to the parsers: */
+static gboolean
+dupin_loader_pipeline_dispatch (dupin_loader_chunk * chunk)
+{
+  g_mutex_lock (&pipeline.mutex);
+
+  while (pipeline.in_flight >= pipeline.max_in_flight
+         && g_atomic_int_get (&pipeline.quit) == FALSE)
+    g_cond_wait (&pipeline.cond, &pipeline.mutex);
+
+  if (g_atomic_int_get (&pipeline.quit) == TRUE)
+    {
+      g_mutex_unlock (&pipeline.mutex);
+      dupin_loader_chunk_free (chunk);
+      return FALSE;
     }
 
+  pipeline.in_flight++;
+
+  g_mutex_unlock (&pipeline.mutex);
+
+  g_thread_pool_push (pipeline.parsers, chunk, NULL);
+
+  return TRUE;
+}
+
+static gpointer
+dupin_loader_pipeline_reader (gpointer user_data)
+{
+  GError * read_error = NULL;
+  GIOStatus status;
+  gchar * line;
+  gsize last;
+  guint seq = 0;
+  guint line_num = 1;
+
+  dupin_loader_chunk * chunk = dupin_loader_chunk_new (seq++, line_num);
+
+  while (g_atomic_int_get (&pipeline.quit) == FALSE)
+    {
+      status = g_io_channel_read_line (io, &line, NULL, &last, &read_error);
+
+      if (status == G_IO_STATUS_ERROR)
+	{
+	  chunk->read_error = g_strdup ((read_error) ? read_error->message : DUPIN_UNKNOWN_ERROR);
+
+          if (read_error != NULL)
+            g_error_free (read_error);
+
+	  break;
+	}
+
+      if (status == G_IO_STATUS_AGAIN)
+	continue;
+
+      if (status == G_IO_STATUS_EOF)
+	break;
+
+      g_ptr_array_add (chunk->lines, line);
+      line_num++;
+
+      if (chunk->lines->len == DUPIN_LOADER_CHUNK_LINES)
+        {
+          if (dupin_loader_pipeline_dispatch (chunk) == FALSE)
+            return NULL;
+
+          chunk = dupin_loader_chunk_new (seq++, line_num);
+        }
+    }
+
+  chunk->eof = TRUE;
+
+  dupin_loader_pipeline_dispatch (chunk);
+
+  return NULL;
+}
+
+static void
+dupin_loader_pipeline_parser (dupin_loader_chunk * chunk, gpointer user_data)
+{
+  JsonParser * parser = json_parser_new ();
+  guint i;
+
+  chunk->nodes = g_malloc0 (sizeof (JsonNode *) * (chunk->lines->len + 1));
+  chunk->context_ids = g_malloc0 (sizeof (gchar *) * (chunk->lines->len + 1));
+  chunk->errors = g_malloc0 (sizeof (gchar *) * (chunk->lines->len + 1));
+
+  for (i = 0; i < chunk->lines->len; i++)
+    {
+      chunk->nodes[i] = dupin_loader_read_json_object (parser, g_ptr_array_index (chunk->lines, i), &chunk->errors[i]);
+
+      if (chunk->nodes[i] != NULL
+          && options.links == TRUE
+          && options.context_id == NULL)
+        chunk->context_ids[i] = dupin_loader_extract_context_id (chunk->nodes[i]);
+    }
+
+  g_object_unref (parser);
+
+  g_mutex_lock (&pipeline.mutex);
+  g_hash_table_insert (pipeline.parsed, GUINT_TO_POINTER (chunk->seq), chunk);
+  g_cond_broadcast (&pipeline.cond);
+  g_mutex_unlock (&pipeline.mutex);
+}
+
+static void
+dupin_loader_pipeline_start (void)
+{
+  g_mutex_init (&pipeline.mutex);
+  g_cond_init (&pipeline.cond);
+
+  pipeline.parsed = g_hash_table_new (g_direct_hash, g_direct_equal);
+  pipeline.in_flight = 0;
+  pipeline.max_in_flight = options.parser_threads * DUPIN_LOADER_CHUNKS_PER_THREAD;
+  pipeline.quit = FALSE;
+
+  pipeline.parsers = g_thread_pool_new ((GFunc) dupin_loader_pipeline_parser,
+					NULL,
+					options.parser_threads,
+					FALSE,
+					NULL);
+
+#if GLIB_CHECK_VERSION (2,31,8)
+  pipeline.reader = g_thread_new ("dupin_loader_reader", dupin_loader_pipeline_reader, NULL);
+#else
+  pipeline.reader = g_thread_create (dupin_loader_pipeline_reader, NULL, TRUE, NULL);
+#endif
+}
+
+/* Returns the chunks in input order: */
+static dupin_loader_chunk *
+dupin_loader_pipeline_next (guint seq)
+{
+  dupin_loader_chunk * chunk;
+
+  g_mutex_lock (&pipeline.mutex);
+
+  while (!(chunk = g_hash_table_lookup (pipeline.parsed, GUINT_TO_POINTER (seq))))
+    g_cond_wait (&pipeline.cond, &pipeline.mutex);
+
+  g_hash_table_remove (pipeline.parsed, GUINT_TO_POINTER (seq));
+
+  pipeline.in_flight--;
+  g_cond_broadcast (&pipeline.cond);
+
+  g_mutex_unlock (&pipeline.mutex);
+
+  return chunk;
+}
+
+static void
+dupin_loader_pipeline_stop (void)
+{
+  GHashTableIter iter;
+  dupin_loader_chunk * chunk;
+
+  g_mutex_lock (&pipeline.mutex);
+  g_atomic_int_set (&pipeline.quit, TRUE);
+  g_cond_broadcast (&pipeline.cond);
+  g_mutex_unlock (&pipeline.mutex);
+
+  g_thread_join (pipeline.reader);
+
+  /* NOTE - the chunks already dispatched are parsed and dropped */
+  g_thread_pool_free (pipeline.parsers, FALSE, TRUE);
+
+  g_hash_table_iter_init (&iter, pipeline.parsed);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &chunk))
+    dupin_loader_chunk_free (chunk);
+
+  g_hash_table_destroy (pipeline.parsed);
+
+  g_cond_clear (&pipeline.cond);
+  g_mutex_clear (&pipeline.mutex);
+}
+
+static JsonNode *
+dupin_loader_read_json_object (JsonParser * parser, gchar * line, gchar ** error_msg)
+{
+  JsonNode * json_object_node = NULL;
+  GError *error = NULL;
+
   if (!json_parser_load_from_data (parser, line, -1, &error))
     {
-      dupin_loader_set_error (error->message);
+      *error_msg = g_strdup (error->message);
       goto dupin_loader_read_json_object_end;
     }
 
@@ -673,7 +988,7 @@ dupin_loader_read_json_object (gchar * line)
 
   if (node == NULL)
     {
-      dupin_loader_set_error ("Cannot parse JSON object");
+      *error_msg = g_strdup ("Cannot parse JSON object");
       goto dupin_loader_read_json_object_end;
     }
 
@@ -684,9 +999,6 @@ dupin_loader_read_json_object_end:
   if (error != NULL)
     g_error_free (error);
 
-  if (parser != NULL)
-    g_object_unref (parser);
-
   return json_object_node;
 }
 
@@ -767,8 +1079,9 @@ dupin_loader_init (DSGlobal *data, GError ** error)
 
   d->conf = data; /* we just copy point from caller */
 
-  d->rwlock = g_new0 (GRWLock, 1);
-  g_rw_lock_init (d->rwlock);
+  dupin_util_set_id_scheme (d->conf->id_scheme);
+
+  d->rwlock = dupin_rwlock_new ();
 
   d->path = g_strdup (d->conf->sqlite_path);
 
@@ -958,10 +1271,7 @@ dupin_loader_shutdown (Dupin * d)
 g_message("dupin_loader_shutdown: worker pools freed\n");
 
   if (d->rwlock)
-    {
-      g_rw_lock_clear (d->rwlock);
-      g_free (d->rwlock);
-    }
+    dupin_rwlock_free (d->rwlock);
 
   if (d->attachment_dbs)
     g_hash_table_destroy (d->attachment_dbs);